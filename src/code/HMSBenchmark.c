@@ -0,0 +1,1779 @@
+/*
+Hospital Management System - Benchmarks
+Authors: Brownie Tran
+         Raymond Yang
+Date: 2025-04-01
+Description: Benchmark driver for the completed Hospital Management System.
+             The system source is included directly so the benchmarks exercise
+             the same store functions the menu uses.
+             Build: gcc -O2 -pthread HMSBenchmark.c -o HMSBenchmark
+             Usage: HMSBenchmark stress [readers] [writers] [seconds]
+                    HMSBenchmark report [patients]
+                    HMSBenchmark stays [patients]
+                    HMSBenchmark filter [patients]
+                    HMSBenchmark roster [doctors] [days]
+                    HMSBenchmark workload [patients] [doctors] [rooms] [results file]
+                    HMSBenchmark layouts [max patients]
+*/
+
+#define HMS_NO_MAIN
+#include "HospitalManagementSystemCompleted.c"
+
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/* Constants for the stress benchmark */
+#define STRESS_SEED_PATIENTS 10000  // Patients loaded before the threads start
+#define STRESS_SEED_DOCTORS 20      // Doctors loaded before the threads start
+#define STRESS_ROOM_RANGE MAX_ROOM_NUMBER   // Rooms are drawn from 1..STRESS_ROOM_RANGE
+#define STRESS_SCAN_INTERVAL 64     // Readers do one full scan every this many lookups
+#define STRESS_MAX_THREADS 64       // Upper bound on reader and writer threads
+#define STRESS_SCHEDULE_DAYS 28     // Shift changes are spread over this many days from today
+
+/* Constants for the report benchmark */
+#define REPORT_BENCH_PATIENTS 1000000   // Default number of patients in the report
+#define REPORT_BENCH_ROUNDS 3           // Each output path is timed this many times and the best run is kept
+
+/* Constants for the length of stay benchmark */
+#define STAY_BENCH_PATIENTS 2000000     // Default number of discharged patients
+#define STAY_BENCH_DIAGNOSES 200        // Distinct diagnoses among the stays
+#define STAY_BENCH_MAX_DAYS 60          // Stays last up to this many days
+
+/* Constants for the filter benchmark */
+#define FILTER_BENCH_PATIENTS 2000000   // Default number of patients filtered
+#define FILTER_BENCH_ROUNDS 5           // Each filter path is timed this many times and the best run is kept
+
+/* Constants for the roster benchmark */
+#define ROSTER_BENCH_DOCTORS 300        // Default number of doctors on the roster
+#define ROSTER_BENCH_DAYS 180           // Default number of days filled, with the most doctors each shift takes
+
+/* Constants for the workload benchmark */
+#define WORKLOAD_BENCH_PATIENTS 100000  // Default number of patients, admitted and discharged
+#define WORKLOAD_BENCH_DOCTORS 200      // Default number of doctors
+#define WORKLOAD_BENCH_ROOMS 2000       // Default number of open rooms, numbered from 1
+#define WORKLOAD_BENCH_RESULTS "workload_results.csv"   // Default file the results are appended to
+#define WORKLOAD_WORKSPACE "/tmp/hms-workload-XXXXXX"   // Template for the scratch directory the data is saved in
+#define WORKLOAD_OCCUPANCY_PERCENT 85   // Share of the beds taken by admitted patients; the other patients are discharged
+#define WORKLOAD_LOOKUPS 1000000        // findPatientByID and isRoomAvailable calls timed
+#define WORKLOAD_CREATES 1000000        // createPatient calls timed
+#define WORKLOAD_REPORT_ROUNDS 3        // Each report is written this many times
+#define WORKLOAD_ROSTER_DAYS 28         // Days the roster is filled for, from today
+#define WORKLOAD_MAX_TIMINGS 24         // Upper bound on operations timed in one run
+#define WEIGHT_COUNT(table) ((int) (sizeof(table) / sizeof((table)[0])))
+
+/* Constants for the layout benchmark */
+#define LAYOUT_BENCH_MIN_PATIENTS 1000  // Smallest store size; each size after it is double the last
+#define LAYOUT_BENCH_MAX_PATIENTS 32000 // Default largest store size
+#define LAYOUT_BENCH_LOOKUPS 10000      // Lookups timed at each size
+#define LAYOUT_BENCH_DELETE_PERCENT 10  // Share of the patients removed at each size
+#define LAYOUT_NAME_LENGTH 50           // Name field of the older generations
+#define LAYOUT_DIAGNOSIS_LENGTH 255     // Diagnosis field of HospitalManagementSystem2.c
+
+/* Per-thread state and results for the stress benchmark */
+typedef struct StressWorker {
+    pthread_t thread;               // Worker thread handle
+    int workerIndex;                // Index used to give writers disjoint patient ID ranges
+    unsigned int randomState;       // xorshift state, one per thread so rand() is not shared
+    long lookups;                   // Patient lookups performed
+    long scans;                     // Full list scans performed
+    long admissions;                // Patients admitted
+    long discharges;                // Patients discharged
+    long shiftAttempts;             // Shift assignments and unassignments attempted
+} StressWorker;
+
+/* A weighted diagnosis or range of values the synthetic hospital draws from */
+typedef struct WorkloadWeight {
+    const char *label;              // Diagnosis, or NULL for a range of values
+    int low;                        // Lowest value of the range
+    int high;                       // Highest value of the range
+    int weight;                     // Relative frequency
+} WorkloadWeight;
+
+/* Timing of one operation in the workload benchmark */
+typedef struct WorkloadTiming {
+    const char *operation;          // Name written to the results file
+    long calls;                     // Calls made
+    double seconds;                 // Total time of those calls
+} WorkloadTiming;
+
+/* One generation's patient store behind the interface the layout benchmark drives */
+typedef struct PatientLayout {
+    const char *name;               // Shown in the results
+    const char *fileName;           // Patient file written by save, or NULL if the generation kept nothing on disk
+    int (*insert)(int id, const char *name, int age, const char *diagnosis);   // 0 if the ID is taken or out of memory
+    int (*find)(int id);            // 1 if the patient is stored
+    int (*remove)(int id);          // 1 if the patient was removed
+    int (*save)(void);              // 0 if the file could not be written; NULL if there is no file
+    int (*load)(void);              // Patients loaded into an empty store, or -1
+    void (*reset)(void);            // Empty the store
+} PatientLayout;
+
+/* The parallel arrays of HospitalManagementSystem1.c, grown on demand instead of capped at 50 patients */
+typedef struct ArrayLayoutStore {
+    int *ids;                       // Patient IDs, in insertion order
+    char (*names)[LAYOUT_NAME_LENGTH];  // Patient names
+    int *ages;                      // Patient ages
+    char (*diagnoses)[250];         // Diagnoses, at HospitalManagementSystem1.c's length
+    int count;                      // Patients stored
+    int capacity;                   // Entries allocated in each array
+} ArrayLayoutStore;
+
+/* A patient node of HospitalManagementSystem2.c's linked list */
+typedef struct ListLayoutPatient {
+    int iD;                         // Patient ID
+    char patientName[LAYOUT_NAME_LENGTH];   // Patient name
+    int age;                        // Patient age
+    char diagnosis[LAYOUT_DIAGNOSIS_LENGTH];    // Diagnosis
+    int roomNum;                    // Room; HospitalManagementSystem2.c saves it but the benchmark leaves it 0
+    struct ListLayoutPatient *next; // Next patient, in insertion order
+} ListLayoutPatient;
+
+atomic_int stressRunning = 0;       // Cleared by the main thread to stop the workers
+ArrayLayoutStore arrayLayout = {0}; // Store of the parallel array layout
+ListLayoutPatient *listLayoutHead = NULL;   // First patient of the linked list layout
+ListLayoutPatient *listLayoutTail = NULL;   // Last patient, where HospitalManagementSystem2.c appends
+
+// Admission mix of a general hospital, most common first
+const WorkloadWeight workloadDiagnoses[] = {
+    {"Observation", 0, 0, 16}, {"Labour and delivery", 0, 0, 10}, {"Chest pain", 0, 0, 8},
+    {"Pneumonia", 0, 0, 8}, {"Heart failure", 0, 0, 7}, {"COPD exacerbation", 0, 0, 6},
+    {"Urinary tract infection", 0, 0, 6}, {"Influenza", 0, 0, 5}, {"Cellulitis", 0, 0, 5},
+    {"Gastroenteritis", 0, 0, 5}, {"Sepsis", 0, 0, 5}, {"Hip fracture", 0, 0, 4}, {"Stroke", 0, 0, 4},
+    {"Post-operative recovery after appendectomy", 0, 0, 4}, {"Acute kidney injury", 0, 0, 2},
+    {"Diabetic ketoacidosis", 0, 0, 2}
+};
+
+// Patient ages, skewed towards older patients
+const WorkloadWeight workloadAges[] = {
+    {NULL, 0, 4, 6}, {NULL, 5, 17, 5}, {NULL, 18, 44, 22}, {NULL, 45, 64, 25}, {NULL, 65, 79, 25}, {NULL, 80, 99, 17}
+};
+
+// Length of stay in days: most stays are short, a few run for weeks
+const WorkloadWeight workloadStays[] = {
+    {NULL, 0, 1, 30}, {NULL, 2, 3, 30}, {NULL, 4, 7, 25}, {NULL, 8, 14, 10}, {NULL, 15, 60, 5}
+};
+
+// Beds per room
+const WorkloadWeight workloadRoomSizes[] = {
+    {NULL, 1, 1, 30}, {NULL, 2, 2, 45}, {NULL, 4, 4, 20}, {NULL, 6, 6, 5}
+};
+
+void runStressBenchmark(int readers, int writers, int seconds);
+void *stressReader(void *arg);
+void *stressWriter(void *arg);
+void runReportBenchmark(int patients);
+double timeFprintfReport(FILE *reportFile);
+double timeBufferedReport(FILE *reportFile);
+int sameFileContents(FILE *first, FILE *second);
+void runStayBenchmark(int patients);
+void runFilterBenchmark(int patients);
+int filterByListWalk(const PatientFilter *filter);
+int filterByColumns(const PatientFilter *filter, unsigned long long **selections, int vectorized);
+void runRosterBenchmark(int doctors, int days);
+void runWorkloadBenchmark(int patients, int doctors, int rooms, FILE *resultsFile);
+int buildWorkloadHospital(int patients, int doctors, int rooms, WorkloadTiming *timings, int *timingCount);
+void printMemoryComparison(const MemoryUsage *before, const MemoryUsage *after);
+Patient *createWorkloadPatient(int id, int roomNum, unsigned int *randomState);
+const WorkloadWeight *pickWeighted(const WorkloadWeight *table, int count, unsigned int *randomState);
+int pickWeightedValue(const WorkloadWeight *table, int count, unsigned int *randomState);
+void formatWorkloadTime(char *text, int bufferSize, time_t when);
+void addWorkloadTiming(WorkloadTiming *timings, int *timingCount, const char *operation, long calls, double seconds);
+double timeQuietCall(int (*operation)(void), int *result);
+double timeReport(int (*writeReport)(FILE *reportFile));
+int writeBufferedAdmissionReport(FILE *reportFile);
+int writeDoctorReportRows(FILE *reportFile);
+int writeRoomReportRows(FILE *reportFile);
+int writeStayReportRows(FILE *reportFile);
+void writeWorkloadResults(const WorkloadTiming *timings, int timingCount, int patients, int doctors, int rooms,
+                          FILE *resultsFile);
+int enterWorkloadWorkspace(char *workspace);
+void removeWorkloadWorkspace(const char *workspace);
+int silenceOutput();
+void restoreOutput(int savedOutput);
+void runLayoutBenchmark(int maxPatients);
+int timeLayout(const PatientLayout *layout, int patients, unsigned int *randomState);
+long fileSize(const char *fileName);
+int arrayLayoutInsert(int id, const char *name, int age, const char *diagnosis);
+int arrayLayoutFind(int id);
+int arrayLayoutIndexOf(int id);
+int arrayLayoutRemove(int id);
+void arrayLayoutReset();
+int listLayoutInsert(int id, const char *name, int age, const char *diagnosis);
+int listLayoutFind(int id);
+int listLayoutRemove(int id);
+int listLayoutSave();
+int listLayoutLoad();
+void listLayoutReset();
+int storeLayoutInsert(int id, const char *name, int age, const char *diagnosis);
+int storeLayoutFind(int id);
+int storeLayoutRemove(int id);
+int storeLayoutSave();
+int storeLayoutLoad();
+void storeLayoutReset();
+unsigned int nextRandom(unsigned int *state);
+double elapsedSeconds(const struct timespec *start, const struct timespec *end);
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "report") == 0) {
+        int patients = argc > 2 ? atoi(argv[2]) : REPORT_BENCH_PATIENTS;
+        if (patients <= 0 || patients > MAX_LOADED_RECORDS) {
+            printf("Error: Invalid number of patients.\n");
+            return 1;
+        }
+
+        initializeSystem();
+        runReportBenchmark(patients);
+        cleanupSystem();
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "stays") == 0) {
+        int patients = argc > 2 ? atoi(argv[2]) : STAY_BENCH_PATIENTS;
+        if (patients <= 0 || patients > MAX_LOADED_RECORDS) {
+            printf("Error: Invalid number of patients.\n");
+            return 1;
+        }
+
+        initializeSystem();
+        runStayBenchmark(patients);
+        cleanupSystem();
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "filter") == 0) {
+        int patients = argc > 2 ? atoi(argv[2]) : FILTER_BENCH_PATIENTS;
+        if (patients <= 0 || patients > MAX_LOADED_RECORDS) {
+            printf("Error: Invalid number of patients.\n");
+            return 1;
+        }
+
+        initializeSystem();
+        runFilterBenchmark(patients);
+        cleanupSystem();
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "roster") == 0) {
+        int doctors = argc > 2 ? atoi(argv[2]) : ROSTER_BENCH_DOCTORS;
+        int days = argc > 3 ? atoi(argv[3]) : ROSTER_BENCH_DAYS;
+        if (doctors <= 0 || doctors > MAX_LOADED_RECORDS || days <= 0 || days > ROSTER_MAX_DAYS) {
+            printf("Error: Invalid number of doctors or days.\n");
+            return 1;
+        }
+
+        initializeSystem();
+        runRosterBenchmark(doctors, days);
+        cleanupSystem();
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "workload") == 0) {
+        int patients = argc > 2 ? atoi(argv[2]) : WORKLOAD_BENCH_PATIENTS;
+        int doctors = argc > 3 ? atoi(argv[3]) : WORKLOAD_BENCH_DOCTORS;
+        int rooms = argc > 4 ? atoi(argv[4]) : WORKLOAD_BENCH_ROOMS;
+        const char *resultsName = argc > 5 ? argv[5] : WORKLOAD_BENCH_RESULTS;
+        if (patients <= 0 || patients > MAX_LOADED_RECORDS || doctors <= 0 || doctors > MAX_LOADED_RECORDS ||
+            rooms <= 0 || rooms > MAX_ROOM_NUMBER) {
+            printf("Error: Invalid number of patients, doctors or rooms.\n");
+            return 1;
+        }
+
+        // Open the results file before moving into the workspace, so a relative name is kept where it was given
+        FILE *resultsFile = fopen(resultsName, "a");
+        if (resultsFile == NULL) {
+            printf("Error: Unable to open %s for appending.\n", resultsName);
+            return 1;
+        }
+        char workspace[] = WORKLOAD_WORKSPACE;
+        if (!enterWorkloadWorkspace(workspace)) {
+            printf("Error: Unable to create a workspace in /tmp.\n");
+            fclose(resultsFile);
+            return 1;
+        }
+
+        initializeSystem();
+        runWorkloadBenchmark(patients, doctors, rooms, resultsFile);
+        cleanupSystem();
+        fclose(resultsFile);
+        removeWorkloadWorkspace(workspace);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "layouts") == 0) {
+        int maxPatients = argc > 2 ? atoi(argv[2]) : LAYOUT_BENCH_MAX_PATIENTS;
+        if (maxPatients < LAYOUT_BENCH_MIN_PATIENTS || maxPatients > MAX_ROOM_NUMBER * MAX_ROOM_CAPACITY) {
+            printf("Error: The largest size must be between %d and %d patients.\n", LAYOUT_BENCH_MIN_PATIENTS,
+                   MAX_ROOM_NUMBER * MAX_ROOM_CAPACITY);
+            return 1;
+        }
+
+        char workspace[] = WORKLOAD_WORKSPACE;
+        if (!enterWorkloadWorkspace(workspace)) {
+            printf("Error: Unable to create a workspace in /tmp.\n");
+            return 1;
+        }
+
+        initializeSystem();
+        runLayoutBenchmark(maxPatients);
+        cleanupSystem();
+        removeWorkloadWorkspace(workspace);
+        return 0;
+    }
+
+    if (argc < 2 || strcmp(argv[1], "stress") != 0) {
+        printf("Usage: %s stress [readers] [writers] [seconds]\n", argv[0]);
+        printf("       %s report [patients]\n", argv[0]);
+        printf("       %s stays [patients]\n", argv[0]);
+        printf("       %s filter [patients]\n", argv[0]);
+        printf("       %s roster [doctors] [days]\n", argv[0]);
+        printf("       %s workload [patients] [doctors] [rooms] [results file]\n", argv[0]);
+        printf("       %s layouts [max patients]\n", argv[0]);
+        return 1;
+    }
+
+    int readers = argc > 2 ? atoi(argv[2]) : 4;
+    int writers = argc > 3 ? atoi(argv[3]) : 1;
+    int seconds = argc > 4 ? atoi(argv[4]) : 5;
+
+    if (readers < 0 || writers < 0 || readers + writers == 0 ||
+        readers > STRESS_MAX_THREADS || writers > STRESS_MAX_THREADS || seconds <= 0) {
+        printf("Error: Invalid thread counts or duration.\n");
+        return 1;
+    }
+
+    initializeSystem();
+    runStressBenchmark(readers, writers, seconds);
+    cleanupSystem();
+    return 0;
+}
+
+//Run readers and writers against the shared store for a fixed duration and report throughput
+void runStressBenchmark(int readers, int writers, int seconds) {
+    StressWorker workers[2 * STRESS_MAX_THREADS];
+    char name[50];
+
+    // Seed the store so lookups and scans have something to find
+    for (int i = 1; i <= STRESS_SEED_PATIENTS; i++) {
+        snprintf(name, sizeof(name), "Patient %d", i);
+        Patient *patient = createPatient(i, name, i % 100, "Observation", 1 + i % STRESS_ROOM_RANGE);
+        if (patient == NULL || admitPatient(patient) != STORE_OK) {
+            printf("Error: Unable to seed patient %d.\n", i);
+            free(patient);
+            return;
+        }
+    }
+    for (int i = 1; i <= STRESS_SEED_DOCTORS; i++) {
+        snprintf(name, sizeof(name), "Doctor %d", i);
+        Doctor *doctor = createDoctor(i, name);
+        if (doctor == NULL || registerDoctor(doctor) != STORE_OK) {
+            printf("Error: Unable to seed doctor %d.\n", i);
+            free(doctor);
+            return;
+        }
+    }
+
+    printf("Stress benchmark: %d readers, %d writers, %d seconds, %d seeded patients\n",
+           readers, writers, seconds, STRESS_SEED_PATIENTS);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    atomic_store(&stressRunning, 1);
+
+    for (int i = 0; i < readers + writers; i++) {
+        memset(&workers[i], 0, sizeof(StressWorker));
+        workers[i].workerIndex = i;
+        workers[i].randomState = 2463534242u + (unsigned int) i * 7919u;
+        pthread_create(&workers[i].thread, NULL, i < readers ? stressReader : stressWriter, &workers[i]);
+    }
+
+    struct timespec duration = {seconds, 0};
+    nanosleep(&duration, NULL);
+    atomic_store(&stressRunning, 0);
+
+    for (int i = 0; i < readers + writers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = elapsedSeconds(&start, &end);
+
+    // Sum per-thread counters
+    long lookups = 0, scans = 0, admissions = 0, discharges = 0, shiftAttempts = 0;
+    for (int i = 0; i < readers + writers; i++) {
+        lookups += workers[i].lookups;
+        scans += workers[i].scans;
+        admissions += workers[i].admissions;
+        discharges += workers[i].discharges;
+        shiftAttempts += workers[i].shiftAttempts;
+    }
+
+    printf("%-20s%-15s%-15s\n", "Operation", "Count", "Ops/sec");
+    printf("--------------------------------------------------\n");
+    printf("%-20s%-15ld%-15.0f\n", "Lookups", lookups, lookups / elapsed);
+    printf("%-20s%-15ld%-15.0f\n", "Full scans", scans, scans / elapsed);
+    printf("%-20s%-15ld%-15.0f\n", "Admissions", admissions, admissions / elapsed);
+    printf("%-20s%-15ld%-15.0f\n", "Discharges", discharges, discharges / elapsed);
+    printf("%-20s%-15ld%-15.0f\n", "Shift attempts", shiftAttempts, shiftAttempts / elapsed);
+
+    // Check that the counters and the filter columns still agree with the shards after the concurrent updates
+    int activeInList = 0;
+    int activeInColumns = 0;
+    lockAllPatientShards(0);
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        for (Patient *current = patientShards[s].head; current != NULL; current = current->next) {
+            activeInList += current->isActive;
+        }
+        for (int row = 0; row < patientShards[s].count; row++) {
+            activeInColumns += patientShards[s].active[row];
+        }
+    }
+    int activeCounter = totalPatientsActive;
+    unlockAllPatientShards();
+
+    printf("\nConsistency check: %d active in list, %d in columns, counter %d -> %s\n",
+           activeInList, activeInColumns, activeCounter,
+           activeInList == activeCounter && activeInColumns == activeCounter ? "OK" : "MISMATCH");
+
+    // The maintained statistics must agree with a recount from the occupancy counters
+    int activeByAge = 0;
+    for (int i = 0; i < AGE_GROUP_COUNT; i++) {
+        activeByAge += atomic_load(&hospitalStats.activeByAgeGroup[i]);
+    }
+    int occupiedRooms = 0;
+    int freeBeds = 0;
+    int roomsWithBeds = 0;
+    for (int i = 1; i <= MAX_ROOM_NUMBER; i++) {
+        occupiedRooms += atomic_load(&roomOccupancy[i]) > 0;
+        freeBeds += roomFreeBeds(i);
+        roomsWithBeds += roomFreeBeds(i) > 0;
+    }
+    int statsMatch = activeByAge == activeCounter && occupiedRooms == atomic_load(&hospitalStats.occupiedRooms) &&
+                     atomic_load(&hospitalStats.admissions) - atomic_load(&hospitalStats.discharges) == activeCounter;
+    printf("Statistics check: %d active by age, %d occupied rooms -> %s\n",
+           activeByAge, occupiedRooms, statsMatch ? "OK" : "MISMATCH");
+
+    // The free-bed heap must hold exactly the rooms with a free bed, each no later than its children
+    int heapOrdered = 1;
+    for (int i = 1; i < roomBeds.count; i++) {
+        heapOrdered &= !roomOfferedBefore(roomBeds.heap[i], roomBeds.heap[(i - 1) / 2]) &&
+                       roomBeds.position[roomBeds.heap[i]] == i;
+    }
+    printf("Free-bed check: %d free beds in %d rooms, heap %d free beds in %d rooms -> %s\n",
+           freeBeds, roomsWithBeds, roomBeds.freeBeds, roomBeds.count,
+           heapOrdered && freeBeds == roomBeds.freeBeds && roomsWithBeds == roomBeds.count ? "OK" : "MISMATCH");
+
+    // Every doctor's shift count and the doctors' week bits must add up to the schedule's assignments
+    int doctorShifts = 0;
+    int shiftBits = 0;
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    for (Doctor *current = doctorHead; current != NULL; current = current->next) {
+        doctorShifts += current->totalShifts;
+    }
+    for (int i = 0; i < doctorSchedule.loadCapacity; i++) {
+        shiftBits += __builtin_popcount(doctorSchedule.loads[i].shiftBits);
+    }
+    int scheduled = doctorSchedule.assignments;
+    pthread_rwlock_unlock(&doctorStoreLock);
+    printf("Schedule check: %d doctor shifts, %d in week bits, %d scheduled -> %s\n", doctorShifts, shiftBits, scheduled,
+           doctorShifts == scheduled && shiftBits == scheduled &&
+           scheduled == atomic_load(&hospitalStats.shiftsAssigned) ? "OK" : "MISMATCH");
+}
+
+//Reader thread. Mixes random ID lookups with periodic full scans of the patient list
+void *stressReader(void *arg) {
+    StressWorker *worker = (StressWorker *) arg;
+
+    while (atomic_load(&stressRunning)) {
+        int id = 1 + (int) (nextRandom(&worker->randomState) % STRESS_SEED_PATIENTS);
+
+        PatientShard *shard = shardForPatient(id);
+        pthread_rwlock_rdlock(&shard->lock);
+        Patient *patient = findPatientByID(id);
+        volatile int age = patient != NULL ? patient->patientAge : -1;
+        (void) age;
+        pthread_rwlock_unlock(&shard->lock);
+        worker->lookups++;
+
+        if (worker->lookups % STRESS_SCAN_INTERVAL == 0) {
+            volatile int active = 0;
+            for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+                pthread_rwlock_rdlock(&patientShards[s].lock);
+                for (Patient *current = patientShards[s].head; current != NULL; current = current->next) {
+                    active += current->isActive;
+                }
+                pthread_rwlock_unlock(&patientShards[s].lock);
+            }
+            worker->scans++;
+        }
+    }
+    return NULL;
+}
+
+//Writer thread. Admits patients from its own ID range, discharges every other one and changes shift assignments
+void *stressWriter(void *arg) {
+    StressWorker *worker = (StressWorker *) arg;
+    int nextID = 1000000 + worker->workerIndex * 10000000;
+
+    while (atomic_load(&stressRunning)) {
+        // Every fourth admission leaves the room to the free-bed index
+        int room = nextID % 4 == 0 ? 0 : 1 + (int) (nextRandom(&worker->randomState) % STRESS_ROOM_RANGE);
+        Patient *patient = createPatient(nextID, "Stress Patient", 40, "Observation", room);
+        if (patient == NULL) {
+            break;
+        }
+
+        if (admitPatient(patient) == STORE_OK) {
+            worker->admissions++;
+            if (nextID % 2 == 0 && dischargePatientByID(nextID) == STORE_OK) {
+                worker->discharges++;
+            }
+        } else {
+            free(patient);
+        }
+        nextID++;
+
+        if (nextID % 16 == 0) {
+            int doctorID = 1 + (int) (nextRandom(&worker->randomState) % STRESS_SEED_DOCTORS);
+            int day = todayScheduleDay() + (int) (nextRandom(&worker->randomState) % STRESS_SCHEDULE_DAYS);
+            int shift = 1 + (int) (nextRandom(&worker->randomState) % MAX_SHIFTS_IN_DAY);
+            if (assignShift(doctorID, day, shift) == STORE_ALREADY_ON_SHIFT) {
+                unassignShift(doctorID, day, shift);
+            }
+            worker->shiftAttempts++;
+        }
+    }
+    return NULL;
+}
+
+//Compare the per-row fprintf output path with the buffered report writer on the same patients
+void runReportBenchmark(int patients) {
+    static const char *diagnoses[] = {"Observation", "Influenza", "Fractured left tibia", "Pneumonia",
+                                      "Post-operative recovery after appendectomy"};
+    char name[50];
+    unsigned int randomState = 2463534242u;
+
+    // Rooms are only checked on admission, so load the records directly to get past the bed limit
+    lockAllPatientShards(1);
+    for (int i = 1; i <= patients; i++) {
+        snprintf(name, sizeof(name), "Patient %d", i);
+        Patient *patient = createPatient(i, name, (int) (nextRandom(&randomState) % 100),
+                                         diagnoses[nextRandom(&randomState) % 5],
+                                         1 + (int) (nextRandom(&randomState) % MAX_ROOM_NUMBER));
+        if (patient == NULL) {
+            unlockAllPatientShards();
+            return;
+        }
+        patient->isActive = i % 3 != 0;
+        addLoadedPatient(patient);
+    }
+    unlockAllPatientShards();
+
+    FILE *fprintfFile = tmpfile();
+    FILE *bufferedFile = tmpfile();
+    if (fprintfFile == NULL || bufferedFile == NULL) {
+        printf("Error: Unable to create temporary report files.\n");
+        if (fprintfFile != NULL) fclose(fprintfFile);
+        if (bufferedFile != NULL) fclose(bufferedFile);
+        return;
+    }
+
+    double fprintfBest = 0, bufferedBest = 0;
+    for (int round = 0; round < REPORT_BENCH_ROUNDS; round++) {
+        double fprintfSeconds = timeFprintfReport(fprintfFile);
+        double bufferedSeconds = timeBufferedReport(bufferedFile);
+        if (fprintfSeconds < 0 || bufferedSeconds < 0) {
+            printf("Error: Unable to write a temporary report file.\n");
+            fclose(fprintfFile);
+            fclose(bufferedFile);
+            return;
+        }
+        if (round == 0 || fprintfSeconds < fprintfBest) fprintfBest = fprintfSeconds;
+        if (round == 0 || bufferedSeconds < bufferedBest) bufferedBest = bufferedSeconds;
+    }
+
+    long reportBytes = ftell(bufferedFile);
+    printf("Report benchmark: %d patients, %.1f MB per report, best of %d runs\n",
+           patients, reportBytes / 1e6, REPORT_BENCH_ROUNDS);
+    printf("%-25s%-15s%-15s%-15s\n", "Output path", "Seconds", "Rows/sec", "MB/sec");
+    printf("-----------------------------------------------------------------------\n");
+    printf("%-25s%-15.3f%-15.0f%-15.1f\n", "fprintf per row", fprintfBest,
+           patients / fprintfBest, reportBytes / 1e6 / fprintfBest);
+    printf("%-25s%-15.3f%-15.0f%-15.1f\n", "Buffered writer", bufferedBest,
+           patients / bufferedBest, reportBytes / 1e6 / bufferedBest);
+    printf("\nSpeedup: %.2fx\n", fprintfBest / bufferedBest);
+
+    // Both paths must produce byte-identical reports
+    printf("Output check: %s\n", sameFileContents(fprintfFile, bufferedFile) ? "OK" : "MISMATCH");
+
+    fclose(fprintfFile);
+    fclose(bufferedFile);
+}
+
+//Write the admission report with one formatted fprintf per row, as the report did before the buffered writer
+double timeFprintfReport(FILE *reportFile) {
+    struct timespec start, end;
+    rewind(reportFile);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    writeAdmissionHeader(reportFile, "benchmark");
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        pthread_rwlock_rdlock(&patientShards[s].lock);
+        for (Patient *current = patientShards[s].head; current != NULL; current = current->next) {
+            writeAdmissionRow(reportFile, current);
+        }
+        pthread_rwlock_unlock(&patientShards[s].lock);
+    }
+    int flushed = fflush(reportFile) == 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return flushed ? elapsedSeconds(&start, &end) : -1;
+}
+
+//Write the admission report the way patientAdmissionReport() does, through the buffered report writer
+double timeBufferedReport(FILE *reportFile) {
+    struct timespec start, end;
+    rewind(reportFile);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int written = writeBufferedAdmissionReport(reportFile) && fflush(reportFile) == 0;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return written ? elapsedSeconds(&start, &end) : -1;
+}
+
+//Write the admission header and rows through the buffered report writer. Returns 0 if it failed
+int writeBufferedAdmissionReport(FILE *reportFile) {
+    writeAdmissionHeader(reportFile, "benchmark");
+    ReportRenderJob *job = (ReportRenderJob *) calloc(1, sizeof(ReportRenderJob));
+    if (job == NULL) {
+        return 0;
+    }
+    renderPatientShardsParallel(job);
+    int written = writeRenderedRows(reportFile, job);
+    freeRenderJob(job);
+    return written;
+}
+
+//Return 1 if two files hold the same bytes up to their current positions
+int sameFileContents(FILE *first, FILE *second) {
+    long length = ftell(first);
+    if (length != ftell(second)) {
+        return 0;
+    }
+
+    char firstChunk[65536], secondChunk[65536];
+    rewind(first);
+    rewind(second);
+    while (length > 0) {
+        size_t chunk = length < (long) sizeof(firstChunk) ? (size_t) length : sizeof(firstChunk);
+        if (fread(firstChunk, 1, chunk, first) != chunk || fread(secondChunk, 1, chunk, second) != chunk ||
+            memcmp(firstChunk, secondChunk, chunk) != 0) {
+            return 0;
+        }
+        length -= (long) chunk;
+    }
+    return 1;
+}
+
+//Time the length of stay report over a store of discharged patients with random stays
+void runStayBenchmark(int patients) {
+    char name[50], diagnosis[32];
+    unsigned int randomState = 88172645u;
+    time_t base = 1704067200;   // 2024-01-01 00:00:00 UTC
+
+    lockAllPatientShards(1);
+    for (int i = 1; i <= patients; i++) {
+        snprintf(name, sizeof(name), "Patient %d", i);
+        snprintf(diagnosis, sizeof(diagnosis), "Diagnosis %u", nextRandom(&randomState) % STAY_BENCH_DIAGNOSES);
+        Patient *patient = createPatient(i, name, (int) (nextRandom(&randomState) % 100), diagnosis,
+                                         1 + (int) (nextRandom(&randomState) % MAX_ROOM_NUMBER));
+        if (patient == NULL) {
+            unlockAllPatientShards();
+            return;
+        }
+
+        // Admitted some time in the year, discharged up to STAY_BENCH_MAX_DAYS later
+        time_t admitted = base + (time_t) (nextRandom(&randomState) % (365 * 86400));
+        time_t discharged = admitted + (time_t) (nextRandom(&randomState) % (STAY_BENCH_MAX_DAYS * 86400));
+        struct tm parts;
+        strftime(patient->admissionDate, sizeof(patient->admissionDate), "%Y-%m-%d %H:%M:%S", gmtime_r(&admitted, &parts));
+        strftime(patient->dischargeDate, sizeof(patient->dischargeDate), "%Y-%m-%d %H:%M:%S", gmtime_r(&discharged, &parts));
+        patient->isActive = 0;
+        addLoadedPatient(patient);
+    }
+    unlockAllPatientShards();
+
+    FILE *reportFile = tmpfile();
+    if (reportFile == NULL) {
+        printf("Error: Unable to create a temporary report file.\n");
+        return;
+    }
+
+    // Time each phase separately as well as the whole report
+    struct timespec start, copied, computed, end;
+    StayColumns columns;
+    StringDictionary diagnoses;
+    StayGroupSummary *byDiagnosis = (StayGroupSummary *) malloc((STAY_BENCH_DIAGNOSES + 1) * sizeof(StayGroupSummary));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int copiedOK = snapshotStays(&columns, &diagnoses);
+    clock_gettime(CLOCK_MONOTONIC, &copied);
+    if (copiedOK) {
+        computeStayBuckets(&columns);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &computed);
+    int summarized = copiedOK && byDiagnosis != NULL && diagnoses.count <= STAY_BENCH_DIAGNOSES &&
+                     summarizeStays(&columns, columns.diagnosis, diagnoses.count, byDiagnosis);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    freeStayColumns(&columns);
+    freeDictionary(&diagnoses);
+    free(byDiagnosis);
+
+    struct timespec reportStart, reportEnd;
+    clock_gettime(CLOCK_MONOTONIC, &reportStart);
+    int stays = writeLengthOfStayReport(reportFile, "benchmark");
+    clock_gettime(CLOCK_MONOTONIC, &reportEnd);
+    fclose(reportFile);
+
+    if (!summarized || stays < 0) {
+        printf("Error: Memory allocation failed for the length of stay report.\n");
+        return;
+    }
+
+    printf("Length of stay benchmark: %d stays, %d diagnoses\n", stays, STAY_BENCH_DIAGNOSES);
+    printf("%-35s%-15s\n", "Phase", "Milliseconds");
+    printf("--------------------------------------------------\n");
+    printf("%-35s%-15.1f\n", "Snapshot stay history", elapsedSeconds(&start, &copied) * 1000);
+    printf("%-35s%-15.1f\n", "Histogram buckets", elapsedSeconds(&copied, &computed) * 1000);
+    printf("%-35s%-15.1f\n", "Per-diagnosis summary", elapsedSeconds(&computed, &end) * 1000);
+    printf("%-35s%-15.1f\n", "Whole report", elapsedSeconds(&reportStart, &reportEnd) * 1000);
+}
+
+//Time one filtered listing three ways: walking the lists, scalar column kernels and vector column kernels
+void runFilterBenchmark(int patients) {
+    char name[50];
+    unsigned int randomState = 2654435761u;
+    time_t base = 1704067200;   // 2024-01-01 00:00:00 UTC
+
+    // Patients of all ages spread over the rooms and admitted through one year; a quarter are discharged
+    lockAllPatientShards(1);
+    for (int i = 1; i <= patients; i++) {
+        snprintf(name, sizeof(name), "Patient %d", i);
+        Patient *patient = createPatient(i, name, (int) (nextRandom(&randomState) % 100), "Observation",
+                                         1 + (int) (nextRandom(&randomState) % 999));
+        if (patient == NULL) {
+            unlockAllPatientShards();
+            return;
+        }
+        time_t admitted = base + (time_t) (nextRandom(&randomState) % (365 * 86400));
+        struct tm parts;
+        strftime(patient->admissionDate, sizeof(patient->admissionDate), "%Y-%m-%d %H:%M:%S", gmtime_r(&admitted, &parts));
+        patient->isActive = nextRandom(&randomState) % 4 != 0;
+        addLoadedPatient(patient);
+    }
+    unlockAllPatientShards();
+
+    // Active patients over 65 in rooms 200-299
+    PatientFilter filter;
+    initializePatientFilter(&filter);
+    filter.status = 1;
+    filter.minAge = 65;
+    filter.minRoom = 200;
+    filter.maxRoom = 299;
+
+    unsigned long long *selections[PATIENT_SHARD_COUNT];
+    int allocated = 1;
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        selections[s] = (unsigned long long *) malloc((selectionWords(patientShards[s].count) + 1) *
+                                                      sizeof(unsigned long long));
+        allocated = allocated && selections[s] != NULL;
+    }
+    if (!allocated) {
+        printf("Error: Memory allocation failed for the selections.\n");
+        for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+            free(selections[s]);
+        }
+        return;
+    }
+
+    double best[3] = {-1, -1, -1};
+    int matches[3] = {0, 0, 0};
+    for (int round = 0; round < FILTER_BENCH_ROUNDS; round++) {
+        for (int path = 0; path < 3; path++) {
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            matches[path] = path == 0 ? filterByListWalk(&filter) : filterByColumns(&filter, selections, path == 2);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            double elapsed = elapsedSeconds(&start, &end);
+            if (best[path] < 0 || elapsed < best[path]) {
+                best[path] = elapsed;
+            }
+        }
+    }
+
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        free(selections[s]);
+    }
+
+    printf("Filter benchmark: %d patients, active, age >= 65, rooms 200-299, best of %d\n",
+           patients, FILTER_BENCH_ROUNDS);
+    printf("%-35s%-15s%-15s\n", "Path", "Matches", "Milliseconds");
+    printf("--------------------------------------------------\n");
+    printf("%-35s%-15d%-15.2f\n", "Linked list walk", matches[0], best[0] * 1000);
+    printf("%-35s%-15d%-15.2f\n", "Columns, scalar kernel", matches[1], best[1] * 1000);
+    printf("%-35s%-15d%-15.2f\n", "Columns, " FILTER_KERNEL_NAME " kernel", matches[2], best[2] * 1000);
+    printf("\nSelections match: %s\n", matches[0] == matches[1] && matches[1] == matches[2] ? "OK" : "MISMATCH");
+}
+
+//Count the patients matching a filter by walking every shard's list, as listings did before the columns
+int filterByListWalk(const PatientFilter *filter) {
+    int matches = 0;
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        pthread_rwlock_rdlock(&patientShards[s].lock);
+        for (Patient *current = patientShards[s].head; current != NULL; current = current->next) {
+            if ((filter->status == FILTER_STATUS_ANY || current->isActive == filter->status) &&
+                current->patientAge >= filter->minAge && current->patientAge <= filter->maxAge &&
+                current->patientRoomNum >= filter->minRoom && current->patientRoomNum <= filter->maxRoom) {
+                matches++;
+            }
+        }
+        pthread_rwlock_unlock(&patientShards[s].lock);
+    }
+    return matches;
+}
+
+//Count the patients matching a filter's status, room and age ranges over the shard columns with either kernel
+int filterByColumns(const PatientFilter *filter, unsigned long long **selections, int vectorized) {
+    int matches = 0;
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        PatientShard *shard = &patientShards[s];
+        pthread_rwlock_rdlock(&shard->lock);
+        if (vectorized) {
+            matches += selectPatientsInShard(shard, filter, selections[s]);
+        } else {
+            int words = selectionWords(shard->count);
+            for (int w = 0; w < words; w++) {
+                selections[s][w] = ~0ULL;
+            }
+            if (shard->count % 64 != 0) {
+                selections[s][words - 1] = (1ULL << (shard->count % 64)) - 1;
+            }
+            selectInRangeScalar(shard->active, shard->count, filter->status, filter->status, selections[s]);
+            selectInRangeScalar(shard->rooms, shard->count, filter->minRoom, filter->maxRoom, selections[s]);
+            selectInRangeScalar(shard->ages, shard->count, filter->minAge, filter->maxAge, selections[s]);
+            for (int w = 0; w < words; w++) {
+                matches += __builtin_popcountll(selections[s][w]);
+            }
+        }
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return matches;
+}
+
+//Fill an empty roster for a period and check every assignment against the weekly limit and the rest rule
+void runRosterBenchmark(int doctors, int days) {
+    char name[50];
+    for (int i = 1; i <= doctors; i++) {
+        snprintf(name, sizeof(name), "Doctor %d", i);
+        Doctor *doctor = createDoctor(i, name);
+        if (doctor == NULL || registerDoctor(doctor) != STORE_OK) {
+            free(doctor);
+            return;
+        }
+    }
+
+    int firstDay = todayScheduleDay();
+    RosterResult result;
+    if (fillRoster(firstDay, firstDay + days - 1, MAX_DOCTORS_PER_SHIFT, &result) != STORE_OK) {
+        printf("Error: The roster could not be filled.\n");
+        return;
+    }
+
+    printf("Roster benchmark: %d doctors, %d days, %d doctors per shift\n", doctors, days, MAX_DOCTORS_PER_SHIFT);
+    printf("%-30s%d\n", "Open places:", result.positions);
+    printf("%-30s%d\n", "Places filled:", result.filled);
+    printf("%-30s%d\n", "Moved to balance shifts:", result.moves);
+    printf("%-30s%d to %d\n", "Shifts per doctor:", result.minShifts, result.maxShifts);
+    printf("%-30s%.2f\n", "Milliseconds:", result.elapsedMicros / 1000.0);
+
+    // Ask who is free for every shift of the period, as Find Free Doctors does for one
+    struct timespec start, end;
+    long long freeDoctors = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    for (int day = firstDay; day < firstDay + days; day++) {
+        for (int shift = 1; shift <= MAX_SHIFTS_IN_DAY; shift++) {
+            for (Doctor *current = doctorHead; current != NULL; current = current->next) {
+                freeDoctors += canTakeShift(&doctorSchedule, current->doctorID, day, shift);
+            }
+        }
+    }
+    pthread_rwlock_unlock(&doctorStoreLock);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%-30s%lld free in %.2f ms\n", "Free doctor lookups:", freeDoctors, elapsedSeconds(&start, &end) * 1000.0);
+
+    // Recheck the committed schedule from its shift entries rather than trusting the solver's own checks,
+    // and compare the week bits against a scan of the same entries
+    int violations = 0;
+    int bitViolations = 0;
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    for (int i = 0; i < doctorSchedule.slotCapacity; i++) {
+        ScheduleSlot *slot = &doctorSchedule.slots[i];
+        for (int d = 0; slot->shift == MAX_SHIFTS_IN_DAY && d < slot->count; d++) {
+            violations += slotHasDoctor(findScheduleSlot(&doctorSchedule, slot->day + 1, 1, 0), slot->doctorIDs[d]);
+        }
+    }
+    for (int i = 0; i < doctorSchedule.loadCapacity; i++) {
+        DoctorWeekLoad *load = &doctorSchedule.loads[i];
+        if (load->doctorID == 0) {
+            continue;
+        }
+        int weekShifts = 0;
+        int monday = weekStartDay(load->week * 7);     // Day 7w always falls in week w
+        for (int day = monday; day < monday + 7; day++) {
+            for (int shift = 1; shift <= MAX_SHIFTS_IN_DAY; shift++) {
+                weekShifts += slotHasDoctor(findScheduleSlot(&doctorSchedule, day, shift, 0), load->doctorID);
+            }
+        }
+        violations += weekShifts > MAX_SHIFTS_PER_DOCTOR;
+        bitViolations += countRestViolations(load->shiftBits);
+        // Sunday evening against the following Monday morning
+        bitViolations += (load->shiftBits >> (WEEK_SHIFT_BITS - 1)) &
+                         weekShiftBits(&doctorSchedule, load->doctorID, load->week + 1);
+        bitViolations += __builtin_popcount(load->shiftBits) > MAX_SHIFTS_PER_DOCTOR;
+    }
+    pthread_rwlock_unlock(&doctorStoreLock);
+    printf("\nConstraint check: %d violations, %d from week bits -> %s\n", violations, bitViolations,
+           violations == 0 && bitViolations == 0 ? "OK" : "MISMATCH");
+}
+
+//Time the core store operations over a synthetic hospital and append the results to a CSV file
+void runWorkloadBenchmark(int patients, int doctors, int rooms, FILE *resultsFile) {
+    WorkloadTiming timings[WORKLOAD_MAX_TIMINGS];
+    int timingCount = 0;
+    struct timespec start, end;
+    unsigned int randomState = 362436069u;
+
+    int admitted = buildWorkloadHospital(patients, doctors, rooms, timings, &timingCount);
+    if (admitted < 0) {
+        printf("Error: The synthetic hospital could not be built.\n");
+        return;
+    }
+    int discharged = patients - admitted;
+
+    // Lookups take the shard read lock as the menu does; every ID is still in the store before the first save
+    long found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < WORKLOAD_LOOKUPS; i++) {
+        int id = 1 + (int) (nextRandom(&randomState) % patients);
+        PatientShard *shard = shardForPatient(id);
+        pthread_rwlock_rdlock(&shard->lock);
+        found += findPatientByID(id) != NULL;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    addWorkloadTiming(timings, &timingCount, "findPatientByID", WORKLOAD_LOOKUPS, elapsedSeconds(&start, &end));
+
+    long available = 0;     // Lookups that found a free bed, out of WORKLOAD_LOOKUPS
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < WORKLOAD_LOOKUPS; i++) {
+        available += isRoomAvailable(1 + (int) (nextRandom(&randomState) % rooms));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    addWorkloadTiming(timings, &timingCount, "isRoomAvailable", WORKLOAD_LOOKUPS, elapsedSeconds(&start, &end));
+
+    // Each record is freed straight away, so this times allocation and copying only
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < WORKLOAD_CREATES; i++) {
+        Patient *patient = createPatient(patients + 1, "Workload Patient", 50, "Observation", 1);
+        if (patient == NULL) {
+            return;
+        }
+        free(patient);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    addWorkloadTiming(timings, &timingCount, "createPatient", WORKLOAD_CREATES, elapsedSeconds(&start, &end));
+
+    // The first save moves the discharged patients to the archive; the second is what every later save costs.
+    // saveData backs up the data as well, as it does on exit
+    MemoryUsage memoryBefore[MEMORY_CATEGORY_COUNT], memoryAfter[MEMORY_CATEGORY_COUNT];
+    collectMemoryUsage(memoryBefore);
+    int ok;
+    double seconds = timeQuietCall(saveData, &ok);
+    if (!ok) {
+        printf("Error: saveData failed.\n");
+        return;
+    }
+    addWorkloadTiming(timings, &timingCount, "saveData.archive", 1, seconds);
+    collectMemoryUsage(memoryAfter);
+    seconds = timeQuietCall(saveData, &ok);
+    if (!ok) {
+        printf("Error: saveData failed.\n");
+        return;
+    }
+    addWorkloadTiming(timings, &timingCount, "saveData", 1, seconds);
+
+    // The backup is named by the second it started in, which is needed to restore it
+    char timestamp[20], finished[20], backupName[MAX_FILENAME_LENGTH];
+    getFileTimestamp(timestamp, sizeof(timestamp));
+    seconds = timeQuietCall(backupData, &ok);
+    getFileTimestamp(finished, sizeof(finished));
+    if (!ok) {
+        printf("Error: backupData failed.\n");
+        return;
+    }
+    addWorkloadTiming(timings, &timingCount, "backupData", 1, seconds);
+    snprintf(backupName, sizeof(backupName), "../backups/snapshot_%s.dat", timestamp);
+    if (access(backupName, F_OK) != 0) {
+        strcpy(timestamp, finished);
+    }
+
+    // Both loads start from an empty store, as at startup
+    cleanupSystem();
+    seconds = timeQuietCall(loadData, &ok);
+    int loadedOK = ok && totalPatientsActive == admitted && archivedPatientCount() == discharged;
+    addWorkloadTiming(timings, &timingCount, "loadData", 1, seconds);
+
+    cleanupSystem();
+    seconds = timeQuietCall(safeLoadData, &ok);
+    loadedOK = loadedOK && ok && totalPatientsActive == admitted && archivedPatientCount() == discharged;
+    addWorkloadTiming(timings, &timingCount, "safeLoadData", 1, seconds);
+
+    // Reports go to temporary files, except that writeAllReports writes to the workspace's reports directory
+    static const char *reportNames[] = {"report.admission", "report.doctor", "report.room", "report.lengthOfStay"};
+    int (*reportWriters[])(FILE *) = {writeBufferedAdmissionReport, writeDoctorReportRows, writeRoomReportRows,
+                                      writeStayReportRows};
+    for (int r = 0; r < 4; r++) {
+        seconds = timeReport(reportWriters[r]);
+        if (seconds < 0) {
+            printf("Error: Unable to write the %s report.\n", reportNames[r]);
+            return;
+        }
+        addWorkloadTiming(timings, &timingCount, reportNames[r], WORKLOAD_REPORT_ROUNDS, seconds);
+    }
+
+    char fileNames[3][MAX_FILENAME_LENGTH];
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < WORKLOAD_REPORT_ROUNDS; round++) {
+        if (!writeAllReports(fileNames)) {
+            printf("Error: writeAllReports failed.\n");
+            return;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    addWorkloadTiming(timings, &timingCount, "writeAllReports", WORKLOAD_REPORT_ROUNDS, elapsedSeconds(&start, &end));
+
+    int savedOutput = silenceOutput();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ok = restoreData(timestamp);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    restoreOutput(savedOutput);
+    int restoredOK = ok && totalPatientsActive == admitted && archivedPatientCount() == discharged;
+    addWorkloadTiming(timings, &timingCount, "restoreData", 1, elapsedSeconds(&start, &end));
+
+    printf("Workload benchmark: %d patients (%d admitted, %d discharged), %d doctors, %d rooms\n",
+           patients, admitted, discharged, doctors, rooms);
+    writeWorkloadResults(timings, timingCount, patients, doctors, rooms, resultsFile);
+    printMemoryComparison(memoryBefore, memoryAfter);
+
+    // Every lookup hit a stored patient, and each load and the restore brought back the same hospital
+    printf("\nData check: %ld of %d patient lookups found, %ld of %d room lookups found a free bed, loads %s, "
+           "restore %s -> %s\n",
+           found, WORKLOAD_LOOKUPS, available, WORKLOAD_LOOKUPS, loadedOK ? "matched" : "differed", restoredOK ? "matched" : "differed",
+           found == WORKLOAD_LOOKUPS && loadedOK && restoredOK ? "OK" : "MISMATCH");
+}
+
+//Print the memory each structure had allocated before and after the first save archived the discharged patients
+void printMemoryComparison(const MemoryUsage *before, const MemoryUsage *after) {
+    long long totalBefore = 0, totalAfter = 0;
+    printf("\n%-24s%-18s%-18s\n", "Structure", "Before save KiB", "After save KiB");
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        printf("%-24s%-18.1f%-18.1f\n", memoryCategoryNames[c], before[c].allocatedBytes / 1024.0,
+               after[c].allocatedBytes / 1024.0);
+        totalBefore += before[c].allocatedBytes;
+        totalAfter += after[c].allocatedBytes;
+    }
+    printf("%-24s%-18.1f%-18.1f\n", "Total", totalBefore / 1024.0, totalAfter / 1024.0);
+}
+
+//Fill the store with a synthetic hospital: rooms of mixed sizes, admitted patients up to the occupancy target,
+//discharged patients for the rest and a roster. Times admitPatient and fillRoster. Returns the patients admitted, or -1
+int buildWorkloadHospital(int patients, int doctors, int rooms, WorkloadTiming *timings, int *timingCount) {
+    unsigned int randomState = 521288629u;
+    struct timespec start, end;
+    time_t now = time(NULL);
+
+    // Open rooms 1..rooms and close the rest, so admissions spread over the rooms asked for
+    for (int room = 1; room <= MAX_ROOM_NUMBER; room++) {
+        int capacity = room <= rooms ? pickWeightedValue(workloadRoomSizes, WEIGHT_COUNT(workloadRoomSizes), &randomState) : 0;
+        if (setRoomCapacity(room, capacity) != STORE_OK) {
+            return -1;
+        }
+    }
+    pthread_mutex_lock(&roomBedLock);
+    int beds = roomBeds.totalBeds;
+    pthread_mutex_unlock(&roomBedLock);
+
+    int admitted = (int) ((long long) beds * WORKLOAD_OCCUPANCY_PERCENT / 100);
+    if (admitted > patients) {
+        admitted = patients;
+    }
+    int discharged = patients - admitted;
+
+    // Discharged patients take the lower IDs and are loaded directly, as they would be from the saved data.
+    // They left some time in the past year
+    lockAllPatientShards(1);
+    for (int id = 1; id <= discharged; id++) {
+        Patient *patient = createWorkloadPatient(id, 1 + (int) (nextRandom(&randomState) % rooms), &randomState);
+        if (patient == NULL) {
+            unlockAllPatientShards();
+            return -1;
+        }
+        time_t left = now - 3600 - (time_t) (nextRandom(&randomState) % (365 * 86400));
+        time_t arrived = left - (time_t) pickWeightedValue(workloadStays, WEIGHT_COUNT(workloadStays), &randomState) * 86400 -
+                         (time_t) (nextRandom(&randomState) % 86400);
+        formatWorkloadTime(patient->admissionDate, sizeof(patient->admissionDate), arrived);
+        formatWorkloadTime(patient->dischargeDate, sizeof(patient->dischargeDate), left);
+        patient->isActive = 0;
+        addLoadedPatient(patient);
+    }
+    unlockAllPatientShards();
+
+    // Admitted patients go through admitPatient with room 0, which takes the best free room
+    Patient **admissions = (Patient **) malloc((admitted + 1) * sizeof(Patient *));
+    if (admissions == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < admitted; i++) {
+        admissions[i] = createWorkloadPatient(discharged + 1 + i, 0, &randomState);
+        if (admissions[i] == NULL) {
+            while (i > 0) {
+                free(admissions[--i]);
+            }
+            free(admissions);
+            return -1;
+        }
+        time_t arrived = now - (time_t) pickWeightedValue(workloadStays, WEIGHT_COUNT(workloadStays), &randomState) * 86400 -
+                         (time_t) (nextRandom(&randomState) % 86400);
+        formatWorkloadTime(admissions[i]->admissionDate, sizeof(admissions[i]->admissionDate), arrived);
+    }
+
+    int next = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (next < admitted && admitPatient(admissions[next]) == STORE_OK) {
+        next++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    int allAdmitted = next == admitted;
+    while (next < admitted) {
+        free(admissions[next++]);
+    }
+    free(admissions);
+    if (!allAdmitted) {
+        printf("Error: A synthetic patient could not be admitted.\n");
+        return -1;
+    }
+    addWorkloadTiming(timings, timingCount, "admitPatient", admitted, elapsedSeconds(&start, &end));
+
+    char name[50];
+    for (int i = 1; i <= doctors; i++) {
+        snprintf(name, sizeof(name), "Doctor %d", i);
+        Doctor *doctor = createDoctor(i, name);
+        if (doctor == NULL || registerDoctor(doctor) != STORE_OK) {
+            free(doctor);
+            return -1;
+        }
+    }
+
+    int firstDay = todayScheduleDay();
+    RosterResult result;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int rostered = fillRoster(firstDay, firstDay + WORKLOAD_ROSTER_DAYS - 1, MAX_DOCTORS_PER_SHIFT, &result);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (rostered != STORE_OK) {
+        printf("Error: The roster could not be filled.\n");
+        return -1;
+    }
+    addWorkloadTiming(timings, timingCount, "fillRoster", 1, elapsedSeconds(&start, &end));
+    return admitted;
+}
+
+//Create a patient with an age and diagnosis drawn from the workload tables
+Patient *createWorkloadPatient(int id, int roomNum, unsigned int *randomState) {
+    char name[50];
+    snprintf(name, sizeof(name), "Patient %d", id);
+    int age = pickWeightedValue(workloadAges, WEIGHT_COUNT(workloadAges), randomState);
+    const char *diagnosis = pickWeighted(workloadDiagnoses, WEIGHT_COUNT(workloadDiagnoses), randomState)->label;
+    return createPatient(id, name, age, diagnosis, roomNum);
+}
+
+//Draw an entry from a weighted table
+const WorkloadWeight *pickWeighted(const WorkloadWeight *table, int count, unsigned int *randomState) {
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        total += table[i].weight;
+    }
+
+    int draw = (int) (nextRandom(randomState) % (unsigned int) total);
+    for (int i = 0; i < count - 1; i++) {
+        if (draw < table[i].weight) {
+            return &table[i];
+        }
+        draw -= table[i].weight;
+    }
+    return &table[count - 1];
+}
+
+//Draw a range from a weighted table, then a value from that range
+int pickWeightedValue(const WorkloadWeight *table, int count, unsigned int *randomState) {
+    const WorkloadWeight *range = pickWeighted(table, count, randomState);
+    return range->low + (int) (nextRandom(randomState) % (unsigned int) (range->high - range->low + 1));
+}
+
+//Format a time the way admission and discharge dates are stored
+void formatWorkloadTime(char *text, int bufferSize, time_t when) {
+    struct tm parts;
+    strftime(text, bufferSize, "%Y-%m-%d %H:%M:%S", localtime_r(&when, &parts));
+}
+
+//Record the timing of one operation
+void addWorkloadTiming(WorkloadTiming *timings, int *timingCount, const char *operation, long calls, double seconds) {
+    if (*timingCount < WORKLOAD_MAX_TIMINGS) {
+        timings[*timingCount].operation = operation;
+        timings[*timingCount].calls = calls;
+        timings[*timingCount].seconds = seconds;
+        (*timingCount)++;
+    }
+}
+
+//Time one call of a store function that prints its progress, with that output discarded. Stores its return value in result
+double timeQuietCall(int (*operation)(void), int *result) {
+    struct timespec start, end;
+    int savedOutput = silenceOutput();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    *result = operation();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    restoreOutput(savedOutput);
+    return elapsedSeconds(&start, &end);
+}
+
+//Write a report to a temporary file WORKLOAD_REPORT_ROUNDS times. Returns the total seconds, or -1 if a round failed
+double timeReport(int (*writeReport)(FILE *reportFile)) {
+    FILE *reportFile = tmpfile();
+    if (reportFile == NULL) {
+        return -1;
+    }
+
+    struct timespec start, end;
+    double total = 0;
+    for (int round = 0; round < WORKLOAD_REPORT_ROUNDS; round++) {
+        rewind(reportFile);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int written = writeReport(reportFile) && fflush(reportFile) == 0;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (!written) {
+            fclose(reportFile);
+            return -1;
+        }
+        total += elapsedSeconds(&start, &end);
+    }
+    fclose(reportFile);
+    return total;
+}
+
+//Write the doctor utilization report for the current week, as doctorUtilizationReport() does
+int writeDoctorReportRows(FILE *reportFile) {
+    writeDoctorHeader(reportFile, "benchmark");
+    int week = weekOfDay(todayScheduleDay());
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    for (Doctor *current = doctorHead; current != NULL; current = current->next) {
+        writeDoctorRow(reportFile, current, week);
+    }
+    pthread_rwlock_unlock(&doctorStoreLock);
+    return 1;
+}
+
+//Write the room utilization report, as roomUtilizationReport() does
+int writeRoomReportRows(FILE *reportFile) {
+    writeRoomHeader(reportFile, "benchmark");
+    writeRoomRows(reportFile);
+    return 1;
+}
+
+//Write the length of stay report. Returns 0 if it failed
+int writeStayReportRows(FILE *reportFile) {
+    return writeLengthOfStayReport(reportFile, "benchmark") >= 0;
+}
+
+//Print the timings as a table and append them to the results file, one CSV row per operation
+void writeWorkloadResults(const WorkloadTiming *timings, int timingCount, int patients, int doctors, int rooms,
+                          FILE *resultsFile) {
+    printf("%-25s%-12s%-15s%-15s\n", "Operation", "Calls", "Seconds", "Calls/sec");
+    printf("-------------------------------------------------------------------\n");
+    for (int i = 0; i < timingCount; i++) {
+        const WorkloadTiming *timing = &timings[i];
+        printf("%-25s%-12ld%-15.4f%-15.0f\n", timing->operation, timing->calls, timing->seconds,
+               timing->seconds > 0 ? timing->calls / timing->seconds : 0);
+    }
+
+    // A new results file starts with the column names
+    fseek(resultsFile, 0, SEEK_END);
+    if (ftell(resultsFile) == 0) {
+        fprintf(resultsFile, "timestamp,patients,doctors,rooms,operation,calls,seconds,calls_per_second\n");
+    }
+
+    char timestamp[20];
+    getCurrentDateTime(timestamp, sizeof(timestamp));
+    for (int i = 0; i < timingCount; i++) {
+        const WorkloadTiming *timing = &timings[i];
+        fprintf(resultsFile, "%s,%d,%d,%d,%s,%ld,%.6f,%.1f\n", timestamp, patients, doctors, rooms, timing->operation,
+                timing->calls, timing->seconds, timing->seconds > 0 ? timing->calls / timing->seconds : 0);
+    }
+    if (fflush(resultsFile) != 0) {
+        printf("Error: Unable to write the results file.\n");
+    }
+}
+
+//Create a scratch directory laid out like the repository and move into its code directory, so the
+//store's ../data, ../backups and ../reports paths land inside it
+int enterWorkloadWorkspace(char *workspace) {
+    static const char *directories[] = {"code", "data", "backups", "reports"};
+    char path[MAX_FILENAME_LENGTH];
+
+    if (mkdtemp(workspace) == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/%s", workspace, directories[i]);
+        if (mkdir(path, 0755) != 0) {
+            removeWorkloadWorkspace(workspace);
+            return 0;
+        }
+    }
+    snprintf(path, sizeof(path), "%s/code", workspace);
+    if (chdir(path) != 0) {
+        removeWorkloadWorkspace(workspace);
+        return 0;
+    }
+    return 1;
+}
+
+//Remove the scratch directory and everything saved in it
+void removeWorkloadWorkspace(const char *workspace) {
+    char command[MAX_FILENAME_LENGTH + 20];
+    snprintf(command, sizeof(command), "rm -rf \"%s\"", workspace);
+    if (system(command) != 0) {
+        printf("Warning: Unable to remove %s\n", workspace);
+    }
+}
+
+//Send stdout to /dev/null. Returns the descriptor to restore it from, or -1 if it was left alone
+int silenceOutput() {
+    fflush(stdout);
+    int savedOutput = dup(STDOUT_FILENO);
+    int nullOutput = open("/dev/null", O_WRONLY);
+    if (savedOutput < 0 || nullOutput < 0 || dup2(nullOutput, STDOUT_FILENO) < 0) {
+        if (savedOutput >= 0) close(savedOutput);
+        if (nullOutput >= 0) close(nullOutput);
+        return -1;
+    }
+    close(nullOutput);
+    return savedOutput;
+}
+
+//Point stdout back at the descriptor saved by silenceOutput()
+void restoreOutput(int savedOutput) {
+    if (savedOutput < 0) {
+        return;
+    }
+    fflush(stdout);
+    dup2(savedOutput, STDOUT_FILENO);
+    close(savedOutput);
+}
+
+//Time the patient data paths of the three generations side by side at growing store sizes
+void runLayoutBenchmark(int maxPatients) {
+    static const PatientLayout layouts[] = {
+        {"Arrays (HMS1)", NULL, arrayLayoutInsert, arrayLayoutFind, arrayLayoutRemove, NULL, NULL, arrayLayoutReset},
+        {"List + text (HMS2)", "patient.txt", listLayoutInsert, listLayoutFind, listLayoutRemove, listLayoutSave,
+         listLayoutLoad, listLayoutReset},
+        {"Shards + binary", "../data/snapshot.dat", storeLayoutInsert, storeLayoutFind, storeLayoutRemove,
+         storeLayoutSave, storeLayoutLoad, storeLayoutReset}
+    };
+    unsigned int randomState = 1013904223u;
+
+    // Every room takes the most beds, so the completed system can admit the largest size
+    for (int room = 1; room <= MAX_ROOM_NUMBER; room++) {
+        setRoomCapacity(room, MAX_ROOM_CAPACITY);
+    }
+
+    printf("Layout benchmark: %d to %d patients, %d lookups and %d%% removed at each size\n",
+           LAYOUT_BENCH_MIN_PATIENTS, maxPatients, LAYOUT_BENCH_LOOKUPS, LAYOUT_BENCH_DELETE_PERCENT);
+    printf("%-10s%-20s%-13s%-13s%-13s%-10s%-10s%-10s\n", "Patients", "Layout", "Insert/sec", "Lookup/sec",
+           "Remove/sec", "Save ms", "Load ms", "File KB");
+    printf("-----------------------------------------------------------------------------------------------\n");
+
+    int mismatches = 0;
+    for (int patients = LAYOUT_BENCH_MIN_PATIENTS; patients <= maxPatients; patients *= 2) {
+        for (int i = 0; i < 3; i++) {
+            mismatches += !timeLayout(&layouts[i], patients, &randomState);
+            layouts[i].reset();
+        }
+        if (patients > maxPatients / 2 && patients < maxPatients) {
+            patients = maxPatients / 2;     // End on the largest size asked for
+        }
+    }
+
+    // Each layout found every patient it stored, loaded what it saved and removed what was asked
+    printf("\nData check: %d mismatches -> %s\n", mismatches, mismatches == 0 ? "OK" : "MISMATCH");
+}
+
+//Insert, look up, save, load and remove patients through one layout and print a row of results. Returns 0 if a
+//step gave the wrong result
+int timeLayout(const PatientLayout *layout, int patients, unsigned int *randomState) {
+    struct timespec start, end;
+    int correct = 1;
+
+    // Names are formatted outside the timed loop so insertion is timed on its own
+    char (*names)[LAYOUT_NAME_LENGTH] = malloc((size_t) patients * LAYOUT_NAME_LENGTH);
+    int *ages = (int *) malloc(patients * sizeof(int));
+    const char **diagnoses = (const char **) malloc(patients * sizeof(const char *));
+    if (names == NULL || ages == NULL || diagnoses == NULL) {
+        free(names);
+        free(ages);
+        free(diagnoses);
+        return 0;
+    }
+    for (int i = 0; i < patients; i++) {
+        snprintf(names[i], LAYOUT_NAME_LENGTH, "Patient %d", i + 1);
+        ages[i] = pickWeightedValue(workloadAges, WEIGHT_COUNT(workloadAges), randomState);
+        diagnoses[i] = pickWeighted(workloadDiagnoses, WEIGHT_COUNT(workloadDiagnoses), randomState)->label;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < patients; i++) {
+        correct &= layout->insert(i + 1, names[i], ages[i], diagnoses[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double insertSeconds = elapsedSeconds(&start, &end);
+    free(names);
+    free(ages);
+    free(diagnoses);
+
+    int found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < LAYOUT_BENCH_LOOKUPS; i++) {
+        found += layout->find(1 + (int) (nextRandom(randomState) % patients));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double lookupSeconds = elapsedSeconds(&start, &end);
+    correct &= found == LAYOUT_BENCH_LOOKUPS;
+
+    // Save, then load into an emptied store; the generation without files keeps its arrays
+    double saveSeconds = 0, loadSeconds = 0;
+    long bytes = 0;
+    if (layout->save != NULL) {
+        int ok;
+        saveSeconds = timeQuietCall(layout->save, &ok);
+        bytes = fileSize(layout->fileName);
+        layout->reset();
+        int loaded;
+        loadSeconds = timeQuietCall(layout->load, &loaded);
+        correct &= ok && loaded == patients;
+    }
+
+    // Remove every tenth patient, in random order
+    int removals = patients * LAYOUT_BENCH_DELETE_PERCENT / 100;
+    int *removeIDs = (int *) malloc((removals + 1) * sizeof(int));
+    if (removeIDs == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < removals; i++) {
+        removeIDs[i] = (i + 1) * (100 / LAYOUT_BENCH_DELETE_PERCENT);
+    }
+    for (int i = removals - 1; i > 0; i--) {
+        int j = (int) (nextRandom(randomState) % (unsigned int) (i + 1));
+        int swap = removeIDs[i];
+        removeIDs[i] = removeIDs[j];
+        removeIDs[j] = swap;
+    }
+    int removed = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < removals; i++) {
+        removed += layout->remove(removeIDs[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double removeSeconds = elapsedSeconds(&start, &end);
+    free(removeIDs);
+    correct &= removed == removals && !layout->find(100 / LAYOUT_BENCH_DELETE_PERCENT);
+
+    printf("%-10d%-20s%-13.0f%-13.0f%-13.0f", patients, layout->name, patients / insertSeconds,
+           LAYOUT_BENCH_LOOKUPS / lookupSeconds, removals / removeSeconds);
+    if (layout->save != NULL) {
+        printf("%-10.1f%-10.1f%-10ld\n", saveSeconds * 1000, loadSeconds * 1000, bytes / 1024);
+    } else {
+        printf("%-10s%-10s%-10s\n", "-", "-", "-");
+    }
+    return correct;
+}
+
+//Return the size of a file in bytes, or 0 if it cannot be opened
+long fileSize(const char *fileName) {
+    struct stat info;
+    return stat(fileName, &info) == 0 ? (long) info.st_size : 0;
+}
+
+//Add a patient to the arrays after checking every stored ID, as addPatient() in HospitalManagementSystem1.c does
+int arrayLayoutInsert(int id, const char *name, int age, const char *diagnosis) {
+    if (arrayLayoutIndexOf(id) != -1) {
+        return 0;
+    }
+
+    if (arrayLayout.count == arrayLayout.capacity) {
+        int capacity = arrayLayout.capacity == 0 ? 1024 : arrayLayout.capacity * 2;
+        int *ids = (int *) realloc(arrayLayout.ids, capacity * sizeof(int));
+        if (ids != NULL) arrayLayout.ids = ids;
+        char (*names)[LAYOUT_NAME_LENGTH] = realloc(arrayLayout.names, (size_t) capacity * LAYOUT_NAME_LENGTH);
+        if (names != NULL) arrayLayout.names = names;
+        int *ages = (int *) realloc(arrayLayout.ages, capacity * sizeof(int));
+        if (ages != NULL) arrayLayout.ages = ages;
+        char (*diagnoses)[250] = realloc(arrayLayout.diagnoses, (size_t) capacity * 250);
+        if (diagnoses != NULL) arrayLayout.diagnoses = diagnoses;
+        if (ids == NULL || names == NULL || ages == NULL || diagnoses == NULL) {
+            return 0;
+        }
+        arrayLayout.capacity = capacity;
+    }
+
+    int i = arrayLayout.count++;
+    arrayLayout.ids[i] = id;
+    strcpy(arrayLayout.names[i], name);
+    arrayLayout.ages[i] = age;
+    strcpy(arrayLayout.diagnoses[i], diagnosis);
+    return 1;
+}
+
+//Return 1 if a patient is in the arrays
+int arrayLayoutFind(int id) {
+    return arrayLayoutIndexOf(id) != -1;
+}
+
+//Return the index of a patient ID by scanning the ID array, as idExists() does, or -1
+int arrayLayoutIndexOf(int id) {
+    for (int i = 0; i < arrayLayout.count; i++) {
+        if (arrayLayout.ids[i] == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//Remove a patient and shift every later record forward, as dischargePatient() in HospitalManagementSystem1.c does
+int arrayLayoutRemove(int id) {
+    int index = arrayLayoutIndexOf(id);
+    if (index == -1) {
+        return 0;
+    }
+
+    // Field by field, one record at a time; memmove would hide the cost of the layout
+    arrayLayout.count--;
+    for (int j = index; j < arrayLayout.count; j++) {
+        arrayLayout.ids[j] = arrayLayout.ids[j + 1];
+        memcpy(arrayLayout.names[j], arrayLayout.names[j + 1], strlen(arrayLayout.names[j + 1]) + 1);
+        arrayLayout.ages[j] = arrayLayout.ages[j + 1];
+        memcpy(arrayLayout.diagnoses[j], arrayLayout.diagnoses[j + 1], strlen(arrayLayout.diagnoses[j + 1]) + 1);
+    }
+    return 1;
+}
+
+//Free the arrays
+void arrayLayoutReset() {
+    free(arrayLayout.ids);
+    free(arrayLayout.names);
+    free(arrayLayout.ages);
+    free(arrayLayout.diagnoses);
+    memset(&arrayLayout, 0, sizeof(arrayLayout));
+}
+
+//Append a patient to the list after walking it for the ID, as addPatient() in HospitalManagementSystem2.c does
+int listLayoutInsert(int id, const char *name, int age, const char *diagnosis) {
+    if (listLayoutFind(id)) {
+        return 0;
+    }
+
+    ListLayoutPatient *newPatient = (ListLayoutPatient *) malloc(sizeof(ListLayoutPatient));
+    if (newPatient == NULL) {
+        return 0;
+    }
+    newPatient->iD = id;
+    strcpy(newPatient->patientName, name);
+    newPatient->age = age;
+    strcpy(newPatient->diagnosis, diagnosis);
+    newPatient->roomNum = 0;
+    newPatient->next = NULL;
+
+    if (listLayoutTail == NULL) {
+        listLayoutHead = newPatient;
+    } else {
+        listLayoutTail->next = newPatient;
+    }
+    listLayoutTail = newPatient;
+    return 1;
+}
+
+//Return 1 if a patient is in the list, walking it from the head as idExists() does
+int listLayoutFind(int id) {
+    for (ListLayoutPatient *temp = listLayoutHead; temp != NULL; temp = temp->next) {
+        if (temp->iD == id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//Unlink and free a patient, as deleteNode() in HospitalManagementSystem2.c does
+int listLayoutRemove(int id) {
+    ListLayoutPatient *prevPtr = NULL;
+    for (ListLayoutPatient *temp = listLayoutHead; temp != NULL; prevPtr = temp, temp = temp->next) {
+        if (temp->iD == id) {
+            if (prevPtr == NULL) {
+                listLayoutHead = temp->next;
+            } else {
+                prevPtr->next = temp->next;
+            }
+            if (listLayoutTail == temp) {
+                listLayoutTail = prevPtr;
+            }
+            free(temp);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//Write the list to patient.txt, one comma-separated line per patient, as saveData() in HospitalManagementSystem2.c does
+int listLayoutSave() {
+    FILE *patientFile = fopen("patient.txt", "w");
+    if (patientFile == NULL) {
+        return 0;
+    }
+
+    for (ListLayoutPatient *temp = listLayoutHead; temp != NULL; temp = temp->next) {
+        fprintf(patientFile, "%d,%s,%d,%s,%d\n", temp->iD, temp->patientName, temp->age, temp->diagnosis, temp->roomNum);
+    }
+    return fclose(patientFile) == 0;
+}
+
+//Read patient.txt back with fgets and strtok, as loadData() in HospitalManagementSystem2.c does. Returns the patients loaded
+int listLayoutLoad() {
+    FILE *patientFile = fopen("patient.txt", "r");
+    if (patientFile == NULL) {
+        return -1;
+    }
+
+    char line[512];
+    int lineCount = 0;
+    while (fgets(line, sizeof(line), patientFile)) {
+        line[strcspn(line, "\n")] = 0;
+
+        ListLayoutPatient *newPatient = (ListLayoutPatient *) calloc(1, sizeof(ListLayoutPatient));
+        if (newPatient == NULL) {
+            fclose(patientFile);
+            return -1;
+        }
+
+        char *token = strtok(line, ",");
+        if (token != NULL) {
+            newPatient->iD = atoi(token);
+            if ((token = strtok(NULL, ",")) != NULL) {
+                strncpy(newPatient->patientName, token, LAYOUT_NAME_LENGTH - 1);
+                if ((token = strtok(NULL, ",")) != NULL) {
+                    newPatient->age = atoi(token);
+                    if ((token = strtok(NULL, ",")) != NULL) {
+                        strncpy(newPatient->diagnosis, token, LAYOUT_DIAGNOSIS_LENGTH - 1);
+                        if ((token = strtok(NULL, ",")) != NULL) {
+                            newPatient->roomNum = atoi(token);
+                        }
+                    }
+                }
+            }
+        }
+
+        if (listLayoutTail == NULL) {
+            listLayoutHead = newPatient;
+        } else {
+            listLayoutTail->next = newPatient;
+        }
+        listLayoutTail = newPatient;
+        lineCount++;
+    }
+    fclose(patientFile);
+    return lineCount;
+}
+
+//Free the list
+void listLayoutReset() {
+    while (listLayoutHead != NULL) {
+        ListLayoutPatient *next = listLayoutHead->next;
+        free(listLayoutHead);
+        listLayoutHead = next;
+    }
+    listLayoutTail = NULL;
+}
+
+//Admit a patient to the best free room through the store
+int storeLayoutInsert(int id, const char *name, int age, const char *diagnosis) {
+    Patient *patient = createPatient(id, name, age, diagnosis, 0);
+    if (patient == NULL) {
+        return 0;
+    }
+    if (admitPatient(patient) != STORE_OK) {
+        free(patient);
+        return 0;
+    }
+    return 1;
+}
+
+//Return 1 if a patient is admitted, looked up under its shard's read lock
+int storeLayoutFind(int id) {
+    PatientShard *shard = shardForPatient(id);
+    pthread_rwlock_rdlock(&shard->lock);
+    Patient *patient = findPatientByID(id);
+    int found = patient != NULL && patient->isActive;
+    pthread_rwlock_unlock(&shard->lock);
+    return found;
+}
+
+//Discharge a patient. The record stays in the store until the next save archives it
+int storeLayoutRemove(int id) {
+    return dischargePatientByID(id) == STORE_OK;
+}
+
+//Write the data files, as every save does
+int storeLayoutSave() {
+    return writeDataFiles();
+}
+
+//Load the data files into the emptied store. Returns the patients loaded
+int storeLayoutLoad() {
+    return loadData() ? totalPatients : -1;
+}
+
+//Empty the store, keeping the room capacities
+void storeLayoutReset() {
+    cleanupSystem();
+}
+
+//Advance a xorshift32 generator and return the next value
+unsigned int nextRandom(unsigned int *state) {
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+//Return the number of seconds between two monotonic timestamps
+double elapsedSeconds(const struct timespec *start, const struct timespec *end) {
+    return (double) (end->tv_sec - start->tv_sec) + (double) (end->tv_nsec - start->tv_nsec) / 1e9;
+}
@@ -10,18 +10,194 @@ Description: Enhanced C program to manage patient records and doctor schedules.
              - Linked lists for efficient data management
              - Reporting and analytics
              - Advanced error handling
+             - Thread-safe patient and doctor stores
 */
 
+#define _GNU_SOURCE             // Exposes the writer-preferring rwlock initializer on glibc
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+/* Vector instructions used by the patient filter kernels, picked at compile time (build with -mavx2 for AVX2) */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FILTER_KERNEL_NAME "AVX2"
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FILTER_KERNEL_NAME "SSE2"
+#else
+#define FILTER_KERNEL_NAME "scalar"
+#endif
 
 /* Constants for the system */
 #define INITIAL_CAPACITY 10     // Initial capacity for data structures
 #define MAX_DAYS_IN_WEEK 7      // Number of days in a week
 #define MAX_SHIFTS_IN_DAY 3     // Number of shifts per day (morning, afternoon, evening)
 #define MAX_FILENAME_LENGTH 100 // Maximum length for filenames
+#define MAX_DIRECTORY_LENGTH 64 // Maximum length for the data directory path
+#define MAX_SHIFTS_PER_DOCTOR 7 // Maximum number of shifts a doctor can work per week (Monday to Sunday)
+#define MAX_DOCTORS_PER_SHIFT 4 // Maximum number of doctors working the same shift
+#define MAX_PATIENTS_PER_ROOM 2 // Beds in a room unless rooms.dat gives it another capacity
+#define MAX_ROOM_CAPACITY 12    // Most beds a room can be given
+#define ROOMS_FORMAT_VERSION 1  // Version written after the rooms.dat magic
+#define MAX_ROOM_NUMBER 9999    // Highest room number that can be assigned
+#define MAX_LOADED_RECORDS 10000000 // Upper bound on record counts accepted from data files
+#define PATIENT_SHARD_BITS 4    // log2 of the number of patient store partitions
+#define PATIENT_SHARD_COUNT (1 << PATIENT_SHARD_BITS)   // Number of patient store partitions
+#define SHARD_INDEX_INITIAL_CAPACITY 64 // Initial slots in each shard's ID index (power of two)
+#define SHARD_COLUMNS_INITIAL_CAPACITY 64   // Initial rows in each shard's filter columns
+#define FILTER_STATUS_ANY -1    // PatientFilter status matching both active and discharged patients
+#define ARCHIVE_INDEX_INITIAL_CAPACITY 1024 // Initial slots in the archive's ID index (power of two)
+#define SCHEDULE_INITIAL_CAPACITY 64    // Initial slots in each schedule hash table (power of two)
+#define SCHEDULE_FORMAT_VERSION 1       // Version written after the schedule.dat magic
+#define SNAPSHOT_FORMAT_VERSION 1       // Version written after the snapshot.dat magic
+#define SNAPSHOT_PATIENTS 0             // Snapshot section holding the patients, in the patients.dat format
+#define SNAPSHOT_DOCTORS 1              // Snapshot section holding the doctors, in the doctors.dat format
+#define SNAPSHOT_SCHEDULE 2             // Snapshot section holding the schedule, in the schedule.dat format
+#define SNAPSHOT_STATISTICS 3           // Snapshot section holding the lifetime totals, in the stats.dat format
+#define SNAPSHOT_ROOMS 4                // Snapshot section holding the room capacities, in the rooms.dat format
+#define SNAPSHOT_ARCHIVE 5              // Backup section holding the archive.idx entries it goes with; saves leave it out
+#define SNAPSHOT_SECTION_COUNT 6        // Sections in a snapshot
+#define SCHEDULE_ASSIGN 1               // schedule.log record putting a doctor on a shift
+#define SCHEDULE_UNASSIGN 2             // schedule.log record taking a doctor off a shift
+#define SCHEDULE_BATCH 3                // schedule.log record announcing that the next records are one bulk change
+#define SCHEDULE_SWAP 4                 // Bulk change exchanging two doctors' shifts; logged as its unassigns and assigns
+#define MAX_SCHEDULE_CHANGES 100000     // Most changes one bulk schedule change file may hold
+#define ROSTER_MAX_DAYS 366             // Longest period the roster can be filled for in one run
+#define ROSTER_MAX_ROUNDS 50            // Most local search rounds after the greedy roster fill
+#define WEEK_SHIFT_BITS (MAX_DAYS_IN_WEEK * MAX_SHIFTS_IN_DAY)  // Bits of DoctorWeekLoad.shiftBits in use
+#define EVENING_SHIFT_BITS 0x124924u    // The evening bit of every day in DoctorWeekLoad.shiftBits
+#define PATIENT_PAGE_SIZE 20    // Patients per page of the patient listing, until the user changes it
+#define MAX_PATIENT_PAGE_SIZE 1000  // Largest page size the patient listing accepts
+
+/* Result orders of a patient query */
+#define QUERY_SORT_ID 1             // Ascending patient ID
+#define QUERY_SORT_AGE 2            // Youngest first, then by ID
+#define QUERY_SORT_ROOM 3           // Lowest room first, then by ID
+#define QUERY_SORT_ADMISSION 4      // Earliest admission first, then by ID
+
+/* Ways a patient query can find its candidates */
+#define QUERY_PLAN_SCAN 1           // Filter kernels over every shard's columns
+#define QUERY_PLAN_ROOM_INDEX 2     // Patients listed under each room of the room range
+#define QUERY_PLAN_ADMISSION_INDEX 3    // Slice of the admission index covering the admission range
+#define QUERY_PROBE_COST 16         // One index candidate costs about as much as this many scanned column rows
+#define AGE_GROUP_COUNT 3       // Age groups tracked by the statistics (children, adults, seniors)
+#define ADULT_AGE 18            // First age counted as an adult
+#define SENIOR_AGE 65           // First age counted as a senior
+
+/* Operations timed by the latency histograms */
+#define LATENCY_ADMIT 0             // admitPatient
+#define LATENCY_SEARCH 1            // Search Patient, in the store then the archive
+#define LATENCY_DISCHARGE 2         // dischargePatientOn
+#define LATENCY_ASSIGN 3            // assignShift
+#define LATENCY_UNASSIGN 4          // unassignShift
+#define LATENCY_QUERY 5             // runPatientQuery from Query Patients
+#define LATENCY_SAVE 6              // writeDataFiles
+#define LATENCY_BACKUP 7            // backupData
+#define LATENCY_RESTORE 8           // restoreData
+#define LATENCY_ADMISSION_REPORT 9  // Patient admission report
+#define LATENCY_DOCTOR_REPORT 10    // Doctor utilization report
+#define LATENCY_ROOM_REPORT 11      // Room utilization report
+#define LATENCY_STAY_REPORT 12      // Length of stay report
+#define LATENCY_ALL_REPORTS 13      // writeAllReports, from the menu or in the background
+#define LATENCY_OPERATION_COUNT 14  // Operations with a histogram
+#define LATENCY_SUB_BUCKET_BITS 5   // log2 of the buckets per power of two; 32 keeps values to within about 3%
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_EXPONENT 39     // Latencies of 2^40 ns (about 18 minutes) or more share the last bucket
+#define LATENCY_BUCKET_COUNT ((LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 2) * LATENCY_SUB_BUCKETS)
+
+/* In-memory structures counted by collectMemoryUsage */
+#define MEMORY_PATIENT_RECORDS 0    // Patient nodes, apart from their text fields
+#define MEMORY_PATIENT_TEXT 1       // Name, diagnosis and date fields of the patient nodes
+#define MEMORY_PATIENT_ID_INDEX 2   // Per-shard patient ID hash tables
+#define MEMORY_PATIENT_COLUMNS 3    // Per-shard row pointer and filter columns
+#define MEMORY_QUERY_INDEXES 4      // Room and admission date indexes
+#define MEMORY_ARCHIVE_INDEX 5      // Archived patient entries and their ID hash table
+#define MEMORY_DOCTOR_RECORDS 6     // Doctor nodes, apart from their names
+#define MEMORY_DOCTOR_TEXT 7        // Name fields of the doctor nodes
+#define MEMORY_SCHEDULE 8           // Shift and doctor week hash tables
+#define MEMORY_STAY_HISTORY 9       // Discharged stay columns
+#define MEMORY_STAY_TEXT 10         // Stay diagnosis dictionary
+#define MEMORY_REPORT_BUFFERS 11    // Report, listing and export buffers currently allocated
+#define MEMORY_FIXED_TABLES 12      // Statically sized globals: shard headers, room tables, histograms
+#define MEMORY_CATEGORY_COUNT 13    // Structures counted
+
+/* Result codes returned by the store mutation functions */
+#define STORE_OK 0                  // Operation completed
+#define STORE_NOT_FOUND 1           // No record with the given ID
+#define STORE_DUPLICATE_ID 2        // A record with the given ID already exists
+#define STORE_ROOM_FULL 3           // The requested room has no free bed
+#define STORE_ALREADY_DISCHARGED 4  // The patient has already been discharged
+#define STORE_SHIFT_TAKEN 5         // The shift already has the maximum number of doctors
+#define STORE_SHIFT_LIMIT 6         // The doctor has reached the maximum number of shifts that week
+#define STORE_INVALID_ARGUMENT 7    // A day, shift or room number is out of range
+#define STORE_OUT_OF_MEMORY 8       // An index could not grow to hold the record
+#define STORE_ALREADY_ON_SHIFT 9    // The doctor is already working the shift
+#define STORE_NOT_ON_SHIFT 10       // The doctor is not working the shift
+#define STORE_REST_VIOLATION 11     // The doctor would work an evening shift followed by the next morning
+
+/* Mutation types written to the replication log */
+#define REPL_ADMIT_PATIENT 1        // Payload: patient record without the next pointer
+#define REPL_DISCHARGE_PATIENT 2    // Payload: ReplicatedDischarge
+#define REPL_ADD_DOCTOR 3           // Payload: doctor record without the next pointer
+#define REPL_ASSIGN_SHIFT 4         // Payload: ReplicatedShift
+#define REPL_UNASSIGN_SHIFT 5       // Payload: ReplicatedShift
+#define REPL_SCHEDULE_BATCH 6       // Payload: ScheduleChange array of assigns and unassigns, applied all or nothing
+#define REPL_SET_ROOM_CAPACITY 7    // Payload: RoomCapacityRecord
+#define REPORT_WORKER_COUNT 4       // Worker threads used to render report rows
+#define REPORT_BUFFER_INITIAL_SIZE 65536    // Initial size of each per-shard report buffer
+#define STAY_BUCKET_COUNT 8         // Buckets in the length of stay histograms
+
+/* States of the background report job */
+#define REPORT_IDLE 0               // No background report has been started
+#define REPORT_RUNNING 1            // A background report is being generated
+#define REPORT_DONE 2               // The last background report finished successfully
+#define REPORT_FAILED 3             // The last background report could not be written
+
+/* How far the startup load has got; see startLazyLoad */
+#define LOAD_PENDING 0              // Nothing read yet
+#define LOAD_INDEXES 1              // Room capacities, archive index, doctors and schedule read; patients being read
+#define LOAD_COMPLETE 2             // Every record read, or the data was loaded before the menu started
+#define LAZY_LOAD_BATCH 1024        // Patient records added per hold of the shard locks by the background load
+
+/* Data export formats and the layout of the columnar format */
+#define EXPORT_COLUMNAR 1           // One .hmsc file of per-column blocks
+#define EXPORT_CSV 2                // One CSV file per table
+#define EXPORT_JSONL 3              // One JSON-lines file per table
+#define EXPORT_FORMAT_VERSION 1     // Version written after the columnar file magic
+#define EXPORT_ROW_GROUP_SIZE 65536 // Rows buffered per columnar row group
+#define EXPORT_MAX_COLUMNS 8        // Most columns in any exported table
+#define EXPORT_FLUSH_SIZE (1 << 20) // CSV and JSON-lines output is written out in chunks of about this size
+#define EXPORT_TABLE_END 0          // Marks the end of a columnar file
+#define EXPORT_TABLE_PATIENTS 1     // Row group of patients
+#define EXPORT_TABLE_DOCTORS 2      // Row group of doctors
+#define EXPORT_TABLE_SCHEDULE 3     // Row group of schedule slots
+
+/* Column encodings of the columnar export format */
+#define COLUMN_VARINT 1             // One zigzag varint per row
+#define COLUMN_DELTA_VARINT 2       // Zigzag varint difference from the previous row (first row from 0)
+#define COLUMN_STRING 3             // Varint length then the bytes, per row
+#define COLUMN_DICTIONARY 4         // Varint count, the distinct strings, then one varint index per row
+#define COLUMN_BITMAP 5             // One bit per row, least significant bit first
+
+#define REPL_POLL_INTERVAL_MS 100   // How often a standby checks the log for new records
+#define REPL_SAVE_INTERVAL_MS 500   // How often a standby writes applied changes to its data files
+
+/* Prefer writers where the platform allows it so a steady stream of readers cannot starve admissions */
+#ifdef PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP
+#define STORE_LOCK_INITIALIZER PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP
+#else
+#define STORE_LOCK_INITIALIZER PTHREAD_RWLOCK_INITIALIZER
+#endif
 
 /* Patient structure to store patient information */
 typedef struct Patient {
@@ -40,17 +216,524 @@ typedef struct Patient {
 typedef struct Doctor {
     int doctorID;                   // Unique ID for each doctor
     char doctorName[50];            // Doctor's full name
-    int totalShifts;                // Count of total shifts assigned to the doctor
+    int totalShifts;                // Count of shifts the doctor has in the schedule, across all dates
     struct Doctor *next;            // Pointer to next doctor in linked list
 } Doctor;
 
+/* Doctors working one shift of one date */
+typedef struct ScheduleSlot {
+    int day;                        // Days since 1970-01-01
+    int shift;                      // Shift of the day (1-3), 0 while the hash slot is unused
+    int count;                      // Doctors on the shift
+    int doctorIDs[MAX_DOCTORS_PER_SHIFT];   // Doctors on the shift, in assignment order
+} ScheduleSlot;
+
+/*
+ * Shifts one doctor works in one week, one bit per shift: bit (day of the week
+ * * 3 + shift - 1), Monday morning first. An evening and the next morning are
+ * neighbouring bits, so duplicate, weekly limit and rest checks are bit tests
+ * and a popcount on the doctor's own entry.
+ */
+typedef struct DoctorWeekLoad {
+    int doctorID;                   // Doctor, 0 while the hash slot is unused
+    int week;                       // Weeks since the week of 1970-01-01; weeks start on Monday
+    unsigned int shiftBits;         // Shifts the doctor has in that week
+} DoctorWeekLoad;
+
+/*
+ * Calendar schedule: the doctors on each shift of each date. Only shifts that
+ * have had a doctor take any space. Both tables use open addressing with
+ * linear probing; entries are emptied but never removed, so probe chains stay
+ * intact without tombstones.
+ */
+typedef struct ScheduleStore {
+    ScheduleSlot *slots;            // Hash table keyed by date and shift
+    int slotCapacity;               // Size of slots (power of two)
+    int slotCount;                  // Entries of slots in use, including emptied ones
+    DoctorWeekLoad *loads;          // Hash table keyed by doctor and week
+    int loadCapacity;               // Size of loads (power of two)
+    int loadCount;                  // Entries of loads in use, including emptied ones
+    int assignments;                // Doctor shifts across all dates
+    long long sequence;             // Sequence number of the last schedule change written or replayed
+    int journalRecords;             // Records in schedule.log since the schedule was last saved
+} ScheduleStore;
+
+/* Outcome of filling the roster for a period */
+typedef struct RosterResult {
+    int positions;                  // Places on shifts that were open in the period
+    int filled;                     // Open places given a doctor
+    int moves;                      // Places the local search handed to a doctor with fewer shifts
+    int minShifts;                  // Fewest shifts of any doctor afterwards, across all dates
+    int maxShifts;                  // Most shifts of any doctor afterwards, across all dates
+    long long elapsedMicros;        // Time taken to plan and commit the roster
+} RosterResult;
+
+/* One place filled by the roster solver */
+typedef struct RosterEntry {
+    int day;                        // Days since 1970-01-01
+    int shift;                      // Shift of the day (1-3)
+    int doctor;                     // Index of the doctor holding the place in the solver's doctor array
+} RosterEntry;
+
+/*
+ * Working state of the roster solver. weekBits is a doctor by week matrix of
+ * DoctorWeekLoad.shiftBits covering the period and a week either side, so the
+ * rest rule can look past both ends; each check the solver makes is a bit
+ * test or popcount on one row instead of a lookup in the schedule.
+ */
+typedef struct RosterPlan {
+    Doctor **doctors;               // Every doctor, in list order
+    int *loads;                     // Shifts of each doctor across all dates, planned ones included
+    int doctorCount;                // Entries of doctors and loads
+    unsigned int *weekBits;         // weekSpan week bits per doctor, planned shifts included
+    int firstWeek;                  // Week of the first column of weekBits
+    int weekSpan;                   // Columns of weekBits
+    int *placesTaken;               // Doctors on each shift of the period, three per day, planned ones included
+    int firstDay;                   // First date of the period
+    int lastDay;                    // Last date of the period
+    int doctorsPerShift;            // Doctors wanted on each shift
+    RosterEntry *entries;           // Places the solver filled, in the order it filled them
+    int entryCount;                 // Entries in use
+} RosterPlan;
+
+/* One doctor on one shift, as stored in schedule.dat */
+typedef struct ScheduleRecord {
+    int day;                        // Days since 1970-01-01
+    int shift;                      // Shift of the day (1-3)
+    int doctorID;                   // Doctor on the shift
+} ScheduleRecord;
+
+/* Table of contents entry of a snapshot: where one section's bytes are */
+typedef struct SnapshotSection {
+    int section;                    // One of the SNAPSHOT_* sections
+    int reserved;                   // Always 0
+    long long offset;               // Byte offset of the section from the start of the file
+    long long length;               // Bytes in the section
+} SnapshotSection;
+
+/*
+ * Header at the start of snapshot.dat and of each backup. Every section keeps
+ * the format of the separate file it replaces, so a reader seeks to the
+ * section it needs and reads it as it read that file.
+ */
+typedef struct SnapshotHeader {
+    char magic[4];                  // "HMSD"
+    int version;                    // SNAPSHOT_FORMAT_VERSION
+    int sectionCount;               // Entries of sections in use
+    int reserved;                   // Always 0
+    SnapshotSection sections[SNAPSHOT_SECTION_COUNT];   // Table of contents
+} SnapshotHeader;
+
+/* Header of schedule.dat, followed by its ScheduleRecord entries */
+typedef struct ScheduleFileHeader {
+    char magic[4];                  // "HMSS"
+    int version;                    // SCHEDULE_FORMAT_VERSION
+    long long sequence;             // Last schedule change the file includes
+    int count;                      // ScheduleRecord entries following the header
+} ScheduleFileHeader;
+
+/* One schedule change appended to schedule.log between saves of the schedule */
+typedef struct ScheduleJournalRecord {
+    long long sequence;             // Increases by one per change; changes already in the saved schedule are skipped
+    int operation;                  // SCHEDULE_ASSIGN, SCHEDULE_UNASSIGN or SCHEDULE_BATCH
+    int day;                        // Days since 1970-01-01
+    int shift;                      // Shift of the day (1-3)
+    int doctorID;                   // Doctor put on or taken off the shift; for SCHEDULE_BATCH, the records that follow
+} ScheduleJournalRecord;
+
+/* One change of a bulk schedule change, as read from a change file */
+typedef struct ScheduleChange {
+    int operation;                  // SCHEDULE_ASSIGN, SCHEDULE_UNASSIGN or SCHEDULE_SWAP
+    int doctorID;                   // Doctor put on or taken off the shift; for a swap, the doctor working it now
+    int day;                        // Days since 1970-01-01
+    int shift;                      // Shift of the day (1-3)
+    int otherDoctorID;              // Swap only: the doctor working the other shift now
+    int otherDay;                   // Swap only: date of the other shift
+    int otherShift;                 // Swap only: the other shift
+    int line;                       // Line of the change file the change came from, 0 if none
+} ScheduleChange;
+
+/* One assignment or unassignment made while applying a bulk change, kept so it can be undone */
+typedef struct ScheduleStep {
+    int operation;                  // SCHEDULE_ASSIGN or SCHEDULE_UNASSIGN
+    Doctor *doctor;                 // Doctor put on or taken off the shift
+    int day;                        // Days since 1970-01-01
+    int shift;                      // Shift of the day (1-3)
+    int position;                   // Unassign only: the doctor's place in the shift's list beforehand
+} ScheduleStep;
+
+/*
+ * Patient store partition. Patients are spread over the shards by a hash of
+ * their ID; each shard has its own list, ID index and lock, so admissions and
+ * discharges on different shards do not contend with each other.
+ *
+ * Row r of a shard is its r-th patient in list order. The fields filters test
+ * are copied into one array per field so a filter runs over contiguous memory
+ * instead of chasing the list.
+ */
+typedef struct PatientShard {
+    Patient *head;                  // Head of this shard's patient linked list
+    Patient *tail;                  // Tail of the list for O(1) appends
+    int *index;                     // Open-addressing hash table of row + 1 keyed by patient ID, 0 when empty
+    int indexCapacity;              // Number of slots in the index (power of two)
+    int count;                      // Number of patients stored in this shard
+    Patient **rows;                 // Patient of each row
+    int *ids;                       // Patient ID of each row
+    int *ages;                      // Patient age of each row
+    int *rooms;                     // Room number of each row
+    int *active;                    // isActive of each row
+    int *admitted;                  // Admission time of each row, minutes since 1970-01-01 on the local clock
+    int rowCapacity;                // Rows the arrays above can hold
+    pthread_rwlock_t lock;          // Guards every field above and the patients themselves
+} PatientShard;
+
+/* Where an archived patient's record is kept: the partition of its discharge month and the byte offset in it */
+typedef struct ArchiveIndexEntry {
+    int patientID;                  // Archived patient
+    int month;                      // Discharge month as year * 12 + month - 1, 0 if the discharge date is missing
+    long long offset;               // Byte offset of the record in the month's partition file
+} ArchiveIndexEntry;
+
+/*
+ * ID index of the discharged patient archive. A save moves discharged patients
+ * out of the shards into append-only partition files, one per discharge month,
+ * and appends where each record went to archive.idx. Only these entries stay
+ * in memory, so the shards and the saved patients hold just the admitted ones.
+ */
+typedef struct ArchiveIndex {
+    ArchiveIndexEntry *entries;     // Entries in archive.idx order
+    int count;                      // Entries stored
+    int capacity;                   // Entries allocated
+    int *slots;                     // Open-addressing hash table of entry + 1 keyed by patient ID, 0 when empty
+    int slotCapacity;               // Number of slots (power of two)
+    int patients;                   // Distinct patients; a later entry for the same ID replaces the earlier one
+} ArchiveIndex;
+
+/* Reader over archived records, one partition at a time in file order */
+typedef struct ArchiveCursor {
+    ArchiveIndexEntry *entries;     // Entries to read, ordered by month and offset
+    int count;                      // Entries to read
+    int next;                       // Next entry to read
+    FILE *partition;                // Open partition file, NULL before the first read
+    int partitionMonth;             // Month of the open partition
+} ArchiveCursor;
+
+/* Work item for one shard in a parallel shard scan */
+typedef struct ShardScanTask {
+    pthread_t thread;                                       // Worker thread handle
+    PatientShard *shard;                                    // Shard scanned by this task
+    void (*scanShard)(PatientShard *shard, void *result);  // Per-shard scan function
+    void *result;                                           // Per-shard result buffer
+} ShardScanTask;
+
+/* Conditions of a filtered patient listing. Ranges are inclusive; initializePatientFilter leaves them unbounded */
+typedef struct PatientFilter {
+    int minAge;                     // Youngest age selected
+    int maxAge;                     // Oldest age selected
+    int minRoom;                    // Lowest room number selected
+    int maxRoom;                    // Highest room number selected
+    int status;                     // 1 for active, 0 for discharged, FILTER_STATUS_ANY for both
+    int admittedFrom;               // Earliest admission selected, minutes since 1970-01-01
+    int admittedTo;                 // Latest admission selected, same clock
+} PatientFilter;
+
+/*
+ * Position-independent view of the patients a paged listing walks through.
+ * The selections are taken once when the listing opens; shard rows are only
+ * appended between saves, and the listing does not save, so the selected row
+ * numbers stay valid while it is open.
+ */
+typedef struct PatientCursor {
+    unsigned long long *selections[PATIENT_SHARD_COUNT];    // Selected rows of each shard
+    int shardRows[PATIENT_SHARD_COUNT];                     // Rows each selection covers
+    int shardSelected[PATIENT_SHARD_COUNT];                 // Rows selected in each shard
+    int total;                                              // Rows selected across all shards
+} PatientCursor;
+
+/* A patient query: the column filter plus the parts the columns cannot answer */
+typedef struct PatientQuery {
+    PatientFilter filter;           // Status, age, room and admission conditions
+    char keyword[50];               // Case-insensitive diagnosis substring, empty for any diagnosis
+    int sortKey;                    // QUERY_SORT_* order of the results
+    int limit;                      // Most results kept, 0 for all
+} PatientQuery;
+
+/* One patient matching a query */
+typedef struct QueryRow {
+    long long sortValue;            // Sort key in the high half and the ID in the low half, so one compare orders rows
+    int patientID;                  // Matching patient
+} QueryRow;
+
+/* Patients matching a query and how they were found */
+typedef struct QueryResult {
+    QueryRow *rows;                 // Matching patients in sortKey order
+    int count;                      // Rows kept after the limit
+    int capacity;                   // Rows allocated
+    int matches;                    // Patients matching before the limit
+    int plan;                       // QUERY_PLAN_* used
+    int examined;                   // Column rows or index candidates the plan looked at
+    int archived;                   // Archived records read for discharged patients
+} QueryResult;
+
+/* A patient's place in the admission index */
+typedef struct AdmissionEntry {
+    int minute;                     // Admission time, minutes since 1970-01-01
+    int patientID;                  // Patient admitted
+} AdmissionEntry;
+
+/*
+ * Secondary indexes for patient queries, guarded by queryIndexLock. Entries
+ * are only added until a save archives patients and rebuilds them; a query
+ * checks every candidate against its shard, so the indexes only need to list
+ * at least the patients that can match.
+ */
+typedef struct QueryIndexes {
+    int *roomPatients[MAX_ROOM_NUMBER + 1];     // IDs of the patients assigned to each room
+    int roomCount[MAX_ROOM_NUMBER + 1];         // Patients listed per room
+    int roomCapacity[MAX_ROOM_NUMBER + 1];      // IDs allocated per room
+    AdmissionEntry *admissions;     // Every patient, ordered by admission minute when admissionsSorted is set
+    int admissionCount;             // Entries in admissions
+    int admissionCapacity;          // Entries allocated
+    int admissionsSorted;           // Cleared when an entry arrives out of order; the next query sorts
+    int incomplete;                 // Set if an entry could not be added; queries then scan instead
+} QueryIndexes;
+
+/*
+ * Running totals behind the reports and the dashboard. Every admit, discharge
+ * and shift assignment adjusts them in O(1) while it holds the store lock, so
+ * reading them never walks the patient or doctor lists.
+ */
+typedef struct HospitalStatistics {
+    atomic_llong admissions;                    // Patients admitted since the data was created
+    atomic_llong discharges;                    // Patients discharged since the data was created
+    atomic_int occupiedRooms;                   // Rooms with at least one active patient
+    atomic_int fullRooms;                       // Rooms with no free bed
+    atomic_int activeByAgeGroup[AGE_GROUP_COUNT];   // Active patients per age group
+    atomic_int shiftsAssigned;                  // Shifts assigned across all doctors
+    atomic_int doctorsWithShifts;               // Doctors with at least one shift
+} HospitalStatistics;
+
+/*
+ * Latency histogram of one operation, in nanoseconds. Buckets are log-linear
+ * in the HDR histogram manner: one per nanosecond below 32 ns, then 32 for
+ * every power of two, so percentiles are within about 3% at any scale.
+ * Recording is a handful of relaxed atomic adds and never takes a lock.
+ */
+typedef struct LatencyHistogram {
+    atomic_llong counts[LATENCY_BUCKET_COUNT];  // Calls per bucket
+    atomic_llong calls;                         // Calls recorded
+    atomic_llong failures;                      // Calls that returned an error
+    atomic_llong totalNanos;                    // Sum of the latencies, for the mean
+    atomic_llong maxNanos;                      // Longest latency recorded
+} LatencyHistogram;
+
+/*
+ * Memory one kind of structure takes. Bytes are those requested from malloc,
+ * without the allocator's own overhead; used bytes leave out capacity that is
+ * allocated but empty, and unused space in fixed-size text fields.
+ */
+typedef struct MemoryUsage {
+    long long objects;              // Records, entries or buffers held
+    long long usedBytes;            // Bytes holding data
+    long long allocatedBytes;       // Bytes allocated, including unused capacity
+} MemoryUsage;
+
+/* A room whose capacity differs from MAX_PATIENTS_PER_ROOM, as stored in rooms.dat */
+typedef struct RoomCapacityRecord {
+    int room;                       // Room number
+    int capacity;                   // Beds in the room, 0 for a closed room
+} RoomCapacityRecord;
+
+/* Header at the start of rooms.dat, followed by its RoomCapacityRecord entries */
+typedef struct RoomFileHeader {
+    char magic[4];                  // "HMSR"
+    int version;                    // ROOMS_FORMAT_VERSION
+    int count;                      // RoomCapacityRecord entries following the header
+} RoomFileHeader;
+
+/*
+ * Free-bed index. Every room with a free bed sits in a binary min-heap
+ * ordered by free beds, then room number, so the top is the fullest room that
+ * can still take a patient: shared rooms fill up before empty ones are opened.
+ * An admission, discharge or capacity change moves one room, in O(log rooms).
+ */
+typedef struct RoomBedIndex {
+    int heap[MAX_ROOM_NUMBER];              // Rooms with a free bed
+    int position[MAX_ROOM_NUMBER + 1];      // Index of each room in heap, -1 if it has no free bed
+    int count;                              // Rooms in heap
+    int totalBeds;                          // Beds across all rooms
+    int freeBeds;                           // Beds not taken by an active patient
+} RoomBedIndex;
+
+/* Lifetime totals written to stats.dat; everything else is rebuilt from the records on load */
+typedef struct StatisticsRecord {
+    long long admissions;           // Patients admitted since the data was created
+    long long discharges;           // Patients discharged since the data was created
+} StatisticsRecord;
+
+/* Growable text buffer that report rows are rendered into */
+typedef struct ReportBuffer {
+    char *data;                     // Rendered text, not NUL-terminated
+    size_t length;                  // Bytes used
+    size_t capacity;                // Bytes allocated
+    int failed;                     // Set if the buffer could not grow
+} ReportBuffer;
+
+/* Shared state of one parallel rendering pass over the patient shards */
+typedef struct ReportRenderJob {
+    atomic_int nextShard;                       // Next shard for a worker to claim
+    const PatientFilter *filter;                // Patients to render, or NULL for all of them
+    ReportBuffer buffers[PATIENT_SHARD_COUNT];  // Admission rows rendered per shard, written out in shard order
+} ReportRenderJob;
+
+/* Status of the background report job, guarded by backgroundReportLock */
+typedef struct BackgroundReport {
+    int state;                                  // One of the REPORT_* states
+    pthread_t thread;                           // Thread generating the reports
+    int threadStarted;                          // Set while the thread has not been joined
+    char fileNames[3][MAX_FILENAME_LENGTH];     // Admission, doctor and room report files
+    double seconds;                             // Time taken by the last finished job
+} BackgroundReport;
+
+/* Growable set of distinct strings, each given a dense index in order of first appearance */
+typedef struct StringDictionary {
+    ReportBuffer text;              // Distinct strings back to back
+    int *offsets;                   // Start of each distinct string in text
+    int *lengths;                   // Length of each distinct string
+    int *slots;                     // Open-addressing table of entry index + 1, 0 when empty
+    int slotCapacity;               // Slots in the table (power of two, at least twice count)
+    int count;                      // Distinct strings so far
+} StringDictionary;
+
+/* Columns of one columnar export row group, encoded as rows arrive */
+typedef struct ExportRowGroup {
+    int table;                                  // One of the EXPORT_TABLE_* values
+    int columnCount;                            // Columns in the table
+    int encodings[EXPORT_MAX_COLUMNS];          // COLUMN_* encoding of each column
+    ReportBuffer columns[EXPORT_MAX_COLUMNS];   // Encoded values of each column
+    long long previous[EXPORT_MAX_COLUMNS];     // Last value of each delta-encoded column
+    StringDictionary dictionary;                // Used by the table's dictionary-encoded column
+    int rows;                                   // Rows in the current group
+} ExportRowGroup;
+
+/*
+ * Discharged stays kept column by column. Each column is a plain array so the
+ * report's passes over them are straight loops the compiler can vectorize.
+ */
+typedef struct StayColumns {
+    int count;                      // Stays stored
+    int capacity;                   // Stays the arrays can hold
+    int *duration;                  // Length of stay, seconds
+    int *diagnosis;                 // Index into the stay diagnosis dictionary
+    int *room;                      // Room the patient stayed in, 0 if not recorded
+    unsigned char *bucket;          // Histogram bucket of each stay, filled in by the report
+} StayColumns;
+
+/* Length of stay summary of one diagnosis, one room or all stays */
+typedef struct StayGroupSummary {
+    int key;                        // Diagnosis dictionary index or room number
+    int stays;                      // Stays in the group
+    long long totalSeconds;         // Sum of the stay durations
+    int median;                     // 50th percentile stay, seconds
+    int p90;                        // 90th percentile stay, seconds
+    int p99;                        // 99th percentile stay, seconds
+    int buckets[STAY_BUCKET_COUNT]; // Stays per histogram bucket
+} StayGroupSummary;
+
+/* Header written in front of every record in the replication log */
+typedef struct ReplicationRecordHeader {
+    long long sequence;             // Log sequence number, increasing by one per record
+    long long commitTime;           // Wall-clock time of the commit on the primary, in microseconds
+    int operation;                  // One of the REPL_* mutation types
+    int payloadSize;                // Number of payload bytes following the header
+} ReplicationRecordHeader;
+
+/* Replication payload for a discharge */
+typedef struct ReplicatedDischarge {
+    int patientID;                  // Patient that was discharged
+    char dischargeDate[20];         // Discharge date recorded on the primary
+} ReplicatedDischarge;
+
+/* Replication payload for a shift assignment or unassignment */
+typedef struct ReplicatedShift {
+    int doctorID;                   // Doctor put on or taken off the shift
+    int day;                        // Days since 1970-01-01
+    int shift;                      // Shift of the day (1-3)
+} ReplicatedShift;
+
 /* Global variables */
-Patient *patientHead = NULL;                                // Head of patient linked list
+PatientShard patientShards[PATIENT_SHARD_COUNT];            // Partitioned patient store
 Doctor *doctorHead = NULL;                                  // Head of doctor linked list
-int totalPatientsActive = 0;                                // Total number of patients active in the system
-int totalPatients = 0;                                      // Total number of patients ever admitted in the system
+atomic_int totalPatientsActive = 0;                         // Total number of patients active in the system
+atomic_int totalPatients = 0;                               // Patients held in the shards: the admitted ones and those discharged since the last save
 int totalDoctors = 0;                                       // Total number of doctors in the system
-int doctorSchedule[MAX_DAYS_IN_WEEK][MAX_SHIFTS_IN_DAY];    // 2D array to store weekly doctor schedule
+ScheduleStore doctorSchedule;                               // Calendar of the doctors on each shift
+FILE *scheduleJournal = NULL;                               // schedule.log open for appends, NULL until a save restarts it
+pthread_mutex_t scheduleJournalLock = PTHREAD_MUTEX_INITIALIZER;    // Serializes schedule.log appends and rewrites; taken after the doctor lock
+Doctor *doctorTail = NULL;                                  // Tail of doctor linked list for O(1) appends
+atomic_int roomOccupancy[MAX_ROOM_NUMBER + 1];              // Active patients per room, read without locks, changed under roomBedLock
+atomic_int roomCapacity[MAX_ROOM_NUMBER + 1];               // Beds per room, 0 for a closed room; read without locks, changed under roomBedLock
+RoomBedIndex roomBeds;                                      // Rooms with a free bed, best room for a new patient first
+pthread_mutex_t roomBedLock = PTHREAD_MUTEX_INITIALIZER;    // Guards roomBeds and changes to room occupancy and capacity; taken after any store lock
+pthread_once_t roomBedsOnce = PTHREAD_ONCE_INIT;            // Sets every room to the default capacity exactly once
+HospitalStatistics hospitalStats;                           // Aggregates maintained on every store mutation
+LatencyHistogram latencyHistograms[LATENCY_OPERATION_COUNT];    // Time taken by each operation since startup or the last reset
+atomic_int latencyRecording = 1;                            // Cleared from System Statistics to stop timing operations
+atomic_llong reportBufferBytes = 0;                         // Bytes allocated by report buffers not yet released
+atomic_llong reportBufferPeakBytes = 0;                     // Most reportBufferBytes has been since startup
+atomic_int reportBuffersAllocated = 0;                      // Report buffers holding memory
+const char *memoryCategoryNames[MEMORY_CATEGORY_COUNT] = {
+    "Patient records", "Patient text", "Patient ID index", "Patient columns", "Query indexes", "Archive index",
+    "Doctor records", "Doctor names", "Schedule", "Stay history", "Stay diagnoses", "Report buffers", "Fixed tables"
+};
+atomic_int startupLoadPhase = LOAD_COMPLETE;                // One of the LOAD_* phases; only --lazy starts below LOAD_COMPLETE
+atomic_int startupPatientsRead = 0;                         // Patient records the background load has added so far
+atomic_int startupPatientsInFile = 0;                       // Patient records the saved data holds, once the load has opened it
+pthread_mutex_t startupLoadLock = PTHREAD_MUTEX_INITIALIZER;    // Guards waits on startupLoadChanged
+pthread_cond_t startupLoadChanged = PTHREAD_COND_INITIALIZER;  // Signalled when startupLoadPhase advances
+pthread_t startupLoadThread;                                // Background load started by --lazy
+int startupLoadStarted = 0;                                 // Set while startupLoadThread has not been joined
+const char *snapshotSectionNames[SNAPSHOT_SECTION_COUNT] = {
+    "patients", "doctors", "schedule", "statistics", "rooms", "archive"
+};
+const char *legacyDataFiles[SNAPSHOT_SECTION_COUNT] = {     // Separate data files written before snapshot.dat
+    "patients.dat", "doctors.dat", "schedule.dat", "stats.dat", "rooms.dat", NULL
+};
+atomic_int legacyDataFilesInUse = 0;                        // Set when data was read from the separate files, so the next save removes them
+FILE *traceFile = NULL;                                     // Chrome trace-event file when started with --trace, otherwise NULL
+atomic_int tracing = 0;                                     // Set while spans are being written to traceFile
+long long traceEvents = 0;                                  // Events written to traceFile, so the next knows to add a separator
+pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;      // Serializes writes to traceFile
+atomic_int traceThreadCount = 0;                            // Trace thread IDs handed out so far
+_Thread_local int traceThreadID = 0;                        // This thread's ID in the trace, 0 until its first span
+const char *latencyOperationNames[LATENCY_OPERATION_COUNT] = {
+    "Admit patient", "Search patient", "Discharge patient", "Assign shift", "Unassign shift", "Query patients",
+    "Save data", "Backup data", "Restore data", "Admission report", "Doctor report", "Room report",
+    "Length of stay report", "All reports"
+};
+FILE *replicationLog = NULL;                                // Open replication log when running as a primary, otherwise NULL
+long long replicationSequence = 0;                          // Sequence number of the last record shipped
+pthread_mutex_t replicationLock = PTHREAD_MUTEX_INITIALIZER;    // Serializes appends to the replication log
+BackgroundReport backgroundReport;                          // Status of the background report job
+pthread_mutex_t backgroundReportLock = PTHREAD_MUTEX_INITIALIZER;   // Guards backgroundReport
+char dataDirectory[MAX_DIRECTORY_LENGTH] = "../data";       // Directory holding snapshot.dat, the schedule log and the archive
+const int stayBucketDays[STAY_BUCKET_COUNT - 1] = {1, 2, 3, 5, 7, 14, 30};  // Upper limits of the stay histogram buckets, in days
+StayColumns stayHistory;                                    // Every measurable discharged stay, appended on discharge and load
+StringDictionary stayDiagnoses;                             // Diagnoses of the stays in stayHistory
+QueryIndexes queryIndexes = {.admissionsSorted = 1};        // Room and admission indexes used by patient queries
+pthread_mutex_t queryIndexLock = PTHREAD_MUTEX_INITIALIZER; // Guards queryIndexes; taken after any shard lock
+pthread_mutex_t stayHistoryLock = PTHREAD_MUTEX_INITIALIZER;    // Guards stayHistory and stayDiagnoses; taken after any store lock
+ArchiveIndex archiveIndex;                                  // Where each archived patient's record is
+pthread_mutex_t archiveLock = PTHREAD_MUTEX_INITIALIZER;    // Guards archiveIndex and appends to the archive files; taken after any shard lock
+
+/*
+ * Store locks. Lookups, listings, reports and saves take the read side and run
+ * concurrently; admit, discharge, add doctor and shift changes take the write side
+ * for as long as the list update itself. Whole-store operations lock the patient
+ * shards in ascending order, and always before the doctor lock.
+ */
+pthread_rwlock_t doctorStoreLock = STORE_LOCK_INITIALIZER;      // Guards doctor list, totalDoctors and doctorSchedule
+pthread_once_t patientShardsOnce = PTHREAD_ONCE_INIT;          // Initializes the shard locks exactly once
 
 /* Function prototypes */
 void initializeSystem();
@@ -58,63 +741,443 @@ void cleanupSystem();
 Patient *createPatient(int id, const char *name, int age, const char *diagnosis, int roomNum);
 Doctor *createDoctor(int id, const char *name);
 int saveData();
+int writeDataFiles();
+int writeDataFilesUntimed();
+void dataFilePath(char *path, const char *fileName);
 int loadData();
+void loadPatients(FILE *patientFile, int batchSize);
+void loadDoctors(FILE *doctorFile);
+int startLazyLoad();
+void *lazyLoadWorker(void *argument);
+void setStartupLoadPhase(int phase);
+void awaitStartupLoad(int phase);
+void finishStartupLoad();
+void printStartupLoadProgress();
+int findUnloadedPatient(int id, Patient *patient);
+void loadSchedule();
+int readScheduleFiles(ScheduleStore *store, const int *doctorIDs, int doctorCount);
+void restartScheduleJournal();
+int writeScheduleSection(FILE *scheduleFile, const ScheduleStore *store);
+void appendScheduleJournal(int operation, int day, int shift, int doctorID);
+void appendScheduleJournalBatch(const ScheduleStep *steps, int stepCount);
+void replayScheduleRecord(ScheduleStore *store, const ScheduleJournalRecord *record);
+void closeScheduleJournal();
 int backupData();
-int restoreData();
+int backupDataUntimed();
+int restoreData(const char *timestamp);
+int restoreDataUntimed(const char *timestamp);
 char *selectBackup();
 void getCurrentDateTime(char *dateTime, int bufferSize);
+void getFileTimestamp(char *timestamp, int bufferSize);
 int safeLoadData();
+int safeLoadDataUntimed();
 void addPatient();
 void viewPatients();
+int openPatientCursor(PatientCursor *cursor, const PatientFilter *filter);
+int renderPatientPage(const PatientCursor *cursor, int first, int count, ReportBuffer *page);
+void closePatientCursor(PatientCursor *cursor);
+void renderPatientListRow(ReportBuffer *buffer, const Patient *patient);
+void renderHeader(ReportBuffer *buffer, const char *title);
+int writeToTerminal(const char *data, size_t length);
 void searchPatient();
+void queryPatients();
+int parseQueryDate(const char *text, int endOfDay, int *minute);
 void dischargePatient();
 Patient *findPatientByID(int id);
 int isRoomAvailable(int roomNum);
+void manageRooms();
+void changeRoomCapacity();
+void viewFreeBeds();
+int setRoomCapacity(int roomNum, int capacity);
+int proposeRoom(int *freeBeds);
+int reserveBestRoom();
+int roomFreeBeds(int roomNum);
+int roomOfferedBefore(int a, int b);
+void updateRoomBeds(int roomNum, int freeBefore);
+void siftRoomUp(int i);
+void siftRoomDown(int i);
+void swapRoomHeapEntries(int i, int j);
+void rebuildRoomBeds();
+void initializeRoomBeds();
+void resetRoomCapacities();
+void loadRooms();
+int writeRoomsSection(FILE *roomsFile);
 void addDoctor();
 void viewDoctors();
 void manageDoctorSchedule();
-void assignShift(int doctorID, int dayInWeek, int shiftInDay);
+int assignShift(int doctorID, int day, int shift);
+int assignShiftUntimed(int doctorID, int day, int shift);
+int unassignShift(int doctorID, int day, int shift);
+int unassignShiftUntimed(int doctorID, int day, int shift);
+int commitShiftAssignment(Doctor *doctor, int day, int shift);
+void adjustDoctorShifts(Doctor *doctor, int change);
+void changeShiftAssignment(int assign);
+void printScheduleError(int result);
+void bulkScheduleChanges();
+int readScheduleChanges(const char *fileName, ScheduleChange **changes, int *count, int *errorLine);
+int applyScheduleChanges(const ScheduleChange *changes, int count, int *failedChange);
+int applyScheduleStep(ScheduleStep *steps, int *stepCount, int operation, int doctorID, int day, int shift);
+void undoScheduleSteps(const ScheduleStep *steps, int stepCount);
+void autoSchedule();
+int fillRoster(int firstDay, int lastDay, int doctorsPerShift, RosterResult *result);
+void planRoster(RosterPlan *plan, RosterResult *result);
+int rosterCanTake(const RosterPlan *plan, int doctor, int day, int shift);
+int shiftFitsWeek(unsigned int previous, unsigned int current, unsigned int next, unsigned int bit);
+void viewFreeDoctors();
+int canTakeShift(ScheduleStore *store, int doctorID, int day, int shift);
+int breaksRestRule(ScheduleStore *store, int doctorID, int day, int shift);
+int slotHasDoctor(const ScheduleSlot *slot, int doctorID);
+unsigned int weekShiftBits(ScheduleStore *store, int doctorID, int week);
+unsigned int shiftBit(int day, int shift);
+int countRestViolations(unsigned int shiftBits);
 void viewSchedule();
+void renderScheduleWeek(ReportBuffer *buffer, int monday);
+int countCoveredShifts(int monday);
+ScheduleSlot *findScheduleSlot(ScheduleStore *store, int day, int shift, int create);
+DoctorWeekLoad *findDoctorWeekLoad(ScheduleStore *store, int doctorID, int week, int create);
+int scheduleAdd(ScheduleStore *store, int day, int shift, int doctorID);
+int scheduleRemove(ScheduleStore *store, int day, int shift, int doctorID);
+void freeSchedule(ScheduleStore *store);
+int collectScheduleRecords(const ScheduleStore *store, ScheduleRecord **records);
+int compareScheduleRecords(const void *a, const void *b);
+int weekOfDay(int day);
+int weekStartDay(int day);
+int todayScheduleDay();
+int parseScheduleDate(const char *text, int *day);
+void formatScheduleDate(int day, char *text);
 Doctor *findDoctorByID(int id);
 void generateReports();
 void patientAdmissionReport();
 void doctorUtilizationReport();
 void roomUtilizationReport();
+void lengthOfStayReport();
+int writeLengthOfStayReport(FILE *reportFile, const char *timestamp);
+void recordStay(const Patient *patient);
+void resetStayHistory();
+int snapshotStays(StayColumns *columns, StringDictionary *diagnoses);
+int allocateStayColumns(StayColumns *columns, int capacity);
+int selectKth(int *values, int count, int k);
+void computeStayBuckets(StayColumns *columns);
+int summarizeStays(const StayColumns *columns, const int *keys, int keyCount, StayGroupSummary *groups);
+void writeStayTable(FILE *reportFile, const char *title, const char *keyHeading, const StayGroupSummary *groups,
+                    int groupCount, const StringDictionary *diagnoses);
+void freeStayColumns(StayColumns *columns);
+int compareStayGroupsBySize(const void *a, const void *b);
+void allReports();
+FILE *openReportFile(const char *prefix, const char *timestamp, char *fileName);
+void writeAdmissionHeader(FILE *reportFile, const char *timestamp);
+void writeAdmissionRow(FILE *reportFile, const Patient *patient);
+void writeDoctorHeader(FILE *reportFile, const char *timestamp);
+void writeDoctorRow(FILE *reportFile, const Doctor *doctor, int week);
+void writeRoomHeader(FILE *reportFile, const char *timestamp);
+void writeRoomRows(FILE *reportFile);
+int writeAllReports(char fileNames[3][MAX_FILENAME_LENGTH]);
+void renderPatientShardsParallel(ReportRenderJob *job);
+void *renderReportWorker(void *arg);
+int writeRenderedRows(FILE *reportFile, ReportRenderJob *job);
+void freeRenderJob(ReportRenderJob *job);
+void reportBufferAppend(ReportBuffer *buffer, const char *format, ...);
+int reportBufferReserve(ReportBuffer *buffer, size_t bytes);
+void reportBufferRelease(ReportBuffer *buffer);
+void reportBufferPutString(ReportBuffer *buffer, const char *text, int width);
+void reportBufferPutInt(ReportBuffer *buffer, int value, int width);
+void renderAdmissionRow(ReportBuffer *buffer, const Patient *patient);
+void startBackgroundReports();
+void *backgroundReportThread(void *arg);
+void waitForBackgroundReports();
+void printBackgroundReportStatus();
 void menu();
 void clearInputBuffer();
 void returnToMenu();
 int scanInt();
 void printHeader(const char *title);
+int admitPatient(Patient *newPatient);
+int admitPatientUntimed(Patient *newPatient);
+int dischargePatientByID(int id);
+int dischargePatientOn(int id, const char *dischargeDate);
+int dischargePatientOnUntimed(int id, const char *dischargeDate);
+int startReplication(const char *logPath);
+void stopReplication();
+void shipMutation(int operation, const void *payload, int payloadSize);
+int runStandby(const char *logPath);
+int applyReplicatedMutation(const ReplicationRecordHeader *header, const void *payload);
+int writeReplicationPosition(const char *fileName, long appliedOffset, long long appliedSequence);
+long long currentTimeMicros();
+int registerDoctor(Doctor *newDoctor);
+int appendPatient(Patient *newPatient);
+void appendDoctor(Doctor *newDoctor);
+void initializePatientShards();
+unsigned int hashPatientID(int id);
+PatientShard *shardForPatient(int id);
+void lockAllPatientShards(int forWriting);
+void unlockAllPatientShards();
+int shardIndexInsert(PatientShard *shard, int id, int row);
+int findPatientRow(PatientShard *shard, int id);
+int archiveDischargedPatients();
+int writeArchivedPatients(ArchiveIndexEntry *entries, int count);
+int closeArchivePartition(FILE *partition);
+int appendArchiveIndex(const ArchiveIndexEntry *entries, int count);
+void compactShard(PatientShard *shard);
+int isPatientArchived(int id);
+int findArchivedPatient(int id, Patient *patient);
+int archivedPatientCount();
+void loadArchive();
+int loadArchiveIndex();
+void loadArchivedStays();
+int readArchiveIndexFile(ArchiveIndex *index);
+int reserveArchiveIndex(ArchiveIndex *index, int extra);
+void archiveIndexInsert(ArchiveIndex *index, const ArchiveIndexEntry *entry);
+int findArchiveEntry(const ArchiveIndex *index, int id);
+void freeArchiveIndex(ArchiveIndex *index);
+int openArchiveCursor(ArchiveCursor *cursor, const ArchiveIndex *index, int fromMonth);
+int readArchivedPatient(ArchiveCursor *cursor, Patient *patient);
+void closeArchiveCursor(ArchiveCursor *cursor);
+int compareArchiveEntries(const void *a, const void *b);
+int archiveMonth(const char *date);
+int monthOfMinute(int minute);
+void archivePartitionPath(char *path, int month);
+int readArchiveSection(const char *fileName, ArchiveIndexEntry **entries);
+ArchiveIndexEntry *readArchiveIndexPrefix(int count);
+int stageArchiveIndex(const ArchiveIndexEntry *entries, int count);
+int commitArchiveIndex();
+int syncDirectory(const char *path);
+int syncParentDirectory(const char *fileName);
+int growShardColumns(PatientShard *shard);
+void initializePatientFilter(PatientFilter *filter);
+int selectPatientsInShard(const PatientShard *shard, const PatientFilter *filter, unsigned long long *selection);
+int selectionWords(int rows);
+void selectInRange(const int *values, int count, int low, int high, unsigned long long *selection);
+void selectInRangeScalar(const int *values, int count, int low, int high, unsigned long long *selection);
+int admissionMinute(const char *admissionDate);
+void indexPatientForQueries(const Patient *patient);
+void resetQueryIndexes();
+int runPatientQuery(const PatientQuery *query, QueryResult *result);
+int chooseQueryPlan(const PatientQuery *query);
+void sortAdmissionIndex();
+int findAdmissionBound(long long minute);
+int collectIndexCandidates(const PatientQuery *query, int plan, int **candidates, int *count);
+int queryRowMatches(const PatientShard *shard, int row, const PatientQuery *query);
+int addQueryRow(QueryResult *result, const PatientShard *shard, int row, int sortKey);
+int appendQueryRow(QueryResult *result, int patientID, int key);
+int queryArchive(const PatientQuery *query, QueryResult *result);
+int compareQueryRows(const void *a, const void *b);
+int compareAdmissionEntries(const void *a, const void *b);
+void freeQueryResult(QueryResult *result);
+int reserveRoomBed(int roomNum);
+void releaseRoomBed(int roomNum);
+void resetRoomOccupancy();
+void addLoadedPatient(Patient *newPatient);
+int countStoredPatients();
+void parallelShardScan(void (*scanShard)(PatientShard *shard, void *result), void **results);
+void *runShardScanTask(void *arg);
+void resetStatistics();
+void noteRoomOccupancyChange(int capacity, int before, int after);
+int ageGroupOf(int age);
+void noteLoadedDoctor(const Doctor *doctor);
+void loadStatistics();
+int writeStatisticsSection(FILE *statsFile);
+int writeSnapshot(const char *fileName, int withArchive);
+int writeSnapshotSection(FILE *snapshotFile, int section);
+FILE *openSnapshotSection(const char *fileName, int section);
+FILE *openDataSection(int section, char *fileName);
+void removeLegacyDataFiles();
+int restoreSnapshotBackup(const char *backupFileName);
+int restoreLegacyBackup(const char *timestamp);
+void viewDashboard();
+long long latencyStart();
+void latencyRecord(int operation, long long started, int succeeded);
+int latencyBucket(long long nanos);
+long long latencyBucketLimit(int bucket);
+long long latencyPercentile(const LatencyHistogram *histogram, long long calls, double fraction);
+void resetLatencyStatistics();
+void writeLatencyTable(FILE *output);
+int dumpLatencyStatistics(char *fileName);
+void systemStatistics();
+void collectMemoryUsage(MemoryUsage usage[MEMORY_CATEGORY_COUNT]);
+long long processResidentBytes();
+void writeMemoryTable(FILE *output);
+void writeMemoryUsageJson(FILE *output);
+int dumpMemoryUsage(char *fileName);
+int startTracing(const char *path);
+void stopTracing();
+long long traceStart();
+void traceSpan(const char *name, const char *category, long long started, const char *fileName);
+FILE *traceOpen(const char *fileName, const char *mode);
+int traceClose(FILE *file, const char *fileName);
+void exportMenu();
+int exportData(int format, char fileNames[3][MAX_FILENAME_LENGTH]);
+int exportColumnar(FILE *patientFile, ArchiveCursor *archive, FILE *doctorFile, const ScheduleRecord *schedule,
+                   int scheduleCount, FILE *exportFile);
+int exportText(int format, FILE *patientFile, ArchiveCursor *archive, FILE *doctorFile, const ScheduleRecord *schedule,
+               int scheduleCount, FILE *exportFiles[3]);
+int readExportedPatient(FILE *patientFile, Patient *patient);
+int readNextExportedPatient(FILE *patientFile, int *remaining, ArchiveCursor *archive, Patient *patient);
+int readExportedDoctor(FILE *doctorFile, Doctor *doctor);
+void initializeExportGroup(ExportRowGroup *group, int table, int columnCount, const int *encodings);
+void freeExportGroup(ExportRowGroup *group);
+int flushExportGroup(FILE *exportFile, ExportRowGroup *group);
+void exportPutVarint(ReportBuffer *buffer, unsigned long long value);
+unsigned long long zigzagEncode(long long value);
+void exportGroupPutValue(ExportRowGroup *group, int column, long long value);
+void exportGroupPutString(ExportRowGroup *group, int column, const char *text);
+void exportGroupPutBit(ExportRowGroup *group, int column, int bit);
+int dictionaryIndexOf(StringDictionary *dictionary, const char *text);
+void resetDictionary(StringDictionary *dictionary);
+void freeDictionary(StringDictionary *dictionary);
+unsigned int hashString(const char *text, int length);
+long long dateTimeToSeconds(const char *dateTime);
+void exportPutCsvString(ReportBuffer *buffer, const char *text);
+void exportPutJsonString(ReportBuffer *buffer, const char *text);
+int flushExportBuffer(FILE *exportFile, ReportBuffer *buffer, int force);
+
+#ifndef HMS_NO_MAIN
+int main(int argc, char *argv[]) {
+    // Optional modes:
+    //   --replicate <log>          ship every committed change to a replication log
+    //   --standby <data dir> <log> apply a primary's log to another data directory until promoted
+    //   --export <columnar|csv|jsonl> stream the saved data files to an export and exit
+    //   --apply-schedule <file>    apply a file of schedule changes, all or nothing, save and exit
+    //   --trace <file>             write saves, backups, restores, loads and reports as Chrome trace events
+    //   --memory-usage             load the data, write the memory each structure takes as JSON and exit
+    //   --lazy                     open the menu at once and load the data in the background
+    if (argc == 3 && strcmp(argv[1], "--apply-schedule") == 0) {
+        ScheduleChange *changes;
+        int count, errorLine, failedChange;
+        if (!readScheduleChanges(argv[2], &changes, &count, &errorLine)) {
+            if (errorLine > 0) {
+                printf("Error: Line %d of the file is not a valid change.\n", errorLine);
+            } else {
+                printf("Error: Unable to read %s.\n", argv[2]);
+            }
+            return 1;
+        }
+        initializeSystem();
+        loadData();
+        loadStatistics();
+        int result = applyScheduleChanges(changes, count, &failedChange);
+        if (result != STORE_OK) {
+            if (failedChange >= 0) {
+                printf("Line %d: ", changes[failedChange].line);
+            }
+            printScheduleError(result);
+            printf("No changes were made.\n");
+        } else {
+            printf("Applied %d changes.\n", count);
+        }
+        int saved = result == STORE_OK && saveData();
+        free(changes);
+        cleanupSystem();
+        return saved ? 0 : 1;
+    }
+    if (argc == 3 && strcmp(argv[1], "--export") == 0) {
+        int format = strcmp(argv[2], "columnar") == 0 ? EXPORT_COLUMNAR :
+                     strcmp(argv[2], "csv") == 0 ? EXPORT_CSV :
+                     strcmp(argv[2], "jsonl") == 0 ? EXPORT_JSONL : 0;
+        char fileNames[3][MAX_FILENAME_LENGTH];
+        int fileCount = format != 0 ? exportData(format, fileNames) : 0;
+        if (fileCount == 0) {
+            printf("Error: Export failed.\n");
+            return 1;
+        }
+        for (int i = 0; i < fileCount; i++) {
+            printf("%s\n", fileNames[i]);
+        }
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "--memory-usage") == 0) {
+        initializeSystem();
+        loadData();
+        loadStatistics();
+        char fileName[MAX_FILENAME_LENGTH];
+        int written = dumpMemoryUsage(fileName);
+        cleanupSystem();
+        if (!written) {
+            printf("Error: Unable to write the memory usage file.\n");
+            return 1;
+        }
+        printf("%s\n", fileName);
+        return 0;
+    }
+    if (argc == 4 && strcmp(argv[1], "--standby") == 0) {
+        if (strlen(argv[2]) >= MAX_DIRECTORY_LENGTH) {
+            printf("Error: Standby data directory path is too long.\n");
+            return 1;
+        }
+        strcpy(dataDirectory, argv[2]);
+        initializeSystem();
+        loadData();
+        loadStatistics();
+        if (!runStandby(argv[3])) {
+            cleanupSystem();
+            return 1;
+        }
+    } else if (argc == 2 && strcmp(argv[1], "--lazy") == 0) {
+        initializeSystem();
+        if (!startLazyLoad()) {
+            return 1;
+        }
+    } else {
+        initializeSystem();    // Initialize system variables and data structures
+        loadData();            // Load existing data from files
+        loadStatistics();      // Load the lifetime totals kept next to the data
+        if (argc == 3 && strcmp(argv[1], "--replicate") == 0 && !startReplication(argv[2])) {
+            cleanupSystem();
+            return 1;
+        }
+        if (argc == 3 && strcmp(argv[1], "--trace") == 0 && !startTracing(argv[2])) {
+            cleanupSystem();
+            return 1;
+        }
+    }
 
-int main() {
-    initializeSystem();    // Initialize system variables and data structures
-    loadData();            // Load existing data from files
     menu();                // Display and handle the main menu
+    finishStartupLoad();   // Let a background load started by --lazy finish
+    waitForBackgroundReports();    // Let a running background report finish its files
     saveData();            // Save data before exiting
+    stopReplication();     // Close the replication log if one is open
+    stopTracing();         // Finish the trace file if one is open
     cleanupSystem();       // Free allocated memory
     return 0;
 }
+#endif
 
-//Initialize the system. Currently initializes the doctor schedule array to zeros
+//Initialize the system. Sets up the patient shards; the schedule starts empty and grows as shifts are assigned
 void initializeSystem() {
-    // Initialize all slots in doctor schedule to 0 (unassigned)
-    for (int i = 0; i < MAX_DAYS_IN_WEEK; i++) {
-        for (int j = 0; j < MAX_SHIFTS_IN_DAY; j++) {
-            doctorSchedule[i][j] = 0;
-        }
-    }
+    pthread_once(&patientShardsOnce, initializePatientShards);
+    pthread_once(&roomBedsOnce, initializeRoomBeds);
 }
 
 //Clean up the system. Frees all dynamically allocated memory for patients and doctors
 void cleanupSystem() {
-    // Free memory allocated for patients
-    Patient *currentPatient = patientHead;
-    Patient *nextPatient;
+    lockAllPatientShards(1);
+    pthread_rwlock_wrlock(&doctorStoreLock);
+
+    // Free memory allocated for patients and the shard indexes
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        PatientShard *shard = &patientShards[s];
+        Patient *currentPatient = shard->head;
+        Patient *nextPatient;
+
+        while (currentPatient != NULL) {
+            nextPatient = currentPatient->next;
+            free(currentPatient);
+            currentPatient = nextPatient;
+        }
 
-    while (currentPatient != NULL) {
-        nextPatient = currentPatient->next;
-        free(currentPatient);
-        currentPatient = nextPatient;
+        free(shard->index);
+        free(shard->rows);
+        free(shard->ids);
+        free(shard->ages);
+        free(shard->rooms);
+        free(shard->active);
+        free(shard->admitted);
+        shard->index = NULL;
+        shard->indexCapacity = 0;
+        shard->rows = NULL;
+        shard->ids = shard->ages = shard->rooms = shard->active = shard->admitted = NULL;
+        shard->rowCapacity = 0;
+        shard->head = shard->tail = NULL;
+        shard->count = 0;
     }
 
     // Free memory allocated for doctors
@@ -126,6 +1189,23 @@ void cleanupSystem() {
         free(currentDoctor);
         currentDoctor = nextDoctor;
     }
+
+    doctorHead = doctorTail = NULL;
+    totalPatientsActive = 0;
+    totalPatients = 0;
+    totalDoctors = 0;
+    freeSchedule(&doctorSchedule);
+    closeScheduleJournal();
+    resetRoomOccupancy();
+    resetStatistics();
+    resetStayHistory();
+    resetQueryIndexes();
+    pthread_mutex_lock(&archiveLock);
+    freeArchiveIndex(&archiveIndex);
+    pthread_mutex_unlock(&archiveLock);
+
+    pthread_rwlock_unlock(&doctorStoreLock);
+    unlockAllPatientShards();
 }
 
 //Create a new patient record
@@ -185,115 +1265,301 @@ Doctor *createDoctor(int id, const char *name) {
     return newDoctor;
 }
 
-//Save all data to files. Saves patients, doctors, and schedule data to their respective files
+//Save all data to files and create a backup of them
 int saveData() {
-    // Save patient data
-    FILE *patientFile = fopen("../data/patients.dat", "wb");
-    if (patientFile == NULL) {
-        printf("Error: Unable to open patients.dat for writing.\n");
+    long long traced = traceStart();
+    if (!writeDataFiles()) {
+        traceSpan("saveData", "persistence", traced, NULL);
         return 0;
     }
 
-    // Write total number of patients
-    fwrite(&totalPatientsActive, sizeof(int), 1, patientFile);
+    printf("Data saved successfully.\n");
 
-    // Write each patient's data (excluding the next pointer)
-    Patient *current = patientHead;
-    while (current != NULL) {
-        fwrite(current, sizeof(Patient) - sizeof(Patient *), 1, patientFile);
-        current = current->next;
+    // Create a backup of the current data
+    backupData();
+    traceSpan("saveData", "persistence", traced, NULL);
+    return 1;
+}
+
+//Write all data files, recording how long it took and tracing it
+int writeDataFiles() {
+    awaitStartupLoad(LOAD_COMPLETE);    // A save before the load finishes would drop the records not read yet
+    long long started = latencyStart();
+    long long traced = traceStart();
+    int success = writeDataFilesUntimed();
+    traceSpan("writeDataFiles", "persistence", traced, NULL);
+    latencyRecord(LATENCY_SAVE, started, success);
+    return success;
+}
+
+//Write all data files. Saves patients, doctors, schedule, totals and room capacities to snapshot.dat in the data directory
+int writeDataFilesUntimed() {
+    char dataFileName[MAX_FILENAME_LENGTH];
+
+    // Move the discharged patients to the archive first, so the snapshot only has to hold the admitted ones
+    long long traced = traceStart();
+    int archived = archiveDischargedPatients();
+    traceSpan("archiveDischargedPatients", "persistence", traced, NULL);
+    if (archived < 0) {
+        printf("Warning: Unable to write the patient archive. Discharged patients stay in the snapshot.\n");
     }
-    fclose(patientFile);
 
-    // Save doctor data
-    FILE *doctorFile = fopen("../data/doctors.dat", "wb");
-    if (doctorFile == NULL) {
-        printf("Error: Unable to open doctors.dat for writing.\n");
+    // Hold the read side of both stores so the snapshot captures one consistent state
+    lockAllPatientShards(0);
+    pthread_rwlock_rdlock(&doctorStoreLock);
+
+    dataFilePath(dataFileName, "snapshot.dat");
+    int written = writeSnapshot(dataFileName, 0);
+
+    // The snapshot has every change in schedule.log; the log restarts before any new change can be made
+    if (written) {
+        restartScheduleJournal();
+    }
+
+    pthread_rwlock_unlock(&doctorStoreLock);
+    unlockAllPatientShards();
+    if (!written) {
+        printf("Error: Unable to write snapshot.dat.\n");
         return 0;
     }
+    if (atomic_exchange(&legacyDataFilesInUse, 0)) {
+        removeLegacyDataFiles();
+    }
+    return 1;
+}
 
-    // Write total number of doctors
-    fwrite(&totalDoctors, sizeof(int), 1, doctorFile);
+//Write the whole state to a snapshot file: a table of contents, then one section per kind of data. The file is
+//written under a temporary name, synced once and renamed into place, so a crash leaves the old snapshot or the
+//new one. Only backups carry the archive index, which a save leaves in archive.idx. Returns 0 on error. Caller
+//must hold the read side of every shard and the doctor lock
+int writeSnapshot(const char *fileName, int withArchive) {
+    char tempFileName[MAX_FILENAME_LENGTH + 4];
+    snprintf(tempFileName, sizeof(tempFileName), "%s.tmp", fileName);
+    FILE *snapshotFile = traceOpen(tempFileName, "wb");
+    if (snapshotFile == NULL) {
+        return 0;
+    }
 
-    // Write each doctor's data (excluding the next pointer)
-    Doctor *currentDoc = doctorHead;
-    while (currentDoc != NULL) {
-        fwrite(currentDoc, sizeof(Doctor) - sizeof(Doctor *), 1, doctorFile);
-        currentDoc = currentDoc->next;
+    // The table of contents is written again once the sections' places are known
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "HMSD", 4);
+    header.version = SNAPSHOT_FORMAT_VERSION;
+    header.sectionCount = withArchive ? SNAPSHOT_SECTION_COUNT : SNAPSHOT_ARCHIVE;
+    int written = fwrite(&header, sizeof(header), 1, snapshotFile) == 1;
+
+    long long offset = sizeof(header);
+    for (int section = 0; written && section < header.sectionCount; section++) {
+        long long traced = traceStart();
+        written = writeSnapshotSection(snapshotFile, section);
+        long long end = ftell(snapshotFile);
+        header.sections[section].section = section;
+        header.sections[section].offset = offset;
+        header.sections[section].length = end - offset;
+        offset = end;
+        traceSpan(snapshotSectionNames[section], "io", traced, tempFileName);
     }
-    fclose(doctorFile);
+    written = written && fseek(snapshotFile, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, snapshotFile) == 1;
 
-    // Save schedule data
-    FILE *scheduleFile = fopen("../data/schedule.dat", "wb");
-    if (scheduleFile == NULL) {
-        printf("Error: Unable to open schedule.dat for writing.\n");
+    long long traced = traceStart();
+    written = written && fflush(snapshotFile) == 0 && fsync(fileno(snapshotFile)) == 0;
+    traceSpan("fsync", "io", traced, tempFileName);
+    written = traceClose(snapshotFile, tempFileName) == 0 && written;
+
+    if (!written || rename(tempFileName, fileName) != 0) {
+        remove(tempFileName);
         return 0;
     }
 
-    // Write the entire schedule array
-    fwrite(doctorSchedule, sizeof(doctorSchedule), 1, scheduleFile);
-    fclose(scheduleFile);
+    // The rename only survives a crash once the directory holding it is synced, which has to happen before a
+    // save restarts schedule.log
+    traced = traceStart();
+    int synced = syncParentDirectory(fileName);
+    traceSpan("fsync directory", "io", traced, fileName);
+    return synced;
+}
 
-    printf("Data saved successfully.\n");
+//Write one section of a snapshot in the format of the separate file it replaces. Returns 0 on error
+int writeSnapshotSection(FILE *snapshotFile, int section) {
+    switch (section) {
+        case SNAPSHOT_PATIENTS: {
+            // Total number of patient records, active and discharged, then each record without its next pointer
+            int recordCount = countStoredPatients();
+            int written = fwrite(&recordCount, sizeof(int), 1, snapshotFile) == 1;
+            for (int s = 0; written && s < PATIENT_SHARD_COUNT; s++) {
+                for (Patient *current = patientShards[s].head; written && current != NULL; current = current->next) {
+                    written = fwrite(current, sizeof(Patient) - sizeof(Patient *), 1, snapshotFile) == 1;
+                }
+            }
+            return written;
+        }
+        case SNAPSHOT_DOCTORS: {
+            // Total number of doctors, then each record without its next pointer
+            int written = fwrite(&totalDoctors, sizeof(int), 1, snapshotFile) == 1;
+            for (Doctor *current = doctorHead; written && current != NULL; current = current->next) {
+                written = fwrite(current, sizeof(Doctor) - sizeof(Doctor *), 1, snapshotFile) == 1;
+            }
+            return written;
+        }
+        case SNAPSHOT_SCHEDULE:
+            return writeScheduleSection(snapshotFile, &doctorSchedule);
+        case SNAPSHOT_STATISTICS:
+            return writeStatisticsSection(snapshotFile);
+        case SNAPSHOT_ROOMS:
+            return writeRoomsSection(snapshotFile);
+        case SNAPSHOT_ARCHIVE: {
+            // The index entries in archive.idx order; partitions are only appended to, so the records stay where they point
+            pthread_mutex_lock(&archiveLock);
+            int written = fwrite(&archiveIndex.count, sizeof(int), 1, snapshotFile) == 1 &&
+                          (archiveIndex.count == 0 ||
+                           fwrite(archiveIndex.entries, sizeof(ArchiveIndexEntry), archiveIndex.count, snapshotFile) ==
+                           (size_t) archiveIndex.count);
+            pthread_mutex_unlock(&archiveLock);
+            return written;
+        }
+    }
+    return 0;
+}
 
-    // Create a backup of the current data
-    backupData();
-    return 1;
+//Open one section of a snapshot file for reading, positioned at its first byte. Returns NULL if the file
+//cannot be read or has no such section
+FILE *openSnapshotSection(const char *fileName, int section) {
+    FILE *snapshotFile = traceOpen(fileName, "rb");
+    if (snapshotFile == NULL) {
+        return NULL;
+    }
+
+    SnapshotHeader header;
+    if (fread(&header, sizeof(header), 1, snapshotFile) == 1 && memcmp(header.magic, "HMSD", 4) == 0 &&
+        header.version == SNAPSHOT_FORMAT_VERSION && header.sectionCount >= 0 &&
+        header.sectionCount <= SNAPSHOT_SECTION_COUNT) {
+        for (int i = 0; i < header.sectionCount; i++) {
+            if (header.sections[i].section == section && header.sections[i].length > 0 &&
+                fseek(snapshotFile, (long) header.sections[i].offset, SEEK_SET) == 0) {
+                return snapshotFile;
+            }
+        }
+    }
+    traceClose(snapshotFile, fileName);
+    return NULL;
+}
+
+//Open one section of the saved data for reading: from snapshot.dat, or while there is none yet from the
+//separate file the section replaced. The name of the file opened is copied into fileName. Returns NULL if
+//there is no such data
+FILE *openDataSection(int section, char *fileName) {
+    dataFilePath(fileName, "snapshot.dat");
+    if (access(fileName, F_OK) == 0) {
+        return openSnapshotSection(fileName, section);
+    }
+    if (legacyDataFiles[section] == NULL) {
+        return NULL;
+    }
+
+    dataFilePath(fileName, legacyDataFiles[section]);
+    FILE *dataFile = traceOpen(fileName, "rb");
+    if (dataFile != NULL) {
+        atomic_store(&legacyDataFilesInUse, 1);
+    }
+    return dataFile;
+}
+
+//Remove the separate data files once snapshot.dat has replaced them
+void removeLegacyDataFiles() {
+    char dataFileName[MAX_FILENAME_LENGTH];
+    for (int section = 0; section < SNAPSHOT_SECTION_COUNT; section++) {
+        if (legacyDataFiles[section] != NULL) {
+            dataFilePath(dataFileName, legacyDataFiles[section]);
+            remove(dataFileName);
+        }
+    }
 }
 
 //Load data from files. Loads patients, doctors, and schedule data from their respective files
 
 int loadData() {
+    char dataFileName[MAX_FILENAME_LENGTH];
+
+    // Room capacities first, so loaded patients are counted against them, then the archive so
+    // discharged records already archived are not loaded twice
+    loadRooms();
+    loadArchive();
+
     // Load patient data
-    FILE *patientFile = fopen("../data/patients.dat", "rb");
+    FILE *patientFile = openDataSection(SNAPSHOT_PATIENTS, dataFileName);
     if (patientFile == NULL) {
         printf("No existing patient data found. Starting with empty records.\n");
         return 0;
     }
+    loadPatients(patientFile, MAX_LOADED_RECORDS);
+
+    // Load doctor data
+    FILE *doctorFile = openDataSection(SNAPSHOT_DOCTORS, dataFileName);
+    if (doctorFile == NULL) {
+        printf("No existing doctor data found. Starting with empty records.\n");
+        return 0;
+    }
+    loadDoctors(doctorFile);
+
+    printf("Data loaded successfully.\n");
+    return 1;
+}
 
-    // Read total number of patients
-    fread(&totalPatientsActive, sizeof(int), 1, patientFile);
+//Read the patient records of an open patients section into the store and close it. The shard locks are
+//taken for batchSize records at a time, so lookups can run between batches
+void loadPatients(FILE *patientFile, int batchSize) {
+    // Read total number of patient records
+    int readPatients = 0;
+    if (fread(&readPatients, sizeof(int), 1, patientFile) != 1 || readPatients < 0 ||
+        readPatients > MAX_LOADED_RECORDS) {
+        readPatients = 0;
+    }
+    atomic_store(&startupPatientsInFile, readPatients);
 
     // Read and recreate each patient record
     Patient tempPatient;
-    for (int i = 0; i < totalPatientsActive; i++) {
-        fread(&tempPatient, sizeof(Patient) - sizeof(Patient *), 1, patientFile);
+    int i = 0;
+    while (i < readPatients) {
+        lockAllPatientShards(1);
+        int batchEnd = readPatients - i > batchSize ? i + batchSize : readPatients;
+        for (; i < batchEnd; i++) {
+            if (fread(&tempPatient, sizeof(Patient) - sizeof(Patient *), 1, patientFile) != 1) {
+                printf("Error reading patient %d data from file.\n", i + 1);
+                readPatients = i;
+                break;
+            }
 
-        // Create a new patient with the basic information
-        Patient *newPatient = createPatient(
-            tempPatient.patientID,
-            tempPatient.patientName,
-            tempPatient.patientAge,
-            tempPatient.patientDiagnosis,
-            tempPatient.patientRoomNum
-        );
+            // Create a new patient with the basic information
+            Patient *newPatient = createPatient(
+                tempPatient.patientID,
+                tempPatient.patientName,
+                tempPatient.patientAge,
+                tempPatient.patientDiagnosis,
+                tempPatient.patientRoomNum
+            );
+            if (newPatient == NULL) {
+                continue;
+            }
 
-        // Copy the admission date from the loaded data
-        strncpy(newPatient->admissionDate, tempPatient.admissionDate, sizeof(newPatient->admissionDate));
+            // Copy the admission date from the loaded data
+            strncpy(newPatient->admissionDate, tempPatient.admissionDate, sizeof(newPatient->admissionDate));
 
-        // Copy the discharge date and active status
-        strncpy(newPatient->dischargeDate, tempPatient.dischargeDate, sizeof(newPatient->dischargeDate));
-        newPatient->isActive = tempPatient.isActive;
+            // Copy the discharge date and active status
+            strncpy(newPatient->dischargeDate, tempPatient.dischargeDate, sizeof(newPatient->dischargeDate));
+            newPatient->isActive = tempPatient.isActive;
 
-        // Add the patient to the linked list
-        if (patientHead == NULL) {
-            patientHead = newPatient;
-        } else {
-            Patient *current = patientHead;
-            while (current->next != NULL) {
-                current = current->next;
-            }
-            current->next = newPatient;
+            // Add the patient to its shard and update the counters
+            addLoadedPatient(newPatient);
         }
+        unlockAllPatientShards();
+        atomic_store(&startupPatientsRead, i);
     }
     fclose(patientFile);
+}
 
-    // Load doctor data
-    FILE *doctorFile = fopen("../data/doctors.dat", "rb");
-    if (doctorFile == NULL) {
-        printf("No existing doctor data found. Starting with empty records.\n");
-        return 0;
-    }
+//Read the doctor records of an open doctors section into the store and close it, then load the schedule
+void loadDoctors(FILE *doctorFile) {
+    pthread_rwlock_wrlock(&doctorStoreLock);
 
     // Read total number of doctors
     fread(&totalDoctors, sizeof(int), 1, doctorFile);
@@ -305,182 +1571,609 @@ int loadData() {
 
         // Create a new doctor with the basic information
         Doctor *newDoctor = createDoctor(tempDoctor.doctorID, tempDoctor.doctorName);
-        newDoctor->totalShifts = tempDoctor.totalShifts;
 
-        // Add the doctor to the linked list
-        if (doctorHead == NULL) {
-            doctorHead = newDoctor;
-        } else {
-            Doctor *current = doctorHead;
-            while (current->next != NULL) {
-                current = current->next;
-            }
-            current->next = newDoctor;
-        }
+        // Add the doctor to the linked list. Its shift count comes from the schedule
+        appendDoctor(newDoctor);
     }
     fclose(doctorFile);
 
-    // Load schedule data
-    FILE *scheduleFile = fopen("../data/schedule.dat", "rb");
-    if (scheduleFile == NULL) {
-        printf("No existing schedule data found. Starting with empty schedule.\n");
+    // Load the schedule and count each doctor's shifts from it
+    loadSchedule();
+    pthread_rwlock_unlock(&doctorStoreLock);
+}
+
+//Start loading the data in the background so the menu can open straight away. Returns 0 if the thread cannot start
+int startLazyLoad() {
+    atomic_store(&startupLoadPhase, LOAD_PENDING);
+    if (pthread_create(&startupLoadThread, NULL, lazyLoadWorker, NULL) != 0) {
+        printf("Error: Unable to start loading the data.\n");
         return 0;
     }
+    startupLoadStarted = 1;
+    return 1;
+}
+
+//Background load for --lazy. Reads the small files first: room capacities, the archive index, the doctors and
+//the schedule. The archived stays and the patients follow, the patients in batches, and the lifetime totals
+//once they are all in
+void *lazyLoadWorker(void *argument) {
+    (void) argument;
+    char dataFileName[MAX_FILENAME_LENGTH];
+
+    // Same order as loadData, except that the doctors come before the patients and the archived records are
+    // read after them; as there, missing patient data leaves the doctors unloaded
+    loadRooms();
+    int archiveLoaded = loadArchiveIndex();
+    FILE *patientFile = openDataSection(SNAPSHOT_PATIENTS, dataFileName);
+    FILE *doctorFile = patientFile != NULL ? openDataSection(SNAPSHOT_DOCTORS, dataFileName) : NULL;
+    if (doctorFile != NULL) {
+        loadDoctors(doctorFile);
+    }
+    setStartupLoadPhase(LOAD_INDEXES);
 
-    // Read the entire schedule array
-    fread(doctorSchedule, sizeof(doctorSchedule), 1, scheduleFile);
-    fclose(scheduleFile);
+    // Only the stay history needs the archived records, and nothing reads it before the load completes
+    if (archiveLoaded) {
+        loadArchivedStays();
+    }
+    if (patientFile != NULL) {
+        loadPatients(patientFile, LAZY_LOAD_BATCH);
+    }
+    loadStatistics();
+    setStartupLoadPhase(LOAD_COMPLETE);
+    return NULL;
+}
 
-    printf("Data loaded successfully.\n");
-    return 1;
+//Advance the startup load and wake anything waiting for it
+void setStartupLoadPhase(int phase) {
+    pthread_mutex_lock(&startupLoadLock);
+    atomic_store(&startupLoadPhase, phase);
+    pthread_cond_broadcast(&startupLoadChanged);
+    pthread_mutex_unlock(&startupLoadLock);
 }
 
-//Back up all data to timestamped files. Creates backup files for patients, doctors, and schedule data
-int backupData() {
-    char reportFileName[MAX_FILENAME_LENGTH];
-    char timestamp[20];
+//Wait until the startup load has reached a phase, saying so if it has not
+void awaitStartupLoad(int phase) {
+    if (atomic_load(&startupLoadPhase) >= phase) {
+        return;
+    }
+    printf("Still loading the data (%d of %d patient records read). Please wait...\n",
+           atomic_load(&startupPatientsRead), atomic_load(&startupPatientsInFile));
+    fflush(stdout);
 
-    // Get current timestamp for backup filenames
-    getCurrentDateTime(timestamp, sizeof(timestamp));
+    pthread_mutex_lock(&startupLoadLock);
+    while (atomic_load(&startupLoadPhase) < phase) {
+        pthread_cond_wait(&startupLoadChanged, &startupLoadLock);
+    }
+    pthread_mutex_unlock(&startupLoadLock);
+}
 
-    // Replace spaces and colons with underscores for filename compatibility
-    for (int i = 0; timestamp[i] != '\0'; i++) {
-        if (timestamp[i] == ' ' || timestamp[i] == ':') {
-            timestamp[i] = '_';
-        }
+//Wait for a background load to finish and join its thread
+void finishStartupLoad() {
+    awaitStartupLoad(LOAD_COMPLETE);
+    if (startupLoadStarted) {
+        pthread_join(startupLoadThread, NULL);
+        startupLoadStarted = 0;
     }
+}
 
-    // Back up patient data
-    snprintf(reportFileName, MAX_FILENAME_LENGTH, "../backups/patients_%s.dat", timestamp);
+//Tell the user that what they see is only the data loaded so far
+void printStartupLoadProgress() {
+    if (atomic_load(&startupLoadPhase) < LOAD_COMPLETE) {
+        printf("Still loading: %d of %d patient records read so far.\n\n", atomic_load(&startupPatientsRead),
+               atomic_load(&startupPatientsInFile));
+    }
+}
 
-    FILE *patientFile = fopen(reportFileName, "wb");
+//Look a patient up in the saved patients section itself, for IDs the background load has not reached yet.
+//Returns 1 and copies the record into patient if found
+int findUnloadedPatient(int id, Patient *patient) {
+    char dataFileName[MAX_FILENAME_LENGTH];
+    FILE *patientFile = openDataSection(SNAPSHOT_PATIENTS, dataFileName);
     if (patientFile == NULL) {
-        printf("Error: Unable to open patients backup file for writing.\n");
         return 0;
     }
 
-    // Write total number of patients
-    fwrite(&totalPatientsActive, sizeof(int), 1, patientFile);
-
-    // Write each patient's data (excluding the next pointer)
-    Patient *current = patientHead;
-    while (current != NULL) {
-        fwrite(current, sizeof(Patient) - sizeof(Patient *), 1, patientFile);
-        current = current->next;
+    // Records are stored without their next pointer, one after another behind the count
+    const size_t recordSize = sizeof(Patient) - sizeof(Patient *);
+    int count = 0;
+    int found = 0;
+    if (fread(&count, sizeof(int), 1, patientFile) == 1) {
+        for (int i = 0; i < count && !found; i++) {
+            if (fread(patient, recordSize, 1, patientFile) != 1) {
+                break;
+            }
+            found = patient->patientID == id;
+        }
     }
     fclose(patientFile);
+    if (found) {
+        patient->next = NULL;
+    }
+    return found;
+}
 
-    // Back up doctor data
-    snprintf(reportFileName, MAX_FILENAME_LENGTH, "../backups/doctors_%s.dat", timestamp);
+//Build the path of a file inside the data directory
+void dataFilePath(char *path, const char *fileName) {
+    snprintf(path, MAX_FILENAME_LENGTH, "%s/%s", dataDirectory, fileName);
+}
 
-    FILE *doctorFile = fopen(reportFileName, "wb");
-    if (doctorFile == NULL) {
-        printf("Error: Unable to open doctors backup file for writing.\n");
-        return 0;
+//Load schedule.dat and schedule.log into the schedule and count every doctor's shifts. Caller must hold the doctor write lock
+void loadSchedule() {
+    // Schedule files from before the calendar refer to doctors by list position
+    int doctorCount = 0;
+    for (Doctor *current = doctorHead; current != NULL; current = current->next) {
+        doctorCount++;
+    }
+    int *doctorIDs = (int *) malloc((doctorCount + 1) * sizeof(int));
+    if (doctorIDs == NULL) {
+        doctorCount = 0;
+    }
+    int position = 0;
+    for (Doctor *current = doctorHead; doctorIDs != NULL && current != NULL; current = current->next) {
+        doctorIDs[position++] = current->doctorID;
     }
 
-    // Write total number of doctors
-    fwrite(&totalDoctors, sizeof(int), 1, doctorFile);
+    freeSchedule(&doctorSchedule);
+    closeScheduleJournal();
+    int appendable = readScheduleFiles(&doctorSchedule, doctorIDs, doctorCount);
+    free(doctorIDs);
 
-    // Write each doctor's data (excluding the next pointer)
-    Doctor *currentDoc = doctorHead;
-    while (currentDoc != NULL) {
-        fwrite(currentDoc, sizeof(Doctor) - sizeof(Doctor *), 1, doctorFile);
-        currentDoc = currentDoc->next;
+    // The saved doctors can be older than schedule.log, so the shift counts are taken from the schedule itself
+    for (Doctor *current = doctorHead; current != NULL; current = current->next) {
+        current->totalShifts = 0;
     }
-    fclose(doctorFile);
-
-    // Back up schedule data
-    snprintf(reportFileName, MAX_FILENAME_LENGTH, "../backups/schedule_%s.dat", timestamp);
-    FILE *scheduleFile = fopen(reportFileName, "wb");
-    if (scheduleFile == NULL) {
-        printf("Error: Unable to open schedule backup file for writing.\n");
-        return 0;
+    for (int i = 0; i < doctorSchedule.loadCapacity; i++) {
+        DoctorWeekLoad *load = &doctorSchedule.loads[i];
+        Doctor *doctor = load->doctorID != 0 ? findDoctorByID(load->doctorID) : NULL;
+        if (doctor != NULL) {
+            doctor->totalShifts += __builtin_popcount(load->shiftBits);
+        }
+    }
+    for (Doctor *current = doctorHead; current != NULL; current = current->next) {
+        noteLoadedDoctor(current);
     }
 
-    // Write the entire schedule array
-    fwrite(doctorSchedule, sizeof(doctorSchedule), 1, scheduleFile);
-    fclose(scheduleFile);
-
-    printf("Data back up successfully.\n");
-    return 1;
+    // Keep appending to schedule.log only if it follows on from the saved schedule; otherwise the next save starts both afresh
+    if (appendable) {
+        char dataFileName[MAX_FILENAME_LENGTH];
+        dataFilePath(dataFileName, "schedule.log");
+        scheduleJournal = fopen(dataFileName, "ab");
+    }
 }
 
-//Restore data from a backup. Copies backup files to the data directory and reloads the data
-int restoreData(const char* timestamp) {
-    char backupFileName[MAX_FILENAME_LENGTH];
+//Read the saved schedule and replay schedule.log into an empty store. Returns 0 if the schedule must be saved again before schedule.log is appended to
+int readScheduleFiles(ScheduleStore *store, const int *doctorIDs, int doctorCount) {
     char dataFileName[MAX_FILENAME_LENGTH];
-    FILE *backupFile, *dataFile;
-    unsigned char buffer[4096];    // Buffer for file copying
-    size_t bytesRead;
-    int success = 1;
-
-    printf("Starting data restoration from timestamp: %s\n", timestamp);
-
-    // Create data directory if it doesn't exist
-    #ifdef _WIN32
-    system("mkdir ..\\data 2>NUL");
-    #else
-    system("mkdir -p ../data");
-    #endif
-
-    // Restore patients data
-    snprintf(backupFileName, MAX_FILENAME_LENGTH, "../backups/patients_%s.dat", timestamp);
-    snprintf(dataFileName, MAX_FILENAME_LENGTH, "../data/patients.dat");
+    int appendable = 1;
+
+    FILE *scheduleFile = openDataSection(SNAPSHOT_SCHEDULE, dataFileName);
+    if (scheduleFile != NULL) {
+        long scheduleStart = ftell(scheduleFile);
+        ScheduleFileHeader header;
+        if (fread(&header, sizeof(header), 1, scheduleFile) == 1 && memcmp(header.magic, "HMSS", 4) == 0 &&
+            header.version == SCHEDULE_FORMAT_VERSION && header.count >= 0 && header.count <= MAX_LOADED_RECORDS) {
+            ScheduleRecord record;
+            for (int i = 0; i < header.count && fread(&record, sizeof(record), 1, scheduleFile) == 1; i++) {
+                scheduleAdd(store, record.day, record.shift, record.doctorID);
+            }
+            store->sequence = header.sequence;
+        } else {
+            // Older files hold one abstract week of 1-based doctor list positions; it becomes the current week
+            int legacy[MAX_DAYS_IN_WEEK][MAX_SHIFTS_IN_DAY];
+            int monday = weekStartDay(todayScheduleDay());
+            fseek(scheduleFile, scheduleStart, SEEK_SET);
+            if (fread(legacy, sizeof(legacy), 1, scheduleFile) == 1) {
+                for (int day = 0; day < MAX_DAYS_IN_WEEK; day++) {
+                    for (int shift = 0; shift < MAX_SHIFTS_IN_DAY; shift++) {
+                        int doctorIndex = legacy[day][shift];
+                        if (doctorIndex > 0 && doctorIndex <= doctorCount) {
+                            scheduleAdd(store, monday + day, shift + 1, doctorIDs[doctorIndex - 1]);
+                        }
+                    }
+                }
+            }
+            appendable = 0;
+        }
+        fclose(scheduleFile);
+    }
 
-    printf("Restoring patients data from: %s\n", backupFileName);
+    dataFilePath(dataFileName, "schedule.log");
+    FILE *journalFile = fopen(dataFileName, "rb");
+    if (journalFile != NULL) {
+        fseek(journalFile, 0, SEEK_END);
+        long journalSize = ftell(journalFile);
+        rewind(journalFile);
+
+        ScheduleJournalRecord record;
+        size_t bytesRead;
+        while ((bytesRead = fread(&record, 1, sizeof(record), journalFile)) == sizeof(record)) {
+            // A bulk change is replayed only if every one of its records reached the log
+            if (record.operation == SCHEDULE_BATCH &&
+                (record.doctorID < 0 || journalSize - ftell(journalFile) < (long) (record.doctorID * sizeof(record)))) {
+                break;
+            }
+            store->journalRecords++;
+            replayScheduleRecord(store, &record);
+        }
 
-    // Open backup file for reading
-    backupFile = fopen(backupFileName, "rb");
-    if (backupFile == NULL) {
-        printf("Error: Cannot open backup file %s\n", backupFileName);
-        return 0;
+        // A record torn by a crash would misalign every later append, and records appended after a
+        // torn bulk change would be read as part of it
+        if (bytesRead != 0) {
+            appendable = 0;
+        }
+        fclose(journalFile);
     }
+    return appendable;
+}
 
-    // Open data file for writing
-    dataFile = fopen(dataFileName, "wb");
-    if (dataFile == NULL) {
-        printf("Error: Unable to create data file %s\n", dataFileName);
-        fclose(backupFile);
-        return 0;
+//Apply one schedule.log record to a store, unless schedule.dat already had it
+void replayScheduleRecord(ScheduleStore *store, const ScheduleJournalRecord *record) {
+    if (record->sequence <= store->sequence) {
+        return;     // Written before a crash cut short the last restart of the log; the saved schedule already has it
     }
+    if (record->operation == SCHEDULE_ASSIGN) {
+        scheduleAdd(store, record->day, record->shift, record->doctorID);
+    } else if (record->operation == SCHEDULE_UNASSIGN) {
+        scheduleRemove(store, record->day, record->shift, record->doctorID);
+    }
+    store->sequence = record->sequence;
+}
 
-    // Copy data from backup to data file
-    while ((bytesRead = fread(buffer, 1, sizeof(buffer), backupFile)) > 0) {
-        if (fwrite(buffer, 1, bytesRead, dataFile) != bytesRead) {
-            printf("Error writing to patients data file\n");
-            success = 0;
-            break;
+//Start an empty schedule.log once a snapshot holding every logged change is in place. Caller must hold the doctor lock
+void restartScheduleJournal() {
+    pthread_mutex_lock(&scheduleJournalLock);
+    if (scheduleJournal == NULL || doctorSchedule.journalRecords > 0) {
+        // Records left in the log are at or below the sequence in the snapshot, so losing this truncation is harmless
+        if (scheduleJournal != NULL) {
+            fclose(scheduleJournal);
         }
+        char dataFileName[MAX_FILENAME_LENGTH];
+        dataFilePath(dataFileName, "schedule.log");
+        scheduleJournal = fopen(dataFileName, "wb");
+        doctorSchedule.journalRecords = 0;
     }
+    pthread_mutex_unlock(&scheduleJournalLock);
+}
 
-    fclose(backupFile);
-    fclose(dataFile);
-
-    if (!success) {
-        printf("Failed to restore patients data\n");
+//Write every assignment of a schedule in the schedule.dat format. Returns 0 on error
+int writeScheduleSection(FILE *scheduleFile, const ScheduleStore *store) {
+    ScheduleRecord *records;
+    int count = collectScheduleRecords(store, &records);
+    if (count < 0) {
         return 0;
     }
 
-    printf("Patients data restored successfully\n");
+    ScheduleFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "HMSS", 4);
+    header.version = SCHEDULE_FORMAT_VERSION;
+    header.sequence = store->sequence;
+    header.count = count;
+
+    int written = fwrite(&header, sizeof(header), 1, scheduleFile) == 1 &&
+                  (count == 0 || fwrite(records, sizeof(ScheduleRecord), count, scheduleFile) == (size_t) count);
+    free(records);
+    return written;
+}
+
+//Append one schedule change to schedule.log. Caller must hold the doctor write lock
+void appendScheduleJournal(int operation, int day, int shift, int doctorID) {
+    pthread_mutex_lock(&scheduleJournalLock);
+    ScheduleJournalRecord record = {++doctorSchedule.sequence, operation, day, shift, doctorID};
+    if (scheduleJournal != NULL) {
+        if (fwrite(&record, sizeof(record), 1, scheduleJournal) == 1 && fflush(scheduleJournal) == 0) {
+            doctorSchedule.journalRecords++;
+        } else {
+            // Stop appending after a failed write; the next save puts the change in the snapshot instead
+            fclose(scheduleJournal);
+            scheduleJournal = NULL;
+        }
+    }
+    pthread_mutex_unlock(&scheduleJournalLock);
+}
+
+//Append the steps of a bulk change to schedule.log behind a SCHEDULE_BATCH record, in one write. Caller must hold the doctor write lock
+void appendScheduleJournalBatch(const ScheduleStep *steps, int stepCount) {
+    pthread_mutex_lock(&scheduleJournalLock);
+    ScheduleJournalRecord *records = (ScheduleJournalRecord *) malloc((stepCount + 1) * sizeof(ScheduleJournalRecord));
+    if (records != NULL) {
+        records[0].sequence = ++doctorSchedule.sequence;
+        records[0].operation = SCHEDULE_BATCH;
+        records[0].day = 0;
+        records[0].shift = 0;
+        records[0].doctorID = stepCount;
+        for (int i = 0; i < stepCount; i++) {
+            records[i + 1].sequence = ++doctorSchedule.sequence;
+            records[i + 1].operation = steps[i].operation;
+            records[i + 1].day = steps[i].day;
+            records[i + 1].shift = steps[i].shift;
+            records[i + 1].doctorID = steps[i].doctor->doctorID;
+        }
+    }
+
+    if (scheduleJournal != NULL) {
+        if (records != NULL && fwrite(records, sizeof(ScheduleJournalRecord), stepCount + 1, scheduleJournal) ==
+                               (size_t) stepCount + 1 && fflush(scheduleJournal) == 0) {
+            doctorSchedule.journalRecords += stepCount + 1;
+        } else {
+            // As for a single change, the next save puts the changes in the snapshot instead
+            fclose(scheduleJournal);
+            scheduleJournal = NULL;
+        }
+    }
+    pthread_mutex_unlock(&scheduleJournalLock);
+    free(records);
+}
+
+//Close schedule.log if it is open
+void closeScheduleJournal() {
+    pthread_mutex_lock(&scheduleJournalLock);
+    if (scheduleJournal != NULL) {
+        fclose(scheduleJournal);
+        scheduleJournal = NULL;
+    }
+    pthread_mutex_unlock(&scheduleJournalLock);
+}
+
+//Back up all data, recording how long it took and tracing it
+int backupData() {
+    awaitStartupLoad(LOAD_COMPLETE);
+    long long started = latencyStart();
+    long long traced = traceStart();
+    int success = backupDataUntimed();
+    traceSpan("backupData", "persistence", traced, NULL);
+    latencyRecord(LATENCY_BACKUP, started, success);
+    return success;
+}
+
+//Back up all data to a timestamped snapshot in the backups directory
+int backupDataUntimed() {
+    char backupFileName[MAX_FILENAME_LENGTH];
+    char timestamp[20];
+
+    // Get current timestamp for the backup filename
+    getFileTimestamp(timestamp, sizeof(timestamp));
+    snprintf(backupFileName, MAX_FILENAME_LENGTH, "../backups/snapshot_%s.dat", timestamp);
+
+    // Hold the read side of both stores so the backup captures one consistent state
+    lockAllPatientShards(0);
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    int written = writeSnapshot(backupFileName, 1);
+    pthread_rwlock_unlock(&doctorStoreLock);
+    unlockAllPatientShards();
+
+    if (!written) {
+        printf("Error: Unable to write the backup file %s.\n", backupFileName);
+        return 0;
+    }
+    printf("Data back up successfully.\n");
+    return 1;
+}
+
+//Restore data from a backup, recording how long it took and tracing it
+int restoreData(const char *timestamp) {
+    awaitStartupLoad(LOAD_COMPLETE);    // Restoring replaces the store, which the load is still filling
+    long long started = latencyStart();
+    long long traced = traceStart();
+    int success = restoreDataUntimed(timestamp);
+    traceSpan("restoreData", "persistence", traced, NULL);
+    latencyRecord(LATENCY_RESTORE, started, success);
+    return success;
+}
+
+//Restore data from a backup. Copies the backup to the data directory and reloads the data
+int restoreDataUntimed(const char *timestamp) {
+    char backupFileName[MAX_FILENAME_LENGTH];
+    long long traced;
+    int success;
+
+    printf("Starting data restoration from timestamp: %s\n", timestamp);
+
+    // Create data directory if it doesn't exist
+    char command[MAX_FILENAME_LENGTH + 20];
+    #ifdef _WIN32
+    snprintf(command, sizeof(command), "mkdir \"%s\" 2>NUL", dataDirectory);
+    #else
+    snprintf(command, sizeof(command), "mkdir -p \"%s\"", dataDirectory);
+    #endif
+    system(command);
+
+    // Backups made before snapshot.dat have one file per kind of data
+    snprintf(backupFileName, MAX_FILENAME_LENGTH, "../backups/snapshot_%s.dat", timestamp);
+    if (access(backupFileName, F_OK) == 0) {
+        success = restoreSnapshotBackup(backupFileName);
+    } else {
+        success = restoreLegacyBackup(timestamp);
+    }
+
+    printf("All backup files processed. Reloading data...\n");
+
+    if (!success) {
+        printf("Warning: Errors occurred during restoration. Data may be incomplete.\n");
+        return 0;
+    }
+
+    // Clean up and reinitialize the system with the restored data
+    cleanupSystem();
+    printf("System cleaned up\n");
+
+    initializeSystem();
+    printf("System reinitialized\n");
+
+    int loadResult = safeLoadData();
+    traced = traceStart();
+    loadStatistics();
+    traceSpan("loadStatistics", "persistence", traced, NULL);
+    printf("Data load result: %s\n", loadResult ? "Success" : "Failed");
+
+    if (loadResult) {
+        printf("Data restored successfully from backup: %s\n", timestamp);
+        return 1;
+    } else {
+        printf("Warning: Restored data files, but had issues loading them.\n");
+        return 0;
+    }
+}
+
+//Restore a snapshot backup: copy it over snapshot.dat the way a save writes it, start an empty schedule.log and
+//put back the archive index it holds. Nothing in the data directory changes until both files are ready. Returns 0 on error
+int restoreSnapshotBackup(const char *backupFileName) {
+    char dataFileName[MAX_FILENAME_LENGTH];
+    char tempFileName[MAX_FILENAME_LENGTH + 4];
+    dataFilePath(dataFileName, "snapshot.dat");
+    snprintf(tempFileName, sizeof(tempFileName), "%s.tmp", dataFileName);
+
+    printf("Restoring data from: %s\n", backupFileName);
+
+    // The archive index goes first, so a backup it cannot be taken from leaves the data as it was
+    ArchiveIndexEntry *archiveEntries;
+    int archiveCount = readArchiveSection(backupFileName, &archiveEntries);
+    if (archiveCount < 0) {
+        printf("Error: Backup file %s has no valid archive index\n", backupFileName);
+        return 0;
+    }
+    int staged = stageArchiveIndex(archiveEntries, archiveCount);
+    free(archiveEntries);
+    if (!staged) {
+        printf("Error: Unable to restore the archive index\n");
+        return 0;
+    }
+
+    FILE *backupFile = traceOpen(backupFileName, "rb");
+    if (backupFile == NULL) {
+        printf("Error: Cannot open backup file %s\n", backupFileName);
+        return 0;
+    }
+    FILE *dataFile = traceOpen(tempFileName, "wb");
+    if (dataFile == NULL) {
+        printf("Error: Unable to create %s\n", tempFileName);
+        traceClose(backupFile, backupFileName);
+        return 0;
+    }
+
+    // Copy data from backup to a new snapshot, then rename it over the old one
+    unsigned char buffer[65536];
+    size_t bytesRead;
+    int success = 1;
+    long long traced = traceStart();
+    while ((bytesRead = fread(buffer, 1, sizeof(buffer), backupFile)) > 0) {
+        if (fwrite(buffer, 1, bytesRead, dataFile) != bytesRead) {
+            success = 0;
+            break;
+        }
+    }
+    success = success && !ferror(backupFile) && fflush(dataFile) == 0 && fsync(fileno(dataFile)) == 0;
+    traceSpan("copy", "io", traced, tempFileName);
+    success = traceClose(dataFile, tempFileName) == 0 && success;
+    traceClose(backupFile, backupFileName);
+    if (!success || rename(tempFileName, dataFileName) != 0) {
+        printf("Error writing to %s\n", tempFileName);
+        remove(tempFileName);
+        return 0;
+    }
+    // Committing the archive index syncs the data directory, which makes both renames durable before schedule.log goes
+    if (!commitArchiveIndex()) {
+        printf("Error: Unable to restore the archive index\n");
+        return 0;
+    }
+
+    // The change log continues the schedule that was just replaced, and any separate data files are older still
+    dataFilePath(dataFileName, "schedule.log");
+    remove(dataFileName);
+    removeLegacyDataFiles();
+    return 1;
+}
+
+//Restore a backup made before snapshot.dat by copying each of its files to the data directory. Returns 0 on error
+int restoreLegacyBackup(const char *timestamp) {
+    char backupFileName[MAX_FILENAME_LENGTH];
+    char dataFileName[MAX_FILENAME_LENGTH];
+    FILE *backupFile, *dataFile;
+    unsigned char buffer[4096];    // Buffer for file copying
+    size_t bytesRead;
+    long long traced;
+    int success = 1;
+
+    // These backups only record how many archive.idx entries there were, so the index is cut back to them.
+    // That is checked first, so a backup it cannot be taken from leaves the data as it was. Older backups
+    // have no count, which means nothing was archived
+    snprintf(backupFileName, MAX_FILENAME_LENGTH, "../backups/archive_%s.dat", timestamp);
+    int archiveCount = 0;
+    backupFile = traceOpen(backupFileName, "rb");
+    if (backupFile != NULL) {
+        if (fread(&archiveCount, sizeof(int), 1, backupFile) != 1) {
+            archiveCount = 0;
+        }
+        traceClose(backupFile, backupFileName);
+    }
+    ArchiveIndexEntry *archiveEntries = readArchiveIndexPrefix(archiveCount);
+    int staged = archiveEntries != NULL && stageArchiveIndex(archiveEntries, archiveCount);
+    free(archiveEntries);
+    if (!staged) {
+        printf("Error: Unable to restore the archive index\n");
+        return 0;
+    }
+
+    // Restore patients data
+    snprintf(backupFileName, MAX_FILENAME_LENGTH, "../backups/patients_%s.dat", timestamp);
+    dataFilePath(dataFileName, "patients.dat");
+
+    printf("Restoring patients data from: %s\n", backupFileName);
+
+    // Open backup file for reading
+    backupFile = traceOpen(backupFileName, "rb");
+    if (backupFile == NULL) {
+        printf("Error: Cannot open backup file %s\n", backupFileName);
+        return 0;
+    }
+
+    // Open data file for writing
+    dataFile = traceOpen(dataFileName, "wb");
+    if (dataFile == NULL) {
+        printf("Error: Unable to create data file %s\n", dataFileName);
+        traceClose(backupFile, backupFileName);
+        return 0;
+    }
+
+    // Copy data from backup to data file
+    traced = traceStart();
+    while ((bytesRead = fread(buffer, 1, sizeof(buffer), backupFile)) > 0) {
+        if (fwrite(buffer, 1, bytesRead, dataFile) != bytesRead) {
+            printf("Error writing to patients data file\n");
+            success = 0;
+            break;
+        }
+    }
+    traceSpan("copy", "io", traced, dataFileName);
+
+    traceClose(backupFile, backupFileName);
+    traceClose(dataFile, dataFileName);
+
+    if (!success) {
+        printf("Failed to restore patients data\n");
+        return 0;
+    }
+
+    printf("Patients data restored successfully\n");
 
     // Restore doctors data
     snprintf(backupFileName, MAX_FILENAME_LENGTH, "../backups/doctors_%s.dat", timestamp);
-    snprintf(dataFileName, MAX_FILENAME_LENGTH, "../data/doctors.dat");
+    dataFilePath(dataFileName, "doctors.dat");
 
     printf("Restoring doctors data from: %s\n", backupFileName);
 
-    backupFile = fopen(backupFileName, "rb");
+    backupFile = traceOpen(backupFileName, "rb");
     if (backupFile == NULL) {
         printf("Warning: Cannot open doctors backup file %s\n", backupFileName);
     } else {
-        dataFile = fopen(dataFileName, "wb");
+        dataFile = traceOpen(dataFileName, "wb");
         if (dataFile == NULL) {
             printf("Error: Unable to create doctors data file\n");
-            fclose(backupFile);
+            traceClose(backupFile, backupFileName);
             success = 0;
         } else {
             // Copy data from backup to data file
+            traced = traceStart();
             while ((bytesRead = fread(buffer, 1, sizeof(buffer), backupFile)) > 0) {
                 if (fwrite(buffer, 1, bytesRead, dataFile) != bytesRead) {
                     printf("Error writing to doctors data file\n");
@@ -488,28 +2181,30 @@ int restoreData(const char* timestamp) {
                     break;
                 }
             }
-            fclose(dataFile);
+            traceSpan("copy", "io", traced, dataFileName);
+            traceClose(dataFile, dataFileName);
         }
-        fclose(backupFile);
+        traceClose(backupFile, backupFileName);
     }
 
     // Restore schedule data
     snprintf(backupFileName, MAX_FILENAME_LENGTH, "../backups/schedule_%s.dat", timestamp);
-    snprintf(dataFileName, MAX_FILENAME_LENGTH, "../data/schedule.dat");
+    dataFilePath(dataFileName, "schedule.dat");
 
     printf("Restoring schedule data from: %s\n", backupFileName);
 
-    backupFile = fopen(backupFileName, "rb");
+    backupFile = traceOpen(backupFileName, "rb");
     if (backupFile == NULL) {
         printf("Warning: Cannot open schedule backup file %s\n", backupFileName);
     } else {
-        dataFile = fopen(dataFileName, "wb");
+        dataFile = traceOpen(dataFileName, "wb");
         if (dataFile == NULL) {
             printf("Error: Unable to create schedule data file\n");
-            fclose(backupFile);
+            traceClose(backupFile, backupFileName);
             success = 0;
         } else {
             // Copy data from backup to data file
+            traced = traceStart();
             while ((bytesRead = fread(buffer, 1, sizeof(buffer), backupFile)) > 0) {
                 if (fwrite(buffer, 1, bytesRead, dataFile) != bytesRead) {
                     printf("Error writing to schedule data file\n");
@@ -517,69 +2212,159 @@ int restoreData(const char* timestamp) {
                     break;
                 }
             }
-            fclose(dataFile);
+            traceSpan("copy", "io", traced, dataFileName);
+            traceClose(dataFile, dataFileName);
+
+            // The change log continues the schedule that was just replaced
+            dataFilePath(dataFileName, "schedule.log");
+            remove(dataFileName);
         }
-        fclose(backupFile);
+        traceClose(backupFile, backupFileName);
     }
 
-    printf("All backup files processed. Reloading data...\n");
+    // Restore the lifetime totals. Older backups have none, so drop the current file and let the load rebuild them
+    snprintf(backupFileName, MAX_FILENAME_LENGTH, "../backups/stats_%s.dat", timestamp);
+    dataFilePath(dataFileName, "stats.dat");
 
-    if (!success) {
-        printf("Warning: Errors occurred during restoration. Data may be incomplete.\n");
-        return 0;
+    backupFile = traceOpen(backupFileName, "rb");
+    if (backupFile == NULL) {
+        printf("Warning: Cannot open statistics backup file %s\n", backupFileName);
+        remove(dataFileName);
+    } else {
+        dataFile = traceOpen(dataFileName, "wb");
+        if (dataFile == NULL) {
+            printf("Error: Unable to create statistics data file\n");
+            success = 0;
+        } else {
+            // Copy data from backup to data file
+            traced = traceStart();
+            while ((bytesRead = fread(buffer, 1, sizeof(buffer), backupFile)) > 0) {
+                if (fwrite(buffer, 1, bytesRead, dataFile) != bytesRead) {
+                    printf("Error writing to statistics data file\n");
+                    success = 0;
+                    break;
+                }
+            }
+            traceSpan("copy", "io", traced, dataFileName);
+            traceClose(dataFile, dataFileName);
+        }
+        traceClose(backupFile, backupFileName);
     }
 
-    // Clean up and reinitialize the system with the restored data
-    cleanupSystem();
-    printf("System cleaned up\n");
+    // Restore the room capacities. Older backups have none, which means every room had the default capacity
+    snprintf(backupFileName, MAX_FILENAME_LENGTH, "../backups/rooms_%s.dat", timestamp);
+    dataFilePath(dataFileName, "rooms.dat");
 
-    initializeSystem();
-    printf("System reinitialized\n");
+    backupFile = traceOpen(backupFileName, "rb");
+    if (backupFile == NULL) {
+        remove(dataFileName);
+    } else {
+        dataFile = traceOpen(dataFileName, "wb");
+        if (dataFile == NULL) {
+            printf("Error: Unable to create rooms data file\n");
+            success = 0;
+        } else {
+            // Copy data from backup to data file
+            traced = traceStart();
+            while ((bytesRead = fread(buffer, 1, sizeof(buffer), backupFile)) > 0) {
+                if (fwrite(buffer, 1, bytesRead, dataFile) != bytesRead) {
+                    printf("Error writing to rooms data file\n");
+                    success = 0;
+                    break;
+                }
+            }
+            traceSpan("copy", "io", traced, dataFileName);
+            traceClose(dataFile, dataFileName);
+        }
+        traceClose(backupFile, backupFileName);
+    }
 
-    int loadResult = safeLoadData();
-    printf("Data load result: %s\n", loadResult ? "Success" : "Failed");
+    // Put the cut-back archive index in place
+    if (success && !commitArchiveIndex()) {
+        printf("Error: Unable to restore the archive index\n");
+        success = 0;
+    }
 
-    if (loadResult) {
-        printf("Data restored successfully from backup: %s\n", timestamp);
-        return 1;
+    // The separate files are only read while there is no snapshot.dat
+    if (success) {
+        dataFilePath(dataFileName, "snapshot.dat");
+        remove(dataFileName);
     } else {
-        printf("Warning: Restored data files, but had issues loading them.\n");
-        return 0;
+        dataFilePath(dataFileName, "archive.idx.tmp");
+        remove(dataFileName);
     }
+    return success;
 }
 
-//Safely load data with validation. Similar to loadData() but with additional validation checks
+//Safely load data with validation, tracing it
 int safeLoadData() {
+    long long traced = traceStart();
+    int success = safeLoadDataUntimed();
+    traceSpan("safeLoadData", "persistence", traced, NULL);
+    return success;
+}
+
+//Safely load data with validation. Similar to loadData() but with additional validation checks
+int safeLoadDataUntimed() {
     printf("Starting safe data loading...\n");
 
-    // Reset counters and list heads
+    lockAllPatientShards(1);
+    pthread_rwlock_wrlock(&doctorStoreLock);
+
+    // Reset counters, list heads and shard indexes
     totalPatientsActive = 0;
+    totalPatients = 0;
     totalDoctors = 0;
-
-    patientHead = NULL;
-    doctorHead = NULL;
+    resetRoomOccupancy();
+    resetStatistics();
+    resetStayHistory();
+    resetQueryIndexes();
+    long long traced = traceStart();
+    loadRooms();
+    traceSpan("loadRooms", "persistence", traced, NULL);
+    traced = traceStart();
+    loadArchive();
+    traceSpan("loadArchive", "persistence", traced, NULL);
+
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        PatientShard *shard = &patientShards[s];
+        shard->head = shard->tail = NULL;
+        shard->count = 0;
+        if (shard->index != NULL) {
+            memset(shard->index, 0, shard->indexCapacity * sizeof(int));
+        }
+    }
+    doctorHead = doctorTail = NULL;
 
     // Load patient data
-    FILE *patientFile = fopen("../data/patients.dat", "rb");
+    char dataFileName[MAX_FILENAME_LENGTH];
+    FILE *patientFile = openDataSection(SNAPSHOT_PATIENTS, dataFileName);
     if (patientFile == NULL) {
         printf("No existing patient data found. Starting with empty records.\n");
+        pthread_rwlock_unlock(&doctorStoreLock);
+        unlockAllPatientShards();
         return 0;
     }
 
     // Read total number of patients with validation
+    traced = traceStart();
     int readPatients = 0;
     if (fread(&readPatients, sizeof(int), 1, patientFile) != 1) {
         printf("Error reading patient count from file.\n");
-        fclose(patientFile);
+        traceClose(patientFile, dataFileName);
+        pthread_rwlock_unlock(&doctorStoreLock);
+        unlockAllPatientShards();
         return 0;
     }
 
     printf("Found %d patients in data file.\n", readPatients);
 
-    // Validate patient count is reasonable
-    if (readPatients <= 0 || readPatients > 1000) {
+    // Validate patient count is reasonable. It is 0 once every patient has been discharged and archived
+    if (readPatients < 0 || readPatients > MAX_LOADED_RECORDS) {
         printf("Invalid patient count: %d\n", readPatients);
-        fclose(patientFile);
+        traceClose(patientFile, dataFileName);
+        pthread_rwlock_unlock(&doctorStoreLock);
+        unlockAllPatientShards();
         return 0;
     }
 
@@ -588,7 +2373,9 @@ int safeLoadData() {
     for (int i = 0; i < readPatients; i++) {
         if (fread(&tempPatient, sizeof(Patient) - sizeof(Patient *), 1, patientFile) != 1) {
             printf("Error reading patient %d data from file.\n", i+1);
-            fclose(patientFile);
+            traceClose(patientFile, dataFileName);
+            pthread_rwlock_unlock(&doctorStoreLock);
+            unlockAllPatientShards();
             return 0;
         }
 
@@ -618,34 +2405,27 @@ int safeLoadData() {
         strncpy(newPatient->dischargeDate, tempPatient.dischargeDate, sizeof(newPatient->dischargeDate));
         newPatient->isActive = tempPatient.isActive;
 
-        // Add the patient to the linked list
-        if (patientHead == NULL) {
-            patientHead = newPatient;
-        } else {
-            Patient *current = patientHead;
-            while (current->next != NULL) {
-                current = current->next;
-            }
-            current->next = newPatient;
-        }
-
-        totalPatientsActive++;
+        // Add the patient to its shard and update the counters
+        addLoadedPatient(newPatient);
         printf("Loaded patient ID: %d\n", newPatient->patientID);
     }
-    fclose(patientFile);
+    traceSpan("read", "io", traced, dataFileName);
+    traceClose(patientFile, dataFileName);
 
-    printf("Successfully loaded %d patients.\n", totalPatientsActive);
+    printf("Successfully loaded %d patients.\n", totalPatients);
 
     // Load doctor data
-    FILE *doctorFile = fopen("../data/doctors.dat", "rb");
+    int doctorsRead = 1;
+    FILE *doctorFile = openDataSection(SNAPSHOT_DOCTORS, dataFileName);
     if (doctorFile == NULL) {
         printf("No existing doctor data found. Starting with empty records.\n");
     } else {
         // Read total number of doctors with validation
+        traced = traceStart();
         int readDoctors = 0;
         if (fread(&readDoctors, sizeof(int), 1, doctorFile) != 1) {
             printf("Error reading doctor count from file.\n");
-            fclose(doctorFile);
+            doctorsRead = 0;
         } else if (readDoctors > 0 && readDoctors <= 1000) {
             printf("Found %d doctors in data file.\n", readDoctors);
 
@@ -654,6 +2434,7 @@ int safeLoadData() {
             for (int i = 0; i < readDoctors; i++) {
                 if (fread(&tempDoctor, sizeof(Doctor) - sizeof(Doctor *), 1, doctorFile) != 1) {
                     printf("Error reading doctor %d data from file.\n", i+1);
+                    doctorsRead = 0;
                     break;
                 }
 
@@ -670,55 +2451,29 @@ int safeLoadData() {
                     continue;  // Skip if memory allocation failed
                 }
 
-                newDoctor->totalShifts = tempDoctor.totalShifts;
-
-                // Add the doctor to the linked list
-                if (doctorHead == NULL) {
-                    doctorHead = newDoctor;
-                } else {
-                    Doctor *current = doctorHead;
-                    while (current->next != NULL) {
-                        current = current->next;
-                    }
-                    current->next = newDoctor;
-                }
+                // Add the doctor to the linked list. Its shift count comes from the schedule
+                appendDoctor(newDoctor);
 
                 totalDoctors++;
                 printf("Loaded doctor ID: %d\n", newDoctor->doctorID);
             }
             printf("Successfully loaded %d doctors.\n", totalDoctors);
         }
-        fclose(doctorFile);
+        traceSpan("read", "io", traced, dataFileName);
+        traceClose(doctorFile, dataFileName);
     }
 
-    // Load schedule data
-    FILE *scheduleFile = fopen("../data/schedule.dat", "rb");
-    if (scheduleFile == NULL) {
-        printf("No existing schedule data found. Starting with empty schedule.\n");
-        // Initialize schedule to zeros
-        for (int i = 0; i < MAX_DAYS_IN_WEEK; i++) {
-            for (int j = 0; j < MAX_SHIFTS_IN_DAY; j++) {
-                doctorSchedule[i][j] = 0;
-            }
-        }
-    } else {
-        size_t readResult = fread(doctorSchedule, sizeof(doctorSchedule), 1, scheduleFile);
-        if (readResult != 1) {
-            printf("Warning: Could not read complete schedule data.\n");
-            // Initialize schedule to zeros if read failed
-            for (int i = 0; i < MAX_DAYS_IN_WEEK; i++) {
-                for (int j = 0; j < MAX_SHIFTS_IN_DAY; j++) {
-                    doctorSchedule[i][j] = 0;
-                }
-            }
-        } else {
-            printf("Successfully loaded schedule data.\n");
-        }
-        fclose(scheduleFile);
-    }
+    // Load the schedule and count each doctor's shifts from it
+    traced = traceStart();
+    loadSchedule();
+    traceSpan("loadSchedule", "persistence", traced, NULL);
+    printf("Successfully loaded %d scheduled shifts.\n", doctorSchedule.assignments);
+
+    pthread_rwlock_unlock(&doctorStoreLock);
+    unlockAllPatientShards();
 
-    // Return success if any data was loaded
-    return (totalPatientsActive > 0 || totalDoctors > 0);
+    // The patient data was read whole, so no records at all only means none were saved: every patient archived, say
+    return doctorsRead;
 }
 
 //Select a backup to restore. Lists available backups and prompts the user to select one
@@ -742,9 +2497,9 @@ char* selectBackup() {
 
     // List available backup files
     #ifdef _WIN32
-    system("dir /b ..\\backups\\patients_*.dat > temp_backups.txt 2>NUL");
+    system("dir /b ..\\backups\\snapshot_*.dat ..\\backups\\patients_*.dat > temp_backups.txt 2>NUL");
     #else
-    system("ls -1 ../backups/patients_*.dat > temp_backups.txt 2>/dev/null");
+    system("ls -1 ../backups/snapshot_*.dat ../backups/patients_*.dat > temp_backups.txt 2>/dev/null");
     #endif
 
     FILE* fileList = fopen("temp_backups.txt", "r");
@@ -774,9 +2529,10 @@ char* selectBackup() {
             }
         }
 
-        // Extract timestamp from filename
-        if (strncmp(filename, "patients_", 9) == 0) {
-            char* timestamp = filename + 9;
+        // Extract timestamp from filename; backups made before snapshot.dat are listed by their patients file
+        char* timestamp = strncmp(filename, "snapshot_", 9) == 0 || strncmp(filename, "patients_", 9) == 0 ?
+                          filename + 9 : NULL;
+        if (timestamp != NULL) {
             char* extension = strstr(timestamp, ".dat");
             if (extension != NULL) {
                 *extension = '\0';  // Remove .dat extension
@@ -823,45 +2579,354 @@ char* selectBackup() {
     return selectedTimestamp;
 }
 
-//Get current date and time as a formatted string
-void getCurrentDateTime(char *dateTime, int bufferSize) {
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    strftime(dateTime, bufferSize, "%Y-%m-%d %H:%M:%S", t);
-}
+//Open a replication log as the primary. Later records continue the sequence numbers already in the log
+int startReplication(const char *logPath) {
+    FILE *log = fopen(logPath, "ab+");
+    if (log == NULL) {
+        printf("Error: Unable to open replication log %s.\n", logPath);
+        return 0;
+    }
 
-//Add a new patient to the system. Collects patient information and creates a new patient record
-void addPatient() {
-    printf("\e[1;1H\e[2J");  // Clear the screen
-    printHeader("Add Patient");
+    // Find the last sequence number by walking the record headers
+    ReplicationRecordHeader header;
+    long long lastSequence = 0;
+    fseek(log, 0, SEEK_SET);
+    while (fread(&header, sizeof(header), 1, log) == 1) {
+        if (header.payloadSize < 0 || fseek(log, header.payloadSize, SEEK_CUR) != 0) {
+            break;
+        }
+        lastSequence = header.sequence;
+    }
+    fseek(log, 0, SEEK_END);
 
-    int patientID;
-    char patientName[50];
-    int patientAge;
-    char patientDiag[250];
-    int patientRoomNum;
+    pthread_mutex_lock(&replicationLock);
+    replicationLog = log;
+    replicationSequence = lastSequence;
+    pthread_mutex_unlock(&replicationLock);
 
-    // Get patient ID with validation
-    printf("\nEnter the patient ID (positive number): ");
-    patientID = scanInt();
+    printf("Replication enabled: shipping changes to %s (last sequence %lld).\n", logPath, lastSequence);
+    return 1;
+}
 
-    if (patientID <= 0) {
-        printf("The patient ID must be a positive number!\n");
-        returnToMenu();
-        return;
+//Close the replication log if one is open
+void stopReplication() {
+    pthread_mutex_lock(&replicationLock);
+    if (replicationLog != NULL) {
+        fclose(replicationLog);
+        replicationLog = NULL;
     }
+    pthread_mutex_unlock(&replicationLock);
+}
 
-    // Check if patient ID already exists
-    if (findPatientByID(patientID) != NULL) {
-        printf("The patient ID already exists!\n");
-        returnToMenu();
+//Append one committed mutation to the replication log. Does nothing when replication is off
+void shipMutation(int operation, const void *payload, int payloadSize) {
+    if (replicationLog == NULL) {
         return;
     }
 
-    // Get patient name
-    printf("Enter the patient name: ");
-    fgets(patientName, sizeof(patientName), stdin);
-    patientName[strcspn(patientName, "\n")] = 0;  // Remove newline
+    pthread_mutex_lock(&replicationLock);
+    if (replicationLog != NULL) {
+        ReplicationRecordHeader header;
+        memset(&header, 0, sizeof(header));
+        header.sequence = ++replicationSequence;
+        header.commitTime = currentTimeMicros();
+        header.operation = operation;
+        header.payloadSize = payloadSize;
+
+        // Header and payload go out in one flush so the standby never waits on half a record for long
+        if (fwrite(&header, sizeof(header), 1, replicationLog) != 1 ||
+            fwrite(payload, payloadSize, 1, replicationLog) != 1 ||
+            fflush(replicationLog) != 0) {
+            printf("Warning: Failed to ship change %lld to the replication log.\n", header.sequence);
+        }
+    }
+    pthread_mutex_unlock(&replicationLock);
+}
+
+//Run as a standby. Applies the primary's log to this data directory until a promote file appears
+int runStandby(const char *logPath) {
+    char positionFileName[MAX_FILENAME_LENGTH];
+    char promoteFileName[MAX_FILENAME_LENGTH];
+    dataFilePath(positionFileName, "replication.pos");
+    dataFilePath(promoteFileName, "promote");
+
+    FILE *log = fopen(logPath, "rb");
+    if (log == NULL) {
+        printf("Error: Unable to open replication log %s.\n", logPath);
+        return 0;
+    }
+
+    // Resume from the position saved with the data files, if any
+    long appliedOffset = 0;
+    long long appliedSequence = 0;
+    FILE *positionFile = fopen(positionFileName, "rb");
+    if (positionFile != NULL) {
+        if (fread(&appliedOffset, sizeof(appliedOffset), 1, positionFile) != 1 ||
+            fread(&appliedSequence, sizeof(appliedSequence), 1, positionFile) != 1) {
+            appliedOffset = 0;
+            appliedSequence = 0;
+        }
+        fclose(positionFile);
+    }
+
+    printf("Standby mode: applying %s to %s from sequence %lld.\n", logPath, dataDirectory, appliedSequence);
+    printf("Create %s to promote this standby.\n", promoteFileName);
+
+    long long applyLag = -1;    // Microseconds between the last applied change being shipped and applied, -1 before the first
+    long long lastSave = currentTimeMicros();
+    long long lastStatus = 0;
+    int unsavedChanges = 0;
+    char *payload = NULL;
+    int payloadCapacity = 0;
+
+    while (1) {
+        // Apply every complete record currently in the log
+        ReplicationRecordHeader header;
+        fseek(log, appliedOffset, SEEK_SET);
+        while (fread(&header, sizeof(header), 1, log) == 1) {
+            if (header.payloadSize < 0) {
+                printf("Error: Corrupt replication record after sequence %lld.\n", appliedSequence);
+                free(payload);
+                fclose(log);
+                return 0;
+            }
+            if (header.payloadSize > payloadCapacity) {
+                char *grown = (char *) realloc(payload, header.payloadSize);
+                if (grown == NULL) {
+                    printf("Error: Memory allocation failed for replication payload.\n");
+                    free(payload);
+                    fclose(log);
+                    return 0;
+                }
+                payload = grown;
+                payloadCapacity = header.payloadSize;
+            }
+            if (fread(payload, 1, header.payloadSize, log) != (size_t) header.payloadSize) {
+                break;  // The primary is still writing this record
+            }
+
+            if (header.sequence > appliedSequence) {
+                if (!applyReplicatedMutation(&header, payload)) {
+                    printf("Warning: Could not apply change %lld (operation %d).\n", header.sequence, header.operation);
+                }
+                appliedSequence = header.sequence;
+                applyLag = currentTimeMicros() - header.commitTime;
+                unsavedChanges = 1;
+            }
+            appliedOffset = ftell(log);
+        }
+        clearerr(log);
+
+        long long now = currentTimeMicros();
+
+        // Persist applied changes together with the log position they correspond to
+        if (unsavedChanges && now - lastSave >= REPL_SAVE_INTERVAL_MS * 1000LL) {
+            if (writeDataFiles()) {
+                if (!writeReplicationPosition(positionFileName, appliedOffset, appliedSequence)) {
+                    printf("Warning: Failed to save the replication position at sequence %lld.\n", appliedSequence);
+                }
+                unsavedChanges = 0;
+            }
+            lastSave = now;
+        }
+
+        // Report replication lag once per second: the bytes not yet applied, and how long the last change
+        // applied took from being shipped, which stays put while the primary is idle
+        if (now - lastStatus >= 1000000LL) {
+            fseek(log, 0, SEEK_END);
+            long shippedBytes = ftell(log);
+            if (applyLag >= 0) {
+                printf("Applied sequence %lld, %ld bytes behind, last change applied %.1f ms after it was shipped\n",
+                       appliedSequence, shippedBytes - appliedOffset, (double) applyLag / 1000.0);
+            } else {
+                printf("Applied sequence %lld, %ld bytes behind\n", appliedSequence, shippedBytes - appliedOffset);
+            }
+            fflush(stdout);
+            lastStatus = now;
+        }
+
+        // Promote when the trigger file appears
+        FILE *promoteFile = fopen(promoteFileName, "r");
+        if (promoteFile != NULL) {
+            fclose(promoteFile);
+            remove(promoteFileName);
+            break;
+        }
+
+        struct timespec pause = {0, REPL_POLL_INTERVAL_MS * 1000000L};
+        nanosleep(&pause, NULL);
+    }
+
+    free(payload);
+    fclose(log);
+
+    // Final save so the promoted data directory matches everything applied
+    writeDataFiles();
+    remove(positionFileName);
+    printf("Standby promoted at sequence %lld. Now serving from %s.\n", appliedSequence, dataDirectory);
+    return 1;
+}
+
+//Save how far a standby has applied the log. The position is written under a temporary name, synced and renamed
+//into place, so a crash leaves the old position or the new one. Returns 0 on error
+int writeReplicationPosition(const char *fileName, long appliedOffset, long long appliedSequence) {
+    char tempFileName[MAX_FILENAME_LENGTH + 4];
+    snprintf(tempFileName, sizeof(tempFileName), "%s.tmp", fileName);
+    FILE *positionFile = fopen(tempFileName, "wb");
+    if (positionFile == NULL) {
+        return 0;
+    }
+
+    int written = fwrite(&appliedOffset, sizeof(appliedOffset), 1, positionFile) == 1 &&
+                  fwrite(&appliedSequence, sizeof(appliedSequence), 1, positionFile) == 1 &&
+                  fflush(positionFile) == 0 && fsync(fileno(positionFile)) == 0;
+    written = fclose(positionFile) == 0 && written;
+    if (!written || rename(tempFileName, fileName) != 0) {
+        remove(tempFileName);
+        return 0;
+    }
+    return syncParentDirectory(fileName);
+}
+
+//Apply one record from the replication log to the local store
+int applyReplicatedMutation(const ReplicationRecordHeader *header, const void *payload) {
+    switch (header->operation) {
+        case REPL_ADMIT_PATIENT: {
+            if (header->payloadSize != (int) (sizeof(Patient) - sizeof(Patient *))) {
+                return 0;
+            }
+            Patient record;
+            memcpy(&record, payload, sizeof(Patient) - sizeof(Patient *));
+
+            Patient *newPatient = createPatient(record.patientID, record.patientName, record.patientAge,
+                                                record.patientDiagnosis, record.patientRoomNum);
+            if (newPatient == NULL) {
+                return 0;
+            }
+            strcpy(newPatient->admissionDate, record.admissionDate);
+
+            if (admitPatient(newPatient) != STORE_OK) {
+                free(newPatient);
+                return 0;
+            }
+            return 1;
+        }
+        case REPL_DISCHARGE_PATIENT: {
+            if (header->payloadSize != (int) sizeof(ReplicatedDischarge)) {
+                return 0;
+            }
+            const ReplicatedDischarge *discharge = (const ReplicatedDischarge *) payload;
+            return dischargePatientOn(discharge->patientID, discharge->dischargeDate) == STORE_OK;
+        }
+        case REPL_ADD_DOCTOR: {
+            if (header->payloadSize != (int) (sizeof(Doctor) - sizeof(Doctor *))) {
+                return 0;
+            }
+            Doctor record;
+            memcpy(&record, payload, sizeof(Doctor) - sizeof(Doctor *));
+
+            Doctor *newDoctor = createDoctor(record.doctorID, record.doctorName);
+            if (newDoctor == NULL) {
+                return 0;
+            }
+            if (registerDoctor(newDoctor) != STORE_OK) {
+                free(newDoctor);
+                return 0;
+            }
+            return 1;
+        }
+        case REPL_ASSIGN_SHIFT: {
+            if (header->payloadSize != (int) sizeof(ReplicatedShift)) {
+                return 0;
+            }
+            const ReplicatedShift *shift = (const ReplicatedShift *) payload;
+            return assignShift(shift->doctorID, shift->day, shift->shift) == STORE_OK;
+        }
+        case REPL_UNASSIGN_SHIFT: {
+            if (header->payloadSize != (int) sizeof(ReplicatedShift)) {
+                return 0;
+            }
+            const ReplicatedShift *shift = (const ReplicatedShift *) payload;
+            return unassignShift(shift->doctorID, shift->day, shift->shift) == STORE_OK;
+        }
+        case REPL_SET_ROOM_CAPACITY: {
+            if (header->payloadSize != (int) sizeof(RoomCapacityRecord)) {
+                return 0;
+            }
+            const RoomCapacityRecord *room = (const RoomCapacityRecord *) payload;
+            return setRoomCapacity(room->room, room->capacity) == STORE_OK;
+        }
+        case REPL_SCHEDULE_BATCH: {
+            if (header->payloadSize % (int) sizeof(ScheduleChange) != 0) {
+                return 0;
+            }
+            int failedChange;
+            return applyScheduleChanges((const ScheduleChange *) payload, header->payloadSize / sizeof(ScheduleChange),
+                                        &failedChange) == STORE_OK;
+        }
+        default:
+            return 0;
+    }
+}
+
+//Return the current wall-clock time in microseconds
+long long currentTimeMicros() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (long long) now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+//Get current date and time as a formatted string. Uses localtime_r, as writers and report threads call it concurrently
+void getCurrentDateTime(char *dateTime, int bufferSize) {
+    time_t now = time(NULL);
+    struct tm parts;
+    strftime(dateTime, bufferSize, "%Y-%m-%d %H:%M:%S", localtime_r(&now, &parts));
+}
+
+//Get current date and time formatted for use in a filename (spaces and colons become underscores)
+void getFileTimestamp(char *timestamp, int bufferSize) {
+    time_t now = time(NULL);
+    struct tm parts;
+    strftime(timestamp, bufferSize, "%Y-%m-%d_%H_%M_%S", localtime_r(&now, &parts));
+}
+
+//Add a new patient to the system. Collects patient information and creates a new patient record
+void addPatient() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Add Patient");
+
+    int patientID;
+    char patientName[50];
+    int patientAge;
+    char patientDiag[250];
+    int patientRoomNum;
+
+    // Get patient ID with validation
+    printf("\nEnter the patient ID (positive number): ");
+    patientID = scanInt();
+
+    if (patientID <= 0) {
+        printf("The patient ID must be a positive number!\n");
+        returnToMenu();
+        return;
+    }
+
+    // Check if patient ID already exists
+    PatientShard *shard = shardForPatient(patientID);
+    pthread_rwlock_rdlock(&shard->lock);
+    int idTaken = findPatientByID(patientID) != NULL;
+    pthread_rwlock_unlock(&shard->lock);
+
+    if (idTaken) {
+        printf("The patient ID already exists!\n");
+        returnToMenu();
+        return;
+    }
+
+    // Get patient name
+    printf("Enter the patient name: ");
+    fgets(patientName, sizeof(patientName), stdin);
+    patientName[strcspn(patientName, "\n")] = 0;  // Remove newline
 
     // Get patient age with validation
     printf("Enter the patient age: ");
@@ -878,11 +2943,21 @@ void addPatient() {
     fgets(patientDiag, sizeof(patientDiag), stdin);
     patientDiag[strcspn(patientDiag, "\n")] = 0;  // Remove newline
 
-    // Get room number with validation
-    printf("Enter the patient room number to assign (positive number): ");
+    // Offer the best free room; the clerk can take it or name another
+    int freeBeds;
+    int bestRoom = proposeRoom(&freeBeds);
+    if (bestRoom > 0) {
+        printf("Best free room: %d (%d of %d beds free)\n", bestRoom, freeBeds, atomic_load(&roomCapacity[bestRoom]));
+    } else {
+        printf("Every room is full.\n");
+    }
+
+    // Get room number with validation. 0 leaves the choice to admitPatient, which takes the best room at that moment
+    printf("Enter the patient room number to assign (0 = best free room): ");
     patientRoomNum = scanInt();
 
-    if (patientRoomNum <= 0 || !isRoomAvailable(patientRoomNum)) {
+    if (patientRoomNum < 0 || (patientRoomNum == 0 && bestRoom == 0) ||
+        (patientRoomNum > 0 && !isRoomAvailable(patientRoomNum))) {
         printf("Room number invalid or room is full!\n");
         returnToMenu();
         return;
@@ -896,20 +2971,22 @@ void addPatient() {
         return;
     }
 
-    // Add the new patient to the linked list
-    if (patientHead == NULL) {
-        patientHead = newPatient;
-    } else {
-        Patient *current = patientHead;
-        while (current->next != NULL) {
-            current = current->next;
+    // Add the new patient to the store. The ID and room are checked again under the write lock
+    int result = admitPatient(newPatient);
+    if (result != STORE_OK) {
+        if (result == STORE_DUPLICATE_ID) {
+            printf("The patient ID already exists!\n");
+        } else if (result == STORE_OUT_OF_MEMORY) {
+            printf("Failed to create patient record!\n");
+        } else {
+            printf("Room number invalid or room is full!\n");
         }
-        current->next = newPatient;
+        free(newPatient);
+        returnToMenu();
+        return;
     }
 
-    totalPatientsActive++;
-    totalPatients++;
-    printf("Patient record added successfully!\n");
+    printf("Patient record added successfully to room %d!\n", newPatient->patientRoomNum);
 
     // Save the updated data
     saveData();
@@ -918,40 +2995,225 @@ void addPatient() {
 }
 
 
- //Display all active patients in the system
+ //Display all active patients in the system, one page at a time
 void viewPatients() {
-    printf("\e[1;1H\e[2J");  // Clear the screen
-    printHeader("View All Patients");
-
     if (totalPatientsActive == 0) {
+        printf("\e[1;1H\e[2J");  // Clear the screen
+        printHeader("View All Patients");
+        printStartupLoadProgress();
         printf("No patients in the system.\n");
         returnToMenu();
         return;
     }
 
-    // Print table header
-    printf("%-10s%-25s%-10s%-30s%-15s%-30s%-10s\n",
-           "ID", "Name", "Age", "Diagnosis", "Room Number", "Admission Date", "Status");
-    printf(
-        "-------------------------------------------------------------------------------------------------------------------------------\n");
+    PatientFilter filter;
+    initializePatientFilter(&filter);
+    filter.status = 1;
 
-    // Print each active patient's details
-    Patient *current = patientHead;
-    while (current != NULL) {
-        if (current->isActive) {
-            printf("%-10d%-25s%-10d%-30s%-15d%-30s%-10s\n",
-               current->patientID,
-               current->patientName,
-               current->patientAge,
-               current->patientDiagnosis,
-               current->patientRoomNum,
-               current->admissionDate,
-               "Active");
+    PatientCursor cursor;
+    if (!openPatientCursor(&cursor, &filter)) {
+        printf("Error: Memory allocation failed for the patient listing.\n");
+        returnToMenu();
+        return;
+    }
+
+    ReportBuffer page;
+    memset(&page, 0, sizeof(page));
+    int pageSize = PATIENT_PAGE_SIZE;
+    int pageNumber = 0;
+    char command[16];
+
+    while (1) {
+        int pageCount = cursor.total == 0 ? 1 : (cursor.total + pageSize - 1) / pageSize;
+        if (pageNumber >= pageCount) {
+            pageNumber = pageCount - 1;
+        }
+
+        // Build the whole screen in one buffer so it reaches the terminal in a single write
+        page.length = 0;
+        reportBufferAppend(&page, "\e[1;1H\e[2J");  // Clear the screen
+        renderHeader(&page, "View All Patients");
+        reportBufferAppend(&page, "%-10s%-25s%-10s%-30s%-15s%-30s%-10s\n",
+                           "ID", "Name", "Age", "Diagnosis", "Room Number", "Admission Date", "Status");
+        reportBufferAppend(&page,
+            "-------------------------------------------------------------------------------------------------------------------------------\n");
+        renderPatientPage(&cursor, pageNumber * pageSize, pageSize, &page);
+        reportBufferAppend(&page, "\nPage %d of %d, %d patients\n", pageNumber + 1, pageCount, cursor.total);
+        if (atomic_load(&startupLoadPhase) < LOAD_COMPLETE) {
+            reportBufferAppend(&page, "Still loading: the list has the patients read when it was opened.\n");
+        }
+
+        fflush(stdout);
+        if (page.failed || !writeToTerminal(page.data, page.length)) {
+            printf("Error: Unable to display the patient listing.\n");
+            break;
+        }
+
+        printf("\nEnter = next page (returns after the last), p = previous, j = jump, s = page size, q = quit: ");
+        if (fgets(command, sizeof(command), stdin) == NULL) {
+            break;
+        }
+        if (strchr(command, '\n') == NULL) {
+            clearInputBuffer();     // Discard the rest of an overlong line
+        }
+
+        char action = command[0] == '\n' ? 'n' : command[0];
+        if (action == 'q') {
+            break;
+        } else if (action == 'n') {
+            if (pageNumber == pageCount - 1) {
+                if (command[0] == '\n') {
+                    break;
+                }
+            } else {
+                pageNumber++;
+            }
+        } else if (action == 'p') {
+            if (pageNumber > 0) {
+                pageNumber--;
+            }
+        } else if (action == 'j') {
+            printf("Page number (1-%d): ", pageCount);
+            int target = scanInt();
+            if (target >= 1 && target <= pageCount) {
+                pageNumber = target - 1;
+            }
+        } else if (action == 's') {
+            printf("Patients per page (1-%d): ", MAX_PATIENT_PAGE_SIZE);
+            int newSize = scanInt();
+            if (newSize >= 1 && newSize <= MAX_PATIENT_PAGE_SIZE) {
+                // Stay on the page holding the first patient currently shown
+                pageNumber = pageNumber * pageSize / newSize;
+                pageSize = newSize;
+            }
         }
-        current = current->next;
     }
 
-    returnToMenu();
+    reportBufferRelease(&page);
+    closePatientCursor(&cursor);
+}
+
+//Select the patients matching a filter in every shard for a paged listing. Returns 0 if memory runs out
+int openPatientCursor(PatientCursor *cursor, const PatientFilter *filter) {
+    memset(cursor, 0, sizeof(PatientCursor));
+
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        PatientShard *shard = &patientShards[s];
+        pthread_rwlock_rdlock(&shard->lock);
+
+        int words = selectionWords(shard->count);
+        cursor->selections[s] = (unsigned long long *) malloc((words + 1) * sizeof(unsigned long long));
+        if (cursor->selections[s] == NULL) {
+            pthread_rwlock_unlock(&shard->lock);
+            closePatientCursor(cursor);
+            return 0;
+        }
+        cursor->shardRows[s] = shard->count;
+        cursor->shardSelected[s] = selectPatientsInShard(shard, filter, cursor->selections[s]);
+        cursor->total += cursor->shardSelected[s];
+
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return 1;
+}
+
+//Render up to count selected patients starting at position first of a cursor. Returns the number rendered
+int renderPatientPage(const PatientCursor *cursor, int first, int count, ReportBuffer *page) {
+    int skip = first;
+    int rendered = 0;
+
+    for (int s = 0; s < PATIENT_SHARD_COUNT && rendered < count; s++) {
+        // Whole shards before the page are skipped by their selected counts
+        if (skip >= cursor->shardSelected[s]) {
+            skip -= cursor->shardSelected[s];
+            continue;
+        }
+
+        PatientShard *shard = &patientShards[s];
+        pthread_rwlock_rdlock(&shard->lock);
+
+        const unsigned long long *selection = cursor->selections[s];
+        int words = selectionWords(cursor->shardRows[s]);
+        for (int w = 0; w < words && rendered < count; w++) {
+            unsigned long long word = selection[w];
+
+            // Then whole words, by their population counts, and finally single bits
+            int bits = __builtin_popcountll(word);
+            if (skip >= bits) {
+                skip -= bits;
+                continue;
+            }
+            for (; skip > 0; skip--) {
+                word &= word - 1;
+            }
+
+            for (; word != 0 && rendered < count; word &= word - 1) {
+                renderPatientListRow(page, shard->rows[w * 64 + __builtin_ctzll(word)]);
+                rendered++;
+            }
+        }
+
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return rendered;
+}
+
+//Free the selections of a cursor
+void closePatientCursor(PatientCursor *cursor) {
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        free(cursor->selections[s]);
+        cursor->selections[s] = NULL;
+    }
+}
+
+//Render one row of the patient listing. Produces the same text as the listing's former printf
+void renderPatientListRow(ReportBuffer *buffer, const Patient *patient) {
+    reportBufferPutInt(buffer, patient->patientID, 10);
+    reportBufferPutString(buffer, patient->patientName, 25);
+    reportBufferPutInt(buffer, patient->patientAge, 10);
+    reportBufferPutString(buffer, patient->patientDiagnosis, 30);
+    reportBufferPutInt(buffer, patient->patientRoomNum, 15);
+    reportBufferPutString(buffer, patient->admissionDate, 30);
+    reportBufferPutString(buffer, patient->isActive ? "Active" : "Discharged", 10);
+    if (reportBufferReserve(buffer, 1)) {
+        buffer->data[buffer->length++] = '\n';
+    }
+}
+
+//Render a header framed like printHeader into a buffer
+void renderHeader(ReportBuffer *buffer, const char *title) {
+    int len = strlen(title);
+    if (!reportBufferReserve(buffer, 3 * (size_t) len + 20)) {
+        return;
+    }
+
+    char *out = buffer->data + buffer->length;
+    *out++ = '\n';
+    memset(out, '=', len + 4);
+    out += len + 4;
+    out += sprintf(out, "\n= %s =\n", title);
+    memset(out, '=', len + 4);
+    out += len + 4;
+    memcpy(out, "\n\n", 2);
+    out += 2;
+    buffer->length = out - buffer->data;
+}
+
+//Write bytes straight to standard output, bypassing stdio. Returns 0 on error
+int writeToTerminal(const char *data, size_t length) {
+    // One write covers a whole page; the loop only matters if the terminal takes less than that
+    while (length > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+    return 1;
 }
 
 //Search for a patient by ID. Displays the patient's details if found
@@ -963,10 +3225,25 @@ void searchPatient() {
     printf("Enter the patient ID: ");
     patientID = scanInt();
 
-    // Find and display patient
-    Patient *patient = findPatientByID(patientID);
+    // Find the patient in the store, or else in the archive. While --lazy is still loading, patients.dat
+    // itself is read for patients not in the store yet
+    long long started = latencyStart();
+    PatientShard *shard = shardForPatient(patientID);
+    pthread_rwlock_rdlock(&shard->lock);
+    Patient *stored = findPatientByID(patientID);
+    Patient patient;
+    int found = stored != NULL;
+    if (found) {
+        patient = *stored;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    if (!found && atomic_load(&startupLoadPhase) < LOAD_COMPLETE) {
+        found = findUnloadedPatient(patientID, &patient);
+    }
+    int archived = !found && findArchivedPatient(patientID, &patient);
+    latencyRecord(LATENCY_SEARCH, started, found || archived);
 
-    if (patient == NULL) {
+    if (!found && !archived) {
         printf("The patient is not found!\n");
     } else {
         printf("\nPatient Details:\n");
@@ -974,547 +3251,5487 @@ void searchPatient() {
         printf(
             "--------------------------------------------------------------------------------------------------------\n");
         printf("%-10d%-25s%-10d%-30s%-15d%-20s\n",
-               patient->patientID,
-               patient->patientName,
-               patient->patientAge,
-               patient->patientDiagnosis,
-               patient->patientRoomNum,
-               patient->admissionDate);
+               patient.patientID,
+               patient.patientName,
+               patient.patientAge,
+               patient.patientDiagnosis,
+               patient.patientRoomNum,
+               patient.admissionDate);
+        if (!patient.isActive) {
+            printf("\nDischarged on %s%s\n", patient.dischargeDate, archived ? " (archived)" : "");
+        }
     }
 
     returnToMenu();
 }
 
-//Discharge a patient. Sets the patient's status to inactive and records discharge date
-void dischargePatient() {
+//Find patients matching a combination of conditions. A zero or empty answer leaves that condition out
+void queryPatients() {
     printf("\e[1;1H\e[2J");  // Clear the screen
-    printHeader("Discharge Patient");
+    printHeader("Query Patients");
 
-    if (totalPatientsActive == 0) {
-        printf("No patients in the system.\n");
+    PatientQuery query;
+    memset(&query, 0, sizeof(query));
+    initializePatientFilter(&query.filter);
+
+    printf("Status (1 = active, 2 = discharged, 3 = any): ");
+    int status = scanInt();
+    if (status < 1 || status > 3) {
+        printf("The status is invalid!\n");
         returnToMenu();
         return;
     }
+    query.filter.status = status == 1 ? 1 : (status == 2 ? 0 : FILTER_STATUS_ANY);
+
+    printf("Minimum age (0 for no minimum): ");
+    int minAge = scanInt();
+    printf("Maximum age (0 for no maximum): ");
+    int maxAge = scanInt();
+    if (minAge < 0 || maxAge < 0 || (maxAge > 0 && maxAge < minAge)) {
+        printf("The age range is invalid!\n");
+        returnToMenu();
+        return;
+    }
+    if (minAge > 0) {
+        query.filter.minAge = minAge;
+    }
+    if (maxAge > 0) {
+        query.filter.maxAge = maxAge;
+    }
 
-    int patientID;
-    printf("Enter the patient ID to discharge: ");
-    patientID = scanInt();
+    printf("Lowest room number (0 for no limit): ");
+    int minRoom = scanInt();
+    printf("Highest room number (0 for no limit): ");
+    int maxRoom = scanInt();
+    if (minRoom < 0 || maxRoom < 0 || minRoom > MAX_ROOM_NUMBER || maxRoom > MAX_ROOM_NUMBER ||
+        (maxRoom > 0 && maxRoom < minRoom)) {
+        printf("The room range is invalid!\n");
+        returnToMenu();
+        return;
+    }
+    if (minRoom > 0 || maxRoom > 0) {
+        query.filter.minRoom = minRoom > 0 ? minRoom : 1;
+        query.filter.maxRoom = maxRoom > 0 ? maxRoom : MAX_ROOM_NUMBER;
+    }
 
-    // Find the patient
-    Patient *patient = findPatientByID(patientID);
+    printf("Diagnosis keyword (Enter for any): ");
+    fgets(query.keyword, sizeof(query.keyword), stdin);
+    query.keyword[strcspn(query.keyword, "\n")] = 0;  // Remove newline
 
-    if (patient == NULL) {
-        printf("The patient is not found!\n");
+    char date[32];
+    printf("Admitted on or after (YYYY-MM-DD, Enter for no limit): ");
+    fgets(date, sizeof(date), stdin);
+    date[strcspn(date, "\n")] = 0;
+    if (date[0] != '\0' && !parseQueryDate(date, 0, &query.filter.admittedFrom)) {
+        printf("The date is invalid!\n");
+        returnToMenu();
+        return;
+    }
+    printf("Admitted on or before (YYYY-MM-DD, Enter for no limit): ");
+    fgets(date, sizeof(date), stdin);
+    date[strcspn(date, "\n")] = 0;
+    if (date[0] != '\0' && !parseQueryDate(date, 1, &query.filter.admittedTo)) {
+        printf("The date is invalid!\n");
         returnToMenu();
         return;
     }
 
-    // Check if already discharged
-    if (patient->isActive == 0) {
-        printf("This patient has already been discharged!\n");
+    printf("Sort by (1 = ID, 2 = age, 3 = room, 4 = admission date): ");
+    query.sortKey = scanInt();
+    if (query.sortKey < QUERY_SORT_ID || query.sortKey > QUERY_SORT_ADMISSION) {
+        printf("The sort order is invalid!\n");
         returnToMenu();
         return;
     }
 
-    // Set discharge date and mark as inactive
-    getCurrentDateTime(patient->dischargeDate, sizeof(patient->dischargeDate));
-    patient->isActive = 0;
-    totalPatientsActive--;
+    printf("Most patients to show (0 for all): ");
+    query.limit = scanInt();
+    if (query.limit < 0) {
+        printf("The limit is invalid!\n");
+        returnToMenu();
+        return;
+    }
 
-    // Free up the room
-    patient->patientRoomNum = 0;
+    QueryResult result;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long started = latencyStart();
+    int success = runPatientQuery(&query, &result);
+    latencyRecord(LATENCY_QUERY, started, success);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (!success) {
+        printf("Error: Memory allocation failed for the query.\n");
+        returnToMenu();
+        return;
+    }
 
-    printf("Patient discharged successfully!\n");
-    saveData();
-    returnToMenu();
-}
+    const char *planNames[] = {"", "column scan", "room index", "admission index"};
+    printf("\nPlan: %s, %d rows examined, %d matches in %.2f ms\n", planNames[result.plan], result.examined,
+           result.matches, (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    if (result.archived > 0) {
+        printf("%d archived records read for discharged patients.\n", result.archived);
+    }
+    if (result.count < result.matches) {
+        printf("Showing the first %d.\n", result.count);
+    }
+    printf("\n");
 
-//Find a patient by ID
+    printf("%-10s%-25s%-10s%-30s%-15s%-30s%-10s\n",
+           "ID", "Name", "Age", "Diagnosis", "Room Number", "Admission Date", "Status");
+    printf(
+        "-------------------------------------------------------------------------------------------------------------------------------\n");
+
+    // Look each patient up again for display, in the store and then in the archive; one discharged since the query still shows
+    for (int i = 0; i < result.count; i++) {
+        PatientShard *shard = shardForPatient(result.rows[i].patientID);
+        pthread_rwlock_rdlock(&shard->lock);
+        Patient *stored = findPatientByID(result.rows[i].patientID);
+        Patient current;
+        int found = stored != NULL;
+        if (found) {
+            current = *stored;
+        }
+        pthread_rwlock_unlock(&shard->lock);
+
+        if (found || findArchivedPatient(result.rows[i].patientID, &current)) {
+            printf("%-10d%-25s%-10d%-30s%-15d%-30s%-10s\n",
+                   current.patientID,
+                   current.patientName,
+                   current.patientAge,
+                   current.patientDiagnosis,
+                   current.patientRoomNum,
+                   current.admissionDate,
+                   current.isActive ? "Active" : "Discharged");
+        }
+    }
+
+    freeQueryResult(&result);
+    returnToMenu();
+}
+
+//Convert a "YYYY-MM-DD" date to minutes since 1970-01-01, at the start or the end of the day. Returns 0 if invalid
+int parseQueryDate(const char *text, int endOfDay, int *minute) {
+    char dateTime[20];
+    if (strlen(text) != 10) {
+        return 0;
+    }
+    snprintf(dateTime, sizeof(dateTime), "%s %s", text, endOfDay ? "23:59:59" : "00:00:00");
+
+    long long seconds = dateTimeToSeconds(dateTime);
+    if (seconds == 0) {
+        return 0;
+    }
+    *minute = (int) (seconds / 60);
+    return 1;
+}
+
+//Discharge a patient. Sets the patient's status to inactive and records discharge date
+void dischargePatient() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Discharge Patient");
+
+    if (totalPatientsActive == 0) {
+        printf("No patients in the system.\n");
+        returnToMenu();
+        return;
+    }
+
+    int patientID;
+    printf("Enter the patient ID to discharge: ");
+    patientID = scanInt();
+
+    // Discharge the patient
+    int result = dischargePatientByID(patientID);
+
+    if (result == STORE_NOT_FOUND) {
+        printf("The patient is not found!\n");
+        returnToMenu();
+        return;
+    }
+
+    // Check if already discharged
+    if (result == STORE_ALREADY_DISCHARGED) {
+        printf("This patient has already been discharged!\n");
+        returnToMenu();
+        return;
+    }
+
+    printf("Patient discharged successfully!\n");
+    saveData();
+    returnToMenu();
+}
+
+//Add a patient to the store, recording how long it took
+int admitPatient(Patient *newPatient) {
+    long long started = latencyStart();
+    int result = admitPatientUntimed(newPatient);
+    latencyRecord(LATENCY_ADMIT, started, result == STORE_OK);
+    return result;
+}
+
+//Add a patient to the store. Validates the ID and claims a bed under the shard write lock
+int admitPatientUntimed(Patient *newPatient) {
+    PatientShard *shard = shardForPatient(newPatient->patientID);
+    pthread_rwlock_wrlock(&shard->lock);
+
+    // Archived patients keep their IDs
+    if (findPatientByID(newPatient->patientID) != NULL || isPatientArchived(newPatient->patientID)) {
+        pthread_rwlock_unlock(&shard->lock);
+        return STORE_DUPLICATE_ID;
+    }
+
+    // Claim the bed before linking the record so admissions on other shards cannot overfill the room.
+    // Room 0 takes the best free room, which is then recorded on the patient and shipped with it
+    if (newPatient->patientRoomNum == 0) {
+        newPatient->patientRoomNum = reserveBestRoom();
+        if (newPatient->patientRoomNum == 0) {
+            pthread_rwlock_unlock(&shard->lock);
+            return STORE_ROOM_FULL;
+        }
+    } else if (!reserveRoomBed(newPatient->patientRoomNum)) {
+        pthread_rwlock_unlock(&shard->lock);
+        return STORE_ROOM_FULL;
+    }
+
+    if (!appendPatient(newPatient)) {
+        releaseRoomBed(newPatient->patientRoomNum);
+        pthread_rwlock_unlock(&shard->lock);
+        return STORE_OUT_OF_MEMORY;
+    }
+    totalPatientsActive++;
+    totalPatients++;
+    atomic_fetch_add(&hospitalStats.admissions, 1);
+    atomic_fetch_add(&hospitalStats.activeByAgeGroup[ageGroupOf(newPatient->patientAge)], 1);
+    shipMutation(REPL_ADMIT_PATIENT, newPatient, sizeof(Patient) - sizeof(Patient *));
+
+    pthread_rwlock_unlock(&shard->lock);
+    return STORE_OK;
+}
+
+//Discharge a patient by ID as of the current date and time
+int dischargePatientByID(int id) {
+    char dischargeDate[20];
+    getCurrentDateTime(dischargeDate, sizeof(dischargeDate));
+    return dischargePatientOn(id, dischargeDate);
+}
+
+//Discharge a patient with a given discharge date, recording how long it took
+int dischargePatientOn(int id, const char *dischargeDate) {
+    long long started = latencyStart();
+    int result = dischargePatientOnUntimed(id, dischargeDate);
+    latencyRecord(LATENCY_DISCHARGE, started, result == STORE_OK);
+    return result;
+}
+
+//Discharge a patient with a given discharge date. Records the date and frees the room under the shard write lock
+int dischargePatientOnUntimed(int id, const char *dischargeDate) {
+    PatientShard *shard = shardForPatient(id);
+    pthread_rwlock_wrlock(&shard->lock);
+
+    int row = findPatientRow(shard, id);
+    if (row < 0) {
+        int archived = isPatientArchived(id);
+        pthread_rwlock_unlock(&shard->lock);
+        return archived ? STORE_ALREADY_DISCHARGED : STORE_NOT_FOUND;
+    }
+
+    Patient *patient = shard->rows[row];
+    if (patient->isActive == 0) {
+        pthread_rwlock_unlock(&shard->lock);
+        return STORE_ALREADY_DISCHARGED;
+    }
+
+    // Set discharge date and mark as inactive
+    strncpy(patient->dischargeDate, dischargeDate, sizeof(patient->dischargeDate) - 1);
+    patient->dischargeDate[sizeof(patient->dischargeDate) - 1] = '\0';
+    patient->isActive = 0;
+    shard->active[row] = 0;
+    totalPatientsActive--;
+    atomic_fetch_add(&hospitalStats.discharges, 1);
+    atomic_fetch_sub(&hospitalStats.activeByAgeGroup[ageGroupOf(patient->patientAge)], 1);
+    recordStay(patient);
+
+    // Free up the bed. The room number stays on the record for length of stay reporting
+    releaseRoomBed(patient->patientRoomNum);
+
+    // Ship while still holding the shard lock so the log orders changes to the same patient
+    ReplicatedDischarge discharge;
+    memset(&discharge, 0, sizeof(discharge));
+    discharge.patientID = id;
+    strcpy(discharge.dischargeDate, patient->dischargeDate);
+    shipMutation(REPL_DISCHARGE_PATIENT, &discharge, sizeof(discharge));
+
+    pthread_rwlock_unlock(&shard->lock);
+    return STORE_OK;
+}
+
+//Add a patient read from a data file to its shard and update the counters. Caller must hold all shard write locks
+void addLoadedPatient(Patient *newPatient) {
+    // A save that stopped after archiving leaves discharged records in patients.dat too; the archive has their stays
+    if (!newPatient->isActive && isPatientArchived(newPatient->patientID)) {
+        free(newPatient);
+        return;
+    }
+
+    if (!appendPatient(newPatient)) {
+        printf("Failed to index patient record for ID: %d\n", newPatient->patientID);
+        free(newPatient);
+        return;
+    }
+
+    totalPatients++;
+    if (newPatient->isActive) {
+        totalPatientsActive++;
+        atomic_fetch_add(&hospitalStats.activeByAgeGroup[ageGroupOf(newPatient->patientAge)], 1);
+
+        // Loaded data is trusted as-is, so the bed is counted even if the room is over capacity
+        int roomNum = newPatient->patientRoomNum;
+        if (roomNum > 0 && roomNum <= MAX_ROOM_NUMBER) {
+            pthread_mutex_lock(&roomBedLock);
+            int freeBefore = roomFreeBeds(roomNum);
+            int before = atomic_fetch_add(&roomOccupancy[roomNum], 1);
+            noteRoomOccupancyChange(atomic_load(&roomCapacity[roomNum]), before, before + 1);
+            updateRoomBeds(roomNum, freeBefore);
+            pthread_mutex_unlock(&roomBedLock);
+        }
+    } else {
+        recordStay(newPatient);
+    }
+}
+
+//Append a patient to the end of its shard's list, columns and index. Caller must hold the shard write lock
+int appendPatient(Patient *newPatient) {
+    PatientShard *shard = shardForPatient(newPatient->patientID);
+    int row = shard->count;
+
+    if (row == shard->rowCapacity && !growShardColumns(shard)) {
+        return 0;
+    }
+    if (!shardIndexInsert(shard, newPatient->patientID, row)) {
+        return 0;
+    }
+
+    shard->rows[row] = newPatient;
+    shard->ids[row] = newPatient->patientID;
+    shard->ages[row] = newPatient->patientAge;
+    shard->rooms[row] = newPatient->patientRoomNum;
+    shard->active[row] = newPatient->isActive != 0;
+    shard->admitted[row] = admissionMinute(newPatient->admissionDate);
+
+    newPatient->next = NULL;
+    if (shard->head == NULL) {
+        shard->head = newPatient;
+    } else {
+        shard->tail->next = newPatient;
+    }
+    shard->tail = newPatient;
+    shard->count++;
+
+    indexPatientForQueries(newPatient);
+    return 1;
+}
+
+//Find a patient by ID using its shard's hash index. Caller must hold the shard lock
 Patient *findPatientByID(int id) {
-    Patient *current = patientHead;
-    while (current != NULL) {
-        if (current->patientID == id) {
-            return current;
+    PatientShard *shard = shardForPatient(id);
+    int row = findPatientRow(shard, id);
+    return row >= 0 ? shard->rows[row] : NULL;
+}
+
+//Find the row of a patient in a shard using its hash index. Returns -1 if not found. Caller must hold the shard lock
+int findPatientRow(PatientShard *shard, int id) {
+    if (shard->index == NULL) {
+        return -1;
+    }
+
+    // Linear probing: stop at the first empty slot
+    unsigned int mask = (unsigned int) shard->indexCapacity - 1;
+    unsigned int slot = hashPatientID(id) & mask;
+    while (shard->index[slot] != 0) {
+        int row = shard->index[slot] - 1;
+        if (shard->ids[row] == id) {
+            return row;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+//Move the discharged patients out of the shards into the archive. Returns the number moved, or -1 if the archive could not be written
+int archiveDischargedPatients() {
+    lockAllPatientShards(1);
+
+    int discharged = 0;
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        for (int row = 0; row < patientShards[s].count; row++) {
+            discharged += !patientShards[s].active[row];
+        }
+    }
+    if (discharged == 0) {
+        unlockAllPatientShards();
+        return 0;
+    }
+
+    // Order the patients by discharge month so each partition is opened once
+    ArchiveIndexEntry *entries = (ArchiveIndexEntry *) malloc(discharged * sizeof(ArchiveIndexEntry));
+    if (entries == NULL) {
+        unlockAllPatientShards();
+        return -1;
+    }
+    int count = 0;
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        for (int row = 0; row < patientShards[s].count; row++) {
+            if (!patientShards[s].active[row]) {
+                entries[count].patientID = patientShards[s].ids[row];
+                entries[count].month = archiveMonth(patientShards[s].rows[row]->dischargeDate);
+                entries[count].offset = 0;
+                count++;
+            }
+        }
+    }
+    qsort(entries, count, sizeof(ArchiveIndexEntry), compareArchiveEntries);
+
+    // The records go out before their index entries and the index has room for them first,
+    // so a failure at any step leaves the patients in the shards and at most unindexed bytes on disk.
+    // Both are synced, with the new files' directory entries, before the snapshot can drop the patients
+    pthread_mutex_lock(&archiveLock);
+    int archived = reserveArchiveIndex(&archiveIndex, count) &&
+                   writeArchivedPatients(entries, count) &&
+                   appendArchiveIndex(entries, count) &&
+                   syncDirectory(dataDirectory);
+    if (archived) {
+        for (int i = 0; i < count; i++) {
+            archiveIndexInsert(&archiveIndex, &entries[i]);
+        }
+    }
+    pthread_mutex_unlock(&archiveLock);
+    free(entries);
+
+    if (!archived) {
+        unlockAllPatientShards();
+        return -1;
+    }
+
+    // Drop the archived patients and index the remaining ones again
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        compactShard(&patientShards[s]);
+    }
+    totalPatients -= count;
+    resetQueryIndexes();
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        for (int row = 0; row < patientShards[s].count; row++) {
+            indexPatientForQueries(patientShards[s].rows[row]);
+        }
+    }
+
+    unlockAllPatientShards();
+    return count;
+}
+
+//Append the records of archived patients to their month partitions and sync them, filling in the offsets. Caller must hold every shard write lock and archiveLock
+int writeArchivedPatients(ArchiveIndexEntry *entries, int count) {
+    char fileName[MAX_FILENAME_LENGTH];
+    FILE *partition = NULL;
+    int success = 1;
+
+    for (int i = 0; i < count && success; i++) {
+        if (partition == NULL || entries[i].month != entries[i - 1].month) {
+            if (partition != NULL && !closeArchivePartition(partition)) {
+                partition = NULL;
+                success = 0;
+                break;
+            }
+            archivePartitionPath(fileName, entries[i].month);
+            partition = fopen(fileName, "ab");
+            if (partition == NULL || fseek(partition, 0, SEEK_END) != 0) {
+                success = 0;
+                break;
+            }
+        }
+
+        entries[i].offset = ftell(partition);
+        const Patient *patient = findPatientByID(entries[i].patientID);
+        success = entries[i].offset >= 0 && fwrite(patient, sizeof(Patient) - sizeof(Patient *), 1, partition) == 1;
+    }
+
+    if (partition != NULL && !closeArchivePartition(partition)) {
+        success = 0;
+    }
+    return success;
+}
+
+//Sync and close an archive partition. Returns 0 if any of it failed
+int closeArchivePartition(FILE *partition) {
+    int synced = fflush(partition) == 0 && fsync(fileno(partition)) == 0;
+    return fclose(partition) == 0 && synced;
+}
+
+//Append entries to archive.idx in one write, after the whole entries already there, and sync it. Caller must hold archiveLock
+int appendArchiveIndex(const ArchiveIndexEntry *entries, int count) {
+    char fileName[MAX_FILENAME_LENGTH];
+    dataFilePath(fileName, "archive.idx");
+
+    // A torn entry left by an earlier failed append is overwritten rather than kept in front of the new ones
+    FILE *indexFile = fopen(fileName, "r+b");
+    if (indexFile == NULL) {
+        indexFile = fopen(fileName, "wb");
+    }
+    if (indexFile == NULL) {
+        return 0;
+    }
+
+    int written = fseek(indexFile, (long) archiveIndex.count * (long) sizeof(ArchiveIndexEntry), SEEK_SET) == 0 &&
+                  fwrite(entries, sizeof(ArchiveIndexEntry), count, indexFile) == (size_t) count &&
+                  fflush(indexFile) == 0 && fsync(fileno(indexFile)) == 0;
+    written = fclose(indexFile) == 0 && written;
+    return written;
+}
+
+//Drop the discharged patients from a shard, keeping the others in order. Caller must hold the shard write lock
+void compactShard(PatientShard *shard) {
+    int rows = shard->count;
+    shard->count = 0;
+    shard->head = shard->tail = NULL;
+    if (shard->index != NULL) {
+        memset(shard->index, 0, shard->indexCapacity * sizeof(int));
+    }
+
+    for (int row = 0; row < rows; row++) {
+        Patient *patient = shard->rows[row];
+        if (!shard->active[row]) {
+            free(patient);
+            continue;
+        }
+
+        int kept = shard->count;
+        shard->rows[kept] = patient;
+        shard->ids[kept] = shard->ids[row];
+        shard->ages[kept] = shard->ages[row];
+        shard->rooms[kept] = shard->rooms[row];
+        shard->active[kept] = 1;
+        shard->admitted[kept] = shard->admitted[row];
+
+        // The table already held every row, so this insert never has to grow it
+        shardIndexInsert(shard, patient->patientID, kept);
+
+        patient->next = NULL;
+        if (shard->head == NULL) {
+            shard->head = patient;
+        } else {
+            shard->tail->next = patient;
+        }
+        shard->tail = patient;
+        shard->count++;
+    }
+}
+
+//Check whether a patient ID belongs to an archived patient
+int isPatientArchived(int id) {
+    pthread_mutex_lock(&archiveLock);
+    int found = findArchiveEntry(&archiveIndex, id) >= 0;
+    pthread_mutex_unlock(&archiveLock);
+    return found;
+}
+
+//Read an archived patient's record from its partition. Returns 0 if the patient is not archived or the record cannot be read
+int findArchivedPatient(int id, Patient *patient) {
+    pthread_mutex_lock(&archiveLock);
+    int i = findArchiveEntry(&archiveIndex, id);
+    ArchiveIndexEntry entry;
+    if (i >= 0) {
+        entry = archiveIndex.entries[i];
+    }
+    pthread_mutex_unlock(&archiveLock);
+    if (i < 0) {
+        return 0;
+    }
+
+    // Partitions are only appended to, so an indexed record can be read without the lock
+    char fileName[MAX_FILENAME_LENGTH];
+    archivePartitionPath(fileName, entry.month);
+    FILE *partition = fopen(fileName, "rb");
+    if (partition == NULL) {
+        return 0;
+    }
+    int found = fseek(partition, (long) entry.offset, SEEK_SET) == 0 && readExportedPatient(partition, patient) &&
+                patient->patientID == id;
+    fclose(partition);
+    return found;
+}
+
+//Return the number of archived patients
+int archivedPatientCount() {
+    pthread_mutex_lock(&archiveLock);
+    int count = archiveIndex.patients;
+    pthread_mutex_unlock(&archiveLock);
+    return count;
+}
+
+//Load the archive index from archive.idx and add the archived stays to the stay history
+void loadArchive() {
+    if (loadArchiveIndex()) {
+        loadArchivedStays();
+    }
+}
+
+//Load the archive index from archive.idx. Returns 0 if memory runs out
+int loadArchiveIndex() {
+    pthread_mutex_lock(&archiveLock);
+    freeArchiveIndex(&archiveIndex);
+    int loaded = readArchiveIndexFile(&archiveIndex);
+    pthread_mutex_unlock(&archiveLock);
+    if (!loaded) {
+        printf("Error: Memory allocation failed for the patient archive.\n");
+    }
+    return loaded;
+}
+
+//Read every archived record and add its stay to the stay history
+void loadArchivedStays() {
+    ArchiveCursor cursor;
+
+    pthread_mutex_lock(&archiveLock);
+    int opened = openArchiveCursor(&cursor, &archiveIndex, 0);
+    pthread_mutex_unlock(&archiveLock);
+    if (!opened) {
+        printf("Error: Memory allocation failed for the patient archive.\n");
+        return;
+    }
+
+    Patient patient;
+    while (readArchivedPatient(&cursor, &patient)) {
+        recordStay(&patient);
+    }
+    closeArchiveCursor(&cursor);
+}
+
+//Read archive.idx into an empty index. Stops at the first torn or invalid entry. Returns 0 if memory runs out
+int readArchiveIndexFile(ArchiveIndex *index) {
+    char fileName[MAX_FILENAME_LENGTH];
+    dataFilePath(fileName, "archive.idx");
+    FILE *indexFile = fopen(fileName, "rb");
+    if (indexFile == NULL) {
+        return 1;
+    }
+
+    ArchiveIndexEntry chunk[1024];
+    int success = 1;
+    size_t read;
+    while (success && (read = fread(chunk, sizeof(ArchiveIndexEntry), 1024, indexFile)) > 0) {
+        success = index->count + (int) read <= MAX_LOADED_RECORDS && reserveArchiveIndex(index, (int) read);
+        for (size_t i = 0; success && i < read; i++) {
+            if (chunk[i].patientID <= 0 || chunk[i].month < 0 || chunk[i].offset < 0) {
+                fclose(indexFile);
+                return 1;
+            }
+            archiveIndexInsert(index, &chunk[i]);
+        }
+    }
+    fclose(indexFile);
+    return success;
+}
+
+//Make room in an archive index for more entries, doubling the table when it would pass 70% full. Returns 0 if memory runs out
+int reserveArchiveIndex(ArchiveIndex *index, int extra) {
+    int needed = index->count + extra;
+    if (needed > index->capacity) {
+        int newCapacity = index->capacity == 0 ? ARCHIVE_INDEX_INITIAL_CAPACITY : index->capacity;
+        while (newCapacity < needed) {
+            newCapacity *= 2;
+        }
+        ArchiveIndexEntry *entries = (ArchiveIndexEntry *) realloc(index->entries,
+                                                                   newCapacity * sizeof(ArchiveIndexEntry));
+        if (entries == NULL) {
+            return 0;
+        }
+        index->entries = entries;
+        index->capacity = newCapacity;
+    }
+
+    if ((long long) needed * 10 > (long long) index->slotCapacity * 7) {
+        int newCapacity = index->slotCapacity == 0 ? ARCHIVE_INDEX_INITIAL_CAPACITY : index->slotCapacity;
+        while ((long long) needed * 10 > (long long) newCapacity * 7) {
+            newCapacity *= 2;
+        }
+        int *slots = (int *) calloc(newCapacity, sizeof(int));
+        if (slots == NULL) {
+            return 0;
+        }
+
+        // Rehash the existing entries into the larger table
+        unsigned int mask = (unsigned int) newCapacity - 1;
+        for (int i = 0; i < index->slotCapacity; i++) {
+            if (index->slots[i] != 0) {
+                unsigned int slot = hashPatientID(index->entries[index->slots[i] - 1].patientID) & mask;
+                while (slots[slot] != 0) {
+                    slot = (slot + 1) & mask;
+                }
+                slots[slot] = index->slots[i];
+            }
+        }
+
+        free(index->slots);
+        index->slots = slots;
+        index->slotCapacity = newCapacity;
+    }
+    return 1;
+}
+
+//Add an entry to an archive index whose room was reserved. An entry for an ID already there replaces it
+void archiveIndexInsert(ArchiveIndex *index, const ArchiveIndexEntry *entry) {
+    int i = index->count++;
+    index->entries[i] = *entry;
+
+    unsigned int mask = (unsigned int) index->slotCapacity - 1;
+    unsigned int slot = hashPatientID(entry->patientID) & mask;
+    while (index->slots[slot] != 0) {
+        if (index->entries[index->slots[slot] - 1].patientID == entry->patientID) {
+            index->slots[slot] = i + 1;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    index->slots[slot] = i + 1;
+    index->patients++;
+}
+
+//Find the current entry of a patient in an archive index. Returns -1 if the patient is not archived
+int findArchiveEntry(const ArchiveIndex *index, int id) {
+    if (index->slots == NULL) {
+        return -1;
+    }
+
+    // Linear probing: stop at the first empty slot
+    unsigned int mask = (unsigned int) index->slotCapacity - 1;
+    unsigned int slot = hashPatientID(id) & mask;
+    while (index->slots[slot] != 0) {
+        int i = index->slots[slot] - 1;
+        if (index->entries[i].patientID == id) {
+            return i;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+//Free an archive index and leave it empty
+void freeArchiveIndex(ArchiveIndex *index) {
+    free(index->entries);
+    free(index->slots);
+    memset(index, 0, sizeof(ArchiveIndex));
+}
+
+//Start reading the current archived records discharged in or after a month, plus the undated ones. Returns 0 if memory runs out
+int openArchiveCursor(ArchiveCursor *cursor, const ArchiveIndex *index, int fromMonth) {
+    memset(cursor, 0, sizeof(ArchiveCursor));
+    cursor->entries = (ArchiveIndexEntry *) malloc((index->count + 1) * sizeof(ArchiveIndexEntry));
+    if (cursor->entries == NULL) {
+        return 0;
+    }
+
+    // Entries replaced by a later one for the same patient are skipped
+    for (int i = 0; i < index->count; i++) {
+        const ArchiveIndexEntry *entry = &index->entries[i];
+        if ((entry->month == 0 || entry->month >= fromMonth) && findArchiveEntry(index, entry->patientID) == i) {
+            cursor->entries[cursor->count++] = *entry;
+        }
+    }
+    qsort(cursor->entries, cursor->count, sizeof(ArchiveIndexEntry), compareArchiveEntries);
+    return 1;
+}
+
+//Read the next archived record of a cursor. Records that cannot be read are skipped. Returns 0 after the last
+int readArchivedPatient(ArchiveCursor *cursor, Patient *patient) {
+    while (cursor->next < cursor->count) {
+        const ArchiveIndexEntry *entry = &cursor->entries[cursor->next++];
+        if (cursor->partition == NULL || entry->month != cursor->partitionMonth) {
+            char fileName[MAX_FILENAME_LENGTH];
+            if (cursor->partition != NULL) {
+                fclose(cursor->partition);
+            }
+            archivePartitionPath(fileName, entry->month);
+            cursor->partition = fopen(fileName, "rb");
+            cursor->partitionMonth = entry->month;
+        }
+
+        // Entries are in offset order, so the seeks only skip bytes a failed save left unindexed
+        if (cursor->partition != NULL && fseek(cursor->partition, (long) entry->offset, SEEK_SET) == 0 &&
+            readExportedPatient(cursor->partition, patient) && patient->patientID == entry->patientID) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//Close a cursor's partition and free its entries
+void closeArchiveCursor(ArchiveCursor *cursor) {
+    if (cursor->partition != NULL) {
+        fclose(cursor->partition);
+    }
+    free(cursor->entries);
+    memset(cursor, 0, sizeof(ArchiveCursor));
+}
+
+//qsort comparator for archive index entries by month, then offset
+int compareArchiveEntries(const void *a, const void *b) {
+    const ArchiveIndexEntry *first = (const ArchiveIndexEntry *) a;
+    const ArchiveIndexEntry *second = (const ArchiveIndexEntry *) b;
+    if (first->month != second->month) {
+        return (first->month > second->month) - (first->month < second->month);
+    }
+    return (first->offset > second->offset) - (first->offset < second->offset);
+}
+
+//Return the archive month of a date starting "YYYY-MM" as year * 12 + month - 1, or 0 if it has no valid month
+int archiveMonth(const char *date) {
+    for (int i = 0; i < 7; i++) {
+        int matches = i == 4 ? date[i] == '-' : date[i] >= '0' && date[i] <= '9';
+        if (!matches) {
+            return 0;    // Stops at the terminator of a short string, so nothing past it is read
+        }
+    }
+    int year = (date[0] - '0') * 1000 + (date[1] - '0') * 100 + (date[2] - '0') * 10 + (date[3] - '0');
+    int month = (date[5] - '0') * 10 + (date[6] - '0');
+    return month >= 1 && month <= 12 ? year * 12 + month - 1 : 0;
+}
+
+//Return the archive month holding a time in minutes since 1970-01-01, or 0 for a time before 1970
+int monthOfMinute(int minute) {
+    if (minute < 0) {
+        return 0;
+    }
+    char date[11];
+    formatScheduleDate(minute / 1440, date);
+    return archiveMonth(date);
+}
+
+//Build the path of the partition file holding the patients discharged in an archive month
+void archivePartitionPath(char *path, int month) {
+    char fileName[32];
+    if (month == 0) {
+        strcpy(fileName, "archive_undated.dat");
+    } else {
+        snprintf(fileName, sizeof(fileName), "archive_%04d-%02d.dat", month / 12, month % 12 + 1);
+    }
+    dataFilePath(path, fileName);
+}
+
+//Read the archive index entries of a backup's archive section. Returns their number, or -1 if the section is missing or invalid
+int readArchiveSection(const char *fileName, ArchiveIndexEntry **entries) {
+    *entries = NULL;
+    FILE *archiveSection = openSnapshotSection(fileName, SNAPSHOT_ARCHIVE);
+    if (archiveSection == NULL) {
+        return -1;
+    }
+
+    int count;
+    int valid = fread(&count, sizeof(int), 1, archiveSection) == 1 && count >= 0 && count <= MAX_LOADED_RECORDS;
+    if (valid && count > 0) {
+        *entries = (ArchiveIndexEntry *) malloc(count * sizeof(ArchiveIndexEntry));
+        valid = *entries != NULL && fread(*entries, sizeof(ArchiveIndexEntry), count, archiveSection) == (size_t) count;
+        for (int i = 0; valid && i < count; i++) {
+            valid = (*entries)[i].patientID > 0 && (*entries)[i].month >= 0 && (*entries)[i].offset >= 0;
+        }
+    }
+    traceClose(archiveSection, fileName);
+
+    if (!valid) {
+        free(*entries);
+        *entries = NULL;
+        return -1;
+    }
+    return count;
+}
+
+//Read the first entries of archive.idx, for a backup that only recorded how many there were. Returns NULL if there are fewer
+ArchiveIndexEntry *readArchiveIndexPrefix(int count) {
+    ArchiveIndexEntry *entries = (ArchiveIndexEntry *) malloc((count > 0 ? count : 1) * sizeof(ArchiveIndexEntry));
+    if (entries == NULL || count <= 0) {
+        return entries;
+    }
+
+    char fileName[MAX_FILENAME_LENGTH];
+    dataFilePath(fileName, "archive.idx");
+    FILE *indexFile = fopen(fileName, "rb");
+    int read = indexFile != NULL && fread(entries, sizeof(ArchiveIndexEntry), count, indexFile) == (size_t) count;
+    if (indexFile != NULL) {
+        fclose(indexFile);
+    }
+    if (!read) {
+        free(entries);
+        return NULL;
+    }
+    return entries;
+}
+
+//Write a restored archive index to archive.idx.tmp and sync it, ready for commitArchiveIndex. Returns 0 on error
+int stageArchiveIndex(const ArchiveIndexEntry *entries, int count) {
+    char fileName[MAX_FILENAME_LENGTH];
+    dataFilePath(fileName, "archive.idx.tmp");
+    FILE *indexFile = fopen(fileName, "wb");
+    if (indexFile == NULL) {
+        return 0;
+    }
+
+    int written = (count == 0 || fwrite(entries, sizeof(ArchiveIndexEntry), count, indexFile) == (size_t) count) &&
+                  fflush(indexFile) == 0 && fsync(fileno(indexFile)) == 0;
+    written = fclose(indexFile) == 0 && written;
+    if (!written) {
+        remove(fileName);
+    }
+    return written;
+}
+
+//Rename the archive index written by stageArchiveIndex over archive.idx. Later records stay in the partitions, unindexed. Returns 0 on error
+int commitArchiveIndex() {
+    char tempFileName[MAX_FILENAME_LENGTH];
+    char fileName[MAX_FILENAME_LENGTH];
+    dataFilePath(tempFileName, "archive.idx.tmp");
+    dataFilePath(fileName, "archive.idx");
+    if (rename(tempFileName, fileName) != 0) {
+        remove(tempFileName);
+        return 0;
+    }
+    return syncDirectory(dataDirectory);
+}
+
+//Sync the directory holding a file, after the file was created or renamed. Returns 0 on error
+int syncParentDirectory(const char *fileName) {
+    char path[MAX_FILENAME_LENGTH];
+    snprintf(path, sizeof(path), "%s", fileName);
+    char *separator = strrchr(path, '/');
+    if (separator == NULL) {
+        return syncDirectory(".");
+    }
+    *separator = '\0';
+    return syncDirectory(path[0] != '\0' ? path : "/");
+}
+
+//Sync a directory so the files created, renamed or removed in it survive a crash. Returns 0 on error
+int syncDirectory(const char *path) {
+    #ifdef _WIN32
+    (void) path;
+    return 1;   // Windows has no directory handle to sync
+    #else
+    int directory = open(path, O_RDONLY);
+    if (directory < 0) {
+        return 0;
+    }
+    int synced = fsync(directory) == 0;
+    close(directory);
+    return synced;
+    #endif
+}
+
+//Room menu. Sets room capacities and shows the free beds
+void manageRooms() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Manage Rooms");
+
+    printf("1. Set Room Capacity\n");
+    printf("2. View Free Beds\n");
+    printf("3. Return to Main Menu\n");
+    printf("Enter your choice: ");
+
+    int choice = scanInt();
+    if (choice == 1) {
+        changeRoomCapacity();
+    } else if (choice == 2) {
+        viewFreeBeds();
+    }
+}
+
+//Prompt for a room and its new number of beds
+void changeRoomCapacity() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Set Room Capacity");
+
+    printf("\nEnter room number (1-%d): ", MAX_ROOM_NUMBER);
+    int roomNum = scanInt();
+    if (roomNum <= 0 || roomNum > MAX_ROOM_NUMBER) {
+        printf("Room number invalid!\n");
+        returnToMenu();
+        return;
+    }
+
+    printf("Room %d has %d beds and %d patients.\n", roomNum, atomic_load(&roomCapacity[roomNum]),
+           atomic_load(&roomOccupancy[roomNum]));
+    printf("Enter the new number of beds (0-%d, 0 closes the room): ", MAX_ROOM_CAPACITY);
+    int capacity = scanInt();
+
+    int result = setRoomCapacity(roomNum, capacity);
+    if (result == STORE_ROOM_FULL) {
+        printf("The room has more patients than that! Discharge or move them first.\n");
+    } else if (result != STORE_OK) {
+        printf("Invalid number of beds!\n");
+    } else {
+        printf("Room %d now has %d beds.\n", roomNum, capacity);
+        saveData();
+    }
+    returnToMenu();
+}
+
+//Show the bed totals and the room the next automatic admission would take
+void viewFreeBeds() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Free Beds");
+
+    pthread_mutex_lock(&roomBedLock);
+    int totalBeds = roomBeds.totalBeds;
+    int freeBeds = roomBeds.freeBeds;
+    int roomsWithBeds = roomBeds.count;
+    pthread_mutex_unlock(&roomBedLock);
+
+    int bestFree;
+    int bestRoom = proposeRoom(&bestFree);
+
+    printf("%-30s%d of %d\n", "Free beds:", freeBeds, totalBeds);
+    printf("%-30s%d\n", "Rooms with a free bed:", roomsWithBeds);
+    if (bestRoom > 0) {
+        printf("%-30s%d (%d of %d beds free)\n", "Next automatic room:", bestRoom, bestFree,
+               atomic_load(&roomCapacity[bestRoom]));
+    } else {
+        printf("%-30s%s\n", "Next automatic room:", "none, every room is full");
+    }
+    returnToMenu();
+}
+
+//Check if a room is available. A room is considered available if it has fewer active patients than beds
+int isRoomAvailable(int roomNum) {
+    if (roomNum <= 0 || roomNum > MAX_ROOM_NUMBER) {
+        return 0;
+    }
+    return atomic_load(&roomOccupancy[roomNum]) < atomic_load(&roomCapacity[roomNum]);
+}
+
+//Claim a bed in a room. Returns 1 if the room had space, 0 if it is full or out of range
+int reserveRoomBed(int roomNum) {
+    if (roomNum <= 0 || roomNum > MAX_ROOM_NUMBER) {
+        return 0;
+    }
+
+    // Under the lock so concurrent admissions to the same room cannot both take the last bed
+    pthread_mutex_lock(&roomBedLock);
+    int freeBefore = roomFreeBeds(roomNum);
+    if (freeBefore == 0) {
+        pthread_mutex_unlock(&roomBedLock);
+        return 0;
+    }
+    int occupied = atomic_fetch_add(&roomOccupancy[roomNum], 1);
+    noteRoomOccupancyChange(atomic_load(&roomCapacity[roomNum]), occupied, occupied + 1);
+    updateRoomBeds(roomNum, freeBefore);
+    pthread_mutex_unlock(&roomBedLock);
+    return 1;
+}
+
+//Claim a bed in the best free room. Returns the room, or 0 if every room is full
+int reserveBestRoom() {
+    pthread_mutex_lock(&roomBedLock);
+    if (roomBeds.count == 0) {
+        pthread_mutex_unlock(&roomBedLock);
+        return 0;
+    }
+    int roomNum = roomBeds.heap[0];
+    int freeBefore = roomFreeBeds(roomNum);
+    int occupied = atomic_fetch_add(&roomOccupancy[roomNum], 1);
+    noteRoomOccupancyChange(atomic_load(&roomCapacity[roomNum]), occupied, occupied + 1);
+    updateRoomBeds(roomNum, freeBefore);
+    pthread_mutex_unlock(&roomBedLock);
+    return roomNum;
+}
+
+//Return the room an automatic admission would take now, with its free beds, or 0 if every room is full
+int proposeRoom(int *freeBeds) {
+    pthread_mutex_lock(&roomBedLock);
+    int roomNum = roomBeds.count > 0 ? roomBeds.heap[0] : 0;
+    *freeBeds = roomNum > 0 ? roomFreeBeds(roomNum) : 0;
+    pthread_mutex_unlock(&roomBedLock);
+    return roomNum;
+}
+
+//Release a bed previously claimed in a room
+void releaseRoomBed(int roomNum) {
+    if (roomNum <= 0 || roomNum > MAX_ROOM_NUMBER) {
+        return;
+    }
+
+    pthread_mutex_lock(&roomBedLock);
+    int occupied = atomic_load(&roomOccupancy[roomNum]);
+    if (occupied > 0) {
+        int freeBefore = roomFreeBeds(roomNum);
+        atomic_store(&roomOccupancy[roomNum], occupied - 1);
+        noteRoomOccupancyChange(atomic_load(&roomCapacity[roomNum]), occupied, occupied - 1);
+        updateRoomBeds(roomNum, freeBefore);
+    }
+    pthread_mutex_unlock(&roomBedLock);
+}
+
+//Give a room a number of beds. Returns STORE_ROOM_FULL if it has more patients than that
+int setRoomCapacity(int roomNum, int capacity) {
+    if (roomNum <= 0 || roomNum > MAX_ROOM_NUMBER || capacity < 0 || capacity > MAX_ROOM_CAPACITY) {
+        return STORE_INVALID_ARGUMENT;
+    }
+
+    pthread_mutex_lock(&roomBedLock);
+    int occupied = atomic_load(&roomOccupancy[roomNum]);
+    if (capacity < occupied) {
+        pthread_mutex_unlock(&roomBedLock);
+        return STORE_ROOM_FULL;
+    }
+
+    int freeBefore = roomFreeBeds(roomNum);
+    int oldCapacity = atomic_exchange(&roomCapacity[roomNum], capacity);
+    roomBeds.totalBeds += capacity - oldCapacity;
+    int wasFull = occupied > 0 && occupied >= oldCapacity;
+    int isFull = occupied > 0 && occupied >= capacity;
+    if (!wasFull && isFull) {
+        atomic_fetch_add(&hospitalStats.fullRooms, 1);
+    } else if (wasFull && !isFull) {
+        atomic_fetch_sub(&hospitalStats.fullRooms, 1);
+    }
+    updateRoomBeds(roomNum, freeBefore);
+
+    RoomCapacityRecord replicated = {roomNum, capacity};
+    shipMutation(REPL_SET_ROOM_CAPACITY, &replicated, sizeof(replicated));
+    pthread_mutex_unlock(&roomBedLock);
+    return STORE_OK;
+}
+
+//Return the free beds of a room, 0 if it is full or over capacity
+int roomFreeBeds(int roomNum) {
+    int freeBeds = atomic_load(&roomCapacity[roomNum]) - atomic_load(&roomOccupancy[roomNum]);
+    return freeBeds > 0 ? freeBeds : 0;
+}
+
+//Return 1 if room a is offered before room b: fewer free beds first, then the lower room number
+int roomOfferedBefore(int a, int b) {
+    int freeA = roomFreeBeds(a);
+    int freeB = roomFreeBeds(b);
+    return freeA != freeB ? freeA < freeB : a < b;
+}
+
+//Reposition a room in the free-bed heap after its free beds changed from freeBefore. Caller must hold roomBedLock
+void updateRoomBeds(int roomNum, int freeBefore) {
+    int freeBeds = roomFreeBeds(roomNum);
+    roomBeds.freeBeds += freeBeds - freeBefore;
+
+    int i = roomBeds.position[roomNum];
+    if (freeBeds == 0) {
+        if (i < 0) {
+            return;
+        }
+        // Move the last entry into the gap, then let it find its place
+        roomBeds.position[roomNum] = -1;
+        roomBeds.count--;
+        if (i == roomBeds.count) {
+            return;
+        }
+        roomBeds.heap[i] = roomBeds.heap[roomBeds.count];
+        roomBeds.position[roomBeds.heap[i]] = i;
+    } else if (i < 0) {
+        i = roomBeds.count++;
+        roomBeds.heap[i] = roomNum;
+        roomBeds.position[roomNum] = i;
+    }
+    int moved = roomBeds.heap[i];
+    siftRoomUp(i);
+    siftRoomDown(roomBeds.position[moved]);
+}
+
+//Move a free-bed heap entry up while it is offered before its parent. Caller must hold roomBedLock
+void siftRoomUp(int i) {
+    while (i > 0 && roomOfferedBefore(roomBeds.heap[i], roomBeds.heap[(i - 1) / 2])) {
+        swapRoomHeapEntries(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+//Move a free-bed heap entry down while a child is offered before it. Caller must hold roomBedLock
+void siftRoomDown(int i) {
+    while (1) {
+        int first = i;
+        int left = 2 * i + 1;
+        if (left < roomBeds.count && roomOfferedBefore(roomBeds.heap[left], roomBeds.heap[first])) {
+            first = left;
+        }
+        if (left + 1 < roomBeds.count && roomOfferedBefore(roomBeds.heap[left + 1], roomBeds.heap[first])) {
+            first = left + 1;
+        }
+        if (first == i) {
+            return;
+        }
+        swapRoomHeapEntries(i, first);
+        i = first;
+    }
+}
+
+//Swap two entries of the free-bed heap and their recorded positions
+void swapRoomHeapEntries(int i, int j) {
+    int roomNum = roomBeds.heap[i];
+    roomBeds.heap[i] = roomBeds.heap[j];
+    roomBeds.heap[j] = roomNum;
+    roomBeds.position[roomBeds.heap[i]] = i;
+    roomBeds.position[roomBeds.heap[j]] = j;
+}
+
+//Rebuild the free-bed index from the room capacities and occupancy counters. Caller must hold roomBedLock
+void rebuildRoomBeds() {
+    roomBeds.count = 0;
+    roomBeds.totalBeds = 0;
+    roomBeds.freeBeds = 0;
+    roomBeds.position[0] = -1;
+    for (int roomNum = 1; roomNum <= MAX_ROOM_NUMBER; roomNum++) {
+        roomBeds.totalBeds += atomic_load(&roomCapacity[roomNum]);
+        int freeBeds = roomFreeBeds(roomNum);
+        roomBeds.freeBeds += freeBeds;
+        roomBeds.position[roomNum] = freeBeds > 0 ? roomBeds.count : -1;
+        if (freeBeds > 0) {
+            roomBeds.heap[roomBeds.count++] = roomNum;
+        }
+    }
+
+    // Build the heap bottom up, which takes linear time
+    for (int i = roomBeds.count / 2 - 1; i >= 0; i--) {
+        siftRoomDown(i);
+    }
+}
+
+//Give every room the default capacity and build the free-bed index. Runs once through pthread_once
+void initializeRoomBeds() {
+    pthread_mutex_lock(&roomBedLock);
+    resetRoomCapacities();
+    rebuildRoomBeds();
+    pthread_mutex_unlock(&roomBedLock);
+}
+
+//Give every room the default capacity. Caller must hold roomBedLock
+void resetRoomCapacities() {
+    atomic_store(&roomCapacity[0], 0);
+    for (int roomNum = 1; roomNum <= MAX_ROOM_NUMBER; roomNum++) {
+        atomic_store(&roomCapacity[roomNum], MAX_PATIENTS_PER_ROOM);
+    }
+}
+
+//Load the room capacities from rooms.dat, if there is one, and rebuild the free-bed index
+void loadRooms() {
+    pthread_mutex_lock(&roomBedLock);
+    resetRoomCapacities();
+
+    char dataFileName[MAX_FILENAME_LENGTH];
+    FILE *roomsFile = openDataSection(SNAPSHOT_ROOMS, dataFileName);
+    if (roomsFile != NULL) {
+        RoomFileHeader header;
+        if (fread(&header, sizeof(header), 1, roomsFile) == 1 && memcmp(header.magic, "HMSR", 4) == 0 &&
+            header.version == ROOMS_FORMAT_VERSION && header.count >= 0 && header.count <= MAX_ROOM_NUMBER) {
+            RoomCapacityRecord record;
+            for (int i = 0; i < header.count && fread(&record, sizeof(record), 1, roomsFile) == 1; i++) {
+                if (record.room > 0 && record.room <= MAX_ROOM_NUMBER &&
+                    record.capacity >= 0 && record.capacity <= MAX_ROOM_CAPACITY) {
+                    atomic_store(&roomCapacity[record.room], record.capacity);
+                }
+            }
+        } else {
+            printf("Warning: %s has no valid room capacities. Every room has %d beds.\n", dataFileName, MAX_PATIENTS_PER_ROOM);
+        }
+        fclose(roomsFile);
+    }
+
+    rebuildRoomBeds();
+    pthread_mutex_unlock(&roomBedLock);
+}
+
+//Write the rooms whose capacity differs from the default in the rooms.dat format. Returns 0 on error
+int writeRoomsSection(FILE *roomsFile) {
+    pthread_mutex_lock(&roomBedLock);
+    RoomFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "HMSR", 4);
+    header.version = ROOMS_FORMAT_VERSION;
+    for (int roomNum = 1; roomNum <= MAX_ROOM_NUMBER; roomNum++) {
+        header.count += atomic_load(&roomCapacity[roomNum]) != MAX_PATIENTS_PER_ROOM;
+    }
+
+    int written = fwrite(&header, sizeof(header), 1, roomsFile) == 1;
+    for (int roomNum = 1; written && roomNum <= MAX_ROOM_NUMBER; roomNum++) {
+        RoomCapacityRecord record = {roomNum, atomic_load(&roomCapacity[roomNum])};
+        if (record.capacity != MAX_PATIENTS_PER_ROOM) {
+            written = fwrite(&record, sizeof(record), 1, roomsFile) == 1;
+        }
+    }
+    pthread_mutex_unlock(&roomBedLock);
+    return written;
+}
+
+//Reset all room occupancy counters to zero and rebuild the free-bed index to match
+void resetRoomOccupancy() {
+    pthread_mutex_lock(&roomBedLock);
+    for (int i = 0; i <= MAX_ROOM_NUMBER; i++) {
+        atomic_store(&roomOccupancy[i], 0);
+    }
+    rebuildRoomBeds();
+    pthread_mutex_unlock(&roomBedLock);
+}
+
+//Initialize the patient shards and their locks. Runs once through pthread_once
+void initializePatientShards() {
+    pthread_rwlockattr_t attributes;
+    pthread_rwlockattr_init(&attributes);
+#ifdef __GLIBC__
+    // Prefer writers so a steady stream of readers cannot starve admissions
+    pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        memset(&patientShards[s], 0, sizeof(PatientShard));
+        pthread_rwlock_init(&patientShards[s].lock, &attributes);
+    }
+    pthread_rwlockattr_destroy(&attributes);
+}
+
+//Hash a patient ID. The high bits pick the shard and the low bits pick the index slot
+unsigned int hashPatientID(int id) {
+    return (unsigned int) id * 2654435761u;
+}
+
+//Return the shard that owns a patient ID
+PatientShard *shardForPatient(int id) {
+    return &patientShards[hashPatientID(id) >> (32 - PATIENT_SHARD_BITS)];
+}
+
+//Lock every patient shard in ascending order, for reading (0) or writing (1)
+void lockAllPatientShards(int forWriting) {
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        if (forWriting) {
+            pthread_rwlock_wrlock(&patientShards[s].lock);
+        } else {
+            pthread_rwlock_rdlock(&patientShards[s].lock);
+        }
+    }
+}
+
+//Unlock every patient shard
+void unlockAllPatientShards() {
+    for (int s = PATIENT_SHARD_COUNT - 1; s >= 0; s--) {
+        pthread_rwlock_unlock(&patientShards[s].lock);
+    }
+}
+
+//Insert a patient's row into a shard's hash index, doubling the table when it is 70% full. Caller must hold the shard write lock
+int shardIndexInsert(PatientShard *shard, int id, int row) {
+    if ((shard->count + 1) * 10 > shard->indexCapacity * 7) {
+        int newCapacity = shard->indexCapacity == 0 ? SHARD_INDEX_INITIAL_CAPACITY : shard->indexCapacity * 2;
+        int *newIndex = (int *) calloc(newCapacity, sizeof(int));
+        if (newIndex == NULL) {
+            printf("Error: Memory allocation failed for patient index.\n");
+            return 0;
+        }
+
+        // Rehash the existing entries into the larger table
+        unsigned int newMask = (unsigned int) newCapacity - 1;
+        for (int i = 0; i < shard->indexCapacity; i++) {
+            if (shard->index[i] != 0) {
+                unsigned int slot = hashPatientID(shard->ids[shard->index[i] - 1]) & newMask;
+                while (newIndex[slot] != 0) {
+                    slot = (slot + 1) & newMask;
+                }
+                newIndex[slot] = shard->index[i];
+            }
+        }
+
+        free(shard->index);
+        shard->index = newIndex;
+        shard->indexCapacity = newCapacity;
+    }
+
+    unsigned int mask = (unsigned int) shard->indexCapacity - 1;
+    unsigned int slot = hashPatientID(id) & mask;
+    while (shard->index[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    shard->index[slot] = row + 1;
+    return 1;
+}
+
+//Double the row capacity of a shard's columns. Returns 0 if memory runs out. Caller must hold the shard write lock
+int growShardColumns(PatientShard *shard) {
+    int newCapacity = shard->rowCapacity == 0 ? SHARD_COLUMNS_INITIAL_CAPACITY : shard->rowCapacity * 2;
+
+    // Keep whichever arrays did grow; the old capacity stays valid for all of them
+    Patient **rows = (Patient **) realloc(shard->rows, newCapacity * sizeof(Patient *));
+    if (rows != NULL) {
+        shard->rows = rows;
+    }
+    int **columns[] = {&shard->ids, &shard->ages, &shard->rooms, &shard->active, &shard->admitted};
+    int grown = rows != NULL;
+    for (int c = 0; c < (int) (sizeof(columns) / sizeof(columns[0])); c++) {
+        int *column = (int *) realloc(*columns[c], newCapacity * sizeof(int));
+        if (column == NULL) {
+            grown = 0;
+        } else {
+            *columns[c] = column;
+        }
+    }
+
+    if (!grown) {
+        printf("Error: Memory allocation failed for patient columns.\n");
+        return 0;
+    }
+    shard->rowCapacity = newCapacity;
+    return 1;
+}
+
+//Set a filter to select every patient
+void initializePatientFilter(PatientFilter *filter) {
+    filter->minAge = INT_MIN;
+    filter->maxAge = INT_MAX;
+    filter->minRoom = INT_MIN;
+    filter->maxRoom = INT_MAX;
+    filter->status = FILTER_STATUS_ANY;
+    filter->admittedFrom = INT_MIN;
+    filter->admittedTo = INT_MAX;
+}
+
+//Set one bit per row of a shard for the patients matching a filter. Returns the number selected. Caller must hold the shard lock
+int selectPatientsInShard(const PatientShard *shard, const PatientFilter *filter, unsigned long long *selection) {
+    int count = shard->count;
+    int words = selectionWords(count);
+
+    // Start with every row selected, leaving the bits past the last row clear
+    for (int w = 0; w < words; w++) {
+        selection[w] = ~0ULL;
+    }
+    if (count % 64 != 0) {
+        selection[words - 1] = (1ULL << (count % 64)) - 1;
+    }
+
+    // Each condition narrows the selection; unbounded ones are skipped
+    if (filter->status != FILTER_STATUS_ANY) {
+        selectInRange(shard->active, count, filter->status, filter->status, selection);
+    }
+    if (filter->minRoom != INT_MIN || filter->maxRoom != INT_MAX) {
+        selectInRange(shard->rooms, count, filter->minRoom, filter->maxRoom, selection);
+    }
+    if (filter->minAge != INT_MIN || filter->maxAge != INT_MAX) {
+        selectInRange(shard->ages, count, filter->minAge, filter->maxAge, selection);
+    }
+    if (filter->admittedFrom != INT_MIN || filter->admittedTo != INT_MAX) {
+        selectInRange(shard->admitted, count, filter->admittedFrom, filter->admittedTo, selection);
+    }
+
+    int selected = 0;
+    for (int w = 0; w < words; w++) {
+        selected += __builtin_popcountll(selection[w]);
+    }
+    return selected;
+}
+
+//Return the number of 64-bit words in a selection bitmap covering the given rows
+int selectionWords(int rows) {
+    return (rows + 63) / 64;
+}
+
+//Clear the selection bits of rows whose value is outside low..high. Whole words are compared with vector instructions
+void selectInRange(const int *values, int count, int low, int high, unsigned long long *selection) {
+    int vectorWords = 0;
+
+#if defined(__AVX2__)
+    vectorWords = count / 64;
+    __m256i lowVector = _mm256_set1_epi32(low);
+    __m256i highVector = _mm256_set1_epi32(high);
+    for (int w = 0; w < vectorWords; w++) {
+        if (selection[w] == 0) {
+            continue;   // Nothing left to narrow down
+        }
+
+        // Eight rows per compare; the sign bits of the "outside" lanes become a mask
+        const int *block = values + w * 64;
+        unsigned long long inside = 0;
+        for (int j = 0; j < 64; j += 8) {
+            __m256i value = _mm256_loadu_si256((const __m256i *) (block + j));
+            __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(lowVector, value),
+                                              _mm256_cmpgt_epi32(value, highVector));
+            unsigned int lanes = ~(unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFFu;
+            inside |= (unsigned long long) lanes << j;
+        }
+        selection[w] &= inside;
+    }
+#elif defined(__SSE2__)
+    vectorWords = count / 64;
+    __m128i lowVector = _mm_set1_epi32(low);
+    __m128i highVector = _mm_set1_epi32(high);
+    for (int w = 0; w < vectorWords; w++) {
+        if (selection[w] == 0) {
+            continue;   // Nothing left to narrow down
+        }
+
+        // Four rows per compare; the sign bits of the "outside" lanes become a mask
+        const int *block = values + w * 64;
+        unsigned long long inside = 0;
+        for (int j = 0; j < 64; j += 4) {
+            __m128i value = _mm_loadu_si128((const __m128i *) (block + j));
+            __m128i outside = _mm_or_si128(_mm_cmplt_epi32(value, lowVector), _mm_cmpgt_epi32(value, highVector));
+            unsigned int lanes = ~(unsigned int) _mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xFu;
+            inside |= (unsigned long long) lanes << j;
+        }
+        selection[w] &= inside;
+    }
+#endif
+
+    // The last partial word, or everything without vector support, is done one row at a time
+    selectInRangeScalar(values + vectorWords * 64, count - vectorWords * 64, low, high, selection + vectorWords);
+}
+
+//Clear the selection bits of rows whose value is outside low..high, one row at a time
+void selectInRangeScalar(const int *values, int count, int low, int high, unsigned long long *selection) {
+    for (int i = 0; i < count; i++) {
+        unsigned long long outside = (unsigned long long) (values[i] < low || values[i] > high);
+        selection[i / 64] &= ~(outside << (i % 64));
+    }
+}
+
+//Convert an admission date to minutes since 1970-01-01, the unit of the admission column. Returns 0 for no date
+int admissionMinute(const char *admissionDate) {
+    return (int) (dateTimeToSeconds(admissionDate) / 60);
+}
+
+//Add a newly stored patient to the room and admission indexes. Called with the patient's shard write lock held
+void indexPatientForQueries(const Patient *patient) {
+    pthread_mutex_lock(&queryIndexLock);
+
+    int room = patient->patientRoomNum;
+    if (room > 0 && room <= MAX_ROOM_NUMBER) {
+        if (queryIndexes.roomCount[room] == queryIndexes.roomCapacity[room]) {
+            int newCapacity = queryIndexes.roomCapacity[room] == 0 ? 4 : queryIndexes.roomCapacity[room] * 2;
+            int *ids = (int *) realloc(queryIndexes.roomPatients[room], newCapacity * sizeof(int));
+            if (ids != NULL) {
+                queryIndexes.roomPatients[room] = ids;
+                queryIndexes.roomCapacity[room] = newCapacity;
+            }
+        }
+        if (queryIndexes.roomCount[room] < queryIndexes.roomCapacity[room]) {
+            queryIndexes.roomPatients[room][queryIndexes.roomCount[room]++] = patient->patientID;
+        } else {
+            queryIndexes.incomplete = 1;
+        }
+    }
+
+    if (queryIndexes.admissionCount == queryIndexes.admissionCapacity) {
+        int newCapacity = queryIndexes.admissionCapacity == 0 ? 1024 : queryIndexes.admissionCapacity * 2;
+        AdmissionEntry *entries = (AdmissionEntry *) realloc(queryIndexes.admissions,
+                                                             newCapacity * sizeof(AdmissionEntry));
+        if (entries != NULL) {
+            queryIndexes.admissions = entries;
+            queryIndexes.admissionCapacity = newCapacity;
+        }
+    }
+    if (queryIndexes.admissionCount < queryIndexes.admissionCapacity) {
+        // New admissions are stamped with the current time, so appends normally keep the index sorted
+        AdmissionEntry entry = {admissionMinute(patient->admissionDate), patient->patientID};
+        if (queryIndexes.admissionCount > 0 &&
+            entry.minute < queryIndexes.admissions[queryIndexes.admissionCount - 1].minute) {
+            queryIndexes.admissionsSorted = 0;
+        }
+        queryIndexes.admissions[queryIndexes.admissionCount++] = entry;
+    } else {
+        queryIndexes.incomplete = 1;
+    }
+
+    pthread_mutex_unlock(&queryIndexLock);
+}
+
+//Empty the query indexes, keeping their memory. Used before the store is cleared or reloaded
+void resetQueryIndexes() {
+    pthread_mutex_lock(&queryIndexLock);
+    memset(queryIndexes.roomCount, 0, sizeof(queryIndexes.roomCount));
+    queryIndexes.admissionCount = 0;
+    queryIndexes.admissionsSorted = 1;
+    queryIndexes.incomplete = 0;
+    pthread_mutex_unlock(&queryIndexLock);
+}
+
+//Run a patient query, filling result with the matching patients in order. Returns 0 if memory runs out
+int runPatientQuery(const PatientQuery *query, QueryResult *result) {
+    memset(result, 0, sizeof(QueryResult));
+    result->plan = chooseQueryPlan(query);
+
+    int success = 1;
+    if (result->plan == QUERY_PLAN_SCAN) {
+        // Filter kernels over each shard, with the keyword checked only on the rows they select
+        for (int s = 0; s < PATIENT_SHARD_COUNT && success; s++) {
+            PatientShard *shard = &patientShards[s];
+            pthread_rwlock_rdlock(&shard->lock);
+
+            int words = selectionWords(shard->count);
+            unsigned long long *selection = (unsigned long long *) malloc((words + 1) * sizeof(unsigned long long));
+            success = selection != NULL;
+            if (success) {
+                selectPatientsInShard(shard, &query->filter, selection);
+                result->examined += shard->count;
+                for (int w = 0; w < words && success; w++) {
+                    for (unsigned long long word = selection[w]; word != 0 && success; word &= word - 1) {
+                        int row = w * 64 + __builtin_ctzll(word);
+                        if (query->keyword[0] == '\0' ||
+                            strcasestr(shard->rows[row]->patientDiagnosis, query->keyword) != NULL) {
+                            success = addQueryRow(result, shard, row, query->sortKey);
+                        }
+                    }
+                }
+            }
+
+            free(selection);
+            pthread_rwlock_unlock(&shard->lock);
+        }
+    } else {
+        // Check each index candidate against its shard; the index lock is not held while shard locks are taken
+        int *candidates = NULL;
+        int count = 0;
+        success = collectIndexCandidates(query, result->plan, &candidates, &count);
+        for (int i = 0; i < count && success; i++) {
+            PatientShard *shard = shardForPatient(candidates[i]);
+            pthread_rwlock_rdlock(&shard->lock);
+            int row = findPatientRow(shard, candidates[i]);
+            if (row >= 0 && queryRowMatches(shard, row, query)) {
+                success = addQueryRow(result, shard, row, query->sortKey);
+            }
+            pthread_rwlock_unlock(&shard->lock);
+        }
+        result->examined = count;
+        free(candidates);
+    }
+
+    // Discharged patients may also be in the archive
+    if (success && query->filter.status != 1) {
+        success = queryArchive(query, result);
+    }
+
+    if (!success) {
+        freeQueryResult(result);
+        return 0;
+    }
+
+    qsort(result->rows, result->count, sizeof(QueryRow), compareQueryRows);
+    result->matches = result->count;
+    if (query->limit > 0 && result->count > query->limit) {
+        result->count = query->limit;
+    }
+    return 1;
+}
+
+//Pick the cheapest way to answer a query. An index is used when its candidates cost less to check than a full scan
+int chooseQueryPlan(const PatientQuery *query) {
+    const PatientFilter *filter = &query->filter;
+    int plan = QUERY_PLAN_SCAN;
+    long long bestCost = totalPatients;
+
+    pthread_mutex_lock(&queryIndexLock);
+    if (!queryIndexes.incomplete) {
+        // The room index only lists rooms 1..MAX_ROOM_NUMBER, so it can only answer ranges inside them
+        if (filter->minRoom >= 1 && filter->maxRoom <= MAX_ROOM_NUMBER) {
+            long long candidates = 0;
+            for (int room = filter->minRoom; room <= filter->maxRoom; room++) {
+                candidates += queryIndexes.roomCount[room];
+            }
+            if (candidates * QUERY_PROBE_COST < bestCost) {
+                plan = QUERY_PLAN_ROOM_INDEX;
+                bestCost = candidates * QUERY_PROBE_COST;
+            }
+        }
+
+        if (filter->admittedFrom != INT_MIN || filter->admittedTo != INT_MAX) {
+            sortAdmissionIndex();
+            long long candidates = findAdmissionBound((long long) filter->admittedTo + 1) -
+                                   findAdmissionBound(filter->admittedFrom);
+            if (candidates * QUERY_PROBE_COST < bestCost) {
+                plan = QUERY_PLAN_ADMISSION_INDEX;
+                bestCost = candidates * QUERY_PROBE_COST;
+            }
+        }
+    }
+    pthread_mutex_unlock(&queryIndexLock);
+
+    return plan;
+}
+
+//Sort the admission index if an entry arrived out of order. Caller must hold queryIndexLock
+void sortAdmissionIndex() {
+    if (!queryIndexes.admissionsSorted) {
+        qsort(queryIndexes.admissions, queryIndexes.admissionCount, sizeof(AdmissionEntry), compareAdmissionEntries);
+        queryIndexes.admissionsSorted = 1;
+    }
+}
+
+//Return the position of the first admission index entry at or after a minute. Caller must hold queryIndexLock on a sorted index
+int findAdmissionBound(long long minute) {
+    int low = 0;
+    int high = queryIndexes.admissionCount;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (queryIndexes.admissions[middle].minute < minute) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+//Copy the patient IDs a query's index plan has to check. Returns 0 if memory runs out
+int collectIndexCandidates(const PatientQuery *query, int plan, int **candidates, int *count) {
+    const PatientFilter *filter = &query->filter;
+    *candidates = NULL;
+    *count = 0;
+
+    pthread_mutex_lock(&queryIndexLock);
+
+    // The index may have grown since the plan was chosen, so size the copy now
+    int total = 0;
+    int first = 0;
+    if (plan == QUERY_PLAN_ROOM_INDEX) {
+        for (int room = filter->minRoom; room <= filter->maxRoom; room++) {
+            total += queryIndexes.roomCount[room];
+        }
+    } else {
+        sortAdmissionIndex();
+        first = findAdmissionBound(filter->admittedFrom);
+        total = findAdmissionBound((long long) filter->admittedTo + 1) - first;
+    }
+
+    int *ids = (int *) malloc((total + 1) * sizeof(int));
+    if (ids != NULL) {
+        if (plan == QUERY_PLAN_ROOM_INDEX) {
+            for (int room = filter->minRoom; room <= filter->maxRoom; room++) {
+                memcpy(ids + *count, queryIndexes.roomPatients[room], queryIndexes.roomCount[room] * sizeof(int));
+                *count += queryIndexes.roomCount[room];
+            }
+        } else {
+            for (int i = 0; i < total; i++) {
+                ids[i] = queryIndexes.admissions[first + i].patientID;
+            }
+            *count = total;
+        }
+    }
+
+    pthread_mutex_unlock(&queryIndexLock);
+
+    *candidates = ids;
+    return ids != NULL;
+}
+
+//Check one row against every condition of a query. Caller must hold the shard lock
+int queryRowMatches(const PatientShard *shard, int row, const PatientQuery *query) {
+    const PatientFilter *filter = &query->filter;
+    if (filter->status != FILTER_STATUS_ANY && shard->active[row] != filter->status) {
+        return 0;
+    }
+    if (shard->ages[row] < filter->minAge || shard->ages[row] > filter->maxAge ||
+        shard->rooms[row] < filter->minRoom || shard->rooms[row] > filter->maxRoom ||
+        shard->admitted[row] < filter->admittedFrom || shard->admitted[row] > filter->admittedTo) {
+        return 0;
+    }
+    return query->keyword[0] == '\0' || strcasestr(shard->rows[row]->patientDiagnosis, query->keyword) != NULL;
+}
+
+//Append a matching row to a query result. Returns 0 if memory runs out. Caller must hold the shard lock
+int addQueryRow(QueryResult *result, const PatientShard *shard, int row, int sortKey) {
+    int key = 0;
+    if (sortKey == QUERY_SORT_AGE) {
+        key = shard->ages[row];
+    } else if (sortKey == QUERY_SORT_ROOM) {
+        key = shard->rooms[row];
+    } else if (sortKey == QUERY_SORT_ADMISSION) {
+        key = shard->admitted[row];
+    }
+    return appendQueryRow(result, shard->ids[row], key);
+}
+
+//Append a patient with its sort key to a query result. Returns 0 if memory runs out
+int appendQueryRow(QueryResult *result, int patientID, int key) {
+    if (result->count == result->capacity) {
+        int newCapacity = result->capacity == 0 ? 256 : result->capacity * 2;
+        QueryRow *rows = (QueryRow *) realloc(result->rows, newCapacity * sizeof(QueryRow));
+        if (rows == NULL) {
+            return 0;
+        }
+        result->rows = rows;
+        result->capacity = newCapacity;
+    }
+
+    QueryRow *queryRow = &result->rows[result->count++];
+    queryRow->patientID = patientID;
+    queryRow->sortValue = (long long) key * 4294967296LL + (unsigned int) patientID;
+    return 1;
+}
+
+//Add the archived patients matching a query to its result. A patient is discharged after being admitted,
+//so only the partitions from the month of the earliest admission wanted are read. Returns 0 if memory runs out
+int queryArchive(const PatientQuery *query, QueryResult *result) {
+    const PatientFilter *filter = &query->filter;
+    ArchiveCursor cursor;
+
+    pthread_mutex_lock(&archiveLock);
+    int opened = openArchiveCursor(&cursor, &archiveIndex, monthOfMinute(filter->admittedFrom));
+    pthread_mutex_unlock(&archiveLock);
+    if (!opened) {
+        return 0;
+    }
+
+    int success = 1;
+    Patient patient;
+    while (success && readArchivedPatient(&cursor, &patient)) {
+        result->archived++;
+        int admitted = admissionMinute(patient.admissionDate);
+        if (patient.patientAge < filter->minAge || patient.patientAge > filter->maxAge ||
+            patient.patientRoomNum < filter->minRoom || patient.patientRoomNum > filter->maxRoom ||
+            admitted < filter->admittedFrom || admitted > filter->admittedTo ||
+            (query->keyword[0] != '\0' && strcasestr(patient.patientDiagnosis, query->keyword) == NULL)) {
+            continue;
+        }
+
+        int key = 0;
+        if (query->sortKey == QUERY_SORT_AGE) {
+            key = patient.patientAge;
+        } else if (query->sortKey == QUERY_SORT_ROOM) {
+            key = patient.patientRoomNum;
+        } else if (query->sortKey == QUERY_SORT_ADMISSION) {
+            key = admitted;
+        }
+        success = appendQueryRow(result, patient.patientID, key);
+    }
+
+    closeArchiveCursor(&cursor);
+    return success;
+}
+
+//qsort comparator for query rows by their combined sort value
+int compareQueryRows(const void *a, const void *b) {
+    long long first = ((const QueryRow *) a)->sortValue;
+    long long second = ((const QueryRow *) b)->sortValue;
+    return (first > second) - (first < second);
+}
+
+//qsort comparator for admission index entries by minute
+int compareAdmissionEntries(const void *a, const void *b) {
+    int first = ((const AdmissionEntry *) a)->minute;
+    int second = ((const AdmissionEntry *) b)->minute;
+    return (first > second) - (first < second);
+}
+
+//Free the rows of a query result
+void freeQueryResult(QueryResult *result) {
+    free(result->rows);
+    memset(result, 0, sizeof(QueryResult));
+}
+
+//Count the patient records held across all shards. Caller must hold every shard lock
+int countStoredPatients() {
+    int count = 0;
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        count += patientShards[s].count;
+    }
+    return count;
+}
+
+//Thread entry point for a parallel shard scan. Holds the shard read lock while scanning
+void *runShardScanTask(void *arg) {
+    ShardScanTask *task = (ShardScanTask *) arg;
+    pthread_rwlock_rdlock(&task->shard->lock);
+    task->scanShard(task->shard, task->result);
+    pthread_rwlock_unlock(&task->shard->lock);
+    return NULL;
+}
+
+//Scan every shard on its own thread. results[s] receives shard s's partial result for the caller to merge
+void parallelShardScan(void (*scanShard)(PatientShard *shard, void *result), void **results) {
+    ShardScanTask tasks[PATIENT_SHARD_COUNT];
+    int started[PATIENT_SHARD_COUNT];
+
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        tasks[s].shard = &patientShards[s];
+        tasks[s].scanShard = scanShard;
+        tasks[s].result = results[s];
+
+        // Fall back to scanning on this thread if a worker cannot be started
+        started[s] = pthread_create(&tasks[s].thread, NULL, runShardScanTask, &tasks[s]) == 0;
+        if (!started[s]) {
+            runShardScanTask(&tasks[s]);
+        }
+    }
+
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        if (started[s]) {
+            pthread_join(tasks[s].thread, NULL);
+        }
+    }
+}
+
+//Add a new doctor to the system. Collects doctor information and creates a new doctor record
+
+void addDoctor() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Add Doctor");
+
+    int doctorID;
+    char doctorName[50];
+
+    // Get doctor ID with validation
+    printf("\nEnter Doctor ID (positive number): ");
+    doctorID = scanInt();
+
+    if (doctorID <= 0) {
+        printf("The doctor ID must be a positive number!\n");
+        returnToMenu();
+        return;
+    }
+
+    // Check if doctor ID already exists
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    int idTaken = findDoctorByID(doctorID) != NULL;
+    pthread_rwlock_unlock(&doctorStoreLock);
+
+    if (idTaken) {
+        printf("The doctor ID already exists!\n");
+        returnToMenu();
+        return;
+    }
+
+    // Get doctor name
+    printf("Enter the doctor name: ");
+    fgets(doctorName, sizeof(doctorName), stdin);
+    doctorName[strcspn(doctorName, "\n")] = 0;  // Remove newline
+
+    // Create the new doctor record
+    Doctor *newDoctor = createDoctor(doctorID, doctorName);
+    if (newDoctor == NULL) {
+        printf("Failed to create doctor record!\n");
+        returnToMenu();
+        return;
+    }
+
+    // Add the new doctor to the store. The ID is checked again under the write lock
+    if (registerDoctor(newDoctor) != STORE_OK) {
+        printf("The doctor ID already exists!\n");
+        free(newDoctor);
+        returnToMenu();
+        return;
+    }
+
+    printf("Doctor record added successfully!\n");
+
+    // Save the updated data
+    saveData();
+
+    returnToMenu();
+}
+
+//Display all doctors in the system
+void viewDoctors() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("View All Doctors");
+
+    if (totalDoctors == 0) {
+        printf("No doctors in the system.\n");
+        returnToMenu();
+        return;
+    }
+
+    // Print table header
+    printf("%-10s%-25s%-15s\n", "ID", "Name", "Total Shifts");
+    printf("---------------------------------------------------\n");
+
+    // Print each doctor's details
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    Doctor *current = doctorHead;
+    while (current != NULL) {
+        printf("%-10d%-25s%-15d\n",
+               current->doctorID,
+               current->doctorName,
+               current->totalShifts);
+        current = current->next;
+    }
+    pthread_rwlock_unlock(&doctorStoreLock);
+
+    returnToMenu();
+}
+
+//Manage doctor schedules. Puts doctors on shifts of calendar dates or takes them off, by hand or for a whole period
+void manageDoctorSchedule() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Manage Doctor Schedule");
+
+    if (totalDoctors == 0) {
+        printf("No doctors in the system. Please add doctors first.\n");
+        returnToMenu();
+        return;
+    }
+
+    printf("1. Assign Shift\n");
+    printf("2. Unassign Shift\n");
+    printf("3. Apply Schedule Changes from File\n");
+    printf("4. Find Free Doctors\n");
+    printf("5. Fill Roster Automatically\n");
+    printf("6. Return to Main Menu\n");
+    printf("Enter your choice: ");
+
+    int choice = scanInt();
+    if (choice == 1 || choice == 2) {
+        changeShiftAssignment(choice == 1);
+    } else if (choice == 3) {
+        bulkScheduleChanges();
+    } else if (choice == 4) {
+        viewFreeDoctors();
+    } else if (choice == 5) {
+        autoSchedule();
+    }
+}
+
+//Prompt for a doctor, a date and a shift, then assign the doctor to that shift or unassign them from it
+void changeShiftAssignment(int assign) {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader(assign ? "Assign Shift" : "Unassign Shift");
+
+    // Get doctor ID
+    printf("\nEnter Doctor ID: ");
+    int doctorID = scanInt();
+
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    Doctor *doctor = findDoctorByID(doctorID);
+    pthread_rwlock_unlock(&doctorStoreLock);
+
+    if (doctor == NULL) {
+        printf("The doctor ID is invalid or doesn't exist!\n");
+        returnToMenu();
+        return;
+    }
+
+    // Get the date
+    char date[32];
+    int day;
+    printf("Enter date (YYYY-MM-DD): ");
+    fgets(date, sizeof(date), stdin);
+    date[strcspn(date, "\n")] = 0;
+    if (!parseScheduleDate(date, &day)) {
+        printf("The date is invalid!\n");
+        returnToMenu();
+        return;
+    }
+
+    if (assign) {
+        pthread_rwlock_rdlock(&doctorStoreLock);
+        int weekShifts = __builtin_popcount(weekShiftBits(&doctorSchedule, doctorID, weekOfDay(day)));
+        pthread_rwlock_unlock(&doctorStoreLock);
+
+        char monday[11];
+        formatScheduleDate(weekStartDay(day), monday);
+        printf("This doctor has %d of %d shifts in the week of %s.\n", weekShifts, MAX_SHIFTS_PER_DOCTOR, monday);
+    }
+
+    // Get the shift
+    printf("Enter shift (1-morning, 2-afternoon, 3-evening): ");
+    int shift = scanInt();
+
+    if (shift < 1 || shift > MAX_SHIFTS_IN_DAY) {
+        printf("Invalid shift! Must be between 1 and 3.\n");
+        returnToMenu();
+        return;
+    }
+
+    // The shift, its doctors and the weekly limit are checked again under the doctor write lock
+    int result = assign ? assignShift(doctorID, day, shift) : unassignShift(doctorID, day, shift);
+
+    if (result != STORE_OK) {
+        printScheduleError(result);
+    } else {
+        printf(assign ? "Shift assigned successfully!\n" : "Shift unassigned successfully!\n");
+        saveData();
+    }
+
+    returnToMenu();
+}
+
+//Print why a schedule change was refused
+void printScheduleError(int result) {
+    if (result == STORE_ALREADY_ON_SHIFT) {
+        printf("This doctor is already working that shift!\n");
+    } else if (result == STORE_REST_VIOLATION) {
+        printf("This doctor would work an evening shift followed by the next morning!\n");
+    } else if (result == STORE_NOT_ON_SHIFT) {
+        printf("This doctor is not working that shift!\n");
+    } else if (result == STORE_SHIFT_TAKEN) {
+        printf("This shift already has %d doctors assigned!\n", MAX_DOCTORS_PER_SHIFT);
+    } else if (result == STORE_SHIFT_LIMIT) {
+        printf("This doctor has reached the maximum number of shifts that week!\n");
+    } else if (result == STORE_INVALID_ARGUMENT) {
+        printf("Invalid shift, or a swap of a doctor with themselves!\n");
+    } else if (result == STORE_OUT_OF_MEMORY) {
+        printf("Error: Memory allocation failed for the schedule.\n");
+    } else {
+        printf("The doctor ID is invalid or doesn't exist!\n");
+    }
+}
+
+//Read a file of schedule changes and apply them together, or not at all if any of them cannot be made
+void bulkScheduleChanges() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Apply Schedule Changes from File");
+
+    printf("\nEach line of the file is one of:\n");
+    printf("  assign <doctor ID> <YYYY-MM-DD> <shift>\n");
+    printf("  unassign <doctor ID> <YYYY-MM-DD> <shift>\n");
+    printf("  swap <doctor ID> <YYYY-MM-DD> <shift> <doctor ID> <YYYY-MM-DD> <shift>\n");
+    printf("A swap gives each doctor the other's shift. Empty lines and lines starting with # are skipped.\n");
+
+    char fileName[MAX_FILENAME_LENGTH];
+    printf("\nEnter file name: ");
+    fgets(fileName, sizeof(fileName), stdin);
+    fileName[strcspn(fileName, "\n")] = 0;
+
+    ScheduleChange *changes;
+    int count, errorLine;
+    if (!readScheduleChanges(fileName, &changes, &count, &errorLine)) {
+        if (errorLine > 0) {
+            printf("Line %d of the file is not a valid change. No changes were made.\n", errorLine);
+        } else {
+            printf("Error: Unable to read %s.\n", fileName);
+        }
+        returnToMenu();
+        return;
+    }
+
+    long long start = currentTimeMicros();
+    int failedChange;
+    int result = applyScheduleChanges(changes, count, &failedChange);
+    long long elapsed = currentTimeMicros() - start;
+
+    if (result != STORE_OK) {
+        if (failedChange >= 0) {
+            printf("Line %d: ", changes[failedChange].line);
+        }
+        printScheduleError(result);
+        printf("No changes were made.\n");
+    } else {
+        printf("Applied %d changes in %.1f ms.\n", count, elapsed / 1000.0);
+        if (count > 0) {
+            saveData();
+        }
+    }
+
+    free(changes);
+    returnToMenu();
+}
+
+//Parse a file of schedule changes into a new array. Returns 0 on error, with *errorLine the bad line or 0 if the file could not be read
+int readScheduleChanges(const char *fileName, ScheduleChange **changes, int *count, int *errorLine) {
+    *changes = NULL;
+    *count = 0;
+    *errorLine = 0;
+
+    FILE *file = fopen(fileName, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    int capacity = 0;
+    int lineNumber = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        char verb[16];
+        if (sscanf(line, "%15s", verb) != 1 || verb[0] == '#') {
+            continue;
+        }
+
+        ScheduleChange change;
+        memset(&change, 0, sizeof(change));
+        change.line = lineNumber;
+        char date[16], otherDate[16], extra[2];
+        int valid = 0;
+        if (strcmp(verb, "assign") == 0 || strcmp(verb, "unassign") == 0) {
+            change.operation = verb[0] == 'a' ? SCHEDULE_ASSIGN : SCHEDULE_UNASSIGN;
+            valid = sscanf(line, "%*s %d %15s %d %1s", &change.doctorID, date, &change.shift, extra) == 3 &&
+                    parseScheduleDate(date, &change.day);
+        } else if (strcmp(verb, "swap") == 0) {
+            change.operation = SCHEDULE_SWAP;
+            valid = sscanf(line, "%*s %d %15s %d %d %15s %d %1s", &change.doctorID, date, &change.shift,
+                           &change.otherDoctorID, otherDate, &change.otherShift, extra) == 6 &&
+                    parseScheduleDate(date, &change.day) && parseScheduleDate(otherDate, &change.otherDay);
+        }
+        if (!valid || *count >= MAX_SCHEDULE_CHANGES) {
+            *errorLine = lineNumber;
+            break;
+        }
+
+        if (*count == capacity) {
+            capacity = capacity == 0 ? INITIAL_CAPACITY : capacity * 2;
+            ScheduleChange *grown = (ScheduleChange *) realloc(*changes, capacity * sizeof(ScheduleChange));
+            if (grown == NULL) {
+                break;
+            }
+            *changes = grown;
+        }
+        (*changes)[(*count)++] = change;
+    }
+
+    int complete = *errorLine == 0 && !ferror(file) && feof(file);
+    fclose(file);
+    if (!complete) {
+        free(*changes);
+        *changes = NULL;
+        *count = 0;
+        return 0;
+    }
+    return 1;
+}
+
+//Apply a list of schedule changes as one: either all of them are made, or none. Each change is checked against
+//the schedule as the earlier ones left it. Returns a STORE_* code; on failure *failedChange is the change refused, or -1
+int applyScheduleChanges(const ScheduleChange *changes, int count, int *failedChange) {
+    *failedChange = -1;
+    if (count == 0) {
+        return STORE_OK;
+    }
+
+    // A swap is two unassigns and two assigns, the most steps any change takes
+    ScheduleStep *steps = (ScheduleStep *) malloc((size_t) count * 4 * sizeof(ScheduleStep));
+    if (steps == NULL) {
+        return STORE_OUT_OF_MEMORY;
+    }
+
+    pthread_rwlock_wrlock(&doctorStoreLock);
+
+    int stepCount = 0;
+    int result = STORE_OK;
+    for (int c = 0; c < count && result == STORE_OK; c++) {
+        const ScheduleChange *change = &changes[c];
+        if (change->operation == SCHEDULE_SWAP) {
+            // Both doctors come off their shifts first, so a swap within a full week stays under the limit
+            result = change->doctorID == change->otherDoctorID ? STORE_INVALID_ARGUMENT :
+                     applyScheduleStep(steps, &stepCount, SCHEDULE_UNASSIGN, change->doctorID, change->day, change->shift);
+            if (result == STORE_OK) {
+                result = applyScheduleStep(steps, &stepCount, SCHEDULE_UNASSIGN, change->otherDoctorID,
+                                           change->otherDay, change->otherShift);
+            }
+            if (result == STORE_OK) {
+                result = applyScheduleStep(steps, &stepCount, SCHEDULE_ASSIGN, change->doctorID,
+                                           change->otherDay, change->otherShift);
+            }
+            if (result == STORE_OK) {
+                result = applyScheduleStep(steps, &stepCount, SCHEDULE_ASSIGN, change->otherDoctorID,
+                                           change->day, change->shift);
+            }
+        } else if (change->operation == SCHEDULE_ASSIGN || change->operation == SCHEDULE_UNASSIGN) {
+            result = applyScheduleStep(steps, &stepCount, change->operation, change->doctorID, change->day, change->shift);
+        } else {
+            result = STORE_INVALID_ARGUMENT;
+        }
+        if (result != STORE_OK) {
+            *failedChange = c;
+        }
+    }
+
+    if (result != STORE_OK) {
+        undoScheduleSteps(steps, stepCount);
+        pthread_rwlock_unlock(&doctorStoreLock);
+        free(steps);
+        return result;
+    }
+
+    // Every step stands, so count them and write them out together
+    for (int i = 0; i < stepCount; i++) {
+        adjustDoctorShifts(steps[i].doctor, steps[i].operation == SCHEDULE_ASSIGN ? 1 : -1);
+    }
+    appendScheduleJournalBatch(steps, stepCount);
+
+    // The standby applies the steps themselves rather than the swaps they came from
+    ScheduleChange *replicated = replicationLog != NULL ?
+                                 (ScheduleChange *) calloc(stepCount, sizeof(ScheduleChange)) : NULL;
+    if (replicated != NULL) {
+        for (int i = 0; i < stepCount; i++) {
+            replicated[i].operation = steps[i].operation;
+            replicated[i].doctorID = steps[i].doctor->doctorID;
+            replicated[i].day = steps[i].day;
+            replicated[i].shift = steps[i].shift;
+        }
+        shipMutation(REPL_SCHEDULE_BATCH, replicated, stepCount * sizeof(ScheduleChange));
+        free(replicated);
+    } else if (replicationLog != NULL) {
+        printf("Warning: Memory allocation failed; the schedule changes were not shipped to the replication log.\n");
+    }
+
+    pthread_rwlock_unlock(&doctorStoreLock);
+    free(steps);
+    return STORE_OK;
+}
+
+//Make one assignment or unassignment of a bulk change and add it to the steps taken. Caller must hold the doctor write lock
+int applyScheduleStep(ScheduleStep *steps, int *stepCount, int operation, int doctorID, int day, int shift) {
+    if (shift < 1 || shift > MAX_SHIFTS_IN_DAY) {
+        return STORE_INVALID_ARGUMENT;
+    }
+    Doctor *doctor = findDoctorByID(doctorID);
+    if (doctor == NULL) {
+        return STORE_NOT_FOUND;
+    }
+
+    ScheduleStep *step = &steps[*stepCount];
+    step->operation = operation;
+    step->doctor = doctor;
+    step->day = day;
+    step->shift = shift;
+    step->position = 0;
+
+    int result;
+    if (operation == SCHEDULE_ASSIGN) {
+        result = breaksRestRule(&doctorSchedule, doctorID, day, shift) ? STORE_REST_VIOLATION :
+                 scheduleAdd(&doctorSchedule, day, shift, doctorID);
+    } else {
+        ScheduleSlot *slot = findScheduleSlot(&doctorSchedule, day, shift, 0);
+        while (slot != NULL && step->position < slot->count && slot->doctorIDs[step->position] != doctorID) {
+            step->position++;
+        }
+        result = scheduleRemove(&doctorSchedule, day, shift, doctorID);
+    }
+
+    if (result == STORE_OK) {
+        (*stepCount)++;
+    }
+    return result;
+}
+
+//Undo the steps of a bulk change, last first, putting each doctor back in their old place on the shift. Caller must hold the doctor write lock
+void undoScheduleSteps(const ScheduleStep *steps, int stepCount) {
+    for (int i = stepCount - 1; i >= 0; i--) {
+        const ScheduleStep *step = &steps[i];
+        if (step->operation == SCHEDULE_ASSIGN) {
+            scheduleRemove(&doctorSchedule, step->day, step->shift, step->doctor->doctorID);
+            continue;
+        }
+
+        // The place and the week's shift the step freed are still free, and the entries still exist,
+        // so the add cannot fail
+        scheduleAdd(&doctorSchedule, step->day, step->shift, step->doctor->doctorID);
+        ScheduleSlot *slot = findScheduleSlot(&doctorSchedule, step->day, step->shift, 0);
+        memmove(&slot->doctorIDs[step->position + 1], &slot->doctorIDs[step->position],
+                (slot->count - 1 - step->position) * sizeof(int));
+        slot->doctorIDs[step->position] = step->doctor->doctorID;
+    }
+}
+
+ //Display the doctor schedule one calendar week at a time
+void viewSchedule() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Doctor Schedule");
+
+    char date[32];
+    int day = todayScheduleDay();
+    printf("Show the week of (YYYY-MM-DD, Enter for this week): ");
+    fgets(date, sizeof(date), stdin);
+    date[strcspn(date, "\n")] = 0;
+    if (date[0] != '\0' && !parseScheduleDate(date, &day)) {
+        printf("The date is invalid!\n");
+        returnToMenu();
+        return;
+    }
+
+    ReportBuffer page;
+    memset(&page, 0, sizeof(page));
+    int monday = weekStartDay(day);
+    char command[16];
+
+    while (1) {
+        // Build the whole screen in one buffer so it reaches the terminal in a single write
+        page.length = 0;
+        reportBufferAppend(&page, "\e[1;1H\e[2J");  // Clear the screen
+        renderHeader(&page, "Doctor Schedule");
+        pthread_rwlock_rdlock(&doctorStoreLock);
+        renderScheduleWeek(&page, monday);
+        pthread_rwlock_unlock(&doctorStoreLock);
+
+        fflush(stdout);
+        if (page.failed || !writeToTerminal(page.data, page.length)) {
+            printf("Error: Unable to display the schedule.\n");
+            break;
+        }
+
+        printf("\nEnter = return, n = next week, p = previous week: ");
+        if (fgets(command, sizeof(command), stdin) == NULL) {
+            break;
+        }
+        if (strchr(command, '\n') == NULL) {
+            clearInputBuffer();     // Discard the rest of an overlong line
+        }
+
+        if (command[0] == 'n') {
+            monday += 7;
+        } else if (command[0] == 'p') {
+            monday -= 7;
+        } else {
+            break;
+        }
+    }
+
+    reportBufferRelease(&page);
+}
+
+//Render the week starting on monday, one line per doctor on the day's busiest shift. Caller must hold the doctor lock
+void renderScheduleWeek(ReportBuffer *buffer, int monday) {
+    static const char *dayNames[] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+    char first[11], last[11], date[11];
+    char cell[25];
+
+    formatScheduleDate(monday, first);
+    formatScheduleDate(monday + 6, last);
+    reportBufferAppend(buffer, "Week of %s to %s\n", first, last);
+    reportBufferAppend(buffer, "-------------------------------------------------------------------------------------\n");
+    reportBufferAppend(buffer, "%-16s| %-24s| %-24s| %-24s|\n", "Date", "Morning", "Afternoon", "Evening");
+    reportBufferAppend(buffer, "-------------------------------------------------------------------------------------\n");
+
+    for (int d = 0; d < MAX_DAYS_IN_WEEK; d++) {
+        // One lookup per shift; the day takes as many lines as its busiest shift has doctors
+        ScheduleSlot *slots[MAX_SHIFTS_IN_DAY];
+        int lines = 1;
+        for (int s = 0; s < MAX_SHIFTS_IN_DAY; s++) {
+            slots[s] = findScheduleSlot(&doctorSchedule, monday + d, s + 1, 0);
+            if (slots[s] != NULL && slots[s]->count > lines) {
+                lines = slots[s]->count;
+            }
+        }
+
+        formatScheduleDate(monday + d, date);
+        for (int line = 0; line < lines; line++) {
+            if (line == 0) {
+                reportBufferAppend(buffer, "%-3s %-12s|", dayNames[d], date);
+            } else {
+                reportBufferAppend(buffer, "%-16s|", "");
+            }
+
+            for (int s = 0; s < MAX_SHIFTS_IN_DAY; s++) {
+                int count = slots[s] != NULL ? slots[s]->count : 0;
+                if (line < count) {
+                    Doctor *doctor = findDoctorByID(slots[s]->doctorIDs[line]);
+                    if (doctor != NULL) {
+                        snprintf(cell, sizeof(cell), "Dr. %.20s", doctor->doctorName);
+                    } else {
+                        snprintf(cell, sizeof(cell), "Unknown (ID %d)", slots[s]->doctorIDs[line]);
+                    }
+                    reportBufferAppend(buffer, " %-24s|", cell);
+                } else {
+                    reportBufferAppend(buffer, " %-24s|", line == 0 ? "Not Assigned" : "");
+                }
+            }
+            reportBufferAppend(buffer, "\n");
+        }
+    }
+}
+
+//Count the shifts of the week starting on monday that have at least one doctor. Caller must hold the doctor lock
+int countCoveredShifts(int monday) {
+    int covered = 0;
+    for (int d = 0; d < MAX_DAYS_IN_WEEK; d++) {
+        for (int s = 1; s <= MAX_SHIFTS_IN_DAY; s++) {
+            ScheduleSlot *slot = findScheduleSlot(&doctorSchedule, monday + d, s, 0);
+            if (slot != NULL && slot->count > 0) {
+                covered++;
+            }
+        }
+    }
+    return covered;
+}
+
+//Assign a doctor to a shift, recording how long it took
+int assignShift(int doctorID, int day, int shift) {
+    long long started = latencyStart();
+    int result = assignShiftUntimed(doctorID, day, shift);
+    latencyRecord(LATENCY_ASSIGN, started, result == STORE_OK);
+    return result;
+}
+
+//Assign a doctor to a shift (1-3) of a date (days since 1970-01-01). Validates the shift, weekly limit and rest rule under the doctor write lock
+int assignShiftUntimed(int doctorID, int day, int shift) {
+    if (shift < 1 || shift > MAX_SHIFTS_IN_DAY) {
+        return STORE_INVALID_ARGUMENT;
+    }
+
+    pthread_rwlock_wrlock(&doctorStoreLock);
+
+    Doctor *doctor = findDoctorByID(doctorID);
+    if (doctor == NULL) {
+        pthread_rwlock_unlock(&doctorStoreLock);
+        return STORE_NOT_FOUND;
+    }
+
+    if (breaksRestRule(&doctorSchedule, doctorID, day, shift)) {
+        pthread_rwlock_unlock(&doctorStoreLock);
+        return STORE_REST_VIOLATION;
+    }
+
+    int result = commitShiftAssignment(doctor, day, shift);
+    pthread_rwlock_unlock(&doctorStoreLock);
+    return result;
+}
+
+//Put a doctor on a shift and record it in the counters, schedule.log and the replication log. Caller must hold the doctor write lock
+int commitShiftAssignment(Doctor *doctor, int day, int shift) {
+    int result = scheduleAdd(&doctorSchedule, day, shift, doctor->doctorID);
+    if (result != STORE_OK) {
+        return result;
+    }
+
+    adjustDoctorShifts(doctor, 1);
+    appendScheduleJournal(SCHEDULE_ASSIGN, day, shift, doctor->doctorID);
+    ReplicatedShift replicated = {doctor->doctorID, day, shift};
+    shipMutation(REPL_ASSIGN_SHIFT, &replicated, sizeof(replicated));
+    return STORE_OK;
+}
+
+//Add to a doctor's shift count and keep the shift statistics in step. Caller must hold the doctor write lock
+void adjustDoctorShifts(Doctor *doctor, int change) {
+    int before = doctor->totalShifts;
+    doctor->totalShifts += change;
+    atomic_fetch_add(&hospitalStats.shiftsAssigned, change);
+    if (before == 0 && doctor->totalShifts > 0) {
+        atomic_fetch_add(&hospitalStats.doctorsWithShifts, 1);
+    } else if (before > 0 && doctor->totalShifts == 0) {
+        atomic_fetch_sub(&hospitalStats.doctorsWithShifts, 1);
+    }
+}
+
+//Take a doctor off a shift, recording how long it took
+int unassignShift(int doctorID, int day, int shift) {
+    long long started = latencyStart();
+    int result = unassignShiftUntimed(doctorID, day, shift);
+    latencyRecord(LATENCY_UNASSIGN, started, result == STORE_OK);
+    return result;
+}
+
+//Take a doctor off a shift (1-3) of a date (days since 1970-01-01) under the doctor write lock
+int unassignShiftUntimed(int doctorID, int day, int shift) {
+    if (shift < 1 || shift > MAX_SHIFTS_IN_DAY) {
+        return STORE_INVALID_ARGUMENT;
+    }
+
+    pthread_rwlock_wrlock(&doctorStoreLock);
+
+    Doctor *doctor = findDoctorByID(doctorID);
+    if (doctor == NULL) {
+        pthread_rwlock_unlock(&doctorStoreLock);
+        return STORE_NOT_FOUND;
+    }
+
+    int result = scheduleRemove(&doctorSchedule, day, shift, doctorID);
+    if (result != STORE_OK) {
+        pthread_rwlock_unlock(&doctorStoreLock);
+        return result;
+    }
+
+    adjustDoctorShifts(doctor, -1);
+    appendScheduleJournal(SCHEDULE_UNASSIGN, day, shift, doctorID);
+    ReplicatedShift replicated = {doctorID, day, shift};
+    shipMutation(REPL_UNASSIGN_SHIFT, &replicated, sizeof(replicated));
+
+    pthread_rwlock_unlock(&doctorStoreLock);
+    return STORE_OK;
+}
+
+//Prompt for a period and the doctors wanted per shift, then fill the open places of the roster
+void autoSchedule() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Fill Roster Automatically");
+
+    char date[32];
+    int firstDay, lastDay;
+    printf("\nFirst date (YYYY-MM-DD): ");
+    fgets(date, sizeof(date), stdin);
+    date[strcspn(date, "\n")] = 0;
+    if (!parseScheduleDate(date, &firstDay)) {
+        printf("The date is invalid!\n");
+        returnToMenu();
+        return;
+    }
+
+    printf("Last date (YYYY-MM-DD): ");
+    fgets(date, sizeof(date), stdin);
+    date[strcspn(date, "\n")] = 0;
+    if (!parseScheduleDate(date, &lastDay)) {
+        printf("The date is invalid!\n");
+        returnToMenu();
+        return;
+    }
+    if (lastDay < firstDay || lastDay - firstDay >= ROSTER_MAX_DAYS) {
+        printf("The period must end on or after its first date and span at most %d days!\n", ROSTER_MAX_DAYS);
+        returnToMenu();
+        return;
+    }
+
+    printf("Doctors per shift (1-%d): ", MAX_DOCTORS_PER_SHIFT);
+    int doctorsPerShift = scanInt();
+    if (doctorsPerShift < 1 || doctorsPerShift > MAX_DOCTORS_PER_SHIFT) {
+        printf("Invalid number of doctors per shift!\n");
+        returnToMenu();
+        return;
+    }
+
+    RosterResult result;
+    int status = fillRoster(firstDay, lastDay, doctorsPerShift, &result);
+    if (status == STORE_NOT_FOUND) {
+        printf("No doctors in the system. Please add doctors first.\n");
+        returnToMenu();
+        return;
+    }
+    if (status != STORE_OK) {
+        printf("Error: Memory allocation failed for the roster.\n");
+        returnToMenu();
+        return;
+    }
+
+    printf("\n%-30s%d\n", "Open places:", result.positions);
+    printf("%-30s%d\n", "Places filled:", result.filled);
+    printf("%-30s%d\n", "Moved to balance shifts:", result.moves);
+    printf("%-30s%d to %d\n", "Shifts per doctor:", result.minShifts, result.maxShifts);
+    printf("%-30s%.1f ms\n", "Time taken:", result.elapsedMicros / 1000.0);
+    if (result.filled < result.positions) {
+        printf("\n%d places were left open: no doctor could take them within the weekly limit and the rest rule.\n",
+               result.positions - result.filled);
+    }
+
+    if (result.filled > 0) {
+        saveData();
+    }
+    returnToMenu();
+}
+
+//Fill the shifts of firstDay..lastDay up to doctorsPerShift doctors each, keeping existing assignments. Returns a STORE_* code
+int fillRoster(int firstDay, int lastDay, int doctorsPerShift, RosterResult *result) {
+    memset(result, 0, sizeof(RosterResult));
+    if (lastDay < firstDay || lastDay - firstDay >= ROSTER_MAX_DAYS ||
+        doctorsPerShift < 1 || doctorsPerShift > MAX_DOCTORS_PER_SHIFT) {
+        return STORE_INVALID_ARGUMENT;
+    }
+
+    long long start = currentTimeMicros();
+    pthread_rwlock_wrlock(&doctorStoreLock);
+
+    RosterPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    for (Doctor *current = doctorHead; current != NULL; current = current->next) {
+        plan.doctorCount++;
+    }
+    if (plan.doctorCount == 0) {
+        pthread_rwlock_unlock(&doctorStoreLock);
+        return STORE_NOT_FOUND;
+    }
+
+    // The roster is planned in the solver's own arrays and then committed; the write lock keeps the two in step
+    int days = lastDay - firstDay + 1;
+    plan.firstDay = firstDay;
+    plan.lastDay = lastDay;
+    plan.doctorsPerShift = doctorsPerShift;
+    plan.firstWeek = weekOfDay(firstDay) - 1;
+    plan.weekSpan = weekOfDay(lastDay) + 2 - plan.firstWeek;
+    plan.doctors = (Doctor **) malloc(plan.doctorCount * sizeof(Doctor *));
+    plan.loads = (int *) malloc(plan.doctorCount * sizeof(int));
+    plan.weekBits = (unsigned int *) malloc((size_t) plan.doctorCount * plan.weekSpan * sizeof(unsigned int));
+    plan.placesTaken = (int *) malloc(days * MAX_SHIFTS_IN_DAY * sizeof(int));
+    plan.entries = (RosterEntry *) malloc(days * MAX_SHIFTS_IN_DAY * doctorsPerShift * sizeof(RosterEntry));
+    int status = STORE_OUT_OF_MEMORY;
+
+    if (plan.doctors != NULL && plan.loads != NULL && plan.weekBits != NULL && plan.placesTaken != NULL &&
+        plan.entries != NULL) {
+        int i = 0;
+        for (Doctor *current = doctorHead; current != NULL; current = current->next, i++) {
+            plan.doctors[i] = current;
+            plan.loads[i] = current->totalShifts;
+            for (int w = 0; w < plan.weekSpan; w++) {
+                plan.weekBits[i * plan.weekSpan + w] = weekShiftBits(&doctorSchedule, current->doctorID,
+                                                                     plan.firstWeek + w);
+            }
+        }
+        for (int day = firstDay; day <= lastDay; day++) {
+            for (int shift = 1; shift <= MAX_SHIFTS_IN_DAY; shift++) {
+                ScheduleSlot *slot = findScheduleSlot(&doctorSchedule, day, shift, 0);
+                plan.placesTaken[(day - firstDay) * MAX_SHIFTS_IN_DAY + shift - 1] = slot != NULL ? slot->count : 0;
+            }
+        }
+
+        planRoster(&plan, result);
+
+        // Every check passed against the plan, so each commit succeeds unless memory runs out
+        status = STORE_OK;
+        int committed = 0;
+        while (status == STORE_OK && committed < plan.entryCount) {
+            RosterEntry *entry = &plan.entries[committed];
+            status = commitShiftAssignment(plan.doctors[entry->doctor], entry->day, entry->shift);
+            if (status == STORE_OK) {
+                committed++;
+            }
+        }
+        result->filled = committed;
+
+        result->minShifts = result->maxShifts = plan.doctors[0]->totalShifts;
+        for (i = 1; i < plan.doctorCount; i++) {
+            if (plan.doctors[i]->totalShifts < result->minShifts) {
+                result->minShifts = plan.doctors[i]->totalShifts;
+            }
+            if (plan.doctors[i]->totalShifts > result->maxShifts) {
+                result->maxShifts = plan.doctors[i]->totalShifts;
+            }
+        }
+    }
+
+    pthread_rwlock_unlock(&doctorStoreLock);
+    free(plan.doctors);
+    free(plan.loads);
+    free(plan.weekBits);
+    free(plan.placesTaken);
+    free(plan.entries);
+    result->elapsedMicros = currentTimeMicros() - start;
+    return status;
+}
+
+//Plan the roster: a greedy fill, then a local search that evens out the shift counts
+void planRoster(RosterPlan *plan, RosterResult *result) {
+    int *loads = plan->loads;
+    int rotation = 0;
+
+    for (int p = 0; p < (plan->lastDay - plan->firstDay + 1) * MAX_SHIFTS_IN_DAY; p++) {
+        int open = plan->doctorsPerShift - plan->placesTaken[p];
+        result->positions += open > 0 ? open : 0;
+    }
+
+    // Fill the period one level at a time, so every shift gets a first doctor before any gets a second.
+    // Each place goes to the eligible doctor with the fewest shifts, then the fewest that week; the scan
+    // starts one doctor further on each time, so ties do not always go to the same doctors
+    for (int level = 1; level <= plan->doctorsPerShift; level++) {
+        for (int day = plan->firstDay; day <= plan->lastDay; day++) {
+            int column = weekOfDay(day) - plan->firstWeek;
+            for (int shift = 1; shift <= MAX_SHIFTS_IN_DAY; shift++) {
+                int *taken = &plan->placesTaken[(day - plan->firstDay) * MAX_SHIFTS_IN_DAY + shift - 1];
+                if (*taken >= level) {
+                    continue;
+                }
+
+                int best = -1;
+                int bestWeek = 0;
+                for (int k = 0; k < plan->doctorCount; k++) {
+                    int i = (k + rotation) % plan->doctorCount;
+                    if (best >= 0 && loads[i] > loads[best]) {
+                        continue;   // Rules out most doctors once counts spread
+                    }
+                    if (!rosterCanTake(plan, i, day, shift)) {
+                        continue;
+                    }
+                    int weekShifts = __builtin_popcount(plan->weekBits[i * plan->weekSpan + column]);
+                    if (best < 0 || loads[i] < loads[best] || weekShifts < bestWeek) {
+                        best = i;
+                        bestWeek = weekShifts;
+                    }
+                }
+                rotation++;
+
+                if (best < 0) {
+                    continue;   // Nobody can take this place
+                }
+                plan->weekBits[best * plan->weekSpan + column] |= shiftBit(day, shift);
+                (*taken)++;
+                loads[best]++;
+                RosterEntry *entry = &plan->entries[plan->entryCount++];
+                entry->day = day;
+                entry->shift = shift;
+                entry->doctor = best;
+            }
+        }
+    }
+    result->filled = plan->entryCount;
+
+    // Hand a filled place to an eligible doctor with at least two fewer shifts. Each move lowers the sum of
+    // squared shift counts, so the search settles; it stops early once a whole round moves nothing
+    for (int round = 0; round < ROSTER_MAX_ROUNDS; round++) {
+        int moved = 0;
+        for (int e = 0; e < plan->entryCount; e++) {
+            RosterEntry *entry = &plan->entries[e];
+            int from = entry->doctor;
+            int best = -1;
+            for (int i = 0; i < plan->doctorCount; i++) {
+                if (loads[i] + 2 > loads[from] || (best >= 0 && loads[i] >= loads[best])) {
+                    continue;
+                }
+                if (rosterCanTake(plan, i, entry->day, entry->shift)) {
+                    best = i;
+                }
+            }
+            if (best < 0) {
+                continue;
+            }
+
+            int column = weekOfDay(entry->day) - plan->firstWeek;
+            unsigned int bit = shiftBit(entry->day, entry->shift);
+            plan->weekBits[from * plan->weekSpan + column] &= ~bit;
+            plan->weekBits[best * plan->weekSpan + column] |= bit;
+            loads[from]--;
+            loads[best]++;
+            entry->doctor = best;
+            moved++;
+        }
+
+        result->moves += moved;
+        if (moved == 0) {
+            break;
+        }
+    }
+}
+
+//Return 1 if the doctor at an index of the plan could take another place on a shift of the period
+int rosterCanTake(const RosterPlan *plan, int doctor, int day, int shift) {
+    // The period has a week either side in the matrix, so both neighbours of any column exist
+    const unsigned int *week = &plan->weekBits[doctor * plan->weekSpan + weekOfDay(day) - plan->firstWeek];
+    return shiftFitsWeek(week[-1], week[0], week[1], shiftBit(day, shift));
+}
+
+//List the doctors who could take another place on a shift of a date, with their shifts that week
+void viewFreeDoctors() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Find Free Doctors");
+
+    char date[32];
+    int day;
+    printf("\nEnter date (YYYY-MM-DD): ");
+    fgets(date, sizeof(date), stdin);
+    date[strcspn(date, "\n")] = 0;
+    if (!parseScheduleDate(date, &day)) {
+        printf("The date is invalid!\n");
+        returnToMenu();
+        return;
+    }
+
+    printf("Enter shift (1-morning, 2-afternoon, 3-evening): ");
+    int shift = scanInt();
+    if (shift < 1 || shift > MAX_SHIFTS_IN_DAY) {
+        printf("Invalid shift! Must be between 1 and 3.\n");
+        returnToMenu();
+        return;
+    }
+
+    const char *shiftNames[] = {"Morning", "Afternoon", "Evening"};
+    printf("\nDoctors free for the %s shift of %s:\n\n", shiftNames[shift - 1], date);
+    printf("%-10s%-30s%-12s\n", "ID", "Name", "This Week");
+    printf("----------------------------------------------------\n");
+
+    int week = weekOfDay(day);
+    int freeDoctors = 0;
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    ScheduleSlot *slot = findScheduleSlot(&doctorSchedule, day, shift, 0);
+    int openPlaces = MAX_DOCTORS_PER_SHIFT - (slot != NULL ? slot->count : 0);
+    for (Doctor *current = doctorHead; current != NULL; current = current->next) {
+        if (canTakeShift(&doctorSchedule, current->doctorID, day, shift)) {
+            int weekShifts = __builtin_popcount(weekShiftBits(&doctorSchedule, current->doctorID, week));
+            printf("%-10d%-30s%d of %d\n", current->doctorID, current->doctorName, weekShifts, MAX_SHIFTS_PER_DOCTOR);
+            freeDoctors++;
+        }
+    }
+    pthread_rwlock_unlock(&doctorStoreLock);
+
+    printf("\n%d doctors free, %d of %d places on the shift open.\n", freeDoctors, openPlaces, MAX_DOCTORS_PER_SHIFT);
+    returnToMenu();
+}
+
+//Return 1 if a doctor could take another place on a shift: not on it already, under the weekly limit and rested
+int canTakeShift(ScheduleStore *store, int doctorID, int day, int shift) {
+    int week = weekOfDay(day);
+    unsigned int bit = shiftBit(day, shift);
+
+    // The neighbouring weeks only matter for Monday morning and Sunday evening
+    unsigned int previous = bit == 1u ? weekShiftBits(store, doctorID, week - 1) : 0;
+    unsigned int next = bit == 1u << (WEEK_SHIFT_BITS - 1) ? weekShiftBits(store, doctorID, week + 1) : 0;
+    return shiftFitsWeek(previous, weekShiftBits(store, doctorID, week), next, bit);
+}
+
+//Return 1 if a shift bit can be added to a doctor's week bits under the weekly limit and rest rule, given the weeks either side
+int shiftFitsWeek(unsigned int previous, unsigned int current, unsigned int next, unsigned int bit) {
+    if ((current & bit) != 0 || __builtin_popcount(current) >= MAX_SHIFTS_PER_DOCTOR) {
+        return 0;
+    }
+    // A morning follows the evening one bit below it, reaching into the previous week's Sunday for Monday
+    if ((bit & (EVENING_SHIFT_BITS >> 2)) != 0 &&
+        ((current & (bit >> 1)) != 0 || (bit == 1u && (previous >> (WEEK_SHIFT_BITS - 1)) != 0))) {
+        return 0;
+    }
+    // An evening precedes the morning one bit above it, or the next week's Monday for Sunday
+    if ((bit & EVENING_SHIFT_BITS) != 0 &&
+        ((current & (bit << 1)) != 0 || (bit == 1u << (WEEK_SHIFT_BITS - 1) && (next & 1u) != 0))) {
+        return 0;
+    }
+    return 1;
+}
+
+//Return 1 if a shift would put a doctor on an evening followed by the next morning
+int breaksRestRule(ScheduleStore *store, int doctorID, int day, int shift) {
+    int neighbour;
+    if (shift == 1) {
+        neighbour = day - 1;
+        shift = MAX_SHIFTS_IN_DAY;
+    } else if (shift == MAX_SHIFTS_IN_DAY) {
+        neighbour = day + 1;
+        shift = 1;
+    } else {
+        return 0;
+    }
+    // The neighbouring shift is in another week only on Monday morning and Sunday evening
+    return (weekShiftBits(store, doctorID, weekOfDay(neighbour)) & shiftBit(neighbour, shift)) != 0;
+}
+
+//Return 1 if a doctor is on a schedule entry, which may be NULL
+int slotHasDoctor(const ScheduleSlot *slot, int doctorID) {
+    for (int i = 0; slot != NULL && i < slot->count; i++) {
+        if (slot->doctorIDs[i] == doctorID) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//Return the shifts a doctor works in a week as DoctorWeekLoad.shiftBits, 0 if none
+unsigned int weekShiftBits(ScheduleStore *store, int doctorID, int week) {
+    DoctorWeekLoad *load = findDoctorWeekLoad(store, doctorID, week, 0);
+    return load != NULL ? load->shiftBits : 0;
+}
+
+//Return the DoctorWeekLoad.shiftBits bit of a shift (1-3) of a date
+unsigned int shiftBit(int day, int shift) {
+    return 1u << ((day - weekStartDay(day)) * MAX_SHIFTS_IN_DAY + shift - 1);
+}
+
+//Count the evenings in a week's shift bits that are followed by a morning in the same week
+int countRestViolations(unsigned int shiftBits) {
+    return __builtin_popcount(shiftBits & (shiftBits >> 1) & EVENING_SHIFT_BITS);
+}
+
+//Find the entry of a date and shift. With create set, adds an empty entry if there is none. Returns NULL if absent or out of memory
+ScheduleSlot *findScheduleSlot(ScheduleStore *store, int day, int shift, int create) {
+    // Keep the table at most half full so probe chains stay short
+    if (create && (store->slotCount + 1) * 2 > store->slotCapacity) {
+        int newCapacity = store->slotCapacity == 0 ? SCHEDULE_INITIAL_CAPACITY : store->slotCapacity * 2;
+        ScheduleSlot *newSlots = (ScheduleSlot *) calloc(newCapacity, sizeof(ScheduleSlot));
+        if (newSlots == NULL) {
+            return NULL;
+        }
+        for (int i = 0; i < store->slotCapacity; i++) {
+            ScheduleSlot *old = &store->slots[i];
+            if (old->shift != 0) {
+                unsigned int j = (unsigned int) (old->day * MAX_SHIFTS_IN_DAY + old->shift) * 2654435761u &
+                                 (newCapacity - 1);
+                while (newSlots[j].shift != 0) {
+                    j = (j + 1) & (newCapacity - 1);
+                }
+                newSlots[j] = *old;
+            }
+        }
+        free(store->slots);
+        store->slots = newSlots;
+        store->slotCapacity = newCapacity;
+    }
+    if (store->slotCapacity == 0) {
+        return NULL;
+    }
+
+    unsigned int mask = store->slotCapacity - 1;
+    unsigned int i = (unsigned int) (day * MAX_SHIFTS_IN_DAY + shift) * 2654435761u & mask;
+    while (store->slots[i].shift != 0) {
+        if (store->slots[i].day == day && store->slots[i].shift == shift) {
+            return &store->slots[i];
+        }
+        i = (i + 1) & mask;
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    store->slots[i].day = day;
+    store->slots[i].shift = shift;
+    store->slots[i].count = 0;
+    store->slotCount++;
+    return &store->slots[i];
+}
+
+//Find the shift count of a doctor in a week. With create set, adds a zero count if there is none. Returns NULL if absent or out of memory
+DoctorWeekLoad *findDoctorWeekLoad(ScheduleStore *store, int doctorID, int week, int create) {
+    if (create && (store->loadCount + 1) * 2 > store->loadCapacity) {
+        int newCapacity = store->loadCapacity == 0 ? SCHEDULE_INITIAL_CAPACITY : store->loadCapacity * 2;
+        DoctorWeekLoad *newLoads = (DoctorWeekLoad *) calloc(newCapacity, sizeof(DoctorWeekLoad));
+        if (newLoads == NULL) {
+            return NULL;
+        }
+        for (int i = 0; i < store->loadCapacity; i++) {
+            DoctorWeekLoad *old = &store->loads[i];
+            if (old->doctorID != 0) {
+                unsigned int j = ((unsigned int) old->doctorID * 2654435761u ^ (unsigned int) old->week * 40503u) &
+                                 (newCapacity - 1);
+                while (newLoads[j].doctorID != 0) {
+                    j = (j + 1) & (newCapacity - 1);
+                }
+                newLoads[j] = *old;
+            }
+        }
+        free(store->loads);
+        store->loads = newLoads;
+        store->loadCapacity = newCapacity;
+    }
+    if (store->loadCapacity == 0) {
+        return NULL;
+    }
+
+    unsigned int mask = store->loadCapacity - 1;
+    unsigned int i = ((unsigned int) doctorID * 2654435761u ^ (unsigned int) week * 40503u) & mask;
+    while (store->loads[i].doctorID != 0) {
+        if (store->loads[i].doctorID == doctorID && store->loads[i].week == week) {
+            return &store->loads[i];
+        }
+        i = (i + 1) & mask;
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    store->loads[i].doctorID = doctorID;
+    store->loads[i].week = week;
+    store->loads[i].shiftBits = 0;
+    store->loadCount++;
+    return &store->loads[i];
+}
+
+//Put a doctor on a shift of a date. The duplicate and weekly limit checks read the doctor's week bits; the full shift check reads the shift
+int scheduleAdd(ScheduleStore *store, int day, int shift, int doctorID) {
+    if (shift < 1 || shift > MAX_SHIFTS_IN_DAY || doctorID <= 0) {
+        return STORE_INVALID_ARGUMENT;
+    }
+
+    int week = weekOfDay(day);
+    unsigned int bit = shiftBit(day, shift);
+    DoctorWeekLoad *load = findDoctorWeekLoad(store, doctorID, week, 0);
+    if (load != NULL && (load->shiftBits & bit) != 0) {
+        return STORE_ALREADY_ON_SHIFT;
+    }
+
+    ScheduleSlot *slot = findScheduleSlot(store, day, shift, 0);
+    if (slot != NULL && slot->count >= MAX_DOCTORS_PER_SHIFT) {
+        return STORE_SHIFT_TAKEN;
+    }
+    if (load != NULL && __builtin_popcount(load->shiftBits) >= MAX_SHIFTS_PER_DOCTOR) {
+        return STORE_SHIFT_LIMIT;
+    }
+
+    // Running out of memory here can leave an empty entry behind, which reads the same as no entry
+    slot = findScheduleSlot(store, day, shift, 1);
+    load = slot != NULL ? findDoctorWeekLoad(store, doctorID, week, 1) : NULL;
+    if (load == NULL) {
+        return STORE_OUT_OF_MEMORY;
+    }
+
+    slot->doctorIDs[slot->count++] = doctorID;
+    load->shiftBits |= bit;
+    store->assignments++;
+    return STORE_OK;
+}
+
+//Take a doctor off a shift of a date
+int scheduleRemove(ScheduleStore *store, int day, int shift, int doctorID) {
+    ScheduleSlot *slot = findScheduleSlot(store, day, shift, 0);
+    for (int i = 0; slot != NULL && i < slot->count; i++) {
+        if (slot->doctorIDs[i] == doctorID) {
+            // Keep the remaining doctors in assignment order
+            memmove(&slot->doctorIDs[i], &slot->doctorIDs[i + 1], (slot->count - i - 1) * sizeof(int));
+            slot->count--;
+
+            DoctorWeekLoad *load = findDoctorWeekLoad(store, doctorID, weekOfDay(day), 0);
+            if (load != NULL) {
+                load->shiftBits &= ~shiftBit(day, shift);
+            }
+            store->assignments--;
+            return STORE_OK;
+        }
+    }
+    return STORE_NOT_ON_SHIFT;
+}
+
+//Free a schedule's tables and empty it
+void freeSchedule(ScheduleStore *store) {
+    free(store->slots);
+    free(store->loads);
+    memset(store, 0, sizeof(ScheduleStore));
+}
+
+//Copy every assignment of a schedule into a new array sorted by date, shift and doctor. Returns the count, or -1 if memory runs out
+int collectScheduleRecords(const ScheduleStore *store, ScheduleRecord **records) {
+    *records = (ScheduleRecord *) malloc((store->assignments + 1) * sizeof(ScheduleRecord));
+    if (*records == NULL) {
+        return -1;
+    }
+
+    int count = 0;
+    for (int i = 0; i < store->slotCapacity; i++) {
+        const ScheduleSlot *slot = &store->slots[i];
+        for (int d = 0; slot->shift != 0 && d < slot->count; d++) {
+            (*records)[count].day = slot->day;
+            (*records)[count].shift = slot->shift;
+            (*records)[count].doctorID = slot->doctorIDs[d];
+            count++;
+        }
+    }
+    qsort(*records, count, sizeof(ScheduleRecord), compareScheduleRecords);
+    return count;
+}
+
+//Compare schedule records by date, then shift, then doctor ID
+int compareScheduleRecords(const void *a, const void *b) {
+    const ScheduleRecord *left = (const ScheduleRecord *) a;
+    const ScheduleRecord *right = (const ScheduleRecord *) b;
+    if (left->day != right->day) {
+        return left->day < right->day ? -1 : 1;
+    }
+    if (left->shift != right->shift) {
+        return left->shift < right->shift ? -1 : 1;
+    }
+    return (left->doctorID > right->doctorID) - (left->doctorID < right->doctorID);
+}
+
+//Return the week of a date (days since 1970-01-01). Weeks start on Monday; week 0 starts on 1969-12-29, so week w starts on day 7w - 3
+int weekOfDay(int day) {
+    int shifted = day + 3;
+    return shifted >= 0 ? shifted / 7 : (shifted - 6) / 7;
+}
+
+//Return the Monday starting the week of a date, as days since 1970-01-01
+int weekStartDay(int day) {
+    return weekOfDay(day) * 7 - 3;
+}
+
+//Return today's date as days since 1970-01-01 on the hospital's local clock
+int todayScheduleDay() {
+    char now[20];
+    getCurrentDateTime(now, sizeof(now));
+    return (int) (dateTimeToSeconds(now) / 86400);
+}
+
+//Convert a "YYYY-MM-DD" date to days since 1970-01-01. Returns 0 if invalid
+int parseScheduleDate(const char *text, int *day) {
+    int minute;
+    if (!parseQueryDate(text, 0, &minute)) {
+        return 0;
+    }
+    *day = minute / (24 * 60);
+    return 1;
+}
+
+//Format days since 1970-01-01 as "YYYY-MM-DD" into a buffer of at least 11 characters
+void formatScheduleDate(int day, char *text) {
+    // Civil date from days, the inverse of the conversion in dateTimeToSeconds
+    long long z = (long long) day + 719468;
+    long long era = (z >= 0 ? z : z - 146096) / 146097;
+    long long dayOfEra = z - era * 146097;
+    long long yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    long long dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    long long monthIndex = (5 * dayOfYear + 2) / 153;
+    int dayOfMonth = (int) (dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+    int month = (int) (monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+    int year = (int) (yearOfEra + era * 400 + (month <= 2));
+    sprintf(text, "%04d-%02d-%02d", year % 10000, month, dayOfMonth);
+}
+
+//Add a doctor to the store. Validates the ID under the doctor write lock
+int registerDoctor(Doctor *newDoctor) {
+    pthread_rwlock_wrlock(&doctorStoreLock);
+
+    if (findDoctorByID(newDoctor->doctorID) != NULL) {
+        pthread_rwlock_unlock(&doctorStoreLock);
+        return STORE_DUPLICATE_ID;
+    }
+
+    appendDoctor(newDoctor);
+    totalDoctors++;
+    shipMutation(REPL_ADD_DOCTOR, newDoctor, sizeof(Doctor) - sizeof(Doctor *));
+
+    pthread_rwlock_unlock(&doctorStoreLock);
+    return STORE_OK;
+}
+
+//Append a doctor to the end of the linked list. Caller must hold the doctor write lock
+void appendDoctor(Doctor *newDoctor) {
+    newDoctor->next = NULL;
+    if (doctorHead == NULL) {
+        doctorHead = newDoctor;
+    } else {
+        doctorTail->next = newDoctor;
+    }
+    doctorTail = newDoctor;
+}
+
+//Find a doctor by ID. Caller must hold the doctor store lock
+Doctor *findDoctorByID(int id) {
+    Doctor *current = doctorHead;
+    while (current != NULL) {
+        if (current->doctorID == id) {
+            return current;
+        }
+        current = current->next;
+    }
+    return NULL;
+}
+
+//Generate reports menu. Provides options for different types of reports
+void generateReports() {
+    int choice;
+
+    do {
+        printf("\e[1;1H\e[2J");  // Clear the screen
+        printHeader("Generate Reports");
+
+        // Display report options
+        printf("1. Patient Admission Report\n");
+        printf("2. Doctor Utilization Report\n");
+        printf("3. Room Utilization Report\n");
+        printf("4. All Reports (single pass)\n");
+        printf("5. All Reports in Background\n");
+        printf("6. Export Data for Analytics\n");
+        printf("7. Length of Stay Report\n");
+        printf("8. Return to Main Menu\n");
+        printBackgroundReportStatus();
+        printf("Enter your choice: ");
+
+        choice = scanInt();
+
+        switch (choice) {
+            case 1: patientAdmissionReport();
+                break;
+            case 2: doctorUtilizationReport();
+                break;
+            case 3: roomUtilizationReport();
+                break;
+            case 4: allReports();
+                break;
+            case 5: startBackgroundReports();
+                break;
+            case 6: exportMenu();
+                break;
+            case 7: lengthOfStayReport();
+                break;
+            case 8: break;
+            default: printf("Invalid choice! Try again.\n");
+        }
+    } while (choice != 8);
+}
+
+//Generate a patient admission report. Creates a report file with details of all patients
+void patientAdmissionReport() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Patient Admission Report");
+
+    if (totalPatientsActive == 0) {
+        printf("No patients in the system.\n");
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+
+    // Create the report file with a timestamped name
+    char reportFileName[MAX_FILENAME_LENGTH];
+    char timestamp[20];
+    getFileTimestamp(timestamp, sizeof(timestamp));
+
+    long long started = latencyStart();
+    FILE *reportFile = openReportFile("patient_admission_report", timestamp, reportFileName);
+    if (reportFile == NULL) {
+        printf("Error: Unable to create report file.\n");
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+
+    long long traced = traceStart();
+    writeAdmissionHeader(reportFile, timestamp);
+
+    // Render the patient rows on the worker threads, then write them in shard order
+    ReportRenderJob *job = (ReportRenderJob *) calloc(1, sizeof(ReportRenderJob));
+    if (job == NULL) {
+        printf("Error: Memory allocation failed for report rendering.\n");
+        traceClose(reportFile, reportFileName);
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+    renderPatientShardsParallel(job);
+    int written = writeRenderedRows(reportFile, job);
+    freeRenderJob(job);
+    traceSpan("write", "report", traced, reportFileName);
+
+    traceClose(reportFile, reportFileName);
+    latencyRecord(LATENCY_ADMISSION_REPORT, started, written);
+
+    if (!written) {
+        printf("Error: Unable to write report file.\n");
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+
+    printf("Report generated successfully: %s\n", reportFileName);
+    printf("Press Enter to continue...");
+    clearInputBuffer();
+}
+
+
+//Generate a doctor utilization report. Creates a report file with details of all doctors and their shift utilization
+
+void doctorUtilizationReport() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Doctor Utilization Report");
+
+    if (totalDoctors == 0) {
+        printf("No doctors in the system.\n");
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+
+    // Create the report file with a timestamped name
+    char reportFileName[MAX_FILENAME_LENGTH];
+    char timestamp[20];
+    getFileTimestamp(timestamp, sizeof(timestamp));
+
+    long long started = latencyStart();
+    FILE *reportFile = openReportFile("doctor_utilization_report", timestamp, reportFileName);
+    if (reportFile == NULL) {
+        printf("Error: Unable to create report file.\n");
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+
+    long long traced = traceStart();
+    writeDoctorHeader(reportFile, timestamp);
+
+    // Write doctor data
+    int week = weekOfDay(todayScheduleDay());
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    for (Doctor *current = doctorHead; current != NULL; current = current->next) {
+        writeDoctorRow(reportFile, current, week);
+    }
+    pthread_rwlock_unlock(&doctorStoreLock);
+    traceSpan("write", "report", traced, reportFileName);
+
+    traceClose(reportFile, reportFileName);
+    latencyRecord(LATENCY_DOCTOR_REPORT, started, 1);
+
+    printf("Report generated successfully: %s\n", reportFileName);
+    printf("Press Enter to continue...");
+    clearInputBuffer();
+}
+
+//Generate a room utilization report. Creates a report file with details of room occupancy
+
+void roomUtilizationReport() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Room Utilization Report");
+
+    if (totalPatientsActive == 0) {
+        printf("No patients in the system.\n");
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+
+    // Create the report file with a timestamped name
+    char reportFileName[MAX_FILENAME_LENGTH];
+    char timestamp[20];
+    getFileTimestamp(timestamp, sizeof(timestamp));
+
+    long long started = latencyStart();
+    FILE *reportFile = openReportFile("room_utilization_report", timestamp, reportFileName);
+    if (reportFile == NULL) {
+        printf("Error: Unable to create report file.\n");
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+
+    // Room counts come straight from the occupancy counters, so no patient is visited
+    long long traced = traceStart();
+    writeRoomHeader(reportFile, timestamp);
+    writeRoomRows(reportFile);
+    traceSpan("write", "report", traced, reportFileName);
+
+    traceClose(reportFile, reportFileName);
+    latencyRecord(LATENCY_ROOM_REPORT, started, 1);
+
+    printf("Report generated successfully: %s\n", reportFileName);
+    printf("Press Enter to continue...");
+    clearInputBuffer();
+}
+
+//Generate a length of stay report. Summarizes the stays of all discharged patients overall, per diagnosis and per room
+void lengthOfStayReport() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Length of Stay Report");
+
+    if (totalPatients - totalPatientsActive + archivedPatientCount() == 0) {
+        printf("No discharged patients in the system.\n");
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+
+    // Create the report file with a timestamped name
+    char reportFileName[MAX_FILENAME_LENGTH];
+    char timestamp[20];
+    getFileTimestamp(timestamp, sizeof(timestamp));
+
+    long long started = latencyStart();
+    FILE *reportFile = openReportFile("length_of_stay_report", timestamp, reportFileName);
+    if (reportFile == NULL) {
+        printf("Error: Unable to create report file.\n");
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+
+    long long traced = traceStart();
+    int stays = writeLengthOfStayReport(reportFile, timestamp);
+    traceSpan("write", "report", traced, reportFileName);
+    traceClose(reportFile, reportFileName);
+    latencyRecord(LATENCY_STAY_REPORT, started, stays >= 0);
+
+    if (stays < 0) {
+        printf("Error: Memory allocation failed for the length of stay report.\n");
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+
+    printf("Report generated successfully: %s\n", reportFileName);
+    printf("%d stays summarized\n", stays);
+    printf("Press Enter to continue...");
+    clearInputBuffer();
+}
+
+//Write the length of stay report. Returns the number of stays summarized, or -1 if memory runs out
+int writeLengthOfStayReport(FILE *reportFile, const char *timestamp) {
+    StayColumns columns;
+    StringDictionary diagnoses;
+
+    // Work on a copy so discharges are not held up while the report runs
+    if (!snapshotStays(&columns, &diagnoses)) {
+        return -1;
+    }
+    computeStayBuckets(&columns);
+
+    StayGroupSummary overall;
+    StayGroupSummary *byDiagnosis = (StayGroupSummary *) malloc((diagnoses.count + 1) * sizeof(StayGroupSummary));
+    StayGroupSummary *byRoom = (StayGroupSummary *) malloc((MAX_ROOM_NUMBER + 1) * sizeof(StayGroupSummary));
+    if (byDiagnosis == NULL || byRoom == NULL ||
+        !summarizeStays(&columns, NULL, 1, &overall) ||
+        !summarizeStays(&columns, columns.diagnosis, diagnoses.count, byDiagnosis) ||
+        !summarizeStays(&columns, columns.room, MAX_ROOM_NUMBER + 1, byRoom)) {
+        free(byDiagnosis);
+        free(byRoom);
+        freeStayColumns(&columns);
+        freeDictionary(&diagnoses);
+        return -1;
+    }
+
+    // Busiest diagnoses first; rooms stay in room order, leaving out stays whose room was not recorded
+    qsort(byDiagnosis, diagnoses.count, sizeof(StayGroupSummary), compareStayGroupsBySize);
+    int unrecordedRooms = byRoom[0].stays;
+    int roomCount = 0;
+    for (int room = 1; room <= MAX_ROOM_NUMBER; room++) {
+        if (byRoom[room].stays > 0) {
+            byRoom[roomCount++] = byRoom[room];
+        }
+    }
+
+    fprintf(reportFile, "LENGTH OF STAY REPORT\n");
+    fprintf(reportFile, "Generated on: %s\n\n", timestamp);
+    fprintf(reportFile, "Discharged Patients: %d\n", overall.stays);
+    if (overall.stays > 0) {
+        fprintf(reportFile, "Average Stay: %.2f days\n", (double) overall.totalSeconds / overall.stays / 86400);
+        fprintf(reportFile, "Median: %.2f days, 90th percentile: %.2f days, 99th percentile: %.2f days\n",
+                overall.median / 86400.0, overall.p90 / 86400.0, overall.p99 / 86400.0);
+    }
+    fprintf(reportFile, "\n");
+
+    writeStayTable(reportFile, "Overall", "Group", &overall, 1, NULL);
+    writeStayTable(reportFile, "By Diagnosis", "Diagnosis", byDiagnosis, diagnoses.count, &diagnoses);
+    writeStayTable(reportFile, "By Room", "Room Number", byRoom, roomCount, NULL);
+    if (unrecordedRooms > 0) {
+        fprintf(reportFile, "%d stays have no room recorded and are left out of the room table.\n", unrecordedRooms);
+    }
+
+    int stays = columns.count;
+    free(byDiagnosis);
+    free(byRoom);
+    freeStayColumns(&columns);
+    freeDictionary(&diagnoses);
+    return stays;
+}
+
+//Append a discharged patient's stay to the stay history. Stays without both dates, or ending before they start, are skipped
+void recordStay(const Patient *patient) {
+    long long admitted = dateTimeToSeconds(patient->admissionDate);
+    long long discharged = dateTimeToSeconds(patient->dischargeDate);
+    if (admitted == 0 || discharged < admitted) {
+        return;
+    }
+
+    // Stays longer than an int can hold are clamped; that is still over 68 years
+    long long seconds = discharged - admitted;
+    int duration = (int) (seconds < 2147483647LL ? seconds : 2147483647LL);
+
+    pthread_mutex_lock(&stayHistoryLock);
+
+    // Grow the columns by doubling; if memory runs out the stay is left out of the reports
+    if (stayHistory.count == stayHistory.capacity) {
+        int newCapacity = stayHistory.capacity == 0 ? 1024 : stayHistory.capacity * 2;
+        int *duration = (int *) realloc(stayHistory.duration, newCapacity * sizeof(int));
+        if (duration != NULL) {
+            stayHistory.duration = duration;
+        }
+        int *diagnosis = (int *) realloc(stayHistory.diagnosis, newCapacity * sizeof(int));
+        if (diagnosis != NULL) {
+            stayHistory.diagnosis = diagnosis;
+        }
+        int *room = (int *) realloc(stayHistory.room, newCapacity * sizeof(int));
+        if (room != NULL) {
+            stayHistory.room = room;
+        }
+        if (duration == NULL || diagnosis == NULL || room == NULL) {
+            pthread_mutex_unlock(&stayHistoryLock);
+            return;
+        }
+        stayHistory.capacity = newCapacity;
+    }
+
+    int diagnosis = dictionaryIndexOf(&stayDiagnoses, patient->patientDiagnosis);
+    if (diagnosis >= 0) {
+        int i = stayHistory.count++;
+        stayHistory.duration[i] = duration;
+        stayHistory.diagnosis[i] = diagnosis;
+        stayHistory.room[i] = patient->patientRoomNum > 0 && patient->patientRoomNum <= MAX_ROOM_NUMBER ?
+                              patient->patientRoomNum : 0;
+    }
+
+    pthread_mutex_unlock(&stayHistoryLock);
+}
+
+//Empty the stay history. Used before the store is cleared or reloaded
+void resetStayHistory() {
+    pthread_mutex_lock(&stayHistoryLock);
+    stayHistory.count = 0;
+    resetDictionary(&stayDiagnoses);
+    pthread_mutex_unlock(&stayHistoryLock);
+}
+
+//Copy the stay history and its diagnosis names. Returns 0 if memory runs out
+int snapshotStays(StayColumns *columns, StringDictionary *diagnoses) {
+    memset(diagnoses, 0, sizeof(StringDictionary));
+
+    pthread_mutex_lock(&stayHistoryLock);
+
+    int count = stayHistory.count;
+    int diagnosisCount = stayDiagnoses.count;
+    int success = allocateStayColumns(columns, count);
+    if (success) {
+        memcpy(columns->duration, stayHistory.duration, count * sizeof(int));
+        memcpy(columns->diagnosis, stayHistory.diagnosis, count * sizeof(int));
+        memcpy(columns->room, stayHistory.room, count * sizeof(int));
+        columns->count = count;
+
+        // Only the names are needed, so the hash slots are not copied
+        diagnoses->offsets = (int *) malloc((diagnosisCount + 1) * sizeof(int));
+        diagnoses->lengths = (int *) malloc((diagnosisCount + 1) * sizeof(int));
+        success = diagnoses->offsets != NULL && diagnoses->lengths != NULL &&
+                  reportBufferReserve(&diagnoses->text, stayDiagnoses.text.length + 1);
+        if (success) {
+            memcpy(diagnoses->offsets, stayDiagnoses.offsets, diagnosisCount * sizeof(int));
+            memcpy(diagnoses->lengths, stayDiagnoses.lengths, diagnosisCount * sizeof(int));
+            memcpy(diagnoses->text.data, stayDiagnoses.text.data, stayDiagnoses.text.length);
+            diagnoses->text.length = stayDiagnoses.text.length;
+            diagnoses->count = diagnosisCount;
+        }
+    }
+
+    pthread_mutex_unlock(&stayHistoryLock);
+
+    if (!success) {
+        freeStayColumns(columns);
+        freeDictionary(diagnoses);
+    }
+    return success;
+}
+
+//Allocate the column arrays for up to capacity stays. Returns 0 if memory runs out
+int allocateStayColumns(StayColumns *columns, int capacity) {
+    memset(columns, 0, sizeof(StayColumns));
+    int allocated = capacity > 0 ? capacity : 1;
+
+    columns->duration = (int *) malloc(allocated * sizeof(int));
+    columns->diagnosis = (int *) malloc(allocated * sizeof(int));
+    columns->room = (int *) malloc(allocated * sizeof(int));
+    columns->bucket = (unsigned char *) malloc(allocated * sizeof(unsigned char));
+    if (columns->duration == NULL || columns->diagnosis == NULL || columns->room == NULL || columns->bucket == NULL) {
+        freeStayColumns(columns);
+        return 0;
+    }
+    columns->capacity = capacity;
+    return 1;
+}
+
+//Put each stay in its histogram bucket. The loop is branch-free so the compiler can vectorize it
+void computeStayBuckets(StayColumns *columns) {
+    int count = columns->count;
+    const int *duration = columns->duration;
+    unsigned char *bucket = columns->bucket;
+
+    int limits[STAY_BUCKET_COUNT - 1];
+    for (int b = 0; b < STAY_BUCKET_COUNT - 1; b++) {
+        limits[b] = stayBucketDays[b] * 86400;
+    }
+
+    // The bucket is the number of limits the stay reaches
+    for (int i = 0; i < count; i++) {
+        int d = duration[i];
+        int b = 0;
+        for (int j = 0; j < STAY_BUCKET_COUNT - 1; j++) {
+            b += d >= limits[j];
+        }
+        bucket[i] = (unsigned char) b;
+    }
+}
+
+//Summarize stays per key. keys NULL puts every stay in group 0. Returns 0 if memory runs out
+int summarizeStays(const StayColumns *columns, const int *keys, int keyCount, StayGroupSummary *groups) {
+    int count = columns->count;
+
+    memset(groups, 0, keyCount * sizeof(StayGroupSummary));
+    for (int k = 0; k < keyCount; k++) {
+        groups[k].key = k;
+    }
+
+    // Counts, totals and histograms in one pass
+    for (int i = 0; i < count; i++) {
+        StayGroupSummary *group = &groups[keys != NULL ? keys[i] : 0];
+        group->stays++;
+        group->totalSeconds += columns->duration[i];
+        group->buckets[columns->bucket[i]]++;
+    }
+
+    // Counting sort the durations by key so each group's stays are contiguous, then select each group's percentiles
+    int *start = (int *) malloc((keyCount + 1) * sizeof(int));
+    int *sorted = (int *) malloc((count > 0 ? count : 1) * sizeof(int));
+    if (start == NULL || sorted == NULL) {
+        free(start);
+        free(sorted);
+        return 0;
+    }
+
+    start[0] = 0;
+    for (int k = 0; k < keyCount; k++) {
+        start[k + 1] = start[k] + groups[k].stays;
+    }
+    for (int i = 0; i < count; i++) {
+        int k = keys != NULL ? keys[i] : 0;
+        sorted[start[k]++] = columns->duration[i];
+    }
+
+    // start[k] now points one past group k, so each group begins where the previous one ended
+    int begin = 0;
+    for (int k = 0; k < keyCount; k++) {
+        int stays = groups[k].stays;
+        if (stays > 0) {
+            int *slice = sorted + begin;
+
+            // Nearest-rank percentiles. Each selection leaves larger values above it, so the next one searches only those
+            int rank50 = (int) ((50LL * stays + 99) / 100 - 1);
+            int rank90 = (int) ((90LL * stays + 99) / 100 - 1);
+            int rank99 = (int) ((99LL * stays + 99) / 100 - 1);
+            groups[k].median = selectKth(slice, stays, rank50);
+            groups[k].p90 = selectKth(slice + rank50, stays - rank50, rank90 - rank50);
+            groups[k].p99 = selectKth(slice + rank90, stays - rank90, rank99 - rank90);
+        }
+        begin += stays;
+    }
+
+    free(start);
+    free(sorted);
+    return 1;
+}
+
+//Write one table of the length of stay report. Diagnosis names are looked up when a dictionary is given, otherwise keys are rooms
+void writeStayTable(FILE *reportFile, const char *title, const char *keyHeading, const StayGroupSummary *groups,
+                    int groupCount, const StringDictionary *diagnoses) {
+    char label[16];
+
+    fprintf(reportFile, "%s\n", title);
+    fprintf(reportFile, "%-30s%-10s%-10s%-10s%-10s%-10s", keyHeading, "Stays", "Avg Days", "Median", "P90", "P99");
+    for (int b = 0; b < STAY_BUCKET_COUNT; b++) {
+        if (b == 0) {
+            snprintf(label, sizeof(label), "<%dd", stayBucketDays[0]);
+        } else if (b == STAY_BUCKET_COUNT - 1) {
+            snprintf(label, sizeof(label), "%dd+", stayBucketDays[b - 1]);
+        } else {
+            snprintf(label, sizeof(label), "%d-%dd", stayBucketDays[b - 1], stayBucketDays[b]);
+        }
+        fprintf(reportFile, "%-8s", label);
+    }
+    fprintf(reportFile, "\n");
+    fprintf(reportFile,
+            "----------------------------------------------------------------------------------------------------------------------------------------------\n");
+
+    for (int g = 0; g < groupCount; g++) {
+        const StayGroupSummary *group = &groups[g];
+        if (group->stays == 0) {
+            continue;
+        }
+
+        if (diagnoses != NULL) {
+            int length = diagnoses->lengths[group->key] < 29 ? diagnoses->lengths[group->key] : 29;
+            fprintf(reportFile, "%-30.*s", length, diagnoses->text.data + diagnoses->offsets[group->key]);
+        } else if (groupCount == 1 && group->key == 0) {
+            fprintf(reportFile, "%-30s", "All stays");
+        } else {
+            fprintf(reportFile, "%-30d", group->key);
+        }
+
+        fprintf(reportFile, "%-10d%-10.2f%-10.2f%-10.2f%-10.2f",
+                group->stays,
+                (double) group->totalSeconds / group->stays / 86400,
+                group->median / 86400.0,
+                group->p90 / 86400.0,
+                group->p99 / 86400.0);
+        for (int b = 0; b < STAY_BUCKET_COUNT; b++) {
+            fprintf(reportFile, "%-8d", group->buckets[b]);
+        }
+        fprintf(reportFile, "\n");
+    }
+    fprintf(reportFile, "\n");
+}
+
+//Free the column arrays of a set of stays
+void freeStayColumns(StayColumns *columns) {
+    free(columns->duration);
+    free(columns->diagnosis);
+    free(columns->room);
+    free(columns->bucket);
+    memset(columns, 0, sizeof(StayColumns));
+}
+
+//qsort comparator ordering stay groups by number of stays, largest first
+int compareStayGroupsBySize(const void *a, const void *b) {
+    const StayGroupSummary *first = (const StayGroupSummary *) a;
+    const StayGroupSummary *second = (const StayGroupSummary *) b;
+    return (second->stays > first->stays) - (second->stays < first->stays);
+}
+
+//Return the k-th smallest value (counting from 0), reordering values so smaller ones come before it and larger ones after
+int selectKth(int *values, int count, int k) {
+    int left = 0;
+    int right = count - 1;
+
+    // Quickselect with Hoare partitioning around the middle element
+    while (left < right) {
+        int pivot = values[left + (right - left) / 2];
+        int i = left;
+        int j = right;
+        while (i <= j) {
+            while (values[i] < pivot) {
+                i++;
+            }
+            while (values[j] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                int swap = values[i];
+                values[i] = values[j];
+                values[j] = swap;
+                i++;
+                j--;
+            }
+        }
+
+        if (k <= j) {
+            right = j;
+        } else if (k >= i) {
+            left = i;
+        } else {
+            break;
+        }
+    }
+    return values[k];
+}
+
+//Generate all three reports in one pass and show the resulting files
+void allReports() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("All Reports");
+
+    char fileNames[3][MAX_FILENAME_LENGTH];
+    if (!writeAllReports(fileNames)) {
+        printf("Error: Unable to create report files.\n");
+        printf("Press Enter to continue...");
+        clearInputBuffer();
+        return;
+    }
+
+    printf("Reports generated successfully:\n");
+    printf("  %s\n  %s\n  %s\n", fileNames[0], fileNames[1], fileNames[2]);
+    printf("Press Enter to continue...");
+    clearInputBuffer();
+}
+
+//Write the admission, doctor and room reports. Only the admission report needs a pass over the patients
+int writeAllReports(char fileNames[3][MAX_FILENAME_LENGTH]) {
+    char timestamp[20];
+
+    // One timestamp names all three files
+    getFileTimestamp(timestamp, sizeof(timestamp));
+
+    long long started = latencyStart();
+    long long traced = traceStart();
+    ReportRenderJob *job = (ReportRenderJob *) calloc(1, sizeof(ReportRenderJob));
+    FILE *admissionFile = openReportFile("patient_admission_report", timestamp, fileNames[0]);
+    FILE *doctorFile = openReportFile("doctor_utilization_report", timestamp, fileNames[1]);
+    FILE *roomFile = openReportFile("room_utilization_report", timestamp, fileNames[2]);
+
+    if (job == NULL || admissionFile == NULL || doctorFile == NULL || roomFile == NULL) {
+        if (admissionFile != NULL) traceClose(admissionFile, fileNames[0]);
+        if (doctorFile != NULL) traceClose(doctorFile, fileNames[1]);
+        if (roomFile != NULL) traceClose(roomFile, fileNames[2]);
+        free(job);
+        traceSpan("writeAllReports", "report", traced, NULL);
+        latencyRecord(LATENCY_ALL_REPORTS, started, 0);
+        return 0;
+    }
+
+    writeAdmissionHeader(admissionFile, timestamp);
+    writeDoctorHeader(doctorFile, timestamp);
+    writeRoomHeader(roomFile, timestamp);
+
+    long long step = traceStart();
+    renderPatientShardsParallel(job);
+    traceSpan("renderPatientShardsParallel", "report", step, NULL);
+    step = traceStart();
+    int written = writeRenderedRows(admissionFile, job);
+    traceSpan("write", "report", step, fileNames[0]);
+    step = traceStart();
+    writeRoomRows(roomFile);
+    traceSpan("write", "report", step, fileNames[2]);
+
+    step = traceStart();
+    int week = weekOfDay(todayScheduleDay());
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    for (Doctor *current = doctorHead; current != NULL; current = current->next) {
+        writeDoctorRow(doctorFile, current, week);
+    }
+    pthread_rwlock_unlock(&doctorStoreLock);
+    traceSpan("write", "report", step, fileNames[1]);
+
+    traceClose(admissionFile, fileNames[0]);
+    traceClose(doctorFile, fileNames[1]);
+    traceClose(roomFile, fileNames[2]);
+    freeRenderJob(job);
+    traceSpan("writeAllReports", "report", traced, NULL);
+    latencyRecord(LATENCY_ALL_REPORTS, started, written);
+    return written;
+}
+
+//Render admission rows for every shard using REPORT_WORKER_COUNT threads. Workers claim whole shards so row order is kept
+void renderPatientShardsParallel(ReportRenderJob *job) {
+    pthread_t workers[REPORT_WORKER_COUNT];
+    int started[REPORT_WORKER_COUNT];
+
+    atomic_store(&job->nextShard, 0);
+    for (int i = 0; i < REPORT_WORKER_COUNT; i++) {
+        started[i] = pthread_create(&workers[i], NULL, renderReportWorker, job) == 0;
+    }
+
+    // Help out on this thread; this also covers the case where no worker could be started
+    renderReportWorker(job);
+
+    for (int i = 0; i < REPORT_WORKER_COUNT; i++) {
+        if (started[i]) {
+            pthread_join(workers[i], NULL);
+        }
+    }
+}
+
+//Report worker. Claims shards until none are left, rendering each under its read lock into that shard's buffer
+void *renderReportWorker(void *arg) {
+    ReportRenderJob *job = (ReportRenderJob *) arg;
+
+    int s;
+    while ((s = atomic_fetch_add(&job->nextShard, 1)) < PATIENT_SHARD_COUNT) {
+        ReportBuffer *buffer = &job->buffers[s];
+
+        PatientShard *shard = &patientShards[s];
+        pthread_rwlock_rdlock(&shard->lock);
+        if (job->filter == NULL) {
+            for (Patient *current = shard->head; current != NULL; current = current->next) {
+                renderAdmissionRow(buffer, current);
+            }
+        } else {
+            // Render only the selected rows, still in list order
+            int words = selectionWords(shard->count);
+            unsigned long long *selection = (unsigned long long *) malloc((words + 1) * sizeof(unsigned long long));
+            if (selection == NULL) {
+                buffer->failed = 1;
+            } else {
+                selectPatientsInShard(shard, job->filter, selection);
+                for (int w = 0; w < words; w++) {
+                    for (unsigned long long word = selection[w]; word != 0; word &= word - 1) {
+                        renderAdmissionRow(buffer, shard->rows[w * 64 + __builtin_ctzll(word)]);
+                    }
+                }
+                free(selection);
+            }
         }
-        current = current->next;
+        pthread_rwlock_unlock(&shard->lock);
     }
     return NULL;
 }
 
-//Check if a room is available. A room is considered available if it has less than 2 patients
-int isRoomAvailable(int roomNum) {
-    int count = 0;
-    Patient *current = patientHead;
+//Write the rendered per-shard buffers to a report file in shard order. Returns 0 if rendering or writing failed
+int writeRenderedRows(FILE *reportFile, ReportRenderJob *job) {
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        ReportBuffer *buffer = &job->buffers[s];
+        if (buffer->failed) {
+            return 0;
+        }
+        if (buffer->length > 0 && fwrite(buffer->data, 1, buffer->length, reportFile) != buffer->length) {
+            return 0;
+        }
+    }
+    return 1;
+}
 
-    // Count how many active patients are in this room
-    while (current != NULL) {
-        if (current->patientRoomNum == roomNum) {
-            count++;
-            if (count >= 2) {  // Maximum 2 patients per room
-                return 0;
-            }
+//Free the buffers and the job of a rendering pass
+void freeRenderJob(ReportRenderJob *job) {
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        reportBufferRelease(&job->buffers[s]);
+    }
+    free(job);
+}
+
+//Append formatted text to a report buffer, doubling its capacity as needed
+void reportBufferAppend(ReportBuffer *buffer, const char *format, ...) {
+    if (buffer->failed) {
+        return;
+    }
+
+    while (1) {
+        size_t available = buffer->capacity - buffer->length;
+        va_list args;
+        va_start(args, format);
+        int needed = buffer->data != NULL ? vsnprintf(buffer->data + buffer->length, available, format, args) : -1;
+        va_end(args);
+
+        if (needed >= 0 && (size_t) needed < available) {
+            buffer->length += needed;
+            return;
         }
-        current = current->next;
+
+        // Grow to fit the row (or to the initial size on first use) and format again
+        if (!reportBufferReserve(buffer, needed >= 0 ? (size_t) needed + 1 : buffer->capacity + 1)) {
+            return;
+        }
+    }
+}
+
+//Make room for at least bytes more in a report buffer, doubling its capacity as needed. Returns 0 if it cannot grow
+int reportBufferReserve(ReportBuffer *buffer, size_t bytes) {
+    if (buffer->failed) {
+        return 0;
+    }
+    if (buffer->capacity - buffer->length >= bytes) {
+        return 1;
     }
 
+    size_t newCapacity = buffer->capacity == 0 ? REPORT_BUFFER_INITIAL_SIZE : buffer->capacity * 2;
+    while (newCapacity - buffer->length < bytes) {
+        newCapacity *= 2;
+    }
+    char *grown = (char *) realloc(buffer->data, newCapacity);
+    if (grown == NULL) {
+        buffer->failed = 1;
+        return 0;
+    }
+    if (buffer->capacity == 0) {
+        atomic_fetch_add_explicit(&reportBuffersAllocated, 1, memory_order_relaxed);
+    }
+    long long bytesNow = atomic_fetch_add_explicit(&reportBufferBytes, (long long) (newCapacity - buffer->capacity),
+                                                   memory_order_relaxed) + (long long) (newCapacity - buffer->capacity);
+    long long peak = atomic_load_explicit(&reportBufferPeakBytes, memory_order_relaxed);
+    while (bytesNow > peak &&
+           !atomic_compare_exchange_weak_explicit(&reportBufferPeakBytes, &peak, bytesNow, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+        // peak now holds the current value; try again while ours is larger
+    }
+    buffer->data = grown;
+    buffer->capacity = newCapacity;
     return 1;
 }
 
-//Add a new doctor to the system. Collects doctor information and creates a new doctor record
+//Free a report buffer's memory and empty it
+void reportBufferRelease(ReportBuffer *buffer) {
+    if (buffer->capacity > 0) {
+        atomic_fetch_sub_explicit(&reportBufferBytes, (long long) buffer->capacity, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&reportBuffersAllocated, 1, memory_order_relaxed);
+    }
+    free(buffer->data);
+    memset(buffer, 0, sizeof(ReportBuffer));
+}
 
-void addDoctor() {
-    printf("\e[1;1H\e[2J");  // Clear the screen
-    printHeader("Add Doctor");
+//Append a string left-aligned in a column of the given width. Like %-Ns, longer strings are not cut
+void reportBufferPutString(ReportBuffer *buffer, const char *text, int width) {
+    size_t length = strlen(text);
+    size_t columnWidth = length > (size_t) width ? length : (size_t) width;
+    if (!reportBufferReserve(buffer, columnWidth)) {
+        return;
+    }
 
-    int doctorID;
-    char doctorName[50];
+    char *out = buffer->data + buffer->length;
+    memcpy(out, text, length);
+    memset(out + length, ' ', columnWidth - length);
+    buffer->length += columnWidth;
+}
 
-    // Get doctor ID with validation
-    printf("\nEnter Doctor ID (positive number): ");
-    doctorID = scanInt();
+//Append an integer left-aligned in a column of the given width, matching %-Nd without parsing a format
+void reportBufferPutInt(ReportBuffer *buffer, int value, int width) {
+    char digits[12];
+    int count = 0;
 
-    if (doctorID <= 0) {
-        printf("The doctor ID must be a positive number!\n");
-        returnToMenu();
+    // Work on the magnitude as unsigned so INT_MIN does not overflow
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int) value : (unsigned int) value;
+    do {
+        digits[count++] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        digits[count++] = '-';
+    }
+
+    int columnWidth = count > width ? count : width;
+    if (!reportBufferReserve(buffer, (size_t) columnWidth)) {
         return;
     }
 
-    // Check if doctor ID already exists
-    if (findDoctorByID(doctorID) != NULL) {
-        printf("The doctor ID already exists!\n");
+    // Digits were produced least significant first
+    char *out = buffer->data + buffer->length;
+    for (int i = 0; i < count; i++) {
+        out[i] = digits[count - 1 - i];
+    }
+    memset(out + count, ' ', columnWidth - count);
+    buffer->length += columnWidth;
+}
+
+//Render one patient row of the patient admission report. Produces the same text as writeAdmissionRow
+void renderAdmissionRow(ReportBuffer *buffer, const Patient *patient) {
+    reportBufferPutInt(buffer, patient->patientID, 10);
+    reportBufferPutString(buffer, patient->patientName, 25);
+    reportBufferPutInt(buffer, patient->patientAge, 10);
+    reportBufferPutString(buffer, patient->patientDiagnosis, 30);
+    reportBufferPutInt(buffer, patient->patientRoomNum, 15);
+    reportBufferPutString(buffer, patient->admissionDate, 25);
+    reportBufferPutString(buffer, patient->isActive ? "Active" : "Discharged", 10);
+    if (reportBufferReserve(buffer, 1)) {
+        buffer->data[buffer->length++] = '\n';
+    }
+}
+
+//Start generating all reports on a background thread so the user can keep working
+void startBackgroundReports() {
+    pthread_mutex_lock(&backgroundReportLock);
+
+    if (backgroundReport.state == REPORT_RUNNING) {
+        pthread_mutex_unlock(&backgroundReportLock);
+        printf("A background report is already running.\n");
         returnToMenu();
         return;
     }
 
-    // Get doctor name
-    printf("Enter the doctor name: ");
-    fgets(doctorName, sizeof(doctorName), stdin);
-    doctorName[strcspn(doctorName, "\n")] = 0;  // Remove newline
+    // Reap the previous job's thread before starting another
+    if (backgroundReport.threadStarted) {
+        pthread_join(backgroundReport.thread, NULL);
+        backgroundReport.threadStarted = 0;
+    }
 
-    // Create the new doctor record
-    Doctor *newDoctor = createDoctor(doctorID, doctorName);
-    if (newDoctor == NULL) {
-        printf("Failed to create doctor record!\n");
+    backgroundReport.state = REPORT_RUNNING;
+    if (pthread_create(&backgroundReport.thread, NULL, backgroundReportThread, NULL) != 0) {
+        backgroundReport.state = REPORT_FAILED;
+        pthread_mutex_unlock(&backgroundReportLock);
+        printf("Error: Unable to start the background report.\n");
         returnToMenu();
         return;
     }
+    backgroundReport.threadStarted = 1;
+    pthread_mutex_unlock(&backgroundReportLock);
 
-    // Add the new doctor to the linked list
-    if (doctorHead == NULL) {
-        doctorHead = newDoctor;
-    } else {
-        Doctor *current = doctorHead;
-        while (current->next != NULL) {
-            current = current->next;
+    printf("Reports are being generated in the background.\n");
+    returnToMenu();
+}
+
+//Background report thread. Writes all reports and records the outcome for the menu to show
+void *backgroundReportThread(void *arg) {
+    (void) arg;
+    char fileNames[3][MAX_FILENAME_LENGTH];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int written = writeAllReports(fileNames);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    pthread_mutex_lock(&backgroundReportLock);
+    backgroundReport.state = written ? REPORT_DONE : REPORT_FAILED;
+    memcpy(backgroundReport.fileNames, fileNames, sizeof(fileNames));
+    backgroundReport.seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    pthread_mutex_unlock(&backgroundReportLock);
+    return NULL;
+}
+
+//Wait for a running background report to finish. Called before the data is freed on exit
+void waitForBackgroundReports() {
+    pthread_mutex_lock(&backgroundReportLock);
+    int threadStarted = backgroundReport.threadStarted;
+    pthread_t thread = backgroundReport.thread;
+    backgroundReport.threadStarted = 0;
+    pthread_mutex_unlock(&backgroundReportLock);
+
+    if (threadStarted) {
+        pthread_join(thread, NULL);
+    }
+}
+
+//Print one line describing the background report job, if one has been started
+void printBackgroundReportStatus() {
+    pthread_mutex_lock(&backgroundReportLock);
+    switch (backgroundReport.state) {
+        case REPORT_RUNNING:
+            printf("\nBackground reports: running...\n");
+            break;
+        case REPORT_DONE:
+            printf("\nBackground reports: finished in %.2f s (%s, %s, %s)\n", backgroundReport.seconds,
+                   backgroundReport.fileNames[0], backgroundReport.fileNames[1], backgroundReport.fileNames[2]);
+            break;
+        case REPORT_FAILED:
+            printf("\nBackground reports: failed to write the report files\n");
+            break;
+        default:
+            break;
+    }
+    pthread_mutex_unlock(&backgroundReportLock);
+}
+
+//Reset all statistics to zero. Used before the store is cleared or reloaded
+void resetStatistics() {
+    atomic_store(&hospitalStats.admissions, 0);
+    atomic_store(&hospitalStats.discharges, 0);
+    atomic_store(&hospitalStats.occupiedRooms, 0);
+    atomic_store(&hospitalStats.fullRooms, 0);
+    for (int i = 0; i < AGE_GROUP_COUNT; i++) {
+        atomic_store(&hospitalStats.activeByAgeGroup[i], 0);
+    }
+    atomic_store(&hospitalStats.shiftsAssigned, 0);
+    atomic_store(&hospitalStats.doctorsWithShifts, 0);
+}
+
+//Update the occupied and full room counts after the patient count of a room with a given capacity changed from before to after
+void noteRoomOccupancyChange(int capacity, int before, int after) {
+    if (before == 0 && after > 0) {
+        atomic_fetch_add(&hospitalStats.occupiedRooms, 1);
+    } else if (before > 0 && after == 0) {
+        atomic_fetch_sub(&hospitalStats.occupiedRooms, 1);
+    }
+
+    // An empty room is never full, even a closed one
+    int wasFull = before > 0 && before >= capacity;
+    int isFull = after > 0 && after >= capacity;
+    if (!wasFull && isFull) {
+        atomic_fetch_add(&hospitalStats.fullRooms, 1);
+    } else if (wasFull && !isFull) {
+        atomic_fetch_sub(&hospitalStats.fullRooms, 1);
+    }
+}
+
+//Return the age group of a patient: 0 for children, 1 for adults, 2 for seniors
+int ageGroupOf(int age) {
+    if (age < ADULT_AGE) {
+        return 0;
+    }
+    return age < SENIOR_AGE ? 1 : 2;
+}
+
+//Add a doctor read from a data file to the shift statistics
+void noteLoadedDoctor(const Doctor *doctor) {
+    atomic_fetch_add(&hospitalStats.shiftsAssigned, doctor->totalShifts);
+    if (doctor->totalShifts > 0) {
+        atomic_fetch_add(&hospitalStats.doctorsWithShifts, 1);
+    }
+}
+
+//Load the lifetime admission and discharge totals. Falls back to the loaded records if stats.dat is missing or stale
+void loadStatistics() {
+    // The records themselves, with the archived ones, are a lower bound on both totals
+    int archived = archivedPatientCount();
+    long long admissions = totalPatients + archived;
+    long long discharges = totalPatients - totalPatientsActive + archived;
+
+    char dataFileName[MAX_FILENAME_LENGTH];
+    FILE *statsFile = openDataSection(SNAPSHOT_STATISTICS, dataFileName);
+    if (statsFile != NULL) {
+        StatisticsRecord record;
+        if (fread(&record, sizeof(record), 1, statsFile) == 1) {
+            if (record.admissions > admissions) {
+                admissions = record.admissions;
+            }
+            if (record.discharges > discharges) {
+                discharges = record.discharges;
+            }
         }
-        current->next = newDoctor;
+        fclose(statsFile);
     }
 
-    totalDoctors++;
-    printf("Doctor record added successfully!\n");
+    atomic_store(&hospitalStats.admissions, admissions);
+    atomic_store(&hospitalStats.discharges, discharges);
+}
 
-    // Save the updated data
-    saveData();
+//Write the lifetime totals to a statistics file. Returns 0 if the file could not be written
+int writeStatisticsSection(FILE *statsFile) {
+    StatisticsRecord record;
+    record.admissions = atomic_load(&hospitalStats.admissions);
+    record.discharges = atomic_load(&hospitalStats.discharges);
+    return fwrite(&record, sizeof(record), 1, statsFile) == 1;
+}
+
+//Display the live dashboard. Every figure is read from the maintained statistics, so this never scans the records
+void viewDashboard() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Dashboard");
+    printStartupLoadProgress();
+
+    int active = atomic_load(&totalPatientsActive);
+    int occupiedRooms = atomic_load(&hospitalStats.occupiedRooms);
+    pthread_mutex_lock(&roomBedLock);
+    int totalBeds = roomBeds.totalBeds;
+    int freeBeds = roomBeds.freeBeds;
+    pthread_mutex_unlock(&roomBedLock);
+    int totalSlots = MAX_DAYS_IN_WEEK * MAX_SHIFTS_IN_DAY;
+
+    // This week's coverage takes one schedule lookup per shift
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    int coveredShifts = countCoveredShifts(weekStartDay(todayScheduleDay()));
+    pthread_rwlock_unlock(&doctorStoreLock);
+
+    printf("Patients\n");
+    printf("  %-30s%d\n", "Currently admitted:", active);
+    printf("  %-30s%lld\n", "Admitted (all time):", (long long) atomic_load(&hospitalStats.admissions));
+    printf("  %-30s%lld\n", "Discharged (all time):", (long long) atomic_load(&hospitalStats.discharges));
+    printf("  %-30s%d / %d / %d\n", "Children / adults / seniors:",
+           atomic_load(&hospitalStats.activeByAgeGroup[0]),
+           atomic_load(&hospitalStats.activeByAgeGroup[1]),
+           atomic_load(&hospitalStats.activeByAgeGroup[2]));
+
+    printf("\nRooms\n");
+    printf("  %-30s%d\n", "Occupied rooms:", occupiedRooms);
+    printf("  %-30s%d\n", "Full rooms:", atomic_load(&hospitalStats.fullRooms));
+    printf("  %-30s%d of %d\n", "Free beds:", freeBeds, totalBeds);
+    printf("  %-30s%.2f%%\n", "Bed occupancy:", totalBeds > 0 ? (float) (totalBeds - freeBeds) / totalBeds * 100 : 0.0f);
+
+    printf("\nDoctors\n");
+    printf("  %-30s%d\n", "Doctors:", totalDoctors);
+    printf("  %-30s%d\n", "Doctors with shifts:", atomic_load(&hospitalStats.doctorsWithShifts));
+    printf("  %-30s%d\n", "Doctor shifts scheduled:", atomic_load(&hospitalStats.shiftsAssigned));
+    printf("  %-30s%d of %d (%.2f%%)\n", "Shifts covered this week:", coveredShifts, totalSlots,
+           (float) coveredShifts / totalSlots * 100);
 
     returnToMenu();
 }
 
-//Display all doctors in the system
-void viewDoctors() {
-    printf("\e[1;1H\e[2J");  // Clear the screen
-    printHeader("View All Doctors");
+//Return the monotonic clock in nanoseconds when operations are being timed, or 0 when they are not
+long long latencyStart() {
+    if (!atomic_load_explicit(&latencyRecording, memory_order_relaxed)) {
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
 
-    if (totalDoctors == 0) {
-        printf("No doctors in the system.\n");
-        returnToMenu();
+//Record the latency of an operation started at latencyStart(). Does nothing if timing was off when it started
+void latencyRecord(int operation, long long started, int succeeded) {
+    if (started == 0) {
         return;
     }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long nanos = (long long) now.tv_sec * 1000000000LL + now.tv_nsec - started;
+
+    LatencyHistogram *histogram = &latencyHistograms[operation];
+    atomic_fetch_add_explicit(&histogram->counts[latencyBucket(nanos)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->totalNanos, nanos, memory_order_relaxed);
+    if (!succeeded) {
+        atomic_fetch_add_explicit(&histogram->failures, 1, memory_order_relaxed);
+    }
+    long long longest = atomic_load_explicit(&histogram->maxNanos, memory_order_relaxed);
+    while (nanos > longest &&
+           !atomic_compare_exchange_weak_explicit(&histogram->maxNanos, &longest, nanos, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+        // longest now holds the value another thread stored; try again if this one is still longer
+    }
+}
 
-    // Print table header
-    printf("%-10s%-25s%-15s\n", "ID", "Name", "Total Shifts");
-    printf("---------------------------------------------------\n");
+//Return the histogram bucket of a latency: the value itself below LATENCY_SUB_BUCKETS, then the power of two and
+//the next LATENCY_SUB_BUCKET_BITS bits below the top bit
+int latencyBucket(long long nanos) {
+    if (nanos < LATENCY_SUB_BUCKETS) {
+        return nanos > 0 ? (int) nanos : 0;
+    }
+    int exponent = 63 - __builtin_clzll((unsigned long long) nanos);
+    if (exponent > LATENCY_MAX_EXPONENT) {
+        return LATENCY_BUCKET_COUNT - 1;
+    }
+    int shift = exponent - LATENCY_SUB_BUCKET_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + (int) (nanos >> shift) - LATENCY_SUB_BUCKETS;
+}
 
-    // Print each doctor's details
-    Doctor *current = doctorHead;
-    while (current != NULL) {
-        printf("%-10d%-25s%-15d\n",
-               current->doctorID,
-               current->doctorName,
-               current->totalShifts);
-        current = current->next;
+//Return the largest latency in nanoseconds that falls in a bucket
+long long latencyBucketLimit(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return bucket;
     }
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    long long lowest = (long long) (LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+    return lowest + (1LL << shift) - 1;
+}
 
-    returnToMenu();
+//Return the latency below which the given fraction of the calls fell: the limit of the bucket that reaches it,
+//or the maximum if that is lower
+long long latencyPercentile(const LatencyHistogram *histogram, long long calls, double fraction) {
+    long long wanted = (long long) (fraction * calls + 0.999999);
+    if (wanted < 1) {
+        wanted = 1;
+    }
+    long long longest = atomic_load_explicit(&histogram->maxNanos, memory_order_relaxed);
+    long long seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKET_COUNT; bucket++) {
+        seen += atomic_load_explicit(&histogram->counts[bucket], memory_order_relaxed);
+        if (seen >= wanted) {
+            long long limit = latencyBucketLimit(bucket);
+            return limit < longest ? limit : longest;
+        }
+    }
+    return longest;
 }
 
-//Manage doctor schedules. Assigns a doctor to a specific day and shift
-void manageDoctorSchedule() {
-    printf("\e[1;1H\e[2J");  // Clear the screen
-    printHeader("Manage Doctor Schedule");
+//Clear every latency histogram. Calls still running when this happens are recorded in the cleared histograms
+void resetLatencyStatistics() {
+    for (int op = 0; op < LATENCY_OPERATION_COUNT; op++) {
+        LatencyHistogram *histogram = &latencyHistograms[op];
+        for (int bucket = 0; bucket < LATENCY_BUCKET_COUNT; bucket++) {
+            atomic_store(&histogram->counts[bucket], 0);
+        }
+        atomic_store(&histogram->calls, 0);
+        atomic_store(&histogram->failures, 0);
+        atomic_store(&histogram->totalNanos, 0);
+        atomic_store(&histogram->maxNanos, 0);
+    }
+}
 
-    if (totalDoctors == 0) {
-        printf("No doctors in the system. Please add doctors first.\n");
+//Write one line per timed operation with its calls, failures, mean, percentiles and maximum in microseconds
+void writeLatencyTable(FILE *output) {
+    fprintf(output, "%-24s%-10s%-8s%-11s%-11s%-11s%-11s%-11s%-11s\n", "Operation", "Calls", "Failed", "Mean us",
+            "p50 us", "p90 us", "p99 us", "p99.9 us", "Max us");
+    fprintf(output, "---------------------------------------------------------------------------------------------------------\n");
+    for (int op = 0; op < LATENCY_OPERATION_COUNT; op++) {
+        const LatencyHistogram *histogram = &latencyHistograms[op];
+        long long calls = atomic_load(&histogram->calls);
+        if (calls == 0) {
+            fprintf(output, "%-24s%-10d\n", latencyOperationNames[op], 0);
+            continue;
+        }
+        fprintf(output, "%-24s%-10lld%-8lld%-11.1f%-11.1f%-11.1f%-11.1f%-11.1f%-11.1f\n", latencyOperationNames[op],
+                calls, (long long) atomic_load(&histogram->failures), atomic_load(&histogram->totalNanos) / 1000.0 / calls,
+                latencyPercentile(histogram, calls, 0.50) / 1000.0, latencyPercentile(histogram, calls, 0.90) / 1000.0,
+                latencyPercentile(histogram, calls, 0.99) / 1000.0, latencyPercentile(histogram, calls, 0.999) / 1000.0,
+                atomic_load(&histogram->maxNanos) / 1000.0);
+    }
+}
+
+//Write the latency table and every non-empty histogram bucket to a timestamped file in the reports directory.
+//Returns 0 if the file could not be written
+int dumpLatencyStatistics(char *fileName) {
+    char timestamp[20];
+    getFileTimestamp(timestamp, sizeof(timestamp));
+    FILE *statsFile = openReportFile("system_statistics", timestamp, fileName);
+    if (statsFile == NULL) {
+        return 0;
+    }
+
+    fprintf(statsFile, "System Statistics - %s\n", timestamp);
+    fprintf(statsFile, "Operation latencies since startup or the last reset\n\n");
+    writeLatencyTable(statsFile);
+
+    // Each bucket line gives the largest latency the bucket holds and how many calls fell in it
+    for (int op = 0; op < LATENCY_OPERATION_COUNT; op++) {
+        const LatencyHistogram *histogram = &latencyHistograms[op];
+        if (atomic_load(&histogram->calls) == 0) {
+            continue;
+        }
+        fprintf(statsFile, "\n%s histogram\n%-16s%s\n", latencyOperationNames[op], "Up to us", "Calls");
+        for (int bucket = 0; bucket < LATENCY_BUCKET_COUNT; bucket++) {
+            long long count = atomic_load(&histogram->counts[bucket]);
+            if (count > 0) {
+                fprintf(statsFile, "%-16.3f%lld\n", latencyBucketLimit(bucket) / 1000.0, count);
+            }
+        }
+    }
+    return fclose(statsFile) == 0;
+}
+
+//Count the objects and bytes of every in-memory structure. Each structure is read under its own lock, so the
+//figures are consistent per structure but not across them
+void collectMemoryUsage(MemoryUsage usage[MEMORY_CATEGORY_COUNT]) {
+    memset(usage, 0, MEMORY_CATEGORY_COUNT * sizeof(MemoryUsage));
+    const long long patientText = sizeof(((Patient *) 0)->patientName) + sizeof(((Patient *) 0)->patientDiagnosis) +
+                                  sizeof(((Patient *) 0)->admissionDate) + sizeof(((Patient *) 0)->dischargeDate);
+    const long long doctorText = sizeof(((Doctor *) 0)->doctorName);
+    const long long rowBytes = sizeof(Patient *) + 5 * sizeof(int);    // rows, ids, ages, rooms, active, admitted
+
+    for (int s = 0; s < PATIENT_SHARD_COUNT; s++) {
+        PatientShard *shard = &patientShards[s];
+        pthread_rwlock_rdlock(&shard->lock);
+        usage[MEMORY_PATIENT_RECORDS].objects += shard->count;
+        usage[MEMORY_PATIENT_TEXT].objects += shard->count;
+        for (Patient *current = shard->head; current != NULL; current = current->next) {
+            usage[MEMORY_PATIENT_TEXT].usedBytes += strlen(current->patientName) + strlen(current->patientDiagnosis) +
+                                                   strlen(current->admissionDate) + strlen(current->dischargeDate) + 4;
+        }
+        usage[MEMORY_PATIENT_ID_INDEX].objects += shard->count;
+        usage[MEMORY_PATIENT_ID_INDEX].usedBytes += (long long) shard->count * sizeof(int);
+        usage[MEMORY_PATIENT_ID_INDEX].allocatedBytes += (long long) shard->indexCapacity * sizeof(int);
+        usage[MEMORY_PATIENT_COLUMNS].objects += shard->count;
+        usage[MEMORY_PATIENT_COLUMNS].usedBytes += shard->count * rowBytes;
+        usage[MEMORY_PATIENT_COLUMNS].allocatedBytes += shard->rowCapacity * rowBytes;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    usage[MEMORY_PATIENT_RECORDS].usedBytes = usage[MEMORY_PATIENT_RECORDS].objects * (sizeof(Patient) - patientText);
+    usage[MEMORY_PATIENT_RECORDS].allocatedBytes = usage[MEMORY_PATIENT_RECORDS].usedBytes;
+    usage[MEMORY_PATIENT_TEXT].allocatedBytes = usage[MEMORY_PATIENT_TEXT].objects * patientText;
+
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    for (Doctor *current = doctorHead; current != NULL; current = current->next) {
+        usage[MEMORY_DOCTOR_RECORDS].objects++;
+        usage[MEMORY_DOCTOR_TEXT].usedBytes += strlen(current->doctorName) + 1;
+    }
+    usage[MEMORY_DOCTOR_RECORDS].usedBytes = usage[MEMORY_DOCTOR_RECORDS].objects * (sizeof(Doctor) - doctorText);
+    usage[MEMORY_DOCTOR_RECORDS].allocatedBytes = usage[MEMORY_DOCTOR_RECORDS].usedBytes;
+    usage[MEMORY_DOCTOR_TEXT].objects = usage[MEMORY_DOCTOR_RECORDS].objects;
+    usage[MEMORY_DOCTOR_TEXT].allocatedBytes = usage[MEMORY_DOCTOR_TEXT].objects * doctorText;
+    usage[MEMORY_SCHEDULE].objects = doctorSchedule.slotCount + doctorSchedule.loadCount;
+    usage[MEMORY_SCHEDULE].usedBytes = (long long) doctorSchedule.slotCount * sizeof(ScheduleSlot) +
+                                       (long long) doctorSchedule.loadCount * sizeof(DoctorWeekLoad);
+    usage[MEMORY_SCHEDULE].allocatedBytes = (long long) doctorSchedule.slotCapacity * sizeof(ScheduleSlot) +
+                                            (long long) doctorSchedule.loadCapacity * sizeof(DoctorWeekLoad);
+    pthread_rwlock_unlock(&doctorStoreLock);
+
+    pthread_mutex_lock(&queryIndexLock);
+    for (int room = 0; room <= MAX_ROOM_NUMBER; room++) {
+        usage[MEMORY_QUERY_INDEXES].objects += queryIndexes.roomCount[room];
+        usage[MEMORY_QUERY_INDEXES].usedBytes += (long long) queryIndexes.roomCount[room] * sizeof(int);
+        usage[MEMORY_QUERY_INDEXES].allocatedBytes += (long long) queryIndexes.roomCapacity[room] * sizeof(int);
+    }
+    usage[MEMORY_QUERY_INDEXES].objects += queryIndexes.admissionCount;
+    usage[MEMORY_QUERY_INDEXES].usedBytes += (long long) queryIndexes.admissionCount * sizeof(AdmissionEntry);
+    usage[MEMORY_QUERY_INDEXES].allocatedBytes += (long long) queryIndexes.admissionCapacity * sizeof(AdmissionEntry);
+    pthread_mutex_unlock(&queryIndexLock);
+
+    pthread_mutex_lock(&archiveLock);
+    usage[MEMORY_ARCHIVE_INDEX].objects = archiveIndex.count;
+    usage[MEMORY_ARCHIVE_INDEX].usedBytes = (long long) archiveIndex.count * sizeof(ArchiveIndexEntry) +
+                                            (long long) archiveIndex.patients * sizeof(int);
+    usage[MEMORY_ARCHIVE_INDEX].allocatedBytes = (long long) archiveIndex.capacity * sizeof(ArchiveIndexEntry) +
+                                                 (long long) archiveIndex.slotCapacity * sizeof(int);
+    pthread_mutex_unlock(&archiveLock);
+
+    // The dictionary's text is a report buffer as well; it is counted here and left out of the report buffers
+    pthread_mutex_lock(&stayHistoryLock);
+    usage[MEMORY_STAY_HISTORY].objects = stayHistory.count;
+    usage[MEMORY_STAY_HISTORY].usedBytes = (long long) stayHistory.count * 3 * sizeof(int);
+    usage[MEMORY_STAY_HISTORY].allocatedBytes = (long long) stayHistory.capacity * 3 * sizeof(int);
+    usage[MEMORY_STAY_TEXT].objects = stayDiagnoses.count;
+    usage[MEMORY_STAY_TEXT].usedBytes = (long long) stayDiagnoses.text.length + (long long) stayDiagnoses.count * 3 * sizeof(int);
+    usage[MEMORY_STAY_TEXT].allocatedBytes = (long long) stayDiagnoses.text.capacity +
+                                             (long long) (stayDiagnoses.slotCapacity / 2) * 2 * sizeof(int) +
+                                             (long long) stayDiagnoses.slotCapacity * sizeof(int);
+    long long dictionaryText = (long long) stayDiagnoses.text.capacity;
+    int dictionaryBuffers = stayDiagnoses.text.capacity > 0;
+    pthread_mutex_unlock(&stayHistoryLock);
+
+    usage[MEMORY_REPORT_BUFFERS].objects = atomic_load(&reportBuffersAllocated) - dictionaryBuffers;
+    usage[MEMORY_REPORT_BUFFERS].allocatedBytes = atomic_load(&reportBufferBytes) - dictionaryText;
+    usage[MEMORY_REPORT_BUFFERS].usedBytes = usage[MEMORY_REPORT_BUFFERS].allocatedBytes;
+
+    usage[MEMORY_FIXED_TABLES].objects = 10;
+    usage[MEMORY_FIXED_TABLES].allocatedBytes = sizeof(patientShards) + sizeof(roomOccupancy) + sizeof(roomCapacity) +
+                                                sizeof(roomBeds) + sizeof(hospitalStats) + sizeof(latencyHistograms) +
+                                                sizeof(queryIndexes) + sizeof(archiveIndex) + sizeof(stayHistory) +
+                                                sizeof(stayDiagnoses);
+    usage[MEMORY_FIXED_TABLES].usedBytes = usage[MEMORY_FIXED_TABLES].allocatedBytes;
+}
+
+//Return the resident set size of the process from /proc/self/statm, or -1 where that is not available
+long long processResidentBytes() {
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL) {
+        return -1;
+    }
+    long long totalPages, residentPages;
+    int read = fscanf(statm, "%lld %lld", &totalPages, &residentPages);
+    fclose(statm);
+    return read == 2 ? residentPages * sysconf(_SC_PAGESIZE) : -1;
+}
+
+//Write one line per structure with its objects and the KiB it uses and has allocated, then the totals
+void writeMemoryTable(FILE *output) {
+    MemoryUsage usage[MEMORY_CATEGORY_COUNT];
+    collectMemoryUsage(usage);
+    MemoryUsage total = {0, 0, 0};
+
+    fprintf(output, "%-24s%-12s%-14s%-14s\n", "Structure", "Objects", "Used KiB", "Allocated KiB");
+    fprintf(output, "----------------------------------------------------------------\n");
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        fprintf(output, "%-24s%-12lld%-14.1f%-14.1f\n", memoryCategoryNames[c], usage[c].objects,
+                usage[c].usedBytes / 1024.0, usage[c].allocatedBytes / 1024.0);
+        total.objects += usage[c].objects;
+        total.usedBytes += usage[c].usedBytes;
+        total.allocatedBytes += usage[c].allocatedBytes;
+    }
+    fprintf(output, "----------------------------------------------------------------\n");
+    fprintf(output, "%-24s%-12lld%-14.1f%-14.1f\n", "Total", total.objects, total.usedBytes / 1024.0,
+            total.allocatedBytes / 1024.0);
+    fprintf(output, "Report buffer peak: %.1f KiB\n", atomic_load(&reportBufferPeakBytes) / 1024.0);
+    long long resident = processResidentBytes();
+    if (resident >= 0) {
+        fprintf(output, "Process resident size: %.1f KiB\n", resident / 1024.0);
+    }
+}
+
+//Write the memory usage of every structure as one JSON object, in bytes
+void writeMemoryUsageJson(FILE *output) {
+    MemoryUsage usage[MEMORY_CATEGORY_COUNT];
+    collectMemoryUsage(usage);
+    MemoryUsage total = {0, 0, 0};
+    char timestamp[20];
+    getCurrentDateTime(timestamp, sizeof(timestamp));
+
+    fprintf(output, "{\"timestamp\":\"%s\",\"patients\":%d,\"doctors\":%d,\"structures\":[", timestamp,
+            atomic_load(&totalPatients), totalDoctors);
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        fprintf(output, "%s\n{\"name\":\"%s\",\"objects\":%lld,\"used_bytes\":%lld,\"allocated_bytes\":%lld}",
+                c == 0 ? "" : ",", memoryCategoryNames[c], usage[c].objects, usage[c].usedBytes, usage[c].allocatedBytes);
+        total.objects += usage[c].objects;
+        total.usedBytes += usage[c].usedBytes;
+        total.allocatedBytes += usage[c].allocatedBytes;
+    }
+    fprintf(output, "],\n\"total\":{\"objects\":%lld,\"used_bytes\":%lld,\"allocated_bytes\":%lld},\n", total.objects,
+            total.usedBytes, total.allocatedBytes);
+    fprintf(output, "\"report_buffer_peak_bytes\":%lld,\"process_resident_bytes\":%lld}\n",
+            (long long) atomic_load(&reportBufferPeakBytes), processResidentBytes());
+}
+
+//Write the memory usage as JSON to a timestamped file in the reports directory. Returns 0 if it could not be written
+int dumpMemoryUsage(char *fileName) {
+    char timestamp[20];
+    getFileTimestamp(timestamp, sizeof(timestamp));
+    snprintf(fileName, MAX_FILENAME_LENGTH, "../reports/memory_usage_%s.json", timestamp);
+    FILE *usageFile = fopen(fileName, "w");
+    if (usageFile == NULL) {
+        return 0;
+    }
+    writeMemoryUsageJson(usageFile);
+    return fclose(usageFile) == 0;
+}
+
+//Show how long each operation has taken and the memory each structure takes; turn the timing on or off, reset it
+//or save either to a file
+void systemStatistics() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("System Statistics");
+    printStartupLoadProgress();
+
+    int recording = atomic_load(&latencyRecording);
+    printf("Operation timing is %s.\n\n", recording ? "on" : "off");
+    writeLatencyTable(stdout);
+    printf("\nMemory in use\n");
+    writeMemoryTable(stdout);
+
+    printf("\n1. Turn Timing %s\n", recording ? "Off" : "On");
+    printf("2. Reset Statistics\n");
+    printf("3. Save Statistics to File\n");
+    printf("4. Save Memory Usage to File\n");
+    printf("5. Return to Main Menu\n");
+    printf("Enter your choice: ");
+
+    int choice = scanInt();
+    if (choice == 1) {
+        atomic_store(&latencyRecording, !recording);
+        printf("Operation timing turned %s.\n", recording ? "off" : "on");
+        returnToMenu();
+    } else if (choice == 2) {
+        resetLatencyStatistics();
+        printf("Statistics reset.\n");
+        returnToMenu();
+    } else if (choice == 3) {
+        char fileName[MAX_FILENAME_LENGTH];
+        if (dumpLatencyStatistics(fileName)) {
+            printf("Statistics saved to %s\n", fileName);
+        } else {
+            printf("Error: Unable to write the statistics file.\n");
+        }
+        returnToMenu();
+    } else if (choice == 4) {
+        char fileName[MAX_FILENAME_LENGTH];
+        if (dumpMemoryUsage(fileName)) {
+            printf("Memory usage saved to %s\n", fileName);
+        } else {
+            printf("Error: Unable to write the memory usage file.\n");
+        }
         returnToMenu();
+    }
+}
+
+//Start writing spans to a Chrome trace-event file (JSON array format). Returns 0 if the file cannot be created
+int startTracing(const char *path) {
+    traceFile = fopen(path, "w");
+    if (traceFile == NULL) {
+        printf("Error: Unable to create trace file %s\n", path);
+        return 0;
+    }
+
+    // Name the process so the viewer labels the track
+    fprintf(traceFile, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"HMS\"}}", (int) getpid());
+    traceEvents = 1;
+    atomic_store(&tracing, 1);
+    return 1;
+}
+
+//Close the trace file, ending the JSON array so any viewer accepts it
+void stopTracing() {
+    atomic_store(&tracing, 0);
+    pthread_mutex_lock(&traceLock);
+    if (traceFile != NULL) {
+        fprintf(traceFile, "\n]\n");
+        fclose(traceFile);
+        traceFile = NULL;
+    }
+    pthread_mutex_unlock(&traceLock);
+}
+
+//Return the monotonic clock in nanoseconds when tracing, or 0 when not
+long long traceStart() {
+    if (!atomic_load_explicit(&tracing, memory_order_relaxed)) {
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+//Write a complete event for a span started at traceStart(). Spans on a file are named after it and carry it as an argument
+void traceSpan(const char *name, const char *category, long long started, const char *fileName) {
+    if (started == 0) {
         return;
     }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long ended = (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+
+    if (traceThreadID == 0) {
+        traceThreadID = atomic_fetch_add(&traceThreadCount, 1) + 1;
+    }
+
+    // Render the event first so the lock only covers the write
+    ReportBuffer event = {0};
+    reportBufferAppend(&event, "{\"name\":");
+    if (fileName != NULL) {
+        char fullName[MAX_FILENAME_LENGTH + 32];
+        snprintf(fullName, sizeof(fullName), "%s %s", name, fileName);
+        exportPutJsonString(&event, fullName);
+    } else {
+        exportPutJsonString(&event, name);
+    }
+    reportBufferAppend(&event, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d", category,
+                       started / 1000.0, (ended - started) / 1000.0, (int) getpid(), traceThreadID);
+    if (fileName != NULL) {
+        reportBufferAppend(&event, ",\"args\":{\"file\":");
+        exportPutJsonString(&event, fileName);
+        reportBufferAppend(&event, "}");
+    }
+    reportBufferAppend(&event, "}");
+
+    pthread_mutex_lock(&traceLock);
+    if (traceFile != NULL && !event.failed) {
+        fputs(",\n", traceFile);
+        fwrite(event.data, 1, event.length, traceFile);
+        traceEvents++;
+    }
+    pthread_mutex_unlock(&traceLock);
+    reportBufferRelease(&event);
+}
+
+//Open a file, tracing the open
+FILE *traceOpen(const char *fileName, const char *mode) {
+    long long traced = traceStart();
+    FILE *file = fopen(fileName, mode);
+    traceSpan("open", "io", traced, fileName);
+    return file;
+}
+
+//Close a file, tracing the close and the flush of its buffered writes
+int traceClose(FILE *file, const char *fileName) {
+    long long traced = traceStart();
+    int result = fclose(file);
+    traceSpan("close", "io", traced, fileName);
+    return result;
+}
+
+//Open a timestamped report file in the reports directory. The chosen name is copied into fileName
+FILE *openReportFile(const char *prefix, const char *timestamp, char *fileName) {
+    snprintf(fileName, MAX_FILENAME_LENGTH, "../reports/%s_%s.txt", prefix, timestamp);
+    return traceOpen(fileName, "w");
+}
+
+//Write the title, totals and column headings of the patient admission report
+void writeAdmissionHeader(FILE *reportFile, const char *timestamp) {
+    fprintf(reportFile, "PATIENT ADMISSION REPORT\n");
+    fprintf(reportFile, "Generated on: %s\n\n", timestamp);
+    fprintf(reportFile, "Total Patients: %d\n", totalPatients);
+    fprintf(reportFile, "Archived Patients: %d (not listed)\n\n", archivedPatientCount());
+    fprintf(reportFile, "%-10s%-25s%-10s%-30s%-15s%-25s%-10s\n",
+            "ID", "Name", "Age", "Diagnosis", "Room Number", "Admission Date", "Status");
+    fprintf(reportFile,
+            "-------------------------------------------------------------------------------------------------------------------------\n");
+}
 
-    int doctorID, dayInWeek, shiftInDay;
+//Write one patient row of the patient admission report
+void writeAdmissionRow(FILE *reportFile, const Patient *patient) {
+    fprintf(reportFile, "%-10d%-25s%-10d%-30s%-15d%-25s%-10s\n",
+            patient->patientID,
+            patient->patientName,
+            patient->patientAge,
+            patient->patientDiagnosis,
+            patient->patientRoomNum,
+            patient->admissionDate,
+            patient->isActive ? "Active" : "Discharged");
+}
 
-    // Get doctor ID
-    printf("\nEnter Doctor ID to assign shifts: ");
-    doctorID = scanInt();
+//Write the title, totals and column headings of the doctor utilization report
+void writeDoctorHeader(FILE *reportFile, const char *timestamp) {
+    fprintf(reportFile, "DOCTOR UTILIZATION REPORT\n");
+    fprintf(reportFile, "Generated on: %s\n\n", timestamp);
+    pthread_rwlock_rdlock(&doctorStoreLock);
+    int coveredShifts = countCoveredShifts(weekStartDay(todayScheduleDay()));
+    pthread_rwlock_unlock(&doctorStoreLock);
+
+    fprintf(reportFile, "Total Doctors: %d\n", totalDoctors);
+    fprintf(reportFile, "Doctor Shifts Scheduled: %d\n", atomic_load(&hospitalStats.shiftsAssigned));
+    fprintf(reportFile, "Shifts Covered This Week: %d of %d\n\n", coveredShifts, MAX_DAYS_IN_WEEK * MAX_SHIFTS_IN_DAY);
+    fprintf(reportFile, "%-10s%-25s%-15s%-15s%-15s\n",
+            "ID", "Name", "Total Shifts", "This Week", "Utilization %");
+    fprintf(reportFile, "-----------------------------------------------------------------------------------\n");
+}
 
-    // Find the doctor
-    Doctor *doctor = findDoctorByID(doctorID);
+//Write one doctor row of the doctor utilization report. Caller must hold the doctor lock
+void writeDoctorRow(FILE *reportFile, const Doctor *doctor, int week) {
+    // Calculate utilization percentage (shifts this week / most shifts allowed in a week * 100)
+    int weekShifts = __builtin_popcount(weekShiftBits(&doctorSchedule, doctor->doctorID, week));
+    float utilization = (float) weekShifts / MAX_SHIFTS_PER_DOCTOR * 100;
+    fprintf(reportFile, "%-10d%-25s%-15d%-15d%-15.2f\n",
+            doctor->doctorID,
+            doctor->doctorName,
+            doctor->totalShifts,
+            weekShifts,
+            utilization);
+}
 
-    if (doctor == NULL) {
-        printf("The doctor ID is invalid or doesn't exist!\n");
-        returnToMenu();
-        return;
-    }
+//Write the title, totals and column headings of the room utilization report
+void writeRoomHeader(FILE *reportFile, const char *timestamp) {
+    fprintf(reportFile, "ROOM UTILIZATION REPORT\n");
+    fprintf(reportFile, "Generated on: %s\n\n", timestamp);
+    fprintf(reportFile, "Total Patients: %d\n", totalPatientsActive);
+    fprintf(reportFile, "Occupied Rooms: %d (%d full)\n",
+            atomic_load(&hospitalStats.occupiedRooms), atomic_load(&hospitalStats.fullRooms));
+    pthread_mutex_lock(&roomBedLock);
+    fprintf(reportFile, "Free Beds: %d of %d\n\n", roomBeds.freeBeds, roomBeds.totalBeds);
+    pthread_mutex_unlock(&roomBedLock);
+    fprintf(reportFile, "%-15s%-15s%-15s%-15s\n",
+            "Room Number", "Patients", "Beds", "Occupancy %");
+    fprintf(reportFile, "---------------------------------------------------------\n");
+}
 
-    // Check if doctor has reached maximum shifts
-    if (doctor->totalShifts >= 7) {  // Maximum 7 shifts per week
-        printf("This doctor has reached the maximum number of shifts this week!\n");
-        returnToMenu();
-        return;
+//Write one row per occupied room of the room utilization report, reading the live occupancy counters
+void writeRoomRows(FILE *reportFile) {
+    for (int i = 1; i <= MAX_ROOM_NUMBER; i++) {
+        int patients = atomic_load(&roomOccupancy[i]);
+        if (patients > 0) {
+            // Calculate occupancy percentage (patients / beds * 100); a closed room still holding patients counts as full
+            int beds = atomic_load(&roomCapacity[i]);
+            float occupancy = beds > 0 ? (float) patients / beds * 100 : 100.0f;
+            fprintf(reportFile, "%-15d%-15d%-15d%-15.2f\n",
+                    i,
+                    patients,
+                    beds,
+                    occupancy);
+        }
     }
+}
 
-    // Get day to assign
-    printf("Enter day to assign shift (1-7): ");
-    dayInWeek = scanInt();
+//Export menu. Streams the saved data files to a columnar, CSV or JSON-lines export
+void exportMenu() {
+    printf("\e[1;1H\e[2J");  // Clear the screen
+    printHeader("Export Data for Analytics");
 
-    if (dayInWeek < 1 || dayInWeek > 7) {
-        printf("The day must be between 1 and 7!\n");
-        returnToMenu();
+    printf("1. Columnar (.hmsc)\n");
+    printf("2. CSV\n");
+    printf("3. JSON lines\n");
+    printf("4. Return\n");
+    printf("Enter your choice: ");
+
+    int format = scanInt();
+    if (format < EXPORT_COLUMNAR || format > EXPORT_JSONL) {
         return;
     }
 
-    // Get shift to assign
-    printf("Enter shift to assign (1-morning, 2-afternoon, 3-evening): ");
-    shiftInDay = scanInt();
-
-    if (shiftInDay < 1 || shiftInDay > 3) {
-        printf("Invalid shift! Must be between 1 and 3.\n");
+    // The export reads the data files, so make sure they hold the current state first
+    if (!writeDataFiles()) {
+        printf("Error: Unable to save data before exporting.\n");
         returnToMenu();
         return;
     }
 
-    // Check if the shift is already assigned
-    if (doctorSchedule[dayInWeek - 1][shiftInDay - 1] != 0) {
-        printf("This shift is already assigned to another doctor!\n");
+    char fileNames[3][MAX_FILENAME_LENGTH];
+    int fileCount = exportData(format, fileNames);
+    if (fileCount == 0) {
+        printf("Error: Unable to export data.\n");
         returnToMenu();
         return;
     }
 
-    // Find doctor's index in the list
-    int doctorIndex = 1;
-    Doctor *current = doctorHead;
-    while (current != NULL && current->doctorID != doctorID) {
-        doctorIndex++;
-        current = current->next;
+    printf("Data exported successfully:\n");
+    for (int i = 0; i < fileCount; i++) {
+        printf("  %s\n", fileNames[i]);
     }
-
-    // Assign the shift
-    doctorSchedule[dayInWeek - 1][shiftInDay - 1] = doctorIndex;
-    doctor->totalShifts++;
-
-    printf("Shift assigned successfully!\n");
-    saveData();
-
     returnToMenu();
 }
 
- //Display the weekly doctor schedule
-void viewSchedule() {
-    printf("\e[1;1H\e[2J");  // Clear the screen
-    printHeader("Doctor Schedule");
+//Export the data files to the reports directory. Returns the number of files written, or 0 on failure
+int exportData(int format, char fileNames[3][MAX_FILENAME_LENGTH]) {
+    char dataFileName[MAX_FILENAME_LENGTH];
+    char timestamp[20];
+    int fileCount = 0;
+
+    FILE *patientFile = openDataSection(SNAPSHOT_PATIENTS, dataFileName);
+    FILE *doctorFile = openDataSection(SNAPSHOT_DOCTORS, dataFileName);
+    long doctorStart = doctorFile != NULL ? ftell(doctorFile) : 0;
+
+    // Schedule files from before the calendar store list positions, so collect the doctor IDs to convert them
+    int doctorCount = 0;
+    int *doctorIDs = NULL;
+    if (doctorFile != NULL && fread(&doctorCount, sizeof(int), 1, doctorFile) == 1 &&
+        doctorCount > 0 && doctorCount <= MAX_LOADED_RECORDS) {
+        doctorIDs = (int *) malloc(doctorCount * sizeof(int));
+        Doctor doctor;
+        for (int i = 0; doctorIDs != NULL && i < doctorCount; i++) {
+            doctorIDs[i] = readExportedDoctor(doctorFile, &doctor) ? doctor.doctorID : 0;
+        }
+        fseek(doctorFile, doctorStart, SEEK_SET);
+    }
+    if (doctorIDs == NULL) {
+        doctorCount = 0;
+    }
 
-    printf("\nWeekly Schedule:\n");
-    printf("-------------------------------------------------------------------------\n");
-    printf("Day\t\t| Morning\t| Afternoon\t| Evening\n");
-    printf("-------------------------------------------------------------------------\n");
+    // Archived patients follow the ones in patients.dat, read through a private copy of archive.idx
+    ArchiveIndex archiveEntries;
+    ArchiveCursor archive;
+    memset(&archiveEntries, 0, sizeof(archiveEntries));
+    int archiveOpened = readArchiveIndexFile(&archiveEntries) && openArchiveCursor(&archive, &archiveEntries, 0);
+    freeArchiveIndex(&archiveEntries);
+
+    // The saved schedule is schedule.dat plus the changes logged since, so replay both into a private store
+    ScheduleStore schedule;
+    memset(&schedule, 0, sizeof(schedule));
+    readScheduleFiles(&schedule, doctorIDs, doctorCount);
+    ScheduleRecord *scheduleRecords;
+    int scheduleCount = collectScheduleRecords(&schedule, &scheduleRecords);
+    freeSchedule(&schedule);
+
+    getFileTimestamp(timestamp, sizeof(timestamp));
+    int success = 0;
+    if (scheduleCount < 0) {
+        scheduleRecords = NULL;
+    } else if (archiveOpened && format == EXPORT_COLUMNAR) {
+        snprintf(fileNames[0], MAX_FILENAME_LENGTH, "../reports/export_%s.hmsc", timestamp);
+        FILE *exportFile = fopen(fileNames[0], "wb");
+        if (exportFile != NULL) {
+            success = exportColumnar(patientFile, &archive, doctorFile, scheduleRecords, scheduleCount, exportFile);
+            success = fclose(exportFile) == 0 && success;
+            fileCount = 1;
+        }
+    } else if (archiveOpened) {
+        const char *tables[3] = {"patients", "doctors", "schedule"};
+        const char *extension = format == EXPORT_CSV ? "csv" : "jsonl";
+        FILE *exportFiles[3] = {NULL, NULL, NULL};
+        success = 1;
+        for (int i = 0; i < 3; i++) {
+            snprintf(fileNames[i], MAX_FILENAME_LENGTH, "../reports/export_%s_%s.%s", tables[i], timestamp, extension);
+            exportFiles[i] = fopen(fileNames[i], "w");
+            success = success && exportFiles[i] != NULL;
+        }
+        if (success) {
+            success = exportText(format, patientFile, &archive, doctorFile, scheduleRecords, scheduleCount, exportFiles);
+        }
+        for (int i = 0; i < 3; i++) {
+            if (exportFiles[i] != NULL && fclose(exportFiles[i]) != 0) {
+                success = 0;
+            }
+        }
+        fileCount = 3;
+    }
 
-    char *dayNames[] = {"Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday", "Sunday"};
+    if (patientFile != NULL) fclose(patientFile);
+    if (doctorFile != NULL) fclose(doctorFile);
+    if (archiveOpened) {
+        closeArchiveCursor(&archive);
+    }
+    free(scheduleRecords);
+    free(doctorIDs);
+    return success ? fileCount : 0;
+}
 
-    // Print each day's schedule
-    for (int i = 0; i < MAX_DAYS_IN_WEEK; i++) {
-        printf("%-10s\t|", dayNames[i]);
+//Write the columnar export. Records are read one at a time and encoded into row groups, so memory use stays bounded
+int exportColumnar(FILE *patientFile, ArchiveCursor *archive, FILE *doctorFile, const ScheduleRecord *schedule,
+                   int scheduleCount, FILE *exportFile) {
+    static const int patientEncodings[] = {COLUMN_DELTA_VARINT, COLUMN_STRING, COLUMN_VARINT, COLUMN_DICTIONARY,
+                                           COLUMN_VARINT, COLUMN_DELTA_VARINT, COLUMN_DELTA_VARINT, COLUMN_BITMAP};
+    static const int doctorEncodings[] = {COLUMN_DELTA_VARINT, COLUMN_STRING, COLUMN_VARINT};
+    static const int scheduleEncodings[] = {COLUMN_DELTA_VARINT, COLUMN_VARINT, COLUMN_VARINT};
 
-        // Print each shift for this day
-        for (int j = 0; j < MAX_SHIFTS_IN_DAY; j++) {
-            int doctorIndex = doctorSchedule[i][j];
-            if (doctorIndex == 0) {
-                printf(" Not Assigned\t|");
-            } else {
-                // Find doctor by index
-                Doctor *current = doctorHead;
-                int currentIndex = 1;
+    ExportRowGroup *group = (ExportRowGroup *) calloc(1, sizeof(ExportRowGroup));
+    if (group == NULL) {
+        return 0;
+    }
 
-                while (current != NULL && currentIndex < doctorIndex) {
-                    current = current->next;
-                    currentIndex++;
-                }
+    ReportBuffer header = {NULL, 0, 0, 0};
+    if (reportBufferReserve(&header, 4)) {
+        memcpy(header.data, "HMSC", 4);
+        header.length = 4;
+    }
+    exportPutVarint(&header, EXPORT_FORMAT_VERSION);
+    int success = flushExportBuffer(exportFile, &header, 1);
+    reportBufferRelease(&header);
+
+    // Patients, from patients.dat and then the archive, in row groups of EXPORT_ROW_GROUP_SIZE
+    int recordCount = 0;
+    if (patientFile == NULL || fread(&recordCount, sizeof(int), 1, patientFile) != 1 ||
+        recordCount < 0 || recordCount > MAX_LOADED_RECORDS) {
+        recordCount = 0;
+    }
+    if (success) {
+        initializeExportGroup(group, EXPORT_TABLE_PATIENTS, 8, patientEncodings);
+        Patient patient;
+        while (success && readNextExportedPatient(patientFile, &recordCount, archive, &patient)) {
+            exportGroupPutValue(group, 0, patient.patientID);
+            exportGroupPutString(group, 1, patient.patientName);
+            exportGroupPutValue(group, 2, patient.patientAge);
+            exportGroupPutString(group, 3, patient.patientDiagnosis);
+            exportGroupPutValue(group, 4, patient.patientRoomNum);
+            exportGroupPutValue(group, 5, dateTimeToSeconds(patient.admissionDate));
+            exportGroupPutValue(group, 6, dateTimeToSeconds(patient.dischargeDate));
+            exportGroupPutBit(group, 7, patient.isActive);
+            group->rows++;
+
+            if (group->rows == EXPORT_ROW_GROUP_SIZE) {
+                success = flushExportGroup(exportFile, group);
+            }
+        }
+        success = success && flushExportGroup(exportFile, group);
+        freeExportGroup(group);
+    }
 
-                if (current != NULL) {
-                    printf(" Dr. %s\t|", current->doctorName);
-                } else {
-                    printf(" Unknown\t|");
-                }
+    // Doctors
+    if (success && doctorFile != NULL && fread(&recordCount, sizeof(int), 1, doctorFile) == 1 &&
+        recordCount > 0 && recordCount <= MAX_LOADED_RECORDS) {
+        initializeExportGroup(group, EXPORT_TABLE_DOCTORS, 3, doctorEncodings);
+        Doctor doctor;
+        for (int i = 0; success && i < recordCount && readExportedDoctor(doctorFile, &doctor); i++) {
+            exportGroupPutValue(group, 0, doctor.doctorID);
+            exportGroupPutString(group, 1, doctor.doctorName);
+            exportGroupPutValue(group, 2, doctor.totalShifts);
+            group->rows++;
+
+            if (group->rows == EXPORT_ROW_GROUP_SIZE) {
+                success = flushExportGroup(exportFile, group);
             }
         }
-        printf("\n");
+        success = success && flushExportGroup(exportFile, group);
+        freeExportGroup(group);
     }
 
-    returnToMenu();
+    // Schedule, one row per doctor on a shift, in date order
+    if (success && scheduleCount > 0) {
+        initializeExportGroup(group, EXPORT_TABLE_SCHEDULE, 3, scheduleEncodings);
+        for (int i = 0; success && i < scheduleCount; i++) {
+            exportGroupPutValue(group, 0, schedule[i].day);
+            exportGroupPutValue(group, 1, schedule[i].shift);
+            exportGroupPutValue(group, 2, schedule[i].doctorID);
+            group->rows++;
+
+            if (group->rows == EXPORT_ROW_GROUP_SIZE) {
+                success = flushExportGroup(exportFile, group);
+            }
+        }
+        success = success && flushExportGroup(exportFile, group);
+        freeExportGroup(group);
+    }
+
+    // Terminate the file so readers can tell a complete export from a truncated one
+    ReportBuffer trailer = {NULL, 0, 0, 0};
+    exportPutVarint(&trailer, EXPORT_TABLE_END);
+    success = success && flushExportBuffer(exportFile, &trailer, 1);
+    reportBufferRelease(&trailer);
+
+    free(group);
+    return success;
 }
 
-//Find a doctor by ID
-Doctor *findDoctorByID(int id) {
-    Doctor *current = doctorHead;
-    while (current != NULL) {
-        if (current->doctorID == id) {
-            return current;
+//Write the CSV or JSON-lines export, one file per table. Rows are rendered into a buffer that is flushed in large chunks
+int exportText(int format, FILE *patientFile, ArchiveCursor *archive, FILE *doctorFile, const ScheduleRecord *schedule,
+               int scheduleCount, FILE *exportFiles[3]) {
+    ReportBuffer buffer = {NULL, 0, 0, 0};
+    void (*putString)(ReportBuffer *, const char *) = format == EXPORT_CSV ? exportPutCsvString : exportPutJsonString;
+    int csv = format == EXPORT_CSV;
+    int success = 1;
+
+    // Patients
+    if (csv) {
+        reportBufferAppend(&buffer, "id,name,age,diagnosis,room,admission_date,discharge_date,active\n");
+    }
+    int recordCount = 0;
+    if (patientFile == NULL || fread(&recordCount, sizeof(int), 1, patientFile) != 1 ||
+        recordCount < 0 || recordCount > MAX_LOADED_RECORDS) {
+        recordCount = 0;
+    }
+    if (success) {
+        Patient patient;
+        while (success && readNextExportedPatient(patientFile, &recordCount, archive, &patient)) {
+            reportBufferAppend(&buffer, csv ? "" : "{\"id\":");
+            reportBufferPutInt(&buffer, patient.patientID, 0);
+            reportBufferAppend(&buffer, csv ? "," : ",\"name\":");
+            putString(&buffer, patient.patientName);
+            reportBufferAppend(&buffer, csv ? "," : ",\"age\":");
+            reportBufferPutInt(&buffer, patient.patientAge, 0);
+            reportBufferAppend(&buffer, csv ? "," : ",\"diagnosis\":");
+            putString(&buffer, patient.patientDiagnosis);
+            reportBufferAppend(&buffer, csv ? "," : ",\"room\":");
+            reportBufferPutInt(&buffer, patient.patientRoomNum, 0);
+            reportBufferAppend(&buffer, csv ? "," : ",\"admissionDate\":");
+            putString(&buffer, patient.admissionDate);
+            reportBufferAppend(&buffer, csv ? "," : ",\"dischargeDate\":");
+            if (patient.dischargeDate[0] != '\0' || csv) {
+                putString(&buffer, patient.dischargeDate);
+            } else {
+                reportBufferAppend(&buffer, "null");
+            }
+            if (csv) {
+                reportBufferAppend(&buffer, ",%d\n", patient.isActive != 0);
+            } else {
+                reportBufferAppend(&buffer, ",\"active\":%s}\n", patient.isActive ? "true" : "false");
+            }
+            success = flushExportBuffer(exportFiles[0], &buffer, 0);
         }
-        current = current->next;
     }
-    return NULL;
-}
+    success = success && flushExportBuffer(exportFiles[0], &buffer, 1);
 
-//Generate reports menu. Provides options for different types of reports
-void generateReports() {
-    int choice;
+    // Doctors
+    if (csv) {
+        reportBufferAppend(&buffer, "id,name,total_shifts\n");
+    }
+    if (success && doctorFile != NULL && fread(&recordCount, sizeof(int), 1, doctorFile) == 1 &&
+        recordCount > 0 && recordCount <= MAX_LOADED_RECORDS) {
+        Doctor doctor;
+        for (int i = 0; success && i < recordCount && readExportedDoctor(doctorFile, &doctor); i++) {
+            reportBufferAppend(&buffer, csv ? "" : "{\"id\":");
+            reportBufferPutInt(&buffer, doctor.doctorID, 0);
+            reportBufferAppend(&buffer, csv ? "," : ",\"name\":");
+            putString(&buffer, doctor.doctorName);
+            reportBufferAppend(&buffer, csv ? "," : ",\"totalShifts\":");
+            reportBufferPutInt(&buffer, doctor.totalShifts, 0);
+            reportBufferAppend(&buffer, csv ? "\n" : "}\n");
+            success = flushExportBuffer(exportFiles[1], &buffer, 0);
+        }
+    }
+    success = success && flushExportBuffer(exportFiles[1], &buffer, 1);
 
-    do {
-        printf("\e[1;1H\e[2J");  // Clear the screen
-        printHeader("Generate Reports");
+    // Schedule, one row per doctor on a shift, in date order
+    if (csv) {
+        reportBufferAppend(&buffer, "date,shift,doctor_id\n");
+    }
+    char date[11];
+    for (int i = 0; success && i < scheduleCount; i++) {
+        formatScheduleDate(schedule[i].day, date);
+        reportBufferAppend(&buffer, csv ? "%s,%d,%d\n" : "{\"date\":\"%s\",\"shift\":%d,\"doctorId\":%d}\n",
+                           date, schedule[i].shift, schedule[i].doctorID);
+        success = flushExportBuffer(exportFiles[2], &buffer, 0);
+    }
+    success = success && flushExportBuffer(exportFiles[2], &buffer, 1);
 
-        // Display report options
-        printf("1. Patient Admission Report\n");
-        printf("2. Doctor Utilization Report\n");
-        printf("3. Room Utilization Report\n");
-        printf("4. Return to Main Menu\n");
-        printf("Enter your choice: ");
+    int failed = buffer.failed;
+    reportBufferRelease(&buffer);
+    return success && !failed;
+}
 
-        choice = scanInt();
+//Read one patient record from a data file, making sure its strings are terminated. Returns 0 at the end of the file
+int readExportedPatient(FILE *patientFile, Patient *patient) {
+    if (fread(patient, sizeof(Patient) - sizeof(Patient *), 1, patientFile) != 1) {
+        return 0;
+    }
+    patient->patientName[sizeof(patient->patientName) - 1] = '\0';
+    patient->patientDiagnosis[sizeof(patient->patientDiagnosis) - 1] = '\0';
+    patient->admissionDate[sizeof(patient->admissionDate) - 1] = '\0';
+    patient->dischargeDate[sizeof(patient->dischargeDate) - 1] = '\0';
+    return 1;
+}
 
-        switch (choice) {
-            case 1: patientAdmissionReport();
-                break;
-            case 2: doctorUtilizationReport();
-                break;
-            case 3: roomUtilizationReport();
-                break;
-            case 4: break;
-            default: printf("Invalid choice! Try again.\n");
+//Read the next patient for an export: the records of patients.dat, then the archived ones. Returns 0 after the last
+int readNextExportedPatient(FILE *patientFile, int *remaining, ArchiveCursor *archive, Patient *patient) {
+    if (*remaining > 0) {
+        (*remaining)--;
+        if (readExportedPatient(patientFile, patient)) {
+            return 1;
         }
-    } while (choice != 4);
+        *remaining = 0;     // A short file ends its part of the export
+    }
+    return readArchivedPatient(archive, patient);
 }
 
-//Generate a patient admission report. Creates a report file with details of all patients
-void patientAdmissionReport() {
-    printf("\e[1;1H\e[2J");  // Clear the screen
-    printHeader("Patient Admission Report");
+//Read one doctor record from a data file, making sure its name is terminated. Returns 0 at the end of the file
+int readExportedDoctor(FILE *doctorFile, Doctor *doctor) {
+    if (fread(doctor, sizeof(Doctor) - sizeof(Doctor *), 1, doctorFile) != 1) {
+        return 0;
+    }
+    doctor->doctorName[sizeof(doctor->doctorName) - 1] = '\0';
+    return 1;
+}
 
-    if (totalPatientsActive == 0) {
-        printf("No patients in the system.\n");
-        printf("Press Enter to continue...");
-        clearInputBuffer();
-        return;
+//Set up an empty row group for a table
+void initializeExportGroup(ExportRowGroup *group, int table, int columnCount, const int *encodings) {
+    memset(group, 0, sizeof(ExportRowGroup));
+    group->table = table;
+    group->columnCount = columnCount;
+    memcpy(group->encodings, encodings, columnCount * sizeof(int));
+}
+
+//Free the buffers of a row group
+void freeExportGroup(ExportRowGroup *group) {
+    for (int i = 0; i < EXPORT_MAX_COLUMNS; i++) {
+        reportBufferRelease(&group->columns[i]);
     }
+    freeDictionary(&group->dictionary);
+}
 
-    // Create filename with timestamp
-    char reportFileName[MAX_FILENAME_LENGTH];
-    char timestamp[20];
-    getCurrentDateTime(timestamp, sizeof(timestamp));
+//Write a row group's header and column blocks, then empty it for the next group. Empty groups are skipped
+int flushExportGroup(FILE *exportFile, ExportRowGroup *group) {
+    if (group->rows == 0) {
+        return 1;
+    }
 
-    // Replace spaces and colons with underscores for filename compatibility
-    for (int i = 0; timestamp[i] != '\0'; i++) {
-        if (timestamp[i] == ' ' || timestamp[i] == ':') {
-            timestamp[i] = '_';
+    // Dictionary blocks start with the distinct strings, which are only known once the group is complete
+    StringDictionary *dictionary = &group->dictionary;
+    ReportBuffer dictionaryHeader = {NULL, 0, 0, 0};
+    exportPutVarint(&dictionaryHeader, dictionary->count);
+    for (int i = 0; i < dictionary->count; i++) {
+        exportPutVarint(&dictionaryHeader, dictionary->lengths[i]);
+        if (reportBufferReserve(&dictionaryHeader, dictionary->lengths[i])) {
+            memcpy(dictionaryHeader.data + dictionaryHeader.length,
+                   dictionary->text.data + dictionary->offsets[i], dictionary->lengths[i]);
+            dictionaryHeader.length += dictionary->lengths[i];
         }
     }
 
-    snprintf(reportFileName, MAX_FILENAME_LENGTH, "../reports/patient_admission_report_%s.txt", timestamp);
+    ReportBuffer groupHeader = {NULL, 0, 0, 0};
+    exportPutVarint(&groupHeader, group->table);
+    exportPutVarint(&groupHeader, group->rows);
+    exportPutVarint(&groupHeader, group->columnCount);
+    int success = flushExportBuffer(exportFile, &groupHeader, 1);
+
+    for (int i = 0; success && i < group->columnCount; i++) {
+        ReportBuffer *column = &group->columns[i];
+        int isDictionary = group->encodings[i] == COLUMN_DICTIONARY;
+
+        exportPutVarint(&groupHeader, i + 1);
+        exportPutVarint(&groupHeader, group->encodings[i]);
+        exportPutVarint(&groupHeader, column->length + (isDictionary ? dictionaryHeader.length : 0));
+        success = flushExportBuffer(exportFile, &groupHeader, 1) &&
+                  (!isDictionary || flushExportBuffer(exportFile, &dictionaryHeader, 1)) &&
+                  !column->failed && flushExportBuffer(exportFile, column, 1);
+    }
+    success = success && !dictionaryHeader.failed;
+    reportBufferRelease(&dictionaryHeader);
+    reportBufferRelease(&groupHeader);
+
+    // Start the next group from scratch
+    for (int i = 0; i < group->columnCount; i++) {
+        group->columns[i].length = 0;
+        group->previous[i] = 0;
+    }
+    resetDictionary(dictionary);
+    group->rows = 0;
+    return success;
+}
 
-    // Create the report file
-    FILE *reportFile = fopen(reportFileName, "w");
-    if (reportFile == NULL) {
-        printf("Error: Unable to create report file.\n");
-        printf("Press Enter to continue...");
-        clearInputBuffer();
+//Append an unsigned LEB128 varint: seven bits per byte, high bit set on all but the last byte
+void exportPutVarint(ReportBuffer *buffer, unsigned long long value) {
+    if (!reportBufferReserve(buffer, 10)) {
         return;
     }
-
-    // Write report header
-    fprintf(reportFile, "PATIENT ADMISSION REPORT\n");
-    fprintf(reportFile, "Generated on: %s\n\n", timestamp);
-    fprintf(reportFile, "Total Patients: %d\n\n", totalPatients);
-    fprintf(reportFile, "%-10s%-25s%-10s%-30s%-15s%-25s%-10s\n",
-            "ID", "Name", "Age", "Diagnosis", "Room Number", "Admission Date", "Status");
-    fprintf(reportFile,
-            "-------------------------------------------------------------------------------------------------------------------------\n");
-
-    // Write patient data
-    Patient *current = patientHead;
-    while (current != NULL) {
-        fprintf(reportFile, "%-10d%-25s%-10d%-30s%-15d%-25s%-10s\n",
-                current->patientID,
-                current->patientName,
-                current->patientAge,
-                current->patientDiagnosis,
-                current->patientRoomNum,
-                current->admissionDate,
-                current->isActive ? "Active" : "Discharged");
-        current = current->next;
+    while (value >= 0x80) {
+        buffer->data[buffer->length++] = (char) (value | 0x80);
+        value >>= 7;
     }
-
-    fclose(reportFile);
-
-    printf("Report generated successfully: %s\n", reportFileName);
-    printf("Press Enter to continue...");
-    clearInputBuffer();
+    buffer->data[buffer->length++] = (char) value;
 }
 
+//Map a signed value to unsigned so small negative numbers also get short varints
+unsigned long long zigzagEncode(long long value) {
+    return ((unsigned long long) value << 1) ^ (unsigned long long) (value >> 63);
+}
 
-//Generate a doctor utilization report. Creates a report file with details of all doctors and their shift utilization
+//Append a numeric value to a varint or delta-varint column
+void exportGroupPutValue(ExportRowGroup *group, int column, long long value) {
+    if (group->encodings[column] == COLUMN_DELTA_VARINT) {
+        exportPutVarint(&group->columns[column], zigzagEncode(value - group->previous[column]));
+        group->previous[column] = value;
+    } else {
+        exportPutVarint(&group->columns[column], zigzagEncode(value));
+    }
+}
 
-void doctorUtilizationReport() {
-    printf("\e[1;1H\e[2J");  // Clear the screen
-    printHeader("Doctor Utilization Report");
+//Append a string to a plain or dictionary-encoded string column
+void exportGroupPutString(ExportRowGroup *group, int column, const char *text) {
+    ReportBuffer *buffer = &group->columns[column];
 
-    if (totalDoctors == 0) {
-        printf("No doctors in the system.\n");
-        printf("Press Enter to continue...");
-        clearInputBuffer();
+    if (group->encodings[column] == COLUMN_DICTIONARY) {
+        int index = dictionaryIndexOf(&group->dictionary, text);
+        if (index < 0) {
+            buffer->failed = 1;
+            return;
+        }
+        exportPutVarint(buffer, index);
         return;
     }
 
-    // Create filename with timestamp
-    char reportFileName[MAX_FILENAME_LENGTH];
-    char timestamp[20];
-    getCurrentDateTime(timestamp, sizeof(timestamp));
+    size_t length = strlen(text);
+    exportPutVarint(buffer, length);
+    if (reportBufferReserve(buffer, length)) {
+        memcpy(buffer->data + buffer->length, text, length);
+        buffer->length += length;
+    }
+}
 
-    // Replace spaces and colons with underscores for filename compatibility
-    for (int i = 0; timestamp[i] != '\0'; i++) {
-        if (timestamp[i] == ' ' || timestamp[i] == ':') {
-            timestamp[i] = '_';
+//Append one bit to a bitmap column. Must be called before the row count is advanced
+void exportGroupPutBit(ExportRowGroup *group, int column, int bit) {
+    ReportBuffer *buffer = &group->columns[column];
+
+    if (group->rows % 8 == 0) {
+        if (!reportBufferReserve(buffer, 1)) {
+            return;
         }
+        buffer->data[buffer->length++] = 0;
     }
+    if (bit) {
+        buffer->data[buffer->length - 1] |= (char) (1 << (group->rows % 8));
+    }
+}
 
-    snprintf(reportFileName, MAX_FILENAME_LENGTH, "../reports/doctor_utilization_report_%s.txt", timestamp);
-
-    // Create the report file
-    FILE *reportFile = fopen(reportFileName, "w");
-    if (reportFile == NULL) {
-        printf("Error: Unable to create report file.\n");
-        printf("Press Enter to continue...");
-        clearInputBuffer();
-        return;
+//Return the index of a string in a dictionary, adding it if it is new. Returns -1 if the dictionary cannot grow
+int dictionaryIndexOf(StringDictionary *dictionary, const char *text) {
+    int length = (int) strlen(text);
+    unsigned int hash = hashString(text, length);
+
+    unsigned int mask = (unsigned int) dictionary->slotCapacity - 1;
+    unsigned int slot = hash & mask;
+    while (dictionary->slotCapacity > 0 && dictionary->slots[slot] != 0) {
+        int entry = dictionary->slots[slot] - 1;
+        if (dictionary->lengths[entry] == length &&
+            memcmp(dictionary->text.data + dictionary->offsets[entry], text, length) == 0) {
+            return entry;
+        }
+        slot = (slot + 1) & mask;
     }
 
-    // Write report header
-    fprintf(reportFile, "DOCTOR UTILIZATION REPORT\n");
-    fprintf(reportFile, "Generated on: %s\n\n", timestamp);
-    fprintf(reportFile, "Total Doctors: %d\n\n", totalDoctors);
-    fprintf(reportFile, "%-10s%-25s%-15s%-15s\n",
-            "ID", "Name", "Total Shifts", "Utilization %");
-    fprintf(reportFile, "--------------------------------------------------------------------\n");
+    // New string. Keep the table at most half full, rehashing the existing entries when it doubles
+    if (2 * (dictionary->count + 1) > dictionary->slotCapacity) {
+        int newCapacity = dictionary->slotCapacity == 0 ? 1024 : dictionary->slotCapacity * 2;
+        int *slots = (int *) calloc(newCapacity, sizeof(int));
+        int *offsets = (int *) realloc(dictionary->offsets, (newCapacity / 2) * sizeof(int));
+        if (offsets != NULL) {
+            dictionary->offsets = offsets;
+        }
+        int *lengths = (int *) realloc(dictionary->lengths, (newCapacity / 2) * sizeof(int));
+        if (lengths != NULL) {
+            dictionary->lengths = lengths;
+        }
+        if (slots == NULL || offsets == NULL || lengths == NULL) {
+            free(slots);
+            return -1;
+        }
 
-    // Write doctor data
-    Doctor *current = doctorHead;
-    while (current != NULL) {
-        // Calculate utilization percentage (shifts / total possible shifts * 100)
-        float utilization = (float) current->totalShifts / (MAX_DAYS_IN_WEEK * MAX_SHIFTS_IN_DAY) * 100;
-        fprintf(reportFile, "%-10d%-25s%-15d%-15.2f\n",
-                current->doctorID,
-                current->doctorName,
-                current->totalShifts,
-                utilization);
-        current = current->next;
-    }
+        free(dictionary->slots);
+        dictionary->slots = slots;
+        dictionary->slotCapacity = newCapacity;
+        mask = (unsigned int) newCapacity - 1;
+        for (int entry = 0; entry < dictionary->count; entry++) {
+            unsigned int entrySlot = hashString(dictionary->text.data + dictionary->offsets[entry],
+                                                dictionary->lengths[entry]) & mask;
+            while (slots[entrySlot] != 0) {
+                entrySlot = (entrySlot + 1) & mask;
+            }
+            slots[entrySlot] = entry + 1;
+        }
 
-    fclose(reportFile);
+        slot = hash & mask;
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+    }
 
-    printf("Report generated successfully: %s\n", reportFileName);
-    printf("Press Enter to continue...");
-    clearInputBuffer();
+    int entry = dictionary->count;
+    if (!reportBufferReserve(&dictionary->text, length)) {
+        return -1;
+    }
+    dictionary->offsets[entry] = (int) dictionary->text.length;
+    dictionary->lengths[entry] = length;
+    memcpy(dictionary->text.data + dictionary->text.length, text, length);
+    dictionary->text.length += length;
+    dictionary->slots[slot] = entry + 1;
+    dictionary->count++;
+    return entry;
 }
 
-//Generate a room utilization report. Creates a report file with details of room occupancy
-
-void roomUtilizationReport() {
-    printf("\e[1;1H\e[2J");  // Clear the screen
-    printHeader("Room Utilization Report");
+//Hash a string of the given length with FNV-1a
+unsigned int hashString(const char *text, int length) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) text[i]) * 16777619u;
+    }
+    return hash;
+}
 
-    if (totalPatientsActive == 0) {
-        printf("No patients in the system.\n");
-        printf("Press Enter to continue...");
-        clearInputBuffer();
-        return;
+//Empty a dictionary but keep its memory for reuse
+void resetDictionary(StringDictionary *dictionary) {
+    if (dictionary->slots != NULL) {
+        memset(dictionary->slots, 0, dictionary->slotCapacity * sizeof(int));
     }
+    dictionary->text.length = 0;
+    dictionary->count = 0;
+}
 
-    // Count patients in each room
-    int roomCounts[100] = {0};  // Assume maximum 100 rooms
-    int maxRoom = 0;
+//Free the memory of a dictionary
+void freeDictionary(StringDictionary *dictionary) {
+    reportBufferRelease(&dictionary->text);
+    free(dictionary->offsets);
+    free(dictionary->lengths);
+    free(dictionary->slots);
+    memset(dictionary, 0, sizeof(StringDictionary));
+}
 
-    Patient *current = patientHead;
-    while (current != NULL) {
-        roomCounts[current->patientRoomNum]++;
-        if (current->patientRoomNum > maxRoom) {
-            maxRoom = current->patientRoomNum;
+//Convert a "YYYY-MM-DD HH:MM:SS" date to seconds since 1970-01-01 00:00:00 on the same clock. Returns 0 for no date
+long long dateTimeToSeconds(const char *dateTime) {
+    // Parsed by hand rather than with sscanf since reports and exports convert every record's dates
+    static const char layout[] = "0000-00-00 00:00:00";
+    for (int i = 0; layout[i] != '\0'; i++) {
+        int matches = layout[i] == '0' ? dateTime[i] >= '0' && dateTime[i] <= '9' : dateTime[i] == layout[i];
+        if (!matches) {
+            return 0;    // Stops at the terminator of a short string, so nothing past it is read
         }
-        current = current->next;
     }
 
-    // Create filename with timestamp
-    char reportFileName[MAX_FILENAME_LENGTH];
-    char timestamp[20];
-    getCurrentDateTime(timestamp, sizeof(timestamp));
-
-    // Replace spaces and colons with underscores for filename compatibility
-    for (int i = 0; timestamp[i] != '\0'; i++) {
-        if (timestamp[i] == ' ' || timestamp[i] == ':') {
-            timestamp[i] = '_';
-        }
+    int year = (dateTime[0] - '0') * 1000 + (dateTime[1] - '0') * 100 + (dateTime[2] - '0') * 10 + (dateTime[3] - '0');
+    int month = (dateTime[5] - '0') * 10 + (dateTime[6] - '0');
+    int day = (dateTime[8] - '0') * 10 + (dateTime[9] - '0');
+    int hour = (dateTime[11] - '0') * 10 + (dateTime[12] - '0');
+    int minute = (dateTime[14] - '0') * 10 + (dateTime[15] - '0');
+    int second = (dateTime[17] - '0') * 10 + (dateTime[18] - '0');
+    if (month < 1 || month > 12) {
+        return 0;
     }
 
-    snprintf(reportFileName, MAX_FILENAME_LENGTH, "../reports/room_utilization_report_%s.txt", timestamp);
+    // Days from the civil date, counting years from March so the leap day comes last
+    long long y = month <= 2 ? year - 1 : year;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yearOfEra = y - era * 400;
+    long long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    long long days = era * 146097 + dayOfEra - 719468;
 
-    // Create the report file
-    FILE *reportFile = fopen(reportFileName, "w");
-    if (reportFile == NULL) {
-        printf("Error: Unable to create report file.\n");
-        printf("Press Enter to continue...");
-        clearInputBuffer();
+    return days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+//Append a CSV field, quoting it and doubling embedded quotes when it contains a comma, quote or line break
+void exportPutCsvString(ReportBuffer *buffer, const char *text) {
+    if (strpbrk(text, ",\"\r\n") == NULL) {
+        reportBufferPutString(buffer, text, 0);
         return;
     }
 
-    // Write report header
-    fprintf(reportFile, "ROOM UTILIZATION REPORT\n");
-    fprintf(reportFile, "Generated on: %s\n\n", timestamp);
-    fprintf(reportFile, "Total Patients: %d\n\n", totalPatientsActive);
-    fprintf(reportFile, "%-15s%-15s%-15s\n",
-            "Room Number", "Patients", "Occupancy %");
-    fprintf(reportFile, "------------------------------------------\n");
-
-    // Write room occupancy data
-    for (int i = 1; i <= maxRoom; i++) {
-        if (roomCounts[i] > 0) {
-            // Calculate occupancy percentage (patients / max capacity * 100)
-            float occupancy = (float) roomCounts[i] / 2 * 100;  // 2 is max capacity per room
-            fprintf(reportFile, "%-15d%-15d%-15.2f\n",
-                    i,
-                    roomCounts[i],
-                    occupancy);
+    // At worst every character is a doubled quote, so one reservation covers the whole field
+    if (!reportBufferReserve(buffer, strlen(text) * 2 + 2)) {
+        return;
+    }
+    char *out = buffer->data + buffer->length;
+    *out++ = '"';
+    for (const char *c = text; *c != '\0'; c++) {
+        if (*c == '"') {
+            *out++ = '"';
         }
+        *out++ = *c;
     }
+    *out++ = '"';
+    buffer->length = out - buffer->data;
+}
 
-    fclose(reportFile);
+//Append a JSON string literal, escaping quotes, backslashes and control characters
+void exportPutJsonString(ReportBuffer *buffer, const char *text) {
+    reportBufferAppend(buffer, "\"");
+    for (const unsigned char *c = (const unsigned char *) text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            reportBufferAppend(buffer, "\\%c", *c);
+        } else if (*c < 0x20) {
+            reportBufferAppend(buffer, "\\u%04x", *c);
+        } else if (reportBufferReserve(buffer, 1)) {
+            buffer->data[buffer->length++] = (char) *c;
+        }
+    }
+    reportBufferAppend(buffer, "\"");
+}
 
-    printf("Report generated successfully: %s\n", reportFileName);
-    printf("Press Enter to continue...");
-    clearInputBuffer();
+//Write a buffer to an export file and empty it. Unless forced, waits until EXPORT_FLUSH_SIZE bytes have built up
+int flushExportBuffer(FILE *exportFile, ReportBuffer *buffer, int force) {
+    if (buffer->failed) {
+        return 0;
+    }
+    if (!force && buffer->length < EXPORT_FLUSH_SIZE) {
+        return 1;
+    }
+    if (buffer->length > 0 && fwrite(buffer->data, 1, buffer->length, exportFile) != buffer->length) {
+        return 0;
+    }
+    buffer->length = 0;
+    return 1;
 }
 
 //Main menu function. Displays the main menu and handles user choices
@@ -1522,6 +8739,17 @@ void roomUtilizationReport() {
 void menu() {
     int choice;
 
+    // Data each choice needs once --lazy has opened the menu early. Viewing patients, the dashboard and the
+    // statistics show what has been read so far; Search Patient reads the saved patients section for anyone not
+    // loaded yet. The doctor and schedule options, changes included, only touch data complete at LOAD_INDEXES;
+    // patient changes, queries, reports, restores and room changes wait for every record, and Exit for the save
+    static const int loadNeeded[16] = {
+        LOAD_PENDING,
+        LOAD_COMPLETE, LOAD_PENDING, LOAD_INDEXES, LOAD_COMPLETE, LOAD_INDEXES, LOAD_INDEXES, LOAD_INDEXES,
+        LOAD_INDEXES, LOAD_COMPLETE, LOAD_COMPLETE, LOAD_PENDING, LOAD_COMPLETE, LOAD_COMPLETE, LOAD_PENDING,
+        LOAD_COMPLETE
+    };
+
     do {
         printf("\e[1;1H\e[2J");  // Clear the screen
         printHeader("Hospital Management System");
@@ -1537,10 +8765,17 @@ void menu() {
         printf("8. View All Doctors\n");
         printf("9. Generate Reports\n");
         printf("10. Restore Data\n");
-        printf("11. Exit\n");
+        printf("11. Dashboard\n");
+        printf("12. Query Patients\n");
+        printf("13. Manage Rooms\n");
+        printf("14. System Statistics\n");
+        printf("15. Exit\n");
         printf("Enter your choice: ");
 
         choice = scanInt();
+        if (choice >= 1 && choice <= 15) {
+            awaitStartupLoad(loadNeeded[choice]);
+        }
 
         // Process user choice
         switch (choice) {
@@ -1582,13 +8817,21 @@ void menu() {
                 returnToMenu();
                 break;
             }
-            case 11:
+            case 11: viewDashboard();
+                break;
+            case 12: queryPatients();
+                break;
+            case 13: manageRooms();
+                break;
+            case 14: systemStatistics();
+                break;
+            case 15:
                 saveData();
                 printf("Exiting...");
                 break;
             default: printf("Invalid choice! Try again.\n");
         }
-    } while (choice != 11);
+    } while (choice != 15);
 }
 
 //Clear the input buffer. Used after scanf to clear any remaining input